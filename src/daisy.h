@@ -40,10 +40,15 @@
 #include "hid/disp/color_display.h"
 #include "hid/disp/oled_color_display.h"
 #include "hid/disp/graphics_common.h"
+#include "hid/disp/glyph_cache.h"
+#include "hid/disp/color_canvas.h"
+#include "hid/disp/color_compositor.h"
 #include "hid/wavplayer.h"
+#include "hid/wavstreamer.h"
 #include "hid/led.h"
 #include "hid/rgb_led.h"
 #include "dev/sr_595.h"
+#include "dev/sensor_sampling.h"
 #include "dev/apds9960.h"
 #include "dev/codec_pcm3060.h"
 #include "dev/codec_wm8731.h"
@@ -71,6 +76,7 @@
 #include "util/Stack.h"
 #include "util/VoctCalibration.h"
 #include "util/WaveTableLoader.h"
+#include "util/WavEncoder.h"
 #include "util/WavWriter.h"
 #endif
 #endif
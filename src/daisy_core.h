@@ -19,6 +19,7 @@
     @{
 */
 
+#ifndef UNIT_TEST
 /** Macro for area of memory that is configured as cacheless
 This should be used primarily for DMA buffers, and the like.
 */
@@ -29,6 +30,11 @@ for DMA transfers. Performance is on par with internal SRAM w/
 cache enabled.
 */
 #define DTCM_MEM_SECTION __attribute__((section(".dtcmram_bss")))
+#else // ifndef UNIT_TEST
+// Host builds have no linker script with these sections.
+#define DMA_BUFFER_MEM_SECTION
+#define DTCM_MEM_SECTION
+#endif // ifndef UNIT_TEST
 
 #define FBIPMAX 0.999985f             /**< close to 1.0f-LSB at 16 bit */
 #define FBIPMIN (-FBIPMAX)            /**< - (1 - LSB) */
@@ -366,6 +366,11 @@ namespace patch_sm
         audio.Start(cb);
     }
 
+    void DaisyPatchSM::StartAudio(AudioHandle::NativeAudioCallback cb)
+    {
+        audio.Start(cb);
+    }
+
     void DaisyPatchSM::ChangeAudioCallback(AudioHandle::AudioCallback cb)
     {
         audio.ChangeCallback(cb);
@@ -377,6 +382,11 @@ namespace patch_sm
         audio.ChangeCallback(cb);
     }
 
+    void DaisyPatchSM::ChangeAudioCallback(AudioHandle::NativeAudioCallback cb)
+    {
+        audio.ChangeCallback(cb);
+    }
+
     void DaisyPatchSM::StopAudio() { audio.Stop(); }
 
     void DaisyPatchSM::SetAudioBlockSize(size_t size)
@@ -73,6 +73,9 @@ namespace patch_sm
         /** Starts an interleaving audio callback */
         void StartAudio(AudioHandle::InterleavingAudioCallback cb);
 
+        /** Starts a native audio callback, working directly on the DMA buffers */
+        void StartAudio(AudioHandle::NativeAudioCallback cb);
+
         /** Changes the callback that is executing.
          *  This may cause clicks if done while audio is processing.
          */
@@ -83,6 +86,11 @@ namespace patch_sm
          */
         void ChangeAudioCallback(AudioHandle::InterleavingAudioCallback cb);
 
+        /** Changes the callback that is executing.
+         *  This may cause clicks if done while audio is processing.
+         */
+        void ChangeAudioCallback(AudioHandle::NativeAudioCallback cb);
+
         /** Stops the transmission of audio. */
         void StopAudio();
 
@@ -193,6 +193,11 @@ void DaisySeed::StartAudio(AudioHandle::AudioCallback cb)
     audio_handle.Start(cb);
 }
 
+void DaisySeed::StartAudio(AudioHandle::NativeAudioCallback cb)
+{
+    audio_handle.Start(cb);
+}
+
 void DaisySeed::ChangeAudioCallback(AudioHandle::InterleavingAudioCallback cb)
 {
     audio_handle.ChangeCallback(cb);
@@ -203,6 +208,11 @@ void DaisySeed::ChangeAudioCallback(AudioHandle::AudioCallback cb)
     audio_handle.ChangeCallback(cb);
 }
 
+void DaisySeed::ChangeAudioCallback(AudioHandle::NativeAudioCallback cb)
+{
+    audio_handle.ChangeCallback(cb);
+}
+
 void DaisySeed::StopAudio()
 {
     audio_handle.Stop();
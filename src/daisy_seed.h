@@ -67,6 +67,13 @@ class DaisySeed
     */
     void StartAudio(AudioHandle::AudioCallback cb);
 
+    /** Begins the audio for the seeds builtin audio.
+    the specified callback will get called whenever
+    new data is ready to be prepared.
+    This will use the native callback, which gets the DMA buffers directly.
+    */
+    void StartAudio(AudioHandle::NativeAudioCallback cb);
+
     /** Changes to a new interleaved callback
      */
     void ChangeAudioCallback(AudioHandle::InterleavingAudioCallback cb);
@@ -75,6 +82,10 @@ class DaisySeed
      */
     void ChangeAudioCallback(AudioHandle::AudioCallback cb);
 
+    /** Changes to a new native callback
+     */
+    void ChangeAudioCallback(AudioHandle::NativeAudioCallback cb);
+
     /** Stops the audio if it is running. */
     void StopAudio();
 
@@ -2,6 +2,8 @@
 #ifndef DSY_APDS9960_H
 #define DSY_APDS9960_H
 
+#include "dev/sensor_sampling.h"
+
 #define APDS9960_ADDRESS (0x39) /**< I2C Address */
 
 #define APDS9960_UP 0x01    /**< Gesture Up */
@@ -119,6 +121,32 @@ class Apds9960I2CTransport
                != i2c_.ReceiveBlocking(APDS9960_ADDRESS, data, size, 10);
     }
 
+    /** Starts reading from a register in the background, see
+        I2CHandle::QueueTransaction(). Used by SensorSamplingSession.
+        \param reg the register address, valid until the callback
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called from an interrupt when the read is done
+        \param context passed to the callback
+        \return false if the read couldn't be queued
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        I2CHandle::Transaction transaction;
+        transaction.address          = APDS9960_ADDRESS;
+        transaction.tx_data          = reg;
+        transaction.tx_size          = 1;
+        transaction.rx_data          = buff;
+        transaction.rx_size          = size;
+        transaction.callback         = callback;
+        transaction.callback_context = context;
+        return i2c_.QueueTransaction(transaction) == I2CHandle::Result::OK;
+    }
+
   private:
     I2CHandle i2c_;
 };
@@ -174,6 +202,21 @@ class Apds9960
         ERR
     };
 
+    /** The color and proximity data of one read, see StartSampling() */
+    struct Sample
+    {
+        bool     color_valid;     /**< like ColorDataReady() */
+        bool     proximity_valid; /**< the proximity data is valid */
+        uint16_t red;             /**< like GetColorDataRed() */
+        uint16_t green;           /**< like GetColorDataGreen() */
+        uint16_t blue;            /**< like GetColorDataBlue() */
+        uint16_t clear;           /**< like GetColorDataClear() */
+        uint8_t  proximity;       /**< like ReadProximity() */
+    };
+
+    /** Called from an interrupt when a sample is available */
+    typedef void (*SampleCallback)(void *context, bool ok);
+
     // turn on/off elements
     void enable(bool en = true);
     /** Initialize the APDS9960 device
@@ -223,6 +266,8 @@ class Apds9960
         EnableProximity(config_.prox_mode);
         EnableColor(config_.color_mode);
 
+        session_.Init(&transport_, APDS9960_STATUS, &DecodeSample, this);
+
         return GetTransportErr();
     }
 
@@ -568,7 +613,7 @@ class Apds9960
         Write8(APDS9960_CONFIG2, config2_.get());
 
         control_.LDRIVE = drive;
-        rite8(APDS9960_CONTROL, control_.get());
+        Write8(APDS9960_CONTROL, control_.get());
     }
 
     /** Converts the raw R/G/B values to color temperature in degrees Kelvin
@@ -686,6 +731,36 @@ class Apds9960
         *b = GetColorDataBlue();
     }
 
+    /** Starts reading the status, color and proximity data in the
+        background, in one transfer. The driver must be static or global and
+        not in the DTCM, see SensorSamplingSession.
+        \param callback called from an interrupt when the sample is
+                        available, or nullptr
+        \param context passed to the callback
+        \return false if the last read hasn't finished or the transfer
+                couldn't be queued
+    */
+    bool StartSampling(SampleCallback callback = nullptr,
+                       void          *context  = nullptr)
+    {
+        return session_.Start(callback, context);
+    }
+
+    /** \return true while a read started by StartSampling() runs */
+    bool IsSampling() const { return session_.IsBusy(); }
+
+    /** Copies the latest sample read by StartSampling()
+        \param sample receives the sample
+        \return false if there is no sample yet
+    */
+    bool GetLatestSample(Sample &sample) const
+    {
+        return session_.GetLatest(sample);
+    }
+
+    /** \return the number of samples read by StartSampling() */
+    uint32_t GetNumSamples() const { return session_.GetNumSamples(); }
+
   private:
     uint8_t gestCnt_, UCount_, DCount_, LCount_, RCount_; // counters
     uint8_t gestureReceived_;
@@ -694,6 +769,26 @@ class Apds9960
     Config    config_;
     Transport transport_;
 
+    // STATUS..PDATA
+    static constexpr size_t kSampleSize
+        = APDS9960_PDATA - APDS9960_STATUS + 1;
+
+    SensorSamplingSession<Transport, Sample, kSampleSize> session_;
+
+    static void DecodeSample(const uint8_t *buffer, Sample &sample, void *)
+    {
+        // little endian, like Read16R()
+        const uint8_t *data = &buffer[APDS9960_CDATAL - APDS9960_STATUS];
+
+        sample.color_valid     = buffer[0] & 0x01;
+        sample.proximity_valid = (buffer[0] >> 1) & 0x01;
+        sample.clear           = data[0] | uint16_t(data[1]) << 8;
+        sample.red             = data[2] | uint16_t(data[3]) << 8;
+        sample.green           = data[4] | uint16_t(data[5]) << 8;
+        sample.blue            = data[6] | uint16_t(data[7]) << 8;
+        sample.proximity       = data[8];
+    }
+
     /** Set the global transport_error_ bool */
     void SetTransportErr(bool err) { transport_error_ |= err; }
 
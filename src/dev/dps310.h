@@ -96,6 +96,32 @@ class Dps310I2CTransport
         Read(buff, size);
     }
 
+    /** Starts reading from a register in the background, see
+        I2CHandle::QueueTransaction(). Used by SensorSamplingSession.
+        \param reg the register address, valid until the callback
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called from an interrupt when the read is done
+        \param context passed to the callback
+        \return false if the read couldn't be queued
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        I2CHandle::Transaction transaction;
+        transaction.address          = config_.address;
+        transaction.tx_data          = reg;
+        transaction.tx_size          = 1;
+        transaction.rx_data          = buff;
+        transaction.rx_size          = size;
+        transaction.callback         = callback;
+        transaction.callback_context = context;
+        return i2c_.QueueTransaction(transaction) == I2CHandle::Result::OK;
+    }
+
     /**  Reads an 8 bit value
         \param reg the register address to read from
         \returns the 16 bit data value read from the device
@@ -224,6 +250,29 @@ class Dps310SpiTransport
         Read(buff, size);
     }
 
+    /** Reads from a register and calls the callback.
+        SPI reads block, so the callback is made before this returns.
+        \param reg the register address
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called when the read is done
+        \param context passed to the callback
+        \return true
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        uint8_t    read_reg = uint8_t(*reg | 0x80);
+        const bool ok
+            = SpiHandle::Result::OK == spi_.BlockingTransmit(&read_reg, 1)
+              && SpiHandle::Result::OK == spi_.BlockingReceive(buff, size, 10);
+        callback(context, ok ? I2CHandle::Result::OK : I2CHandle::Result::ERR);
+        return true;
+    }
+
     /**  Reads an 8 bit value
         \param reg the register address to read from
         \returns the data uint8_t read from the device
@@ -337,6 +386,16 @@ class Dps310
         ERR
     };
 
+    /** The measurements of one read, see StartSampling() */
+    struct Sample
+    {
+        float pressure;    /**< in hPa, like GetPressure() */
+        float temperature; /**< in degrees C, like GetTemperature() */
+    };
+
+    /** Called from an interrupt when a sample is available */
+    typedef void (*SampleCallback)(void *context, bool ok);
+
     /** Initialize the Dps310 device
         \param config Configuration settings
     */
@@ -366,6 +425,8 @@ class Dps310
             System::Delay(10);
         }
 
+        session_.Init(&transport_, DPS310_PRSB2, &DecodeSample, this);
+
         return GetTransportError();
     }
 
@@ -527,19 +588,7 @@ class Dps310
 
         _scaled_rawtemp = (float)raw_temperature / temp_scale;
         _temperature    = _scaled_rawtemp * _c1 + _c0 / 2.0;
-
-        _pressure = (float)raw_pressure / pressure_scale;
-
-        _pressure
-            = (int32_t)_c00
-              + _pressure
-                    * ((int32_t)_c10
-                       + _pressure
-                             * ((int32_t)_c20 + _pressure * (int32_t)_c30))
-              + _scaled_rawtemp
-                    * ((int32_t)_c01
-                       + _pressure
-                             * ((int32_t)_c11 + _pressure * (int32_t)_c21));
+        _pressure       = CompensatePressure(raw_pressure, _scaled_rawtemp);
     }
 
     /** Get last temperature reading
@@ -552,6 +601,37 @@ class Dps310
     */
     float GetPressure() { return _pressure / 100; }
 
+    /** Starts reading pressure and temperature in the background, unlike
+        Process(), which waits for the transfer.
+        With the SPI transport, the read blocks. The driver must be static or
+        global and not in the DTCM, see SensorSamplingSession.
+        \param callback called from an interrupt when the sample is
+                        available, or nullptr
+        \param context passed to the callback
+        \return false if the last read hasn't finished or the transfer
+                couldn't be queued
+    */
+    bool StartSampling(SampleCallback callback = nullptr,
+                       void          *context  = nullptr)
+    {
+        return session_.Start(callback, context);
+    }
+
+    /** \return true while a read started by StartSampling() runs */
+    bool IsSampling() const { return session_.IsBusy(); }
+
+    /** Copies the latest sample read by StartSampling()
+        \param sample receives the sample
+        \return false if there is no sample yet
+    */
+    bool GetLatestSample(Sample &sample) const
+    {
+        return session_.GetLatest(sample);
+    }
+
+    /** \return the number of samples read by StartSampling() */
+    uint32_t GetNumSamples() const { return session_.GetNumSamples(); }
+
     /**  Writes an 8 bit value
         \param reg the register address to write to
         \param value the value to write to the register
@@ -636,9 +716,44 @@ class Dps310
     Result GetTransportError() { return transport_.GetError() ? ERR : OK; }
 
   private:
+    /** \return the compensated pressure in Pa */
+    float CompensatePressure(int32_t raw, float scaled_rawtemp) const
+    {
+        const float pressure = (float)raw / pressure_scale;
+
+        return (int32_t)_c00
+               + pressure
+                     * ((int32_t)_c10
+                        + pressure
+                              * ((int32_t)_c20 + pressure * (int32_t)_c30))
+               + scaled_rawtemp
+                     * ((int32_t)_c01
+                        + pressure
+                              * ((int32_t)_c11 + pressure * (int32_t)_c21));
+    }
+
+    // PRSB2..PRSB0, then TMPB2..TMPB0
+    static void DecodeSample(const uint8_t *buffer, Sample &sample, void *ctx)
+    {
+        const Dps310 *dps = static_cast<const Dps310 *>(ctx);
+
+        const int32_t raw_p = twosComplement(
+            int32_t(buffer[0]) << 16 | int32_t(buffer[1]) << 8 | buffer[2], 24);
+        const int32_t raw_t = twosComplement(
+            int32_t(buffer[3]) << 16 | int32_t(buffer[4]) << 8 | buffer[5], 24);
+
+        const float scaled_rawtemp = (float)raw_t / dps->temp_scale;
+
+        sample.temperature = scaled_rawtemp * dps->_c1 + dps->_c0 / 2.0f;
+        sample.pressure
+            = dps->CompensatePressure(raw_p, scaled_rawtemp) / 100.0f;
+    }
+
     Config    config_;
     Transport transport_;
 
+    SensorSamplingSession<Transport, Sample, 6> session_;
+
     int16_t _c0, _c1, _c01, _c11, _c20, _c21, _c30;
     int32_t _c00, _c10;
 
@@ -167,6 +167,32 @@ class Icm20948I2CTransport
         Read(buff, size);
     }
 
+    /** Starts reading from a register in the background, see
+        I2CHandle::QueueTransaction(). Used by SensorSamplingSession.
+        \param reg the register address, valid until the callback
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called from an interrupt when the read is done
+        \param context passed to the callback
+        \return false if the read couldn't be queued
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        I2CHandle::Transaction transaction;
+        transaction.address          = config_.address;
+        transaction.tx_data          = reg;
+        transaction.tx_size          = 1;
+        transaction.rx_data          = buff;
+        transaction.rx_size          = size;
+        transaction.callback         = callback;
+        transaction.callback_context = context;
+        return i2c_.QueueTransaction(transaction) == I2CHandle::Result::OK;
+    }
+
     /**  Reads an 8 bit value
         \param reg the register address to read from
         \return the 16 bit data value read from the device
@@ -284,6 +310,29 @@ class Icm20948SpiTransport
         Read(buff, size);
     }
 
+    /** Reads from a register and calls the callback.
+        SPI reads block, so the callback is made before this returns.
+        \param reg the register address
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called when the read is done
+        \param context passed to the callback
+        \return true
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        uint8_t    read_reg = uint8_t(*reg | 0x80);
+        const bool ok
+            = SpiHandle::Result::OK == spi_.BlockingTransmit(&read_reg, 1)
+              && SpiHandle::Result::OK == spi_.BlockingReceive(buff, size, 10);
+        callback(context, ok ? I2CHandle::Result::OK : I2CHandle::Result::ERR);
+        return true;
+    }
+
 
     /**  Reads an 8 bit value
         \param reg the register address to read from
@@ -333,6 +382,18 @@ class Icm20948
         float z;
     };
 
+    /** All measurements of one read, see StartSampling() */
+    struct Sample
+    {
+        Icm20948Vect accel;       /**< in m/s^2, like GetAccelVect() */
+        Icm20948Vect gyro;        /**< in rad/s, like GetGyroVect() */
+        Icm20948Vect mag;         /**< in uT, like GetMagVect() */
+        float        temperature; /**< in degrees C, like GetTemp() */
+    };
+
+    /** Called from an interrupt when a sample is available */
+    typedef void (*SampleCallback)(void *context, bool ok);
+
     /** The accelerometer data range */
     enum icm20948_accel_range_t
     {
@@ -410,6 +471,8 @@ class Icm20948
 
         System::Delay(20);
 
+        session_.Init(&transport_, ICM20X_B0_ACCEL_XOUT_H, &DecodeSample, this);
+
         return GetTransportError();
     }
 
@@ -500,33 +563,36 @@ class Icm20948
         return WriteExternalRegister(0x0C, mag_reg_addr, value);
     }
 
+    /** \return LSB per dps of the current gyro range */
+    float GetGyroScale() const
+    {
+        switch(current_gyro_range_)
+        {
+            case ICM20948_GYRO_RANGE_250_DPS: return 131.0;
+            case ICM20948_GYRO_RANGE_500_DPS: return 65.5;
+            case ICM20948_GYRO_RANGE_1000_DPS: return 32.8;
+            case ICM20948_GYRO_RANGE_2000_DPS: return 16.4;
+            default: return 1.0;
+        }
+    }
+
+    /** \return LSB per g of the current accelerometer range */
+    float GetAccelScale() const
+    {
+        switch(current_accel_range_)
+        {
+            case ICM20948_ACCEL_RANGE_2_G: return 16384.0;
+            case ICM20948_ACCEL_RANGE_4_G: return 8192.0;
+            case ICM20948_ACCEL_RANGE_8_G: return 4096.0;
+            case ICM20948_ACCEL_RANGE_16_G: return 2048.0;
+            default: return 1.0;
+        }
+    }
+
     void ScaleValues()
     {
-        icm20948_gyro_range_t gyro_range
-            = (icm20948_gyro_range_t)current_gyro_range_;
-        icm20948_accel_range_t accel_range
-            = (icm20948_accel_range_t)current_accel_range_;
-
-        float accel_scale = 1.0;
-        float gyro_scale  = 1.0;
-
-        if(gyro_range == ICM20948_GYRO_RANGE_250_DPS)
-            gyro_scale = 131.0;
-        if(gyro_range == ICM20948_GYRO_RANGE_500_DPS)
-            gyro_scale = 65.5;
-        if(gyro_range == ICM20948_GYRO_RANGE_1000_DPS)
-            gyro_scale = 32.8;
-        if(gyro_range == ICM20948_GYRO_RANGE_2000_DPS)
-            gyro_scale = 16.4;
-
-        if(accel_range == ICM20948_ACCEL_RANGE_2_G)
-            accel_scale = 16384.0;
-        if(accel_range == ICM20948_ACCEL_RANGE_4_G)
-            accel_scale = 8192.0;
-        if(accel_range == ICM20948_ACCEL_RANGE_8_G)
-            accel_scale = 4096.0;
-        if(accel_range == ICM20948_ACCEL_RANGE_16_G)
-            accel_scale = 2048.0;
+        const float accel_scale = GetAccelScale();
+        const float gyro_scale  = GetGyroScale();
 
         gyroX = rawGyroX / gyro_scale;
         gyroY = rawGyroY / gyro_scale;
@@ -832,6 +898,38 @@ class Icm20948
 
     float GetTemp() { return (temperature / 333.87) + 21.0; }
 
+    /** Starts reading all measurements in the background, unlike Process(),
+        which waits for the transfer. Register bank 0 must be selected, as it
+        is after Init() and all other functions.
+        With the SPI transport, the read blocks. The driver must be static or
+        global and not in the DTCM, see SensorSamplingSession.
+        \param callback called from an interrupt when the sample is
+                        available, or nullptr
+        \param context passed to the callback
+        \return false if the last read hasn't finished or the transfer
+                couldn't be queued
+    */
+    bool StartSampling(SampleCallback callback = nullptr,
+                       void          *context  = nullptr)
+    {
+        return session_.Start(callback, context);
+    }
+
+    /** \return true while a read started by StartSampling() runs */
+    bool IsSampling() const { return session_.IsBusy(); }
+
+    /** Copies the latest sample read by StartSampling()
+        \param sample receives the sample
+        \return false if there is no sample yet
+    */
+    bool GetLatestSample(Sample &sample) const
+    {
+        return session_.GetLatest(sample);
+    }
+
+    /** \return the number of samples read by StartSampling() */
+    uint32_t GetNumSamples() const { return session_.GetNumSamples(); }
+
     /**  Reads an 8 bit value
         \param reg the register address to read from
         \return the data uint8_t read from the device
@@ -955,9 +1053,38 @@ class Icm20948
     Result GetTransportError() { return transport_.GetError() ? ERR : OK; }
 
   private:
+    // Accel, gyro, temp, and 9 bytes of mag, as in Process()
+    static constexpr size_t kSampleSize = 14 + 9;
+
+    static void DecodeSample(const uint8_t *buffer, Sample &sample, void *ctx)
+    {
+        const Icm20948 *icm = static_cast<const Icm20948 *>(ctx);
+        const float accel = SENSORS_GRAVITY_EARTH / icm->GetAccelScale();
+        const float gyro  = SENSORS_DPS_TO_RADS / icm->GetGyroScale();
+        const float mag   = ICM20948_UT_PER_LSB;
+
+        sample.accel.x = int16_t(buffer[0] << 8 | buffer[1]) * accel;
+        sample.accel.y = int16_t(buffer[2] << 8 | buffer[3]) * accel;
+        sample.accel.z = int16_t(buffer[4] << 8 | buffer[5]) * accel;
+
+        sample.gyro.x = int16_t(buffer[6] << 8 | buffer[7]) * gyro;
+        sample.gyro.y = int16_t(buffer[8] << 8 | buffer[9]) * gyro;
+        sample.gyro.z = int16_t(buffer[10] << 8 | buffer[11]) * gyro;
+
+        sample.temperature
+            = int16_t(buffer[12] << 8 | buffer[13]) / 333.87f + 21.0f;
+
+        // Mag data is read little endian
+        sample.mag.x = int16_t(buffer[16] << 8 | buffer[15]) * mag;
+        sample.mag.y = int16_t(buffer[18] << 8 | buffer[17]) * mag;
+        sample.mag.z = int16_t(buffer[20] << 8 | buffer[19]) * mag;
+    }
+
     Config    config_;
     Transport transport_;
 
+    SensorSamplingSession<Transport, Sample, kSampleSize> session_;
+
     uint16_t _sensorid_accel, ///< ID number for accelerometer
         _sensorid_gyro,       ///< ID number for gyro
         _sensorid_mag,        ///< ID number for mag
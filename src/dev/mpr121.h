@@ -2,6 +2,8 @@
 #ifndef DSY_MPR121_H
 #define DSY_MPR121_H
 
+#include "dev/sensor_sampling.h"
+
 // The default I2C address
 #define MPR121_I2CADDR_DEFAULT 0x5A        ///< default I2C address
 #define MPR121_TOUCH_THRESHOLD_DEFAULT 12  ///< default touch threshold value
@@ -73,6 +75,32 @@ class Mpr121I2CTransport
                != i2c_.ReceiveBlocking(config_.dev_addr, data, size, 10);
     }
 
+    /** Starts reading from a register in the background, see
+        I2CHandle::QueueTransaction(). Used by SensorSamplingSession.
+        \param reg the register address, valid until the callback
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called from an interrupt when the read is done
+        \param context passed to the callback
+        \return false if the read couldn't be queued
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        I2CHandle::Transaction transaction;
+        transaction.address          = config_.dev_addr;
+        transaction.tx_data          = reg;
+        transaction.tx_size          = 1;
+        transaction.rx_data          = buff;
+        transaction.rx_size          = size;
+        transaction.callback         = callback;
+        transaction.callback_context = context;
+        return i2c_.QueueTransaction(transaction) == I2CHandle::Result::OK;
+    }
+
   private:
     I2CHandle i2c_;
     Config    config_;
@@ -109,6 +137,16 @@ class Mpr121
         ERR
     };
 
+    /** The touch status and filtered data of one read, see StartSampling() */
+    struct Sample
+    {
+        uint16_t touched;      /**< like Touched() */
+        uint16_t filtered[13]; /**< like FilteredData(), for channels 0-12 */
+    };
+
+    /** Called from an interrupt when a sample is available */
+    typedef void (*SampleCallback)(void *context, bool ok);
+
     /** Initialize the MPR121 device
         \param config Configuration settings
     */
@@ -166,6 +204,8 @@ class Mpr121
         WriteRegister(MPR121_ECR,
                       ECR_SETTING); // start with above ECR setting
 
+        session_.Init(&transport_, MPR121_TOUCHSTATUS_L, &DecodeSample, this);
+
         return GetTransportErr();
     }
 
@@ -224,6 +264,36 @@ class Mpr121
         return t & 0x0FFF;
     }
 
+    /** Starts reading the touch status and the filtered data of all
+        channels in the background, in one transfer. The driver must be
+        static or global and not in the DTCM, see SensorSamplingSession.
+        \param callback called from an interrupt when the sample is
+                        available, or nullptr
+        \param context passed to the callback
+        \return false if the last read hasn't finished or the transfer
+                couldn't be queued
+    */
+    bool StartSampling(SampleCallback callback = nullptr,
+                       void          *context  = nullptr)
+    {
+        return session_.Start(callback, context);
+    }
+
+    /** \return true while a read started by StartSampling() runs */
+    bool IsSampling() const { return session_.IsBusy(); }
+
+    /** Copies the latest sample read by StartSampling()
+        \param sample receives the sample
+        \return false if there is no sample yet
+    */
+    bool GetLatestSample(Sample &sample) const
+    {
+        return session_.GetLatest(sample);
+    }
+
+    /** \return the number of samples read by StartSampling() */
+    uint32_t GetNumSamples() const { return session_.GetNumSamples(); }
+
     /** Read the contents of an 8 bit device register.
         \param      reg the register address to read from
         \returns    the 8 bit value that was read.
@@ -335,10 +405,26 @@ class Mpr121
     };
 
   private:
+    // the touch status, the out of range status, then the filtered data
+    static constexpr size_t kSampleSize = 30;
+
     Config    config_;
     Transport transport_;
     bool      transport_error_;
 
+    SensorSamplingSession<Transport, Sample, kSampleSize> session_;
+
+    // TOUCHSTATUS_L..FILTDATA_12H, little endian
+    static void DecodeSample(const uint8_t *buffer, Sample &sample, void *)
+    {
+        sample.touched = (buffer[0] | uint16_t(buffer[1]) << 8) & 0x0FFF;
+        for(size_t i = 0; i < 13; i++)
+        {
+            const uint8_t *data = &buffer[MPR121_FILTDATA_0L + 2 * i];
+            sample.filtered[i]  = data[0] | uint16_t(data[1]) << 8;
+        }
+    }
+
     /** Set the global transport_error_ bool */
     void SetTransportErr(bool err) { transport_error_ |= err; }
 
@@ -12,27 +12,38 @@ template <size_t width, size_t height, typename Transport>
 class SH1106Driver : public SSD130xDriver<width, height, Transport>
 {
   public:
+    using UpdateCallback
+        = typename SSD130xDriver<width, height, Transport>::UpdateCallback;
+
     /**
-   * Update the display
+   * Update the display. Only the columns of each page that changed since
+   * the last update are sent.
    */
     void Update()
     {
-        uint8_t i;
-        uint8_t high_column_addr;
+        // the SH1106 has 132 columns, the display starts at column 2
         switch(height)
         {
-            case 32: high_column_addr = 0x12; break;
+            case 32: this->UpdatePages(0x22); break;
 
-            default: high_column_addr = 0x10; break;
+            default: this->UpdatePages(0x02); break;
         }
-        for(i = 0; i < (height / 8); i++)
+    };
+
+    /**
+     * Starts sending the changed columns with the DMA and returns, see
+     * SSD130xDriver::UpdateAsync()
+     */
+    bool UpdateAsync(UpdateCallback callback = nullptr,
+                     void*          context  = nullptr)
+    {
+        switch(height)
         {
-            this->transport_.SendCommand(0xB0 + i);
-            this->transport_.SendCommand(0x02);
-            this->transport_.SendCommand(high_column_addr);
-            this->transport_.SendData(&this->buffer_[width * i], width);
+            case 32: return this->StartUpdatePages(0x22, callback, context);
+
+            default: return this->StartUpdatePages(0x02, callback, context);
         }
-    };
+    }
 };
 
 /**
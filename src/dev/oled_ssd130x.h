@@ -6,6 +6,9 @@
 #include "per/spi.h"
 #include "per/gpio.h"
 #include "sys/system.h"
+#ifndef UNIT_TEST
+#include "sys/dma.h"
+#endif
 
 namespace daisy
 {
@@ -54,6 +57,16 @@ class SSD130xI2CTransport
         }
     };
 
+    /** Sends the data blocking, then calls the callback */
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        SendData(buff, size);
+        callback(context, SpiHandle::Result::OK);
+    };
+
   private:
     daisy::I2CHandle i2c_;
     uint8_t          i2c_address_;
@@ -131,6 +144,19 @@ class SSD130x4WireSpiTransport
         spi_.BlockingTransmit(buff, size);
     };
 
+    /** Starts sending the data with the DMA and returns. The callback is
+     *  called from an interrupt when it's sent. The buffer must stay valid
+     *  until then.
+     */
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        dsy_gpio_write(&pin_dc_, 1);
+        spi_.DmaTransmit(buff, size, nullptr, callback, context);
+    };
+
   private:
     SpiHandle spi_;
     dsy_gpio  pin_reset_;
@@ -208,6 +234,16 @@ class SSD130x4WireSoftSpiTransport
             SoftSpiTransmit(buff[i]);
     };
 
+    /** Sends the data blocking, then calls the callback */
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        SendData(buff, size);
+        callback(context, SpiHandle::Result::OK);
+    };
+
   private:
     void SoftSpiTransmit(uint8_t val)
     {
@@ -240,18 +276,29 @@ class SSD130x4WireSoftSpiTransport
 
 /**
  * A driver implementation for the SSD1306/SSD1309
+ *
+ * UpdateAsync() sends from a buffer inside the driver. The I2C and SPI DMA
+ * can't reach the DTCM RAM, where the stack and DTCM_MEM_SECTION variables
+ * are, so a driver used with UpdateAsync() must be a static or global
+ * object in the AXI SRAM, or be placed with DMA_BUFFER_MEM_SECTION.
  */
 template <size_t width, size_t height, typename Transport>
 class SSD130xDriver
 {
+    static_assert(width <= 256, "SSD130xDriver supports up to 256 columns");
+
   public:
     struct Config
     {
         typename Transport::Config transport_config;
     };
 
+    /** Called from an interrupt when an UpdateAsync() is done */
+    typedef void (*UpdateCallback)(void* context);
+
     void Init(Config config)
     {
+        busy_ = false;
         transport_.Init(config.transport_config);
 
         // Init routine...
@@ -344,6 +391,9 @@ class SSD130xDriver
 
         // Display On
         transport_.SendCommand(0xAF); //--turn on oled panel
+
+        // the display memory doesn't match the buffer yet
+        SetAllDirty();
     };
 
     size_t Width() const { return width; };
@@ -353,45 +403,368 @@ class SSD130xDriver
     {
         if(x >= width || y >= height)
             return;
-        if(on)
-            buffer_[x + (y / 8) * width] |= (1 << (y % 8));
-        else
-            buffer_[x + (y / 8) * width] &= ~(1 << (y % 8));
+        uint8_t&      data  = buffer_[x + (y / 8) * width];
+        const uint8_t mask  = 1 << (y % 8);
+        const uint8_t value = on ? (data | mask) : (data & ~mask);
+        if(value != data)
+        {
+            data = value;
+            MarkDirty(y / 8, x, x);
+        }
     }
 
     void Fill(bool on)
     {
-        for(size_t i = 0; i < sizeof(buffer_); i++)
+        const uint8_t value = on ? 0xff : 0x00;
+        for(size_t page = 0; page < kNumPages; page++)
         {
-            buffer_[i] = on ? 0xff : 0x00;
+            uint8_t* row   = &buffer_[width * page];
+            size_t   first = width, last = 0;
+            for(size_t x = 0; x < width; x++)
+            {
+                if(row[x] != value)
+                {
+                    row[x] = value;
+                    if(first == width)
+                        first = x;
+                    last = x;
+                }
+            }
+            if(first < width)
+                MarkDirty(page, first, last);
         }
     };
 
+    /** Sets the pixels from (x1, y) to (x2, y) */
+    void FillSpan(uint_fast8_t x1, uint_fast8_t x2, uint_fast8_t y, bool on)
+    {
+        FillRect(x1, y, x2, y, on);
+    }
+
+    /** Sets the pixels of a rectangle. Each page byte is written once. */
+    void FillRect(uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on)
+    {
+        if(x2 >= width)
+            x2 = width - 1;
+        if(y2 >= height)
+            y2 = height - 1;
+        if(x1 > x2 || y1 > y2)
+            return;
+        for(size_t page = y1 / 8; page <= y2 / 8; page++)
+        {
+            const uint8_t mask = GetPageMask(page, y1, y2);
+            const uint8_t bits = on ? mask : 0x00;
+            uint8_t*      row  = &buffer_[width * page];
+            // only the columns between the first and the last change are
+            // written
+            size_t first = x1, last = x2;
+            while(first <= last && (row[first] & mask) == bits)
+                first++;
+            if(first > last)
+                continue;
+            while((row[last] & mask) == bits)
+                last--;
+            for(size_t x = first; x <= last; x++)
+                row[x] = (row[x] & ~mask) | bits;
+            MarkDirty(page, first, last);
+        }
+    }
+
+    /**
+     * Draws a 1 bit bitmap with its background, see
+     * OneBitGraphicsDisplayImpl::BlitBitmap(). The bits of each column are
+     * gathered into page bytes, so each byte is written once.
+     */
+    void BlitBitmap(uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    bitmap_width,
+                    uint_fast8_t    bitmap_height,
+                    bool            on)
+    {
+        if(x >= width || y >= height || bitmap_width == 0
+           || bitmap_height == 0)
+            return;
+        const size_t x2 = x + bitmap_width > width ? width - 1
+                                                   : x + bitmap_width - 1;
+        const size_t y2 = y + bitmap_height > height ? height - 1
+                                                     : y + bitmap_height - 1;
+        for(size_t page = y / 8; page <= y2 / 8; page++)
+        {
+            const uint8_t mask  = GetPageMask(page, y, y2);
+            uint8_t*      row   = &buffer_[width * page];
+            size_t        first = width, last = 0;
+            // the bitmap rows in this page
+            const size_t top    = page * 8 < y ? y : page * 8;
+            const size_t bottom = page * 8 + 7 > y2 ? y2 : page * 8 + 7;
+            for(size_t col = x; col <= x2; col++)
+            {
+                const uint16_t column = col - x < 16 ? 0x8000 >> (col - x) : 0;
+                uint8_t        bits   = 0x00;
+                for(size_t r = top; r <= bottom; r++)
+                {
+                    if(rows[r - y] & column)
+                        bits |= 1 << (r % 8);
+                }
+                if(!on)
+                    bits = ~bits & mask;
+                if(SetBits(row[col], mask, bits))
+                {
+                    if(first == width)
+                        first = col;
+                    last = col;
+                }
+            }
+            if(first < width)
+                MarkDirty(page, first, last);
+        }
+    }
+
+    /**
+     * Draws columns of pixels with their background, see
+     * OneBitGraphicsDisplay::BlitColumns(). Each column is shifted to the
+     * first row and written to the pages with whole bytes.
+     */
+    void BlitColumns(uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    num_columns,
+                     uint_fast8_t    column_height,
+                     bool            on)
+    {
+        if(x >= width || y >= height || num_columns == 0
+           || column_height == 0)
+            return;
+        const size_t x2 = x + num_columns > width ? width - 1
+                                                  : x + num_columns - 1;
+        const size_t y2 = y + column_height > height ? height - 1
+                                                     : y + column_height - 1;
+        for(size_t page = y / 8; page <= y2 / 8; page++)
+        {
+            const uint8_t mask  = GetPageMask(page, y, y2);
+            const size_t  shift = page * 8 - (y / 8) * 8;
+            uint8_t*      row   = &buffer_[width * page];
+            size_t        first = width, last = 0;
+            for(size_t col = x; col <= x2; col++)
+            {
+                const uint64_t column = uint64_t(columns[col - x]) << (y % 8);
+                uint8_t        bits   = (column >> shift) & mask;
+                if(!on)
+                    bits = ~bits & mask;
+                if(SetBits(row[col], mask, bits))
+                {
+                    if(first == width)
+                        first = col;
+                    last = col;
+                }
+            }
+            if(first < width)
+                MarkDirty(page, first, last);
+        }
+    }
+
     /**
-     * Update the display 
+     * Update the display. Only the columns of each page that changed since
+     * the last update are sent.
     */
     void Update()
     {
-        uint8_t i;
-        uint8_t high_column_addr;
         switch(height)
         {
-            case 32: high_column_addr = 0x12; break;
+            case 32: UpdatePages(0x20); break;
 
-            default: high_column_addr = 0x10; break;
+            default: UpdatePages(0x00); break;
         }
-        for(i = 0; i < (height / 8); i++)
+    };
+
+    /**
+     * Starts sending the changed columns with the DMA and returns. They are
+     * copied to a second buffer first, so drawing can continue while they
+     * are sent. Transports without DMA send them before this returns.
+     * \param callback called from an interrupt when the update is done, or
+     *        nullptr
+     * \param context passed to the callback
+     * \return false if the previous update is still running. The changes
+     *         are kept for the next update.
+     */
+    bool UpdateAsync(UpdateCallback callback = nullptr,
+                     void*          context  = nullptr)
+    {
+        switch(height)
         {
-            transport_.SendCommand(0xB0 + i);
-            transport_.SendCommand(0x00);
-            transport_.SendCommand(high_column_addr);
-            transport_.SendData(&buffer_[width * i], width);
+            case 32: return StartUpdatePages(0x20, callback, context);
+
+            default: return StartUpdatePages(0x00, callback, context);
         }
-    };
+    }
+
+    /** Returns true while an UpdateAsync() is running */
+    bool IsBusy() const { return busy_; }
+
+    /** Marks the whole display to be sent with the next Update(), e.g.
+     *  after the display was reset
+     */
+    void SetAllDirty()
+    {
+        for(size_t page = 0; page < kNumPages; page++)
+        {
+            dirty_first_[page] = 0;
+            dirty_last_[page]  = width - 1;
+        }
+    }
 
   protected:
+    static constexpr size_t kNumPages = height / 8;
+
+    /** Returns the bits of the rows y1 to y2 in a page */
+    static uint8_t GetPageMask(size_t page, size_t y1, size_t y2)
+    {
+        const size_t top    = page == y1 / 8 ? y1 % 8 : 0;
+        const size_t bottom = page == y2 / 8 ? y2 % 8 : 7;
+        return (0xff << top) & (0xff >> (7 - bottom));
+    }
+
+    /** Sets the masked bits of a page byte
+     *  \return true if the byte changed
+     */
+    static bool SetBits(uint8_t& data, uint8_t mask, uint8_t bits)
+    {
+        const uint8_t value = (data & ~mask) | bits;
+        if(value == data)
+            return false;
+        data = value;
+        return true;
+    }
+
+    void MarkDirty(size_t page, size_t first, size_t last)
+    {
+        if(first < dirty_first_[page])
+            dirty_first_[page] = first;
+        if(last > dirty_last_[page])
+            dirty_last_[page] = last;
+    }
+
+    /** Sends the changed columns of each page
+     *  \param column_offset the display column of the first pixel
+     */
+    void UpdatePages(uint8_t column_offset)
+    {
+        while(busy_) {}
+        for(uint8_t page = 0; page < kNumPages; page++)
+        {
+            const uint8_t first = dirty_first_[page];
+            const uint8_t last  = dirty_last_[page];
+            if(first > last)
+                continue;
+            const uint8_t column = column_offset + first;
+            transport_.SendCommand(0xB0 + page);
+            transport_.SendCommand(0x00 | (column & 0x0F));
+            transport_.SendCommand(0x10 | (column >> 4));
+            transport_.SendData(&buffer_[width * page + first],
+                                last - first + 1);
+            dirty_first_[page] = 0xff;
+            dirty_last_[page]  = 0;
+        }
+    }
+
+    /** Copies the changed columns to the front buffer and starts sending
+     *  them, one page after the other
+     */
+    bool StartUpdatePages(uint8_t        column_offset,
+                          UpdateCallback callback,
+                          void*          context)
+    {
+        if(busy_)
+            return false;
+        bool changed = false;
+        for(size_t page = 0; page < kNumPages; page++)
+        {
+            const uint8_t first = dirty_first_[page];
+            const uint8_t last  = dirty_last_[page];
+            sent_first_[page]   = first;
+            sent_last_[page]    = last;
+            if(first > last)
+                continue;
+            for(size_t x = first; x <= last; x++)
+                front_buffer_[width * page + x] = buffer_[width * page + x];
+            dirty_first_[page] = 0xff;
+            dirty_last_[page]  = 0;
+            changed            = true;
+        }
+        if(!changed)
+        {
+            if(callback != nullptr)
+                callback(context);
+            return true;
+        }
+#ifndef UNIT_TEST
+        dsy_dma_clear_cache_for_buffer(front_buffer_, sizeof(front_buffer_));
+#endif
+        busy_          = true;
+        callback_      = callback;
+        context_       = context;
+        column_offset_ = column_offset;
+        next_page_     = 0;
+        SendNextPage();
+        return true;
+    }
+
+    /** Sends the address of the next changed page, then starts its data.
+     *  Called from the DMA interrupt after the first page.
+     */
+    void SendNextPage()
+    {
+        while(next_page_ < kNumPages
+              && sent_first_[next_page_] > sent_last_[next_page_])
+            next_page_++;
+        if(next_page_ == kNumPages)
+        {
+            busy_ = false;
+            if(callback_ != nullptr)
+                callback_(context_);
+            return;
+        }
+        const uint8_t page   = next_page_++;
+        const uint8_t first  = sent_first_[page];
+        const uint8_t column = column_offset_ + first;
+        transport_.SendCommand(0xB0 + page);
+        transport_.SendCommand(0x00 | (column & 0x0F));
+        transport_.SendCommand(0x10 | (column >> 4));
+        transport_.SendDataDma(&front_buffer_[width * page + first],
+                               sent_last_[page] - first + 1,
+                               &PageSent,
+                               this);
+    }
+
+    static void PageSent(void* context, SpiHandle::Result result)
+    {
+        auto* driver = static_cast<SSD130xDriver*>(context);
+        // after an error, the rest of the update is dropped
+        if(result != SpiHandle::Result::OK)
+            driver->next_page_ = kNumPages;
+        driver->SendNextPage();
+    }
+
     Transport transport_;
     uint8_t   buffer_[width * height / 8];
+    // the changed columns of each page. first > last if none changed.
+    uint8_t dirty_first_[kNumPages];
+    uint8_t dirty_last_[kNumPages];
+
+    // sent by UpdateAsync() while buffer_ is drawn to, the DMA source
+    alignas(32) uint8_t front_buffer_[width * height / 8];
+
+    uint8_t        sent_first_[kNumPages];
+    uint8_t        sent_last_[kNumPages];
+    volatile bool  busy_;
+    uint8_t        next_page_;
+    uint8_t        column_offset_;
+    UpdateCallback callback_;
+    void*          context_;
 };
 
 /**
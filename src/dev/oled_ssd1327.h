@@ -3,6 +3,9 @@
 #include "per/spi.h"
 #include "per/gpio.h"
 #include "sys/system.h"
+#ifndef UNIT_TEST
+#include "sys/dma.h"
+#endif
 
 namespace daisy
 {
@@ -79,6 +82,19 @@ class SSD13274WireSpiTransport
         spi_.BlockingTransmit(buff, size);
     };
 
+    /** Starts sending the data with the DMA and returns. The callback is
+     *  called from an interrupt when it's sent. The buffer must stay valid
+     *  until then.
+     */
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        dsy_gpio_write(&pin_dc_, 1);
+        spi_.DmaTransmit(buff, size, nullptr, callback, context);
+    };
+
   private:
     SpiHandle spi_;
     dsy_gpio  pin_reset_;
@@ -88,6 +104,11 @@ class SSD13274WireSpiTransport
 
 /**
  * A driver implementation for the SSD1327
+ *
+ * UpdateAsync() sends from a buffer inside the driver, which the SPI DMA
+ * can't read from the DTCM RAM (the stack or DTCM_MEM_SECTION). Make the
+ * driver a static or global object in the AXI SRAM, or place it with
+ * DMA_BUFFER_MEM_SECTION.
  */
 template <size_t width, size_t height, typename Transport>
 class SSD1327Driver
@@ -98,9 +119,13 @@ class SSD1327Driver
         typename Transport::Config transport_config;
     };
 
+    /** Called from an interrupt when an UpdateAsync() is done */
+    typedef void (*UpdateCallback)(void* context);
+
     void Init(Config config)
     {
         color_ = 0x0f;
+        busy_  = false;
         transport_.Init(config.transport_config);
 
         transport_.SendCommand(0x15);   // set column address
@@ -202,27 +227,79 @@ class SSD1327Driver
     */
     void Update()
     {
-        transport_.SendCommand(0x15);	// column
-        transport_.SendCommand(0x00);
-        transport_.SendCommand((width/2)-1);
-
-        transport_.SendCommand(0x75);	// row
-        transport_.SendCommand(0x00);
-        transport_.SendCommand(height-1);
+        while(busy_) {}
+        SendWindow();
 
         //write data
-        transport_.SendData(buffer_, 8192);
+        transport_.SendData(buffer_, sizeof(buffer_));
     };
 
+    /**
+     * Starts sending the display buffer with the DMA and returns. It is
+     * copied to a second buffer first, so drawing can continue while it is
+     * sent.
+     * \param callback called from an interrupt when the update is done, or
+     *        nullptr
+     * \param context passed to the callback
+     * \return false if the previous update is still running
+     */
+    bool UpdateAsync(UpdateCallback callback = nullptr,
+                     void*          context  = nullptr)
+    {
+        if(busy_)
+            return false;
+        for(size_t i = 0; i < sizeof(buffer_); i++)
+            front_buffer_[i] = buffer_[i];
+#ifndef UNIT_TEST
+        dsy_dma_clear_cache_for_buffer(front_buffer_, sizeof(front_buffer_));
+#endif
+        busy_     = true;
+        callback_ = callback;
+        context_  = context;
+        SendWindow();
+        transport_.SendDataDma(
+            front_buffer_, sizeof(front_buffer_), &Sent, this);
+        return true;
+    }
+
+    /** Returns true while an UpdateAsync() is running */
+    bool IsBusy() const { return busy_; }
+
     void Set_Color(uint8_t in_col)
     {
     	color_ = in_col & 0x0f;
     };
 
   protected:
+    void SendWindow()
+    {
+        transport_.SendCommand(0x15); // column
+        transport_.SendCommand(0x00);
+        transport_.SendCommand((width / 2) - 1);
+
+        transport_.SendCommand(0x75); // row
+        transport_.SendCommand(0x00);
+        transport_.SendCommand(height - 1);
+    }
+
+    static void Sent(void* context, SpiHandle::Result)
+    {
+        auto* driver  = static_cast<SSD1327Driver*>(context);
+        driver->busy_ = false;
+        if(driver->callback_ != nullptr)
+            driver->callback_(driver->context_);
+    }
+
     Transport transport_;
     uint8_t   buffer_[width/2 * height];
     uint8_t   color_;
+
+    // sent by UpdateAsync() while buffer_ is drawn to, the DMA source
+    alignas(32) uint8_t front_buffer_[width / 2 * height];
+
+    volatile bool  busy_;
+    UpdateCallback callback_;
+    void*          context_;
 };
 
 /**
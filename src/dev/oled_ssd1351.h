@@ -3,6 +3,9 @@
 #include "per/spi.h"
 #include "per/gpio.h"
 #include "sys/system.h"
+#ifndef UNIT_TEST
+#include "sys/dma.h"
+#endif
 
 #define	oled_white		0xffff
 #define	oled_black		0x0000
@@ -94,6 +97,19 @@ class SSD13514WireSpiTransport
         spi_.BlockingTransmit(&data, 1);
     };
 
+    /** Starts sending the data with the DMA and returns. The callback is
+     *  called from an interrupt when it's sent. The buffer must stay valid
+     *  until then.
+     */
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        dsy_gpio_write(&pin_dc_, 1);
+        spi_.DmaTransmit(buff, size, nullptr, callback, context);
+    };
+
   private:
     SpiHandle spi_;
     dsy_gpio  pin_reset_;
@@ -101,92 +117,112 @@ class SSD13514WireSpiTransport
 };
 
 
-/**
- * A driver implementation for the SSD1351
- */
-template <size_t width, size_t height, typename Transport>
-class SSD1351Driver
+/** Sends the commands that set up the SSD1351 and turn the display on */
+template <typename Transport>
+void SSD1351SendInitCommands(Transport& transport)
 {
-  public:
-    struct Config
-    {
-        typename Transport::Config transport_config;
-    };
+    transport.SendCommand(0xfd);		// lock IC
+    transport.SendData(0x12);
+    transport.SendCommand(0xfd);		// unlock IC
+    transport.SendData(0xb1);     		//
 
-    void Init(Config config)
-    {
-        fg_color_ = oled_white;
-        bg_color_ = oled_black;
-        transport_.Init(config.transport_config);
+    transport.SendCommand(0xae);		// display off
+
+    transport.SendCommand(0x15);		// set column address
+    transport.SendData(0x00);     		// column address start 00
+    transport.SendData(0x7f);     		// column address end 127
+
+    transport.SendCommand(0x75);		// set row address
+    transport.SendData(0x00);     		// row address start 00
+    transport.SendData(0x7f);     		// row address end 127
 
-    	transport_.SendCommand(0xfd);		// lock IC
-    	transport_.SendData(0x12);
-    	transport_.SendCommand(0xfd);		// unlock IC
-    	transport_.SendData(0xb1);     		//
+    transport.SendCommand(0xB3);		// Set Front Clock Divider / Oscillator Frequency
+    transport.SendData(0xF1);
 
-        transport_.SendCommand(0xae);		// display off
+    transport.SendCommand(0xCA);		// Set Multiplex Ratio
+    transport.SendData(0x7F);
 
-    	transport_.SendCommand(0x15);		// set column address
-    	transport_.SendData(0x00);     		// column address start 00
-    	transport_.SendData(0x7f);     		// column address end 127
+    transport.SendCommand(0xa0);  		// Set Re-map & Dual COM Line Mode
+    transport.SendData(0x74);			// color mode 64k, enable com split, reverse com scan, color swapped, hz scan
 
-    	transport_.SendCommand(0x75);		// set row address
-    	transport_.SendData(0x00);     		// row address start 00
-    	transport_.SendData(0x7f);     		// row address end 127
+    transport.SendCommand(0xa1);		// set display start line
+    transport.SendData(0x00);     		// line 0
 
-    	transport_.SendCommand(0xB3);		// Set Front Clock Divider / Oscillator Frequency
-    	transport_.SendData(0xF1);
+    transport.SendCommand(0xa2);  		// set display offset
+    transport.SendData(0x00);			// column 0
 
-    	transport_.SendCommand(0xCA);		// Set Multiplex Ratio
-    	transport_.SendData(0x7F);
+    transport.SendCommand(0xAB);		// Function Selection
+    transport.SendData(0x01);
 
-    	transport_.SendCommand(0xa0);  		// Set Re-map & Dual COM Line Mode
-    	transport_.SendData(0x74);			// color mode 64k, enable com split, reverse com scan, color swapped, hz scan
+    transport.SendCommand(0xB4);		// Set Segment Low Voltage
+    transport.SendData(0xA0);
+    transport.SendData(0xB5);
+    transport.SendData(0x55);
 
-    	transport_.SendCommand(0xa1);		// set display start line
-    	transport_.SendData(0x00);     		// line 0
+    transport.SendCommand(0xC1);		// Set Contrast Current for Color A,B,C
+    transport.SendData(0xC8);
+    transport.SendData(0x80);
+    transport.SendData(0xC0);
 
-    	transport_.SendCommand(0xa2);  		// set display offset
-    	transport_.SendData(0x00);			// column 0
+    transport.SendCommand(0xC7);		// Master Contrast Current Control
+    transport.SendData(0x0F);
 
-    	transport_.SendCommand(0xAB);		// Function Selection
-    	transport_.SendData(0x01);
+    transport.SendCommand(0xB1);		// Set Reset (Phase 1) / Pre-charge (Phase 2) period
+    transport.SendData(0x32);
 
-    	transport_.SendCommand(0xB4);		// Set Segment Low Voltage
-    	transport_.SendData(0xA0);
-    	transport_.SendData(0xB5);
-    	transport_.SendData(0x55);
+    transport.SendCommand(0xB2);		// Display Enhancement
+    transport.SendData(0xA4);
+    transport.SendData(0x00);
+    transport.SendData(0x00);
 
-    	transport_.SendCommand(0xC1);		// Set Contrast Current for Color A,B,C
-    	transport_.SendData(0xC8);
-    	transport_.SendData(0x80);
-    	transport_.SendData(0xC0);
+    transport.SendCommand(0xBB);		// Set Pre-charge voltage
+    transport.SendData(0x17);
 
-    	transport_.SendCommand(0xC7);		// Master Contrast Current Control
-    	transport_.SendData(0x0F);
+    transport.SendCommand(0xB6);		// Set Second Precharge Period
+    transport.SendData(0x01);
 
-    	transport_.SendCommand(0xB1);		// Set Reset (Phase 1) / Pre-charge (Phase 2) period
-    	transport_.SendData(0x32);
+    transport.SendCommand(0xBE);		//	Set VCOMH Voltage
+    transport.SendData(0x05);
 
-    	transport_.SendCommand(0xB2);		// Display Enhancement
-    	transport_.SendData(0xA4);
-    	transport_.SendData(0x00);
-    	transport_.SendData(0x00);
+    transport.SendCommand(0xA6);		// Normal display
 
-    	transport_.SendCommand(0xBB);		// Set Pre-charge voltage
-    	transport_.SendData(0x17);
+    System::Delay(300);					//	wait 300ms
+    transport.SendCommand(0xaf);		// turn on display
+}
+
+/**
+ * A driver implementation for the SSD1351
+ *
+ * UpdateAsync() sends from a buffer inside the driver, which the SPI DMA
+ * can't read from the DTCM RAM (the stack or DTCM_MEM_SECTION). Make the
+ * driver a static or global object in the AXI SRAM, or place it with
+ * DMA_BUFFER_MEM_SECTION.
+ */
+template <size_t width, size_t height, typename Transport>
+class SSD1351Driver
+{
+    static_assert(width <= 128 && height <= 128,
+                  "SSD1351Driver supports up to 128x128 pixels");
 
-    	transport_.SendCommand(0xB6);		// Set Second Precharge Period
-    	transport_.SendData(0x01);
+  public:
+    struct Config
+    {
+        typename Transport::Config transport_config;
+    };
 
-    	transport_.SendCommand(0xBE);		//	Set VCOMH Voltage
-    	transport_.SendData(0x05);
+    /** Called from an interrupt when an UpdateAsync() is done */
+    typedef void (*UpdateCallback)(void* context);
 
-    	transport_.SendCommand(0xA6);		// Normal display
+    void Init(Config config)
+    {
+        busy_     = false;
+        fg_color_ = oled_white;
+        bg_color_ = oled_black;
+        transport_.Init(config.transport_config);
 
-    	System::Delay(300);					//	wait 300ms
-        transport_.SendCommand(0xaf);		// turn on display
+        SSD1351SendInitCommands(transport_);
         Fill(false);
+        SetAllDirty();
     };
 
     size_t Width() const { return width; };
@@ -197,39 +233,238 @@ class SSD1351Driver
         if ((x >= width) || (y >= height))
             return;
 
-        if (on) {
-        	buffer_[(y * width) + x] = fg_color_;
-        }
-        else {
-        	buffer_[(y * width) + x] = bg_color_;
+        uint16_t&      pixel = buffer_[(y * width) + x];
+        const uint16_t color = on ? fg_color_ : bg_color_;
+        if(pixel != color)
+        {
+            pixel = color;
+            MarkDirty(x, y, x, y);
         }
     };
 
     void Fill(bool on)
     {
-        for(size_t i = 0; i < sizeof(buffer_)/2; i++)
+        const uint16_t color = on ? fg_color_ : bg_color_;
+        for(size_t y = 0; y < height; y++)
         {
-            buffer_[i] = on ? fg_color_ : bg_color_;
+            uint16_t* row   = &buffer_[y * width];
+            size_t    first = width, last = 0;
+            for(size_t x = 0; x < width; x++)
+            {
+                if(row[x] != color)
+                {
+                    row[x] = color;
+                    if(first == width)
+                        first = x;
+                    last = x;
+                }
+            }
+            if(first < width)
+                MarkDirty(first, y, last, y);
         }
     };
 
+    /** Sets the pixels from (x1, y) to (x2, y) with a word fill */
+    void FillSpan(uint_fast8_t x1, uint_fast8_t x2, uint_fast8_t y, bool on)
+    {
+        if(x2 >= width)
+            x2 = width - 1;
+        if(y >= height || x1 > x2)
+            return;
+        const uint16_t color = on ? fg_color_ : bg_color_;
+        uint16_t*      row   = &buffer_[y * width];
+        size_t         first = width, last = 0;
+        for(size_t x = x1; x <= x2; x++)
+        {
+            if(row[x] != color)
+            {
+                row[x] = color;
+                if(first == width)
+                    first = x;
+                last = x;
+            }
+        }
+        if(first < width)
+            MarkDirty(first, y, last, y);
+    }
+
+    /** Sets the pixels of a rectangle */
+    void FillRect(uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on)
+    {
+        if(y2 >= height)
+            y2 = height - 1;
+        for(size_t y = y1; y <= y2; y++)
+            FillSpan(x1, x2, y, on);
+    }
+
+    /**
+     * Draws a 1 bit bitmap with its background, see
+     * ColorGraphicsDisplayImpl::BlitBitmap()
+     */
+    void BlitBitmap(uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    bitmap_width,
+                    uint_fast8_t    bitmap_height,
+                    bool            on)
+    {
+        if(x >= width || y >= height || bitmap_width == 0)
+            return;
+        const uint16_t set   = on ? fg_color_ : bg_color_;
+        const uint16_t clear = on ? bg_color_ : fg_color_;
+        const size_t   x2    = x + bitmap_width > width ? width - 1
+                                                        : x + bitmap_width - 1;
+        for(size_t i = 0; i < bitmap_height && y + i < height; i++)
+        {
+            uint16_t* row   = &buffer_[(y + i) * width];
+            size_t    first = width, last = 0;
+            uint32_t  bits  = rows[i];
+            for(size_t col = x; col <= x2; col++, bits <<= 1)
+            {
+                const uint16_t color = (bits & 0x8000) ? set : clear;
+                if(row[col] != color)
+                {
+                    row[col] = color;
+                    if(first == width)
+                        first = col;
+                    last = col;
+                }
+            }
+            if(first < width)
+                MarkDirty(first, y + i, last, y + i);
+        }
+    }
+
     /**
-     * Update the display 
+     * Draws columns of pixels with their background, see
+     * ColorGraphicsDisplay::BlitColumns()
+     */
+    void BlitColumns(uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    num_columns,
+                     uint_fast8_t    column_height,
+                     bool            on)
+    {
+        if(x >= width || y >= height || num_columns == 0)
+            return;
+        const uint16_t set   = on ? fg_color_ : bg_color_;
+        const uint16_t clear = on ? bg_color_ : fg_color_;
+        const size_t   x2    = x + num_columns > width ? width - 1
+                                                       : x + num_columns - 1;
+        for(size_t i = 0; i < column_height && y + i < height; i++)
+        {
+            uint16_t* row   = &buffer_[(y + i) * width];
+            size_t    first = width, last = 0;
+            for(size_t col = x; col <= x2; col++)
+            {
+                const bool     bit   = (columns[col - x] >> i) & 1;
+                const uint16_t color = bit ? set : clear;
+                if(row[col] != color)
+                {
+                    row[col] = color;
+                    if(first == width)
+                        first = col;
+                    last = col;
+                }
+            }
+            if(first < width)
+                MarkDirty(first, y + i, last, y + i);
+        }
+    }
+
+    /**
+     * Update the display. Only the rectangle around the pixels that changed
+     * since the last update is sent.
     */
     void Update()
     {
-        transport_.SendCommand(0x15);		// column
-        transport_.SendData(0x00);
-        transport_.SendData(width-1);
+        while(busy_) {}
+        if(dirty_x0_ > dirty_x1_)
+            return;
 
-        transport_.SendCommand(0x75);		// row
-        transport_.SendData(0x00);
-        transport_.SendData(height-1);
+        SendWindow();
+        const size_t row_size = dirty_x1_ - dirty_x0_ + 1;
+        if(row_size == width)
+        {
+            // whole rows are contiguous in the buffer
+            transport_.SendData(
+                (uint8_t*)&buffer_[dirty_y0_ * width],
+                row_size * (dirty_y1_ - dirty_y0_ + 1) * sizeof(uint16_t));
+        }
+        else
+        {
+            for(size_t y = dirty_y0_; y <= dirty_y1_; y++)
+                transport_.SendData((uint8_t*)&buffer_[y * width + dirty_x0_],
+                                    row_size * sizeof(uint16_t));
+        }
 
-        transport_.SendCommand(0x5c);		// write display buffer
-        transport_.SendData((uint8_t*)buffer_, sizeof(buffer_));
+        dirty_x0_ = dirty_y0_ = 0xff;
+        dirty_x1_ = dirty_y1_ = 0;
     };
 
+    /**
+     * Starts sending the rectangle around the changed pixels with the DMA
+     * and returns. It is copied to a second buffer first, so drawing can
+     * continue while it is sent.
+     * \param callback called from an interrupt when the update is done, or
+     *        nullptr
+     * \param context passed to the callback
+     * \return false if the previous update is still running. The changes
+     *         are kept for the next update.
+     */
+    bool UpdateAsync(UpdateCallback callback = nullptr,
+                     void*          context  = nullptr)
+    {
+        if(busy_)
+            return false;
+        if(dirty_x0_ > dirty_x1_)
+        {
+            if(callback != nullptr)
+                callback(context);
+            return true;
+        }
+
+        // the rows of the rectangle are packed, so it is sent in one go
+        const size_t row_size = dirty_x1_ - dirty_x0_ + 1;
+        uint16_t*    dest     = front_buffer_;
+        for(size_t y = dirty_y0_; y <= dirty_y1_; y++)
+        {
+            const uint16_t* src = &buffer_[y * width + dirty_x0_];
+            for(size_t x = 0; x < row_size; x++)
+                *dest++ = src[x];
+        }
+        const size_t size = (dest - front_buffer_) * sizeof(uint16_t);
+#ifndef UNIT_TEST
+        dsy_dma_clear_cache_for_buffer((uint8_t*)front_buffer_, size);
+#endif
+        busy_     = true;
+        callback_ = callback;
+        context_  = context;
+        SendWindow();
+        dirty_x0_ = dirty_y0_ = 0xff;
+        dirty_x1_ = dirty_y1_ = 0;
+        transport_.SendDataDma((uint8_t*)front_buffer_, size, &Sent, this);
+        return true;
+    }
+
+    /** Returns true while an UpdateAsync() is running */
+    bool IsBusy() const { return busy_; }
+
+    /** Marks the whole display to be sent with the next Update(), e.g.
+     *  after the display was reset
+     */
+    void SetAllDirty()
+    {
+        dirty_x0_ = dirty_y0_ = 0;
+        dirty_x1_             = width - 1;
+        dirty_y1_             = height - 1;
+    }
+
     void SetColorFG(uint8_t red, uint8_t green, uint8_t blue)
     {
     	uint16_t t1, t2;
@@ -252,10 +487,133 @@ class SSD1351Driver
     };
 
   protected:
+    /** Sets the display window to the changed rectangle and starts writing
+     *  to the display memory
+     */
+    void SendWindow()
+    {
+        transport_.SendCommand(0x15); // column
+        transport_.SendData(dirty_x0_);
+        transport_.SendData(dirty_x1_);
+
+        transport_.SendCommand(0x75); // row
+        transport_.SendData(dirty_y0_);
+        transport_.SendData(dirty_y1_);
+
+        transport_.SendCommand(0x5c); // write display buffer
+    }
+
+    static void Sent(void* context, SpiHandle::Result)
+    {
+        auto* driver  = static_cast<SSD1351Driver*>(context);
+        driver->busy_ = false;
+        if(driver->callback_ != nullptr)
+            driver->callback_(driver->context_);
+    }
+
+    void MarkDirty(size_t x0, size_t y0, size_t x1, size_t y1)
+    {
+        if(x0 < dirty_x0_)
+            dirty_x0_ = x0;
+        if(y0 < dirty_y0_)
+            dirty_y0_ = y0;
+        if(x1 > dirty_x1_)
+            dirty_x1_ = x1;
+        if(y1 > dirty_y1_)
+            dirty_y1_ = y1;
+    }
+
     Transport transport_;
     uint16_t  buffer_[width * height];
     uint16_t  fg_color_;
     uint16_t  bg_color_;
+    // the rectangle around the changed pixels. x0 > x1 if none changed.
+    uint8_t dirty_x0_, dirty_y0_, dirty_x1_, dirty_y1_;
+
+    // sent by UpdateAsync() while buffer_ is drawn to, the DMA source
+    alignas(32) uint16_t front_buffer_[width * height];
+
+    volatile bool  busy_;
+    UpdateCallback callback_;
+    void*          context_;
+};
+
+/**
+ * A driver for the SSD1351 without a framebuffer. Pixels are streamed to a
+ * window of the display memory with the DMA, e.g. band by band from a
+ * ColorCompositor.
+ */
+template <size_t width, size_t height, typename Transport>
+class SSD1351StreamDriver
+{
+    static_assert(width <= 128 && height <= 128,
+                  "SSD1351StreamDriver supports up to 128x128 pixels");
+
+  public:
+    struct Config
+    {
+        typename Transport::Config transport_config;
+    };
+
+    void Init(Config config)
+    {
+        busy_ = false;
+        transport_.Init(config.transport_config);
+        SSD1351SendInitCommands(transport_);
+    }
+
+    size_t Width() const { return width; };
+    size_t Height() const { return height; };
+
+    /** Sets the window that the following pixels are written to, row by
+     *  row. Waits until the previous pixels are sent.
+     *  \param x0 the left column
+     *  \param y0 the top row
+     *  \param x1 the right column, inclusive
+     *  \param y1 the bottom row, inclusive
+     */
+    void SetWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+    {
+        while(busy_) {}
+        transport_.SendCommand(0x15); // column
+        transport_.SendData(x0);
+        transport_.SendData(x1);
+
+        transport_.SendCommand(0x75); // row
+        transport_.SendData(y0);
+        transport_.SendData(y1);
+
+        transport_.SendCommand(0x5c); // write display buffer
+    }
+
+    /** Starts sending pixels to the window with the DMA and returns. The
+     *  pixels are RGB565 values with the high byte first in memory. They
+     *  must stay valid until IsBusy() returns false.
+     *  \return false if the previous pixels are still being sent
+     */
+    bool WritePixelsDma(const uint16_t* pixels, size_t num_pixels)
+    {
+        if(busy_)
+            return false;
+        busy_ = true;
+        transport_.SendDataDma((uint8_t*)pixels,
+                               num_pixels * sizeof(uint16_t),
+                               &Sent,
+                               this);
+        return true;
+    }
+
+    /** Returns true while pixels are being sent */
+    bool IsBusy() const { return busy_; }
+
+  protected:
+    static void Sent(void* context, SpiHandle::Result)
+    {
+        static_cast<SSD1351StreamDriver*>(context)->busy_ = false;
+    }
+
+    Transport     transport_;
+    volatile bool busy_;
 };
 
 /**
@@ -263,4 +621,11 @@ class SSD1351Driver
  */
 using SSD13514WireSpi128x128Driver = daisy::SSD1351Driver<128, 128, SSD13514WireSpiTransport>;
 
+/**
+ * A stream driver for the SSD1351 128x128 OLED displays connected via 4 wire
+ * SPI
+ */
+using SSD13514WireSpi128x128StreamDriver
+    = daisy::SSD1351StreamDriver<128, 128, SSD13514WireSpiTransport>;
+
 }; // namespace daisy
@@ -0,0 +1,232 @@
+#pragma once
+#ifndef DSY_SENSOR_SAMPLING_H
+#define DSY_SENSOR_SAMPLING_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include "per/i2c.h"
+#ifndef UNIT_TEST
+#include "sys/dma.h"
+#endif
+
+namespace daisy
+{
+/** @addtogroup external
+    @{
+*/
+
+/** @brief   The latest sample of a sensor, double buffered
+ *  @details One context (usually an interrupt) writes samples, another one
+ *           (usually the main loop) reads the latest one. The writer fills
+ *           the buffer that isn't published, so it never waits. If a
+ *           sample is replaced while the reader copies it, the reader copies
+ *           again.
+ */
+template <typename Sample>
+class SampleSnapshot
+{
+  public:
+    SampleSnapshot() { Reset(); }
+
+    /** Forgets all samples */
+    void Reset() { count_.store(0, std::memory_order_release); }
+
+    /** Returns the buffer to write the next sample to. Writer only. */
+    Sample& BeginWrite()
+    {
+        // a reader that sees data written after this also sees the count
+        // of the sample before, and copies again
+        std::atomic_thread_fence(std::memory_order_release);
+        return buffers_[(count_.load(std::memory_order_relaxed) + 1) & 1];
+    }
+
+    /** Publishes the sample written to BeginWrite(). Writer only. */
+    void EndWrite()
+    {
+        count_.store(count_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+    }
+
+    /** Publishes a sample. Writer only. */
+    void Write(const Sample& sample)
+    {
+        BeginWrite() = sample;
+        EndWrite();
+    }
+
+    /** Copies the latest sample. Reader only.
+     *  \param sample receives the sample
+     *  \return false if there is no sample yet
+     */
+    bool Read(Sample& sample) const
+    {
+        for(;;)
+        {
+            const uint32_t count = count_.load(std::memory_order_acquire);
+            if(count == 0)
+                return false;
+            sample = buffers_[count & 1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(count_.load(std::memory_order_relaxed) == count)
+                return true;
+        }
+    }
+
+    /** Returns the number of samples written since Reset(). A change tells
+     *  that there is a new sample.
+     */
+    uint32_t GetCount() const
+    {
+        return count_.load(std::memory_order_acquire);
+    }
+
+  private:
+    Sample                buffers_[2];
+    std::atomic<uint32_t> count_;
+};
+
+/** @brief   Reads the data registers of a sensor in the background
+ *  @details Start() queues a burst read of the sensor's data registers and
+ *           returns. When the read is done, the data is decoded in the
+ *           interrupt into a SampleSnapshot, and a callback is made. The main
+ *           loop can compute in the meantime, or start the sessions of other
+ *           sensors, whose reads are queued on the bus (see
+ *           I2CHandle::QueueTransaction()).
+ *
+ *           The transport needs a function
+ *           `bool ReadRegAsync(uint8_t* reg, uint8_t* data, uint16_t size,
+ *           I2CHandle::CallbackFunctionPtr callback, void* context)`
+ *           that reads size bytes from the register at *reg and calls the
+ *           callback when it's done. Both pointers stay valid until then.
+ *
+ *           The session holds the DMA buffer, aligned to cache lines. The
+ *           I2C peripherals use DMA1, which can't reach the DTCM RAM, where
+ *           the stack and DTCM_MEM_SECTION variables are. So the session,
+ *           and the sensor driver that holds it, must be a static or global
+ *           object in the AXI SRAM, or be placed with DMA_BUFFER_MEM_SECTION.
+ *           It must never be on the stack or in the DTCM.
+ *  @tparam  Transport the transport of the sensor driver
+ *  @tparam  Sample the decoded sample
+ *  @tparam  num_bytes number of bytes read
+ */
+template <typename Transport, typename Sample, size_t num_bytes>
+class SensorSamplingSession
+{
+  public:
+    /** Decodes the raw register data of a sample */
+    typedef void (*DecodeFunction)(const uint8_t* data,
+                                   Sample&        sample,
+                                   void*          context);
+
+    /** Called from the interrupt when a read is done and decoded */
+    typedef void (*DoneCallback)(void* context, bool ok);
+
+    SensorSamplingSession() : transport_(nullptr), busy_(false) {}
+
+    /** Initializes the session
+     *  \param transport the transport to read with
+     *  \param reg the first register to read
+     *  \param decode decodes the data into a sample
+     *  \param decode_context passed to decode
+     */
+    void Init(Transport*     transport,
+              uint8_t        reg,
+              DecodeFunction decode,
+              void*          decode_context)
+    {
+        transport_      = transport;
+        reg_            = reg;
+        decode_         = decode;
+        decode_context_ = decode_context;
+        busy_           = false;
+        num_errors_     = 0;
+        snapshot_.Reset();
+    }
+
+    /** Starts a read
+     *  \param callback called when the sample is available, or nullptr
+     *  \param context passed to the callback
+     *  \return false if a read is still running or couldn't be queued
+     */
+    bool Start(DoneCallback callback = nullptr, void* context = nullptr)
+    {
+        if(transport_ == nullptr || busy_)
+            return false;
+        busy_      = true;
+        callback_  = callback;
+        context_   = context;
+        buffer_[0] = reg_;
+#ifndef UNIT_TEST
+        dsy_dma_clear_cache_for_buffer(buffer_, kCachedSize);
+#endif
+        if(!transport_->ReadRegAsync(
+               &buffer_[0], &buffer_[1], num_bytes, &ReadDone, this))
+        {
+            busy_ = false;
+            num_errors_++;
+            return false;
+        }
+        return true;
+    }
+
+    /** Returns true while a read is running */
+    bool IsBusy() const { return busy_; }
+
+    /** Copies the latest sample
+     *  \return false if there is no sample yet
+     */
+    bool GetLatest(Sample& sample) const { return snapshot_.Read(sample); }
+
+    /** Returns the number of samples read, see SampleSnapshot::GetCount() */
+    uint32_t GetNumSamples() const { return snapshot_.GetCount(); }
+
+    /** Returns the number of reads that failed */
+    uint32_t GetNumErrors() const { return num_errors_; }
+
+  private:
+    // the data follows the register address. The cache maintenance
+    // functions work on whole lines and one line more, hence the padding.
+    static constexpr size_t kCachedSize = ((1 + num_bytes + 31) / 32) * 32;
+
+    static void ReadDone(void* context, I2CHandle::Result result)
+    {
+        auto*      session = static_cast<SensorSamplingSession*>(context);
+        const bool ok      = result == I2CHandle::Result::OK;
+        if(ok)
+        {
+#ifndef UNIT_TEST
+            dsy_dma_invalidate_cache_for_buffer(session->buffer_,
+                                                kCachedSize);
+#endif
+            session->decode_(&session->buffer_[1],
+                             session->snapshot_.BeginWrite(),
+                             session->decode_context_);
+            session->snapshot_.EndWrite();
+        }
+        else
+        {
+            session->num_errors_++;
+        }
+        session->busy_ = false;
+        if(session->callback_ != nullptr)
+            session->callback_(session->context_, ok);
+    }
+
+    alignas(32) uint8_t buffer_[kCachedSize + 32];
+
+    Transport*             transport_;
+    uint8_t                reg_;
+    DecodeFunction         decode_;
+    void*                  decode_context_;
+    DoneCallback           callback_;
+    void*                  context_;
+    volatile bool          busy_;
+    volatile uint32_t      num_errors_;
+    SampleSnapshot<Sample> snapshot_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
@@ -2,6 +2,8 @@
 #ifndef DSY_TLV493D_H
 #define DSY_TLV493D_H
 
+#include "dev/sensor_sampling.h"
+
 #define TLV493D_DEFAULTMODE POWERDOWNMODE
 
 #define TLV493D_ADDRESS1 0x5E
@@ -88,6 +90,32 @@ class Tlv493dI2CTransport
                 != i2c_.ReceiveBlocking(config_.address, data, size, 10);
     }
 
+    /** Starts reading in the background, see I2CHandle::QueueTransaction().
+        Used by SensorSamplingSession. The TLV493D has no register address,
+        every read starts at its first register.
+        \param reg ignored
+        \param buff buffer for the data
+        \param size number of bytes to read
+        \param callback called from an interrupt when the read is done
+        \param context passed to the callback
+        \return false if the read couldn't be queued
+    */
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        (void)reg;
+        I2CHandle::Transaction transaction;
+        transaction.address          = config_.address;
+        transaction.rx_data          = buff;
+        transaction.rx_size          = size;
+        transaction.callback         = callback;
+        transaction.callback_context = context;
+        return i2c_.QueueTransaction(transaction) == I2CHandle::Result::OK;
+    }
+
     bool GetError()
     {
         bool tmp = err_;
@@ -218,6 +246,18 @@ class Tlv493d
         ERR
     };
 
+    /** The measurements of one read, see StartSampling() */
+    struct Sample
+    {
+        float x;           /**< in mT, like GetX() */
+        float y;           /**< in mT, like GetY() */
+        float z;           /**< in mT, like GetZ() */
+        float temperature; /**< in degrees C, like GetTemp() */
+    };
+
+    /** Called from an interrupt when a sample is available */
+    typedef void (*SampleCallback)(void *context, bool ok);
+
     /** Initialize the TLV493D device
         \param config Configuration settings
     */
@@ -244,6 +284,8 @@ class Tlv493d
 
         prev_sample_period_ = System::GetNow();
 
+        session_.Init(&transport_, R_BX1, &DecodeSample, this);
+
         return GetTransportErr();
     }
 
@@ -300,6 +342,37 @@ class Tlv493d
         }
     }
 
+    /** Starts reading the measurements in the background, unlike
+        UpdateData(), which waits for the transfer. Reads should be at least
+        GetMeasurementDelay() ms apart. The driver must be static or global
+        and not in the DTCM, see SensorSamplingSession.
+        \param callback called from an interrupt when the sample is
+                        available, or nullptr
+        \param context passed to the callback
+        \return false if the last read hasn't finished or the transfer
+                couldn't be queued
+    */
+    bool StartSampling(SampleCallback callback = nullptr,
+                       void          *context  = nullptr)
+    {
+        return session_.Start(callback, context);
+    }
+
+    /** \return true while a read started by StartSampling() runs */
+    bool IsSampling() const { return session_.IsBusy(); }
+
+    /** Copies the latest sample read by StartSampling()
+        \param sample receives the sample
+        \return false if there is no sample yet
+    */
+    bool GetLatestSample(Sample &sample) const
+    {
+        return session_.GetLatest(sample);
+    }
+
+    /** \return the number of samples read by StartSampling() */
+    uint32_t GetNumSamples() const { return session_.GetNumSamples(); }
+
     void SetInterrupt(bool enable)
     {
         SetRegBits(W_INT, enable);
@@ -415,6 +488,31 @@ class Tlv493d
     int16_t   mXdata, mYdata, mZdata, mTempdata, mExpectedFrameCount, mMode;
     uint32_t  prev_sample_period_;
 
+    SensorSamplingSession<Transport, Sample, TLV493D_MEASUREMENT_READOUT>
+        session_;
+
+    // the read registers up to the temperature, decoded like UpdateData()
+    static void DecodeSample(const uint8_t *buffer, Sample &sample, void *ctx)
+    {
+        Tlv493d *tlv = static_cast<Tlv493d *>(ctx);
+        auto     get = [tlv, buffer](uint8_t index) {
+            return tlv->GetFromRegs(&tlv->RegMasks[index], buffer);
+        };
+
+        const int16_t x = tlv->ConcatResults(get(R_BX1), get(R_BX2), true);
+        const int16_t y = tlv->ConcatResults(get(R_BY1), get(R_BY2), true);
+        const int16_t z = tlv->ConcatResults(get(R_BZ1), get(R_BZ2), true);
+
+        const int16_t temp
+            = tlv->ConcatResults(get(R_TEMP1), get(R_TEMP2), false);
+
+        sample.x           = static_cast<float>(x) * TLV493D_B_MULT;
+        sample.y           = static_cast<float>(y) * TLV493D_B_MULT;
+        sample.z           = static_cast<float>(z) * TLV493D_B_MULT;
+        sample.temperature = static_cast<float>(temp - TLV493D_TEMP_OFFSET)
+                             * TLV493D_TEMP_MULT;
+    }
+
     /** Get the global transport_error_ bool (as a Result), then reset it */
     Result GetTransportErr()
     {
@@ -441,7 +539,7 @@ class Tlv493d
         transport_.WriteAddress(0x00, &data, 1);
     }
 
-    uint8_t GetFromRegs(const RegMask_t *mask, uint8_t *regData)
+    uint8_t GetFromRegs(const RegMask_t *mask, const uint8_t *regData)
     {
         return (regData[mask->byteAdress] & mask->bitMask) >> mask->shift;
     }
@@ -1,4 +1,8 @@
+#pragma once
+#include <stdint.h>
+
 // TODO: make this adjustable
+/** Number of bytes in a SystemExclusiveEvent */
 #define SYSEX_BUFFER_LEN 128
 
 namespace daisy
@@ -17,7 +21,7 @@ namespace daisy
 /** Parsed from the Status Byte, these are the common Midi Messages that can be handled. \n
 At this time only 3-byte messages are correctly parsed into MidiEvents.
 */
-enum MidiMessageType
+enum MidiMessageType : uint8_t
 {
     NoteOff,               /**< & */
     NoteOn,                /**< & */
@@ -32,7 +36,7 @@ enum MidiMessageType
     MessageLast,           /**< & */
 };
 
-enum SystemCommonType
+enum SystemCommonType : uint8_t
 {
     SystemExclusive,     /**< & */
     MTCQuarterFrame,     /**< & */
@@ -45,7 +49,7 @@ enum SystemCommonType
     SystemCommonLast,    /**< & */
 };
 
-enum SystemRealTimeType
+enum SystemRealTimeType : uint8_t
 {
     TimingClock,        /**< & */
     SRTUndefined0,      /**< & */
@@ -58,7 +62,7 @@ enum SystemRealTimeType
     SystemRealTimeLast, /**< & */
 };
 
-enum ChannelModeType
+enum ChannelModeType : uint8_t
 {
     AllSoundOff,         /**< & */
     ResetAllControllers, /**< & */
@@ -142,8 +146,8 @@ struct ChannelModeEvent
     ChannelModeType event_type; /**< & */
     int16_t         value;      /**< & */
 };
-/** Struct containing sysex data.
-Can be made from MidiEvent
+/** Struct containing the first SYSEX_BUFFER_LEN bytes of sysex data.
+Can be made with MidiSysExArenaBase::AsSystemExclusive()
 */
 struct SystemExclusiveEvent
 {
@@ -235,18 +239,30 @@ struct PolyModeOnEvent
 
 
 /** Simple MidiEvent with message type, channel, and data[2] members.
+ *  It is kept small (8 bytes), so that it can be queued and copied cheaply.
+ *  The data of SysEx messages is stored in a MidiSysExArena and referenced
+ *  with `sysex_handle`.
 */
 struct MidiEvent
 {
     // Newer ish.
-    MidiMessageType    type;                         /**< & */
-    int                channel;                      /**< & */
-    uint8_t            data[2];                      /**< & */
-    uint8_t            sysex_data[SYSEX_BUFFER_LEN]; /**< & */
-    uint8_t            sysex_message_len;
-    SystemCommonType   sc_type;
-    SystemRealTimeType srt_type;
-    ChannelModeType    cm_type;
+    MidiMessageType type;    /**< & */
+    uint8_t         channel; /**< & */
+    /** Only the one that matches type is valid */
+    union
+    {
+        SystemCommonType   sc_type;
+        SystemRealTimeType srt_type;
+        ChannelModeType    cm_type;
+    };
+    union
+    {
+        uint8_t data[2]; /**< & */
+        /** Position of the SysEx data in the MidiSysExArena */
+        uint16_t sysex_handle;
+    };
+    /** Length of the SysEx data in the MidiSysExArena */
+    uint16_t sysex_message_len;
 
     /** Returns the data within the MidiEvent as a NoteOffEvent struct */
     NoteOffEvent AsNoteOff()
@@ -326,20 +342,6 @@ struct MidiEvent
         return m;
     }
 
-    SystemExclusiveEvent AsSystemExclusive()
-    {
-        SystemExclusiveEvent m;
-        m.length = sysex_message_len;
-        for(int i = 0; i < SYSEX_BUFFER_LEN; i++)
-        {
-            m.data[i] = 0;
-            if(i < m.length)
-            {
-                m.data[i] = sysex_data[i];
-            }
-        }
-        return m;
-    }
     MTCQuarterFrameEvent AsMTCQuarterFrame()
     {
         MTCQuarterFrameEvent m;
@@ -413,6 +415,8 @@ struct MidiEvent
     }
 };
 
+static_assert(sizeof(MidiEvent) == 8, "MidiEvent should stay compact");
+
 /** @} */ // End midi_events
 
 /** @} */ // End midi
@@ -1,4 +1,6 @@
 #include "hid/audio.h"
+#include "util/CpuLoadMeter.h"
+#include "util/SampleConversion.h"
 
 namespace daisy
 {
@@ -11,16 +13,17 @@ namespace daisy
 // these buffers will always be present, and usable.
 //
 static const size_t kAudioMaxBufferSize = 1024;
-static const size_t kAudioMaxChannels   = 4;
+static const size_t kAudioMaxSais       = 2;
 
 // Static Global Buffers
-// 8kB in SRAM1, non-cached memory
-// 1k samples in, 1k samples out, 4 bytes per sample.
-// One buffer per 2 channels (Interleaved on hardware)
+// 16kB in SRAM1, non-cached memory
+// 1k samples in, 1k samples out per SAI, 4 bytes per sample.
+// One buffer per SAI, with all of its slots interleaved (as on hardware)
+// The more slots an SAI has, the smaller the maximum blocksize.
 static int32_t DMA_BUFFER_MEM_SECTION
-    dsy_audio_rx_buffer[kAudioMaxChannels / 2][kAudioMaxBufferSize];
+    dsy_audio_rx_buffer[kAudioMaxSais][kAudioMaxBufferSize];
 static int32_t DMA_BUFFER_MEM_SECTION
-    dsy_audio_tx_buffer[kAudioMaxChannels / 2][kAudioMaxBufferSize];
+    dsy_audio_tx_buffer[kAudioMaxSais][kAudioMaxBufferSize];
 
 // ================================================================
 // Private Implementation Definition
@@ -35,24 +38,33 @@ class AudioHandle::Impl
     AudioHandle::Result DeInit();
     AudioHandle::Result Start(AudioHandle::AudioCallback callback);
     AudioHandle::Result Start(AudioHandle::InterleavingAudioCallback callback);
+    AudioHandle::Result Start(AudioHandle::NativeAudioCallback callback);
     AudioHandle::Result Stop();
     AudioHandle::Result ChangeCallback(AudioHandle::AudioCallback callback);
     AudioHandle::Result
     ChangeCallback(AudioHandle::InterleavingAudioCallback callback);
+    AudioHandle::Result
+    ChangeCallback(AudioHandle::NativeAudioCallback callback);
 
-    inline size_t GetChannels() const
+    /** Number of slots (channels) of the SAI at idx, or 0 if it isn't used */
+    inline size_t GetSlots(size_t idx) const
     {
-        if(sai1_.IsInitialized() && sai2_.IsInitialized())
-            return 4;
-        else if(sai1_.IsInitialized() || sai2_.IsInitialized())
-            return 2;
-        else
-            return 0;
+        const SaiHandle& sai = idx == 0 ? sai1_ : sai2_;
+        return sai.IsInitialized() ? sai.GetConfig().num_slots : 0;
+    }
+
+    inline size_t GetChannels() const { return GetSlots(0) + GetSlots(1); }
+
+    /** Largest blocksize that fits the DMA buffers of every SAI in use */
+    inline size_t GetMaxBlockSize() const
+    {
+        size_t slots = GetSlots(0) > GetSlots(1) ? GetSlots(0) : GetSlots(1);
+        return kAudioMaxBufferSize / 2 / (slots > 2 ? slots : 2);
     }
 
     AudioHandle::Result SetBlockSize(size_t size)
     {
-        size_t maxSize    = kAudioMaxBufferSize / 4;
+        size_t maxSize    = GetMaxBlockSize();
         config_.blocksize = size <= maxSize ? size : maxSize;
         return size <= maxSize ? AudioHandle::Result::OK
                                : AudioHandle::Result::ERR;
@@ -82,10 +94,17 @@ class AudioHandle::Impl
 
     AudioHandle::Result SetSampleRate(SaiHandle::Config::SampleRate sampelrate);
 
+    // Starts the DMA for SAI1 (with the internal callback), and for SAI2
+    AudioHandle::Result StartDma(bool start_sai2);
+
     // Internal Callback
     static void InternalCallback(int32_t* in, int32_t* out, size_t size);
 
-    void *callback_, *interleaved_callback_;
+    // Format conversion and user callback for a given bit depth
+    template <int bits>
+    static void ProcessBlock(int32_t* in, int32_t* out, size_t size);
+
+    void *callback_, *interleaved_callback_, *native_callback_;
 
     // Data
     AudioHandle::Config config_;
@@ -94,6 +113,7 @@ class AudioHandle::Impl
     int32_t*            buff_tx_[2];
     float               postgain_recip_;
     float               output_adjust_;
+    CpuLoadMeter        load_meter_;
 };
 
 // ================================================================
@@ -123,6 +143,7 @@ AudioHandle::Result AudioHandle::Impl::Init(const AudioHandle::Config config,
     if(sai.IsInitialized())
     {
         sai1_              = sai;
+        sai2_              = SaiHandle();
         config_.samplerate = sai1_.GetConfig().sr;
     }
     else
@@ -166,35 +187,57 @@ AudioHandle::Result AudioHandle::Impl::DeInit()
     return Result::OK;
 }
 
-AudioHandle::Result
-AudioHandle::Impl::Start(AudioHandle::AudioCallback callback)
+AudioHandle::Result AudioHandle::Impl::StartDma(bool start_sai2)
 {
-    // Get instance of object
-    if(sai2_.IsInitialized())
+    if(config_.blocksize == 0 || config_.blocksize > GetMaxBlockSize())
+        return Result::ERR;
+    // Two halves of blocksize frames, one word per slot in each frame
+    if(start_sai2 && sai2_.IsInitialized())
     {
         // Start stream with no callback. Data will be filled externally.
-        sai2_.StartDma(
-            buff_rx_[1], buff_tx_[1], config_.blocksize * 2 * 2, nullptr);
+        sai2_.StartDma(buff_rx_[1],
+                       buff_tx_[1],
+                       config_.blocksize * 2 * GetSlots(1),
+                       nullptr);
     }
+    load_meter_.Init(sai1_.GetSampleRate(), config_.blocksize);
     sai1_.StartDma(buff_rx_[0],
                    buff_tx_[0],
-                   config_.blocksize * 2 * 2,
+                   config_.blocksize * 2 * GetSlots(0),
                    audio_handle.InternalCallback);
+    return Result::OK;
+}
+
+AudioHandle::Result
+AudioHandle::Impl::Start(AudioHandle::AudioCallback callback)
+{
+    if(StartDma(true) != Result::OK)
+        return Result::ERR;
     callback_             = (void*)callback;
     interleaved_callback_ = nullptr;
+    native_callback_      = nullptr;
     return Result::OK;
 }
 
 AudioHandle::Result
 AudioHandle::Impl::Start(AudioHandle::InterleavingAudioCallback callback)
 {
-    // Get instance of object
-    sai1_.StartDma(buff_rx_[0],
-                   buff_tx_[0],
-                   config_.blocksize * 2 * 2,
-                   audio_handle.InternalCallback);
+    if(StartDma(false) != Result::OK)
+        return Result::ERR;
     interleaved_callback_ = (void*)callback;
     callback_             = nullptr;
+    native_callback_      = nullptr;
+    return Result::OK;
+}
+
+AudioHandle::Result
+AudioHandle::Impl::Start(AudioHandle::NativeAudioCallback callback)
+{
+    if(StartDma(true) != Result::OK)
+        return Result::ERR;
+    native_callback_      = (void*)callback;
+    callback_             = nullptr;
+    interleaved_callback_ = nullptr;
     return Result::OK;
 }
 
@@ -214,6 +257,7 @@ AudioHandle::Impl::ChangeCallback(AudioHandle::AudioCallback callback)
     {
         callback_             = (void*)callback;
         interleaved_callback_ = nullptr;
+        native_callback_      = nullptr;
         return Result::OK;
     }
     else
@@ -229,6 +273,23 @@ AudioHandle::Result AudioHandle::Impl::ChangeCallback(
     {
         interleaved_callback_ = (void*)callback;
         callback_             = nullptr;
+        native_callback_      = nullptr;
+        return Result::OK;
+    }
+    else
+    {
+        return Result::ERR;
+    }
+}
+
+AudioHandle::Result
+AudioHandle::Impl::ChangeCallback(AudioHandle::NativeAudioCallback callback)
+{
+    if(callback != nullptr)
+    {
+        native_callback_      = (void*)callback;
+        callback_             = nullptr;
+        interleaved_callback_ = nullptr;
         return Result::OK;
     }
     else
@@ -266,219 +327,118 @@ AudioHandle::Impl::SetSampleRate(SaiHandle::Config::SampleRate samplerate)
     return Result::OK;
 }
 
-// This turned into a very large function due to the bit-depth conversions..
-// I didn't want to do a conditional conversion in a single loop because it seemed
-// far less efficient, so this is where I landed.
-//
-// Using function pointers for the x2f and f2x functions would have been ideal, but
-// wasn't possible due to the different parameter/return types for each function.
-void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
+// The bit depth is resolved once per callback, so the conversion loops
+// themselves never branch on it.
+template <int bits>
+void AudioHandle::Impl::ProcessBlock(int32_t* in, int32_t* out, size_t size)
 {
-    // Convert from sai format to float, and call user callback
-    size_t                      chns;
-    SaiHandle::Config::BitDepth bd;
-    bd   = audio_handle.sai1_.GetConfig().bit_depth;
-    chns = audio_handle.GetChannels();
-    if(chns == 0)
-        return;
+    typedef SampleConversion<bits> Convert;
+
     // Handle Interleaved / Non Interleaved separate
     if(audio_handle.interleaved_callback_)
     {
+        // Only the first SAI is used, its DMA layout already is interleaved
         InterleavingAudioCallback cb
             = (InterleavingAudioCallback)audio_handle.interleaved_callback_;
         float fin[size];
         float fout[size];
-        // There _must_ be a more elegant way to do this....
-        // Convert from int to float
-        switch(bd)
-        {
-            case SaiHandle::Config::BitDepth::SAI_16BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[i] = s162f(in[i]) * audio_handle.postgain_recip_;
-                    fin[i + 1]
-                        = s162f(in[i + 1]) * audio_handle.postgain_recip_;
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_24BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[i] = s242f(in[i]) * audio_handle.postgain_recip_;
-                    fin[i + 1]
-                        = s242f(in[i + 1]) * audio_handle.postgain_recip_;
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_32BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[i] = s322f(in[i]) * audio_handle.postgain_recip_;
-                    fin[i + 1]
-                        = s322f(in[i + 1]) * audio_handle.postgain_recip_;
-                }
-                break;
-            default: break;
-        }
+        Convert::ToFloat(in, fin, size, audio_handle.postgain_recip_);
         cb(fin, fout, size);
-        switch(bd)
-        {
-            case SaiHandle::Config::BitDepth::SAI_16BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i] = f2s16(fout[i] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s16(fout[i + 1] * audio_handle.output_adjust_);
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_24BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i] = f2s24(fout[i] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s24(fout[i + 1] * audio_handle.output_adjust_);
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_32BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i] = f2s32(fout[i] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s32(fout[i + 1] * audio_handle.output_adjust_);
-                }
-                break;
-            default: break;
-        }
+        Convert::FromFloat(fout, out, size, audio_handle.output_adjust_);
     }
     else if(audio_handle.callback_)
     {
         AudioCallback cb = (AudioCallback)audio_handle.callback_;
-        // offset needed for 2nd audio codec.
-        size_t offset    = audio_handle.sai2_.GetOffset();
-        size_t buff_size = chns > 2 ? size * 2 : size;
-        float  finbuff[buff_size], foutbuff[buff_size];
-        float* fin[chns];
-        float* fout[chns];
-        fin[0]  = finbuff;
-        fin[1]  = finbuff + (buff_size / chns);
-        fout[0] = foutbuff;
-        fout[1] = foutbuff + (buff_size / chns);
-        if(chns > 2)
+
+        // Table of the ready DMA halves and slot counts for each SAI.
+        // Channels are numbered through the slots of SAI1, then SAI2.
+        const size_t slots[kAudioMaxSais]
+            = {audio_handle.GetSlots(0), audio_handle.GetSlots(1)};
+        int32_t* rx[kAudioMaxSais] = {in, nullptr};
+        int32_t* tx[kAudioMaxSais] = {out, nullptr};
+        if(slots[1] > 0)
         {
-            fin[2]  = fin[1] + (buff_size / chns);
-            fin[3]  = fin[2] + (buff_size / chns);
-            fout[2] = fout[1] + (buff_size / chns);
-            fout[3] = fout[2] + (buff_size / chns);
+            // offset needed for 2nd audio codec.
+            size_t offset = audio_handle.sai2_.GetOffset();
+            rx[1]         = audio_handle.buff_rx_[1] + offset;
+            tx[1]         = audio_handle.buff_tx_[1] + offset;
+        }
+
+        const size_t chns   = slots[0] + slots[1];
+        const size_t frames = size / slots[0];
+        float        finbuff[frames * chns], foutbuff[frames * chns];
+        float*       fin[chns];
+        float*       fout[chns];
+        for(size_t i = 0; i < chns; i++)
+        {
+            fin[i]  = finbuff + i * frames;
+            fout[i] = foutbuff + i * frames;
         }
         // Deinterleave and scale
-        switch(bd)
+        for(size_t s = 0, first = 0; s < kAudioMaxSais; first += slots[s++])
         {
-            case SaiHandle::Config::BitDepth::SAI_16BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[0][i / 2] = s162f(in[i]) * audio_handle.postgain_recip_;
-                    fin[1][i / 2]
-                        = s162f(in[i + 1]) * audio_handle.postgain_recip_;
-                    if(chns > 2)
-                    {
-                        fin[2][i / 2]
-                            = s162f(audio_handle.buff_rx_[1][offset + i])
-                              * audio_handle.postgain_recip_;
-                        fin[3][i / 2]
-                            = s162f(audio_handle.buff_rx_[1][offset + i + 1])
-                              * audio_handle.postgain_recip_;
-                    }
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_24BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[0][i / 2] = s242f(in[i]) * audio_handle.postgain_recip_;
-                    fin[1][i / 2]
-                        = s242f(in[i + 1]) * audio_handle.postgain_recip_;
-                    if(chns > 2)
-                    {
-                        fin[2][i / 2]
-                            = s242f(audio_handle.buff_rx_[1][offset + i])
-                              * audio_handle.postgain_recip_;
-                        fin[3][i / 2]
-                            = s242f(audio_handle.buff_rx_[1][offset + i + 1])
-                              * audio_handle.postgain_recip_;
-                    }
-                }
-                break;
-            case SaiHandle::Config::BitDepth::SAI_32BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    fin[0][i / 2] = s322f(in[i]) * audio_handle.postgain_recip_;
-                    fin[1][i / 2]
-                        = s322f(in[i + 1]) * audio_handle.postgain_recip_;
-                    if(chns > 2)
-                    {
-                        fin[2][i / 2]
-                            = s322f(audio_handle.buff_rx_[1][offset + i])
-                              * audio_handle.postgain_recip_;
-                        fin[3][i / 2]
-                            = s322f(audio_handle.buff_rx_[1][offset + i + 1])
-                              * audio_handle.postgain_recip_;
-                    }
-                }
-                break;
-            default: break;
+            if(slots[s] > 0)
+                Convert::DeinterleaveToFloat(rx[s],
+                                             fin + first,
+                                             frames,
+                                             slots[s],
+                                             audio_handle.postgain_recip_);
         }
-        cb(fin, fout, size / 2);
+        cb(fin, fout, frames);
         // Reinterleave and scale
-        switch(bd)
+        for(size_t s = 0, first = 0; s < kAudioMaxSais; first += slots[s++])
+        {
+            if(slots[s] > 0)
+                Convert::InterleaveFromFloat(fout + first,
+                                             tx[s],
+                                             frames,
+                                             slots[s],
+                                             audio_handle.output_adjust_);
+        }
+    }
+}
+
+void AudioHandle::Impl::InternalCallback(int32_t* in, int32_t* out, size_t size)
+{
+    const size_t slots = audio_handle.GetSlots(0);
+    if(slots == 0)
+        return;
+    audio_handle.load_meter_.OnBlockStart();
+    // The native callback works directly on the DMA buffers
+    if(audio_handle.native_callback_)
+    {
+        NativeAudioCallback cb
+            = (NativeAudioCallback)audio_handle.native_callback_;
+        const int32_t* nin[kAudioMaxSais]  = {in, nullptr};
+        int32_t*       nout[kAudioMaxSais] = {out, nullptr};
+        if(audio_handle.GetSlots(1) > 0)
+        {
+            size_t offset = audio_handle.sai2_.GetOffset();
+            nin[1]        = audio_handle.buff_rx_[1] + offset;
+            nout[1]       = audio_handle.buff_tx_[1] + offset;
+        }
+        cb(nin, nout, size / slots);
+    }
+    else
+    {
+        switch(audio_handle.sai1_.GetConfig().bit_depth)
         {
             case SaiHandle::Config::BitDepth::SAI_16BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i]
-                        = f2s16(fout[0][i / 2] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s16(fout[1][i / 2] * audio_handle.output_adjust_);
-                    if(chns > 2)
-                    {
-                        audio_handle.buff_tx_[1][offset + i] = f2s16(
-                            fout[2][i / 2] * audio_handle.output_adjust_);
-                        audio_handle.buff_tx_[1][offset + i + 1] = f2s16(
-                            fout[3][i / 2] * audio_handle.output_adjust_);
-                    }
-                }
+                ProcessBlock<16>(in, out, size);
                 break;
             case SaiHandle::Config::BitDepth::SAI_24BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i]
-                        = f2s24(fout[0][i / 2] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s24(fout[1][i / 2] * audio_handle.output_adjust_);
-                    if(chns > 2)
-                    {
-                        audio_handle.buff_tx_[1][offset + i] = f2s24(
-                            fout[2][i / 2] * audio_handle.output_adjust_);
-                        audio_handle.buff_tx_[1][offset + i + 1] = f2s24(
-                            fout[3][i / 2] * audio_handle.output_adjust_);
-                    }
-                }
+                ProcessBlock<24>(in, out, size);
                 break;
             case SaiHandle::Config::BitDepth::SAI_32BIT:
-                for(size_t i = 0; i < size; i += 2)
-                {
-                    out[i]
-                        = f2s32(fout[0][i / 2] * audio_handle.output_adjust_);
-                    out[i + 1]
-                        = f2s32(fout[1][i / 2] * audio_handle.output_adjust_);
-                    if(chns > 2)
-                    {
-                        audio_handle.buff_tx_[1][offset + i] = f2s32(
-                            fout[2][i / 2] * audio_handle.output_adjust_);
-                        audio_handle.buff_tx_[1][offset + i + 1] = f2s32(
-                            fout[3][i / 2] * audio_handle.output_adjust_);
-                    }
-                }
+                ProcessBlock<32>(in, out, size);
                 break;
             default: break;
         }
     }
+    // The SAI DMA interrupt can't preempt itself, so a late block shows up
+    // as the next transfer having finished already.
+    audio_handle.load_meter_.OnBlockEnd(
+        audio_handle.sai1_.GetNumPendingTransfers());
 }
 
 // ================================================================
@@ -541,6 +501,11 @@ AudioHandle::Result AudioHandle::Start(InterleavingAudioCallback callback)
     return pimpl_->Start(callback);
 }
 
+AudioHandle::Result AudioHandle::Start(NativeAudioCallback callback)
+{
+    return pimpl_->Start(callback);
+}
+
 AudioHandle::Result AudioHandle::Stop()
 {
     return pimpl_->Stop();
@@ -557,6 +522,16 @@ AudioHandle::ChangeCallback(InterleavingAudioCallback callback)
     return pimpl_->ChangeCallback(callback);
 }
 
+AudioHandle::Result AudioHandle::ChangeCallback(NativeAudioCallback callback)
+{
+    return pimpl_->ChangeCallback(callback);
+}
+
+CpuLoadMeter& AudioHandle::GetCpuLoadMeter()
+{
+    return pimpl_->load_meter_;
+}
+
 AudioHandle::Result AudioHandle::SetPostGain(float val)
 {
     return pimpl_->SetPostGain(val);
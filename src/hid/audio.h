@@ -5,6 +5,8 @@
 
 namespace daisy
 {
+class CpuLoadMeter;
+
 /** @brief Audio Engine Handle
  *  @ingroup audio 
  *  @details This class allows for higher level access to an audio engine.
@@ -50,6 +52,8 @@ class AudioHandle
 
     /** Non-Interleaving input buffer
      * Buffer arranged by float[chn][sample] 
+     * Channels are numbered through the slots of the first SAI, 
+     * followed by the slots of the second SAI.
      * const so that the user can't modify the input
      */
     typedef const float* const* InputBuffer;
@@ -68,6 +72,7 @@ class AudioHandle
 
     /** Interleaving Input buffer
      ** audio is prepared as { L0, R0, L1, R1, . . . LN, RN }]
+     ** or, when the first SAI uses TDM, with all of its slots per frame.
      ** this is const, as the user shouldn't modify it
     */
     typedef const float* InterleavingInputBuffer;
@@ -84,16 +89,41 @@ class AudioHandle
                                               InterleavingOutputBuffer out,
                                               size_t                   size);
 
+    /** Native Input buffer
+     ** One pointer per SAI to the half of its DMA receive buffer that is
+     ** ready. Each holds { L0, R0, L1, R1, . . . LN, RN } (or all slots of
+     ** each frame for TDM) in the SAI's bit depth, right-justified in 32
+     ** bit words.
+     ** const so that the user can't modify the input
+     */
+    typedef const int32_t* const* NativeInputBuffer;
+
+    /** Native Output buffer
+     ** One pointer per SAI to the half of its DMA transmit buffer that is
+     ** due to be filled, laid out the same way as the NativeInputBuffer.
+     */
+    typedef int32_t* const* NativeOutputBuffer;
+
+    /** Native Audio Callback
+     ** Native audio callbacks get the DMA buffers directly, without any
+     ** format conversion, gain adjustment or copying.
+     ** Useful for fixed point processing.
+     ** size is the number of frames per SAI
+     */
+    typedef void (*NativeAudioCallback)(NativeInputBuffer  in,
+                                        NativeOutputBuffer out,
+                                        size_t             size);
+
     AudioHandle() : pimpl_(nullptr) {}
     ~AudioHandle() {}
 
     AudioHandle(const AudioHandle& other) = default;
     AudioHandle& operator=(const AudioHandle& other) = default;
 
-    /** Initializes audio to run using a single SAI configured in Stereo I2S mode. */
+    /** Initializes audio to run using a single SAI, in Stereo I2S or TDM mode. */
     Result Init(const Config& config, SaiHandle sai);
 
-    /** Initializes audio to run using two SAI, each configured in Stereo I2S mode. */
+    /** Initializes audio to run using two SAI, each in Stereo I2S or TDM mode. */
     Result Init(const Config& config, SaiHandle sai1, SaiHandle sai2);
 
     /** Stops and deinitializes audio. */
@@ -104,10 +134,9 @@ class AudioHandle
 
     /** Returns the number of channels of audio.  
      **
-     ** When using a single SAI this returns 2, when using two SAI it returns 4
+     ** This is the sum of the slots of each SAI (SaiHandle::Config::num_slots).
+     ** With standard I2S, a single SAI returns 2, and two SAI return 4.
      ** If no SAI is initialized this returns 0
-     **
-     ** Eventually when we add non-standard I2S for each SAI this will be work differently
      */
     size_t GetChannels() const;
 
@@ -119,6 +148,8 @@ class AudioHandle
 
     /** Sets the block size after initialization, and updates the internal configuration struct.
      ** Get BlockSize and other details via the GetConfig 
+     ** The maximum block size is 256 for standard I2S, and shrinks with the 
+     ** number of TDM slots (e.g. 64 for 8 slots).
      */
     Result SetBlockSize(size_t size);
 
@@ -140,10 +171,15 @@ class AudioHandle
     Result Start(AudioCallback callback);
 
     /** Starts the Audio using the interleaving callback. 
-     ** For now only two channels are supported via this method. 
+     ** Only the slots of the first SAI are passed to this callback. 
      */
     Result Start(InterleavingAudioCallback callback);
 
+    /** Starts the Audio using the native callback. 
+     ** Postgain and output compensation are not applied in this mode.
+     */
+    Result Start(NativeAudioCallback callback);
+
     /** Stop the Audio*/
     Result Stop();
 
@@ -153,6 +189,17 @@ class AudioHandle
     /** Immediatley changes the audio callback to the interleaving callback passed in. */
     Result ChangeCallback(InterleavingAudioCallback callback);
 
+    /** Immediatley changes the audio callback to the native callback passed in. */
+    Result ChangeCallback(NativeAudioCallback callback);
+
+    /** Returns the CpuLoadMeter that measures every audio callback, 
+     ** including the format conversion around it. 
+     ** It is initialized each time the audio is started. GetNumOverruns()
+     ** counts the callbacks that missed their deadline (audio underruns).
+     ** Include "util/CpuLoadMeter.h" to use it.
+     */
+    CpuLoadMeter& GetCpuLoadMeter();
+
 
     class Impl;
 
@@ -0,0 +1,317 @@
+#pragma once
+#ifndef DSY_AUDIO_HOST_H
+#define DSY_AUDIO_HOST_H /**< & */
+
+#ifdef UNIT_TEST // The host renderer only exists in host (unit test) builds
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "hid/audio.h"
+#include "util/wav_format.h"
+
+namespace daisy
+{
+/** @brief Offline renderer for the host build of the AudioHandle
+ *  @ingroup audio
+ *  @details In host builds the SaiHandle has no peripheral behind it, so
+ *           nothing ever calls the audio callback. This class plays the part
+ *           of the DMA engine: it writes audio into the same int32 receive
+ *           buffers the hardware would fill, triggers the half/complete
+ *           interrupt (which runs the AudioHandle conversion path and the
+ *           user callback), and collects the transmit buffers.
+ *
+ *           Audio is rendered as fast as the host can run it, which makes
+ *           this useful for testing and benchmarking callbacks in CI.
+ *
+ *           Usage:
+ *             sai.Init(sai_config);
+ *             audio.Init(audio_config, sai);
+ *             audio.Start(MyCallback);
+ *             AudioHostRenderer renderer;
+ *             renderer.Init(sai);
+ *             renderer.RenderWavFile("in.wav", "out.wav");
+ */
+class AudioHostRenderer
+{
+  public:
+    enum class Result
+    {
+        OK,
+        ERR,
+    };
+
+    AudioHostRenderer() : blocks_rendered_(0) {}
+    ~AudioHostRenderer() {}
+
+    /** Initializes the renderer with the SaiHandle(s) that were passed
+     ** to AudioHandle::Init
+     */
+    Result Init(SaiHandle sai1, SaiHandle sai2 = SaiHandle())
+    {
+        if(!sai1.IsInitialized())
+            return Result::ERR;
+        sai_[0]          = sai1;
+        sai_[1]          = sai2;
+        blocks_rendered_ = 0;
+        return Result::OK;
+    }
+
+    /** Returns the number of interleaved channels in the rendered audio.
+     ** Channels are numbered through the slots of SAI1, then SAI2.
+     */
+    size_t GetChannels() const { return GetSlots(0) + GetSlots(1); }
+
+    /** Returns the number of blocks that have been rendered since Init */
+    size_t GetBlocksRendered() const { return blocks_rendered_; }
+
+    /** Renders audio in the native SAI format.
+     ** The last block is padded with silence if frames is not a multiple
+     ** of the block size.
+     ** \param in GetChannels() interleaved channels of input, or nullptr for silence
+     ** \param out GetChannels() interleaved channels of output
+     ** \param frames number of frames in both buffers
+     */
+    Result RenderNative(const int32_t* in, int32_t* out, size_t frames)
+    {
+        const size_t chns     = GetChannels();
+        const size_t nsai     = GetSlots(1) > 0 ? 2 : 1;
+        const size_t slots[2] = {GetSlots(0), GetSlots(1)};
+        const size_t first[2] = {0, slots[0]};
+        const size_t block    = sai_[0].GetBlockSize();
+        if(chns == 0 || block == 0 || out == nullptr)
+            return Result::ERR;
+
+        for(size_t s = 0; s < nsai; s++)
+        {
+            rx_[s].resize(block * slots[s]);
+            tx_[s].resize(block * slots[s]);
+        }
+
+        for(size_t pos = 0; pos < frames; pos += block)
+        {
+            const size_t n = frames - pos < block ? frames - pos : block;
+            for(size_t s = 0; s < nsai; s++)
+            {
+                for(size_t i = 0; i < block * slots[s]; i++)
+                {
+                    const size_t f = i / slots[s];
+                    const size_t c = first[s] + i % slots[s];
+                    rx_[s][i]
+                        = (in && f < n) ? in[(pos + f) * chns + c] : 0;
+                }
+            }
+
+            // The second SAI has no callback of its own. Its half of the
+            // buffer must be refreshed before the first SAI's callback runs.
+            bool sai2_running
+                = nsai > 1
+                  && sai_[1].SimulateDmaCallbackForUnitTest(rx_[1].data())
+                         == SaiHandle::Result::OK;
+            if(sai_[0].SimulateDmaCallbackForUnitTest(rx_[0].data())
+               != SaiHandle::Result::OK)
+                return Result::ERR;
+            sai_[0].ReadTxForUnitTest(tx_[0].data());
+            if(sai2_running)
+                sai_[1].ReadTxForUnitTest(tx_[1].data());
+            else if(nsai > 1)
+                std::fill(tx_[1].begin(), tx_[1].end(), 0);
+
+            for(size_t s = 0; s < nsai; s++)
+                for(size_t f = 0; f < n; f++)
+                    for(size_t c = 0; c < slots[s]; c++)
+                        out[(pos + f) * chns + first[s] + c]
+                            = tx_[s][f * slots[s] + c];
+            blocks_rendered_++;
+        }
+        return Result::OK;
+    }
+
+    /** Renders floating point audio, converting to and from the bit depth
+     ** of the SAI on the way in and out.
+     ** \param in GetChannels() interleaved channels of input, or nullptr for silence
+     ** \param out GetChannels() interleaved channels of output
+     ** \param frames number of frames in both buffers
+     */
+    Result Render(const float* in, float* out, size_t frames)
+    {
+        const size_t chns = GetChannels();
+        if(chns == 0 || out == nullptr)
+            return Result::ERR;
+        const auto bd = sai_[0].GetConfig().bit_depth;
+
+        std::vector<int32_t> native_in(in ? frames * chns : 0);
+        std::vector<int32_t> native_out(frames * chns);
+        for(size_t i = 0; i < native_in.size(); i++)
+            native_in[i] = FloatToNative(in[i], bd);
+
+        Result res = RenderNative(
+            in ? native_in.data() : nullptr, native_out.data(), frames);
+        for(size_t i = 0; i < native_out.size(); i++)
+            out[i] = NativeToFloat(native_out[i], bd);
+        return res;
+    }
+
+    /** Renders a WAV file through the audio callback and writes the result
+     ** as a WAV file at the bit depth of the SAI.
+     ** 16/24/32-bit PCM and 32-bit float files are supported. Channels in
+     ** the input file are repeated to fill all channels of the engine.
+     */
+    Result RenderWavFile(const char* in_path, const char* out_path)
+    {
+        std::vector<float> file_data;
+        uint16_t           file_chns;
+        uint32_t           samplerate;
+        if(!ReadWav(in_path, file_data, file_chns, samplerate))
+            return Result::ERR;
+
+        const size_t chns   = GetChannels();
+        const size_t frames = file_data.size() / file_chns;
+        if(chns == 0)
+            return Result::ERR;
+
+        const auto           bd = sai_[0].GetConfig().bit_depth;
+        std::vector<int32_t> in(frames * chns), out(frames * chns);
+        for(size_t f = 0; f < frames; f++)
+            for(size_t c = 0; c < chns; c++)
+                in[f * chns + c] = FloatToNative(
+                    file_data[f * file_chns + (c % file_chns)], bd);
+
+        if(RenderNative(in.data(), out.data(), frames) != Result::OK)
+            return Result::ERR;
+        return WriteWav(out_path, out, chns) ? Result::OK : Result::ERR;
+    }
+
+  private:
+    size_t GetSlots(size_t idx) const
+    {
+        return sai_[idx].IsInitialized() ? sai_[idx].GetConfig().num_slots : 0;
+    }
+
+    // 24 bit samples occupy the low 24 bits of the DMA words,
+    // the same way the SAI delivers them on hardware.
+    static int32_t FloatToNative(float x, SaiHandle::Config::BitDepth bd)
+    {
+        switch(bd)
+        {
+            case SaiHandle::Config::BitDepth::SAI_16BIT: return f2s16(x);
+            case SaiHandle::Config::BitDepth::SAI_24BIT:
+                return f2s24(x) & 0x00ffffff;
+            case SaiHandle::Config::BitDepth::SAI_32BIT: return f2s32(x);
+            default: return 0;
+        }
+    }
+
+    static float NativeToFloat(int32_t x, SaiHandle::Config::BitDepth bd)
+    {
+        switch(bd)
+        {
+            case SaiHandle::Config::BitDepth::SAI_16BIT: return s162f(x);
+            case SaiHandle::Config::BitDepth::SAI_24BIT:
+                return s242f(x & 0x00ffffff);
+            case SaiHandle::Config::BitDepth::SAI_32BIT: return s322f(x);
+            default: return 0.f;
+        }
+    }
+
+    static bool ReadWav(const char*         path,
+                        std::vector<float>& data,
+                        uint16_t&           chns,
+                        uint32_t&           samplerate)
+    {
+        FILE* f = fopen(path, "rb");
+        if(f == nullptr)
+            return false;
+
+        uint32_t riff[3];
+        bool     ok = fread(riff, sizeof(riff), 1, f) == 1
+                  && riff[0] == kWavFileChunkId && riff[2] == kWavFileWaveId;
+        uint16_t format = 0, bits = 0;
+        chns            = 0;
+        // Walk the chunks, skipping anything that isn't "fmt " or "data"
+        uint32_t chunk[2];
+        while(ok && fread(chunk, sizeof(chunk), 1, f) == 1)
+        {
+            std::vector<uint8_t> body(chunk[1] + (chunk[1] & 1));
+            if(body.size() > 0 && fread(body.data(), body.size(), 1, f) != 1)
+                break;
+            if(chunk[0] == kWavFileSubChunk1Id && chunk[1] >= 16)
+            {
+                std::memcpy(&format, &body[0], 2);
+                std::memcpy(&chns, &body[2], 2);
+                std::memcpy(&samplerate, &body[4], 4);
+                std::memcpy(&bits, &body[14], 2);
+                if(format == WAVE_FORMAT_EXTENSIBLE && chunk[1] >= 26)
+                    std::memcpy(&format, &body[24], 2);
+            }
+            else if(chunk[0] == kWavFileSubChunk2Id && chns > 0)
+            {
+                const size_t bytes = bits / 8;
+                if(bytes < 2 || bytes > 4)
+                    break;
+                const size_t count = chunk[1] / bytes;
+                data.resize(count - count % chns);
+                for(size_t i = 0; i < data.size(); i++)
+                {
+                    int32_t word = 0;
+                    // Shift up to the top of the word to sign extend
+                    std::memcpy(reinterpret_cast<uint8_t*>(&word) + 4 - bytes,
+                                &body[i * bytes],
+                                bytes);
+                    if(format == WAVE_FORMAT_IEEE_FLOAT && bytes == 4)
+                        std::memcpy(&data[i], &word, 4);
+                    else
+                        data[i] = s322f(word);
+                }
+                fclose(f);
+                return format == WAVE_FORMAT_PCM
+                       || format == WAVE_FORMAT_IEEE_FLOAT;
+            }
+        }
+        fclose(f);
+        return false;
+    }
+
+    bool
+    WriteWav(const char* path, const std::vector<int32_t>& data, size_t chns)
+    {
+        const auto   bd    = sai_[0].GetConfig().bit_depth;
+        const size_t bytes = bd == SaiHandle::Config::BitDepth::SAI_16BIT   ? 2
+                             : bd == SaiHandle::Config::BitDepth::SAI_24BIT ? 3
+                                                                            : 4;
+        WAV_FormatTypeDef hdr;
+        hdr.ChunkId       = kWavFileChunkId;
+        hdr.FileFormat    = kWavFileWaveId;
+        hdr.SubChunk1ID   = kWavFileSubChunk1Id;
+        hdr.SubChunk1Size = 16;
+        hdr.AudioFormat   = WAVE_FORMAT_PCM;
+        hdr.NbrChannels   = chns;
+        hdr.SampleRate    = sai_[0].GetSampleRate();
+        hdr.BitPerSample  = bytes * 8;
+        hdr.BlockAlign    = chns * bytes;
+        hdr.ByteRate      = hdr.SampleRate * hdr.BlockAlign;
+        hdr.SubChunk2ID   = kWavFileSubChunk2Id;
+        hdr.SubCHunk2Size = data.size() * bytes;
+        hdr.FileSize      = sizeof(hdr) - 8 + hdr.SubCHunk2Size;
+
+        FILE* f = fopen(path, "wb");
+        if(f == nullptr)
+            return false;
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+        // Native words are right-justified, so the low bytes are the sample
+        for(size_t i = 0; ok && i < data.size(); i++)
+            ok = fwrite(&data[i], bytes, 1, f) == 1;
+        fclose(f);
+        return ok;
+    }
+
+    SaiHandle            sai_[2];
+    std::vector<int32_t> rx_[2], tx_[2];
+    size_t               blocks_rendered_;
+};
+
+} // namespace daisy
+
+#endif // ifdef UNIT_TEST
+#endif
@@ -0,0 +1,205 @@
+#pragma once
+#ifndef DSY_COLOR_CANVAS_H
+#define DSY_COLOR_CANVAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "graphics_common.h"
+
+namespace daisy
+{
+/** Returns the RGB565 color of 8 bit red, green and blue values */
+constexpr uint16_t Rgb565(uint8_t red, uint8_t green, uint8_t blue)
+{
+    return ((red & 0xf8) << 8) | ((green & 0xfc) << 3) | (blue >> 3);
+}
+
+/** Blends two RGB565 colors
+ *  \param dst the color below
+ *  \param src the color on top
+ *  \param alpha opacity of src, 0 (dst) to 255 (src)
+ */
+inline uint16_t BlendRgb565(uint16_t dst, uint16_t src, uint8_t alpha)
+{
+    // green is moved to the upper half word, so that all three channels are
+    // blended with one multiply. The alpha has 5 bits.
+    const uint32_t a = (alpha + 4) >> 3;
+    const uint32_t d = (dst | (uint32_t(dst) << 16)) & 0x07e0f81f;
+    const uint32_t s = (src | (uint32_t(src) << 16)) & 0x07e0f81f;
+    const uint32_t r = ((((s - d) * a) >> 5) + d) & 0x07e0f81f;
+    return r | (r >> 16);
+}
+
+/** An RGB565 image, e.g. an icon or a meter scale */
+struct Rgb565Sprite
+{
+    uint16_t        width;
+    uint16_t        height;
+    const uint16_t* pixels; /**< width * height pixels, row by row */
+    /** Opacity of each pixel (0 to 255), or nullptr */
+    const uint8_t* alpha;
+    /** Pixels of this color aren't drawn if has_key is set */
+    uint16_t key;
+    bool     has_key;
+};
+
+/** @brief   Draws RGB565 pixels into a buffer
+ *  @details The canvas is a window of the display: a rectangle in display
+ *           coordinates whose pixels are in a buffer, row by row. Everything
+ *           is drawn in display coordinates and clipped to the window, so the
+ *           same drawing code can render a whole frame, or one band of rows
+ *           after the other (see ColorCompositor).
+ *
+ *           Pixels are stored as RGB565 values. Displays that expect the
+ *           high byte first need them swapped before they are sent.
+ *  @ingroup device
+ */
+class Rgb565Canvas
+{
+  public:
+    /** Creates a canvas
+     *  \param pixels the buffer, bounds.GetWidth() * bounds.GetHeight()
+     *         pixels
+     *  \param bounds the rectangle of the display that the buffer holds
+     */
+    Rgb565Canvas(uint16_t* pixels, const Rectangle& bounds)
+    : pixels_(pixels), bounds_(bounds)
+    {
+    }
+
+    /** Returns the rectangle of the display that the canvas holds */
+    const Rectangle& GetBounds() const { return bounds_; }
+
+    /** Returns the pixels, row by row */
+    uint16_t* GetPixels() { return pixels_; }
+
+    /** Sets all pixels */
+    void Fill(uint16_t color)
+    {
+        const size_t size = bounds_.GetWidth() * bounds_.GetHeight();
+        for(size_t i = 0; i < size; i++)
+            pixels_[i] = color;
+    }
+
+    /** Sets a pixel, if it's on the canvas */
+    void SetPixel(int16_t x, int16_t y, uint16_t color)
+    {
+        if(Contains(x, y))
+            *GetPixel(x, y) = color;
+    }
+
+    /** Blends a color into a pixel, if it's on the canvas
+     *  \param alpha opacity, 0 to 255
+     */
+    void BlendPixel(int16_t x, int16_t y, uint16_t color, uint8_t alpha)
+    {
+        if(Contains(x, y))
+        {
+            uint16_t* pixel = GetPixel(x, y);
+            *pixel          = BlendRgb565(*pixel, color, alpha);
+        }
+    }
+
+    /** Fills a rectangle
+     *  \param rect the rectangle in display coordinates
+     *  \param color the color
+     *  \param alpha opacity, 0 to 255
+     */
+    void FillRect(const Rectangle& rect, uint16_t color, uint8_t alpha = 255)
+    {
+        Rectangle clipped;
+        if(alpha == 0 || !Clip(rect, clipped))
+            return;
+        for(int16_t y = clipped.GetY(); y < clipped.GetBottom(); y++)
+        {
+            uint16_t* row = GetPixel(clipped.GetX(), y);
+            if(alpha == 255)
+            {
+                for(int16_t i = 0; i < clipped.GetWidth(); i++)
+                    row[i] = color;
+            }
+            else
+            {
+                for(int16_t i = 0; i < clipped.GetWidth(); i++)
+                    row[i] = BlendRgb565(row[i], color, alpha);
+            }
+        }
+    }
+
+    /** Draws a sprite
+     *  \param x x coordinate of the top left pixel
+     *  \param y y coordinate of the top left pixel
+     *  \param sprite the sprite
+     *  \param alpha opacity of the whole sprite, 0 to 255
+     */
+    void DrawSprite(int16_t             x,
+                    int16_t             y,
+                    const Rgb565Sprite& sprite,
+                    uint8_t             alpha = 255)
+    {
+        Rectangle clipped;
+        if(alpha == 0
+           || !Clip(Rectangle(x, y, sprite.width, sprite.height), clipped))
+            return;
+        for(int16_t row_y = clipped.GetY(); row_y < clipped.GetBottom();
+            row_y++)
+        {
+            const size_t src_offset
+                = (row_y - y) * sprite.width + (clipped.GetX() - x);
+            const uint16_t* src = &sprite.pixels[src_offset];
+            const uint8_t*  src_alpha
+                = sprite.alpha != nullptr ? &sprite.alpha[src_offset] : nullptr;
+            uint16_t* dst = GetPixel(clipped.GetX(), row_y);
+            for(int16_t i = 0; i < clipped.GetWidth(); i++)
+            {
+                if(sprite.has_key && src[i] == sprite.key)
+                    continue;
+                uint32_t a = alpha;
+                if(src_alpha != nullptr)
+                    a = (a * src_alpha[i] + 127) / 255;
+                if(a == 255)
+                    dst[i] = src[i];
+                else if(a > 0)
+                    dst[i] = BlendRgb565(dst[i], src[i], a);
+            }
+        }
+    }
+
+  private:
+    bool Contains(int16_t x, int16_t y) const
+    {
+        return x >= bounds_.GetX() && x < bounds_.GetRight()
+               && y >= bounds_.GetY() && y < bounds_.GetBottom();
+    }
+
+    uint16_t* GetPixel(int16_t x, int16_t y)
+    {
+        return &pixels_[(y - bounds_.GetY()) * bounds_.GetWidth()
+                        + (x - bounds_.GetX())];
+    }
+
+    /** Intersects a rectangle with the canvas
+     *  \return false if nothing is left
+     */
+    bool Clip(const Rectangle& rect, Rectangle& clipped) const
+    {
+        const int16_t x0 = Max(rect.GetX(), bounds_.GetX());
+        const int16_t y0 = Max(rect.GetY(), bounds_.GetY());
+        const int16_t x1 = Min(rect.GetRight(), bounds_.GetRight());
+        const int16_t y1 = Min(rect.GetBottom(), bounds_.GetBottom());
+        if(x0 >= x1 || y0 >= y1)
+            return false;
+        clipped = Rectangle(x0, y0, x1 - x0, y1 - y0);
+        return true;
+    }
+
+    static int16_t Max(int16_t a, int16_t b) { return a > b ? a : b; }
+    static int16_t Min(int16_t a, int16_t b) { return a < b ? a : b; }
+
+    uint16_t* pixels_;
+    Rectangle bounds_;
+};
+
+} // namespace daisy
+
+#endif
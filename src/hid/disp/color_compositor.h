@@ -0,0 +1,151 @@
+#pragma once
+#ifndef DSY_COLOR_COMPOSITOR_H
+#define DSY_COLOR_COMPOSITOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "color_canvas.h"
+#ifndef UNIT_TEST
+#include "sys/dma.h"
+#endif
+
+namespace daisy
+{
+/** @brief   Something that a ColorCompositor draws, e.g. a meter
+ *  @details Draw() is called once for each band of the screen, with a canvas
+ *           that holds only that band. It draws everything in display
+ *           coordinates; what is outside of the band is clipped. Layers that
+ *           know their bounds can return early for bands they don't touch.
+ *  @ingroup device
+ */
+class ColorLayer
+{
+  public:
+    virtual ~ColorLayer() {}
+
+    /** Draws the layer into a band of the screen */
+    virtual void Draw(Rgb565Canvas& canvas) = 0;
+};
+
+/** @brief   Renders layers band by band and streams them to a color display
+ *  @details Instead of a framebuffer of the whole screen (32 KB for
+ *           128x128 pixels), the compositor has two buffers of a few rows.
+ *           A band is filled with the background, the layers are drawn into
+ *           it in the order they were added, and it is sent with the DMA
+ *           while the next band is rendered into the other buffer.
+ *
+ *           The driver needs the functions of SSD1351StreamDriver:
+ *           `Width()`, `Height()`, `SetWindow(x0, y0, x1, y1)`,
+ *           `WritePixelsDma(const uint16_t* pixels, size_t num_pixels)` and
+ *           `IsBusy()`. The pixels are sent high byte first.
+ *
+ *           The band buffers are members, and the SPI DMA reads them
+ *           directly. The DMA can't reach the DTCM RAM, where the stack and
+ *           DTCM_MEM_SECTION variables are, so the compositor must be a
+ *           static or global object in the AXI SRAM, or be placed with
+ *           DMA_BUFFER_MEM_SECTION. Never put it on the stack.
+ *  @tparam  width the width of the display
+ *  @tparam  band_height rows rendered at once. Two buffers of
+ *           width * band_height pixels are used.
+ *  @tparam  max_layers the number of layers
+ *  @ingroup device
+ */
+template <size_t width, size_t band_height = 8, size_t max_layers = 8>
+class ColorCompositor
+{
+  public:
+    ColorCompositor() : num_layers_(0), background_(0) {}
+
+    /** Initializes the compositor without layers
+     *  \param background the color below all layers
+     */
+    void Init(uint16_t background = 0)
+    {
+        num_layers_ = 0;
+        background_ = background;
+    }
+
+    /** Adds a layer on top of the others
+     *  \return false if there are max_layers layers
+     */
+    bool AddLayer(ColorLayer* layer)
+    {
+        if(num_layers_ >= max_layers)
+            return false;
+        layers_[num_layers_++] = layer;
+        return true;
+    }
+
+    /** Removes all layers */
+    void Clear() { num_layers_ = 0; }
+
+    /** Sets the color below all layers */
+    void SetBackground(uint16_t color) { background_ = color; }
+
+    /** Renders the whole screen and sends it to the display */
+    template <typename Driver>
+    void Render(Driver& driver)
+    {
+        Render(driver, Rectangle(driver.Width(), driver.Height()));
+    }
+
+    /** Renders a region of the screen and sends it to the display. Returns
+     *  when the last band is started; the DMA may still be sending it.
+     *  \param driver the display
+     *  \param region the region in display coordinates, e.g. a meter that
+     *         changed
+     */
+    template <typename Driver>
+    void Render(Driver& driver, const Rectangle& region)
+    {
+        const int16_t x0 = region.GetX() > 0 ? region.GetX() : 0;
+        const int16_t y0 = region.GetY() > 0 ? region.GetY() : 0;
+        const int16_t x1 = region.GetRight() < int16_t(driver.Width())
+                               ? region.GetRight()
+                               : driver.Width();
+        const int16_t y1 = region.GetBottom() < int16_t(driver.Height())
+                               ? region.GetBottom()
+                               : driver.Height();
+        if(x0 >= x1 || y0 >= y1 || x1 > int16_t(width))
+            return;
+
+        driver.SetWindow(x0, y0, x1 - 1, y1 - 1);
+        size_t buffer = 0;
+        for(int16_t y = y0; y < y1; y += band_height)
+        {
+            const int16_t rows = y1 - y < int16_t(band_height) ? y1 - y
+                                                               : band_height;
+            const Rectangle bounds(x0, y, x1 - x0, rows);
+            uint16_t*       pixels = bands_[buffer];
+
+            // the other buffer may still be sent, this one is done
+            Rgb565Canvas canvas(pixels, bounds);
+            canvas.Fill(background_);
+            for(size_t i = 0; i < num_layers_; i++)
+                layers_[i]->Draw(canvas);
+
+            const size_t num_pixels = bounds.GetWidth() * bounds.GetHeight();
+            for(size_t i = 0; i < num_pixels; i++)
+                pixels[i] = (pixels[i] << 8) | (pixels[i] >> 8);
+#ifndef UNIT_TEST
+            dsy_dma_clear_cache_for_buffer((uint8_t*)pixels,
+                                           num_pixels * sizeof(uint16_t));
+#endif
+            while(driver.IsBusy()) {}
+            driver.WritePixelsDma(pixels, num_pixels);
+            buffer = 1 - buffer;
+        }
+    }
+
+  private:
+    // the DMA source, see the placement rule above
+    alignas(32) uint16_t bands_[2][width * band_height];
+
+    ColorLayer* layers_[max_layers];
+    size_t      num_layers_;
+    uint16_t    background_;
+};
+
+} // namespace daisy
+
+#endif
@@ -5,6 +5,7 @@
 #include "util/oled_fonts.h"
 #include "daisy_core.h"
 #include "graphics_common.h"
+#include "glyph_cache.h"
 
 #ifndef deg2rad
 #define deg2rad(deg) ((deg)*3.141592 / 180.0)
@@ -163,6 +164,71 @@ class OneBitGraphicsDisplay
                                          bool           on)
         = 0;
 
+    /**
+    Writes a string with the glyphs of a GlyphCache to the display buffer at
+    the current cursor position, and moves the cursor.
+    \param str  string to be written
+    \param font the glyphs to use
+    \param on   on or off
+    \return the first character that couldn't be written, or 0
+    */
+    char WriteString(const char* str, const GlyphCacheBase& font, bool on)
+    {
+        return font.WriteString(*this, str, on);
+    }
+
+    /**
+    Similar to WriteString but justified within a bounding box.
+    \param str          string to be written
+    \param font         the glyphs to use
+    \param boundingBox  the bounding box to draw the text in
+    \param alignment    the alignment to use
+    \param on           on or off
+    \return The rectangle that was drawn to
+    */
+    Rectangle WriteStringAligned(const char*           str,
+                                 const GlyphCacheBase& font,
+                                 Rectangle             boundingBox,
+                                 Alignment             alignment,
+                                 bool                  on)
+    {
+        const auto alignedRect
+            = Rectangle(int16_t(font.GetTextWidth(str)), font.GetHeight())
+                  .AlignedWithin(boundingBox, alignment);
+        SetCursor(alignedRect.GetX(), alignedRect.GetY());
+        WriteString(str, font, on);
+        return alignedRect;
+    }
+
+    /**
+    Draws columns of up to 32 pixels with their background: set bits are
+    drawn on, the others !on. Bit 0 is the top pixel. Used to draw the
+    glyphs of a GlyphCache; displays can override it to write their buffer
+    directly.
+    \param x       x Coordinate of the top left pixel
+    \param y       y Coordinate of the top left pixel
+    \param columns one word per column
+    \param width   number of columns
+    \param height  height in pixels, up to 32
+    \param on      on or off
+    */
+    virtual void BlitColumns(uint_fast8_t    x,
+                             uint_fast8_t    y,
+                             const uint32_t* columns,
+                             uint_fast8_t    width,
+                             uint_fast8_t    height,
+                             bool            on)
+    {
+        for(uint_fast16_t i = 0; i < width && x + i < Width(); i++)
+        {
+            for(uint_fast8_t j = 0; j < height; j++)
+            {
+                const bool set = (columns[i] >> j) & 1;
+                DrawPixel(x + i, y + j, set ? on : !on);
+            }
+        }
+    }
+
     /** 
     Moves the 'Cursor' position used for WriteChar, and WriteStr to the specified coordinate.
     \param x x pos
@@ -210,6 +276,10 @@ class OneBitGraphicsDisplay
  *          void Update() override { ... }
  *      };
  *  
+ *  Lines, filled rectangles and text are drawn with FillSpan(), FillRect() and BlitBitmap(),
+ *  which set one pixel after the other. For speed, the child class can provide its own versions
+ *  of these that write to its buffer directly. They are found the same way as DrawPixel().
+ *  
  */
 template <class ChildType>
 class OneBitGraphicsDisplayImpl : public OneBitGraphicsDisplay
@@ -218,12 +288,110 @@ class OneBitGraphicsDisplayImpl : public OneBitGraphicsDisplay
     OneBitGraphicsDisplayImpl() {}
     virtual ~OneBitGraphicsDisplayImpl() {}
 
+    // the GlyphCache overloads would be hidden by the overrides below
+    using OneBitGraphicsDisplay::WriteString;
+    using OneBitGraphicsDisplay::WriteStringAligned;
+
+    /**
+    Sets the pixels from (x1, y) to (x2, y). This and FillRect() and
+    BlitBitmap() are used by the other drawing functions. They call
+    DrawPixel(); a child class can hide them with versions that write whole
+    bytes or words of its buffer at once.
+    \param x1 x Coordinate of the first pixel
+    \param x2 x Coordinate of the last pixel, nothing is drawn if < x1
+    \param y  y Coordinate
+    \param on on or off
+    */
+    void FillSpan(uint_fast8_t x1, uint_fast8_t x2, uint_fast8_t y, bool on)
+    {
+        for(uint_fast16_t x = x1; x <= x2; x++)
+            ((ChildType*)(this))->ChildType::DrawPixel(x, y, on);
+    }
+
+    /**
+    Sets the pixels of a rectangle, see FillSpan()
+    \param x1 x Coordinate of the top left pixel
+    \param y1 y Coordinate of the top left pixel
+    \param x2 x Coordinate of the bottom right pixel
+    \param y2 y Coordinate of the bottom right pixel
+    \param on on or off
+    */
+    void FillRect(uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on)
+    {
+        for(uint_fast16_t y = y1; y <= y2; y++)
+            ((ChildType*)(this))->ChildType::FillSpan(x1, x2, y, on);
+    }
+
+    /**
+    Draws a 1 bit bitmap with its background: set bits are drawn on, the
+    others !on. See FillSpan().
+    \param x      x Coordinate of the top left pixel
+    \param y      y Coordinate of the top left pixel
+    \param rows   one word per row, the leftmost pixel in the MSB (the
+                  layout of the FontDef glyphs)
+    \param width  width in pixels, up to 16
+    \param height height in pixels
+    \param on     on or off
+    */
+    void BlitBitmap(uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    width,
+                    uint_fast8_t    height,
+                    bool            on)
+    {
+        for(uint_fast8_t i = 0; i < height; i++)
+        {
+            for(uint_fast8_t j = 0; j < width; j++)
+            {
+                const bool set = (rows[i] << j) & 0x8000;
+                ((ChildType*)(this))
+                    ->ChildType::DrawPixel(x + j, y + i, set ? on : !on);
+            }
+        }
+    }
+
+    void BlitColumns(uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    width,
+                     uint_fast8_t    height,
+                     bool            on) override
+    {
+        const uint_fast16_t displayWidth = Width();
+        for(uint_fast16_t i = 0; i < width && x + i < displayWidth; i++)
+        {
+            for(uint_fast8_t j = 0; j < height; j++)
+            {
+                const bool set = (columns[i] >> j) & 1;
+                ((ChildType*)(this))
+                    ->ChildType::DrawPixel(x + i, y + j, set ? on : !on);
+            }
+        }
+    }
+
     void DrawLine(uint_fast8_t x1,
                   uint_fast8_t y1,
                   uint_fast8_t x2,
                   uint_fast8_t y2,
                   bool         on) override
     {
+        // horizontal and vertical lines are spans
+        if(x1 == x2 || y1 == y2)
+        {
+            ((ChildType*)(this))
+                ->ChildType::FillRect(x1 < x2 ? x1 : x2,
+                                      y1 < y2 ? y1 : y2,
+                                      x1 < x2 ? x2 : x1,
+                                      y1 < y2 ? y2 : y1,
+                                      on);
+            return;
+        }
+
         int_fast16_t deltaX = abs((int_fast16_t)x2 - (int_fast16_t)x1);
         int_fast16_t deltaY = abs((int_fast16_t)y2 - (int_fast16_t)y1);
         int_fast16_t signX  = ((x1 < x2) ? 1 : -1);
@@ -263,13 +431,7 @@ class OneBitGraphicsDisplayImpl : public OneBitGraphicsDisplay
     {
         if(fill)
         {
-            for(uint_fast8_t x = x1; x <= x2; x++)
-            {
-                for(uint_fast8_t y = y1; y <= y2; y++)
-                {
-                    ((ChildType*)(this))->ChildType::DrawPixel(x, y, on);
-                }
-            }
+            ((ChildType*)(this))->ChildType::FillRect(x1, y1, x2, y2, on);
         }
         else
         {
@@ -395,8 +557,6 @@ class OneBitGraphicsDisplayImpl : public OneBitGraphicsDisplay
 
     char WriteChar(char ch, FontDef font, bool on) override
     {
-        uint32_t i, b, j;
-
         // Check if character is valid
         if(ch < 32 || ch > 126)
             return 0;
@@ -410,25 +570,13 @@ class OneBitGraphicsDisplayImpl : public OneBitGraphicsDisplay
         }
 
         // Use the font to write
-        for(i = 0; i < font.FontHeight; i++)
-        {
-            b = font.data[(ch - 32) * font.FontHeight + i];
-            for(j = 0; j < font.FontWidth; j++)
-            {
-                if((b << j) & 0x8000)
-                {
-                    ((ChildType*)(this))
-                        ->ChildType::DrawPixel(
-                            currentX_ + j, (currentY_ + i), on);
-                }
-                else
-                {
-                    ((ChildType*)(this))
-                        ->ChildType::DrawPixel(
-                            currentX_ + j, (currentY_ + i), !on);
-                }
-            }
-        }
+        ((ChildType*)(this))
+            ->ChildType::BlitBitmap(currentX_,
+                                    currentY_,
+                                    &font.data[(ch - 32) * font.FontHeight],
+                                    font.FontWidth,
+                                    font.FontHeight,
+                                    on);
 
         // The current space is now taken
         SetCursor(currentX_ + font.FontWidth, currentY_);
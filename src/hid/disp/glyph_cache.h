@@ -0,0 +1,259 @@
+#pragma once
+#ifndef DSY_GLYPH_CACHE_H
+#define DSY_GLYPH_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "util/oled_fonts.h"
+
+namespace daisy
+{
+/** @brief   A font pre-rendered into columns, with proportional widths
+ *  @details Init() converts the glyphs of a FontDef into columns of up to 32
+ *           pixels. Bit 0 of a column is the top pixel, so for displays that
+ *           store pages of 8 rows, like the SSD130x, a column is written
+ *           with a shift and a few byte writes instead of pixel by pixel
+ *           (see OneBitGraphicsDisplay::BlitColumns()).
+ *
+ *           In proportional mode, the empty columns on both sides of each
+ *           glyph are removed and a gap is added instead. Pairs of
+ *           characters can be moved closer or further apart with a kerning
+ *           table. The font covers the characters of FontDef, ASCII 32 to
+ *           126.
+ *
+ *           GlyphCacheBase doesn't hold the columns; use GlyphCache.
+ *  @ingroup device
+ */
+class GlyphCacheBase
+{
+  public:
+    /** Changes the distance between two characters */
+    struct KerningPair
+    {
+        char   first;
+        char   second;
+        int8_t adjust; /**< added to the distance, in pixels */
+    };
+
+    struct Config
+    {
+        Config() { Defaults(); }
+
+        /** Removes the empty columns around the glyphs. Otherwise the
+         *  glyphs keep the width of the font, and spacing is usually 0.
+         */
+        bool proportional;
+        /** Empty columns after each glyph */
+        uint8_t spacing;
+        /** Width of the space character in proportional mode, 0 for half
+         *  the font width
+         */
+        uint8_t space_width;
+        /** Kerning pairs, or nullptr. The table isn't copied. */
+        const KerningPair* kerning;
+        size_t             num_kerning_pairs;
+
+        void Defaults()
+        {
+            proportional      = true;
+            spacing           = 1;
+            space_width       = 0;
+            kerning           = nullptr;
+            num_kerning_pairs = 0;
+        }
+    };
+
+    /** Renders the glyphs of a font
+     *  \param font the font, up to 32 pixels high
+     *  \param config the layout of the glyphs
+     *  \return false if the font is too high or the glyphs don't fit
+     */
+    bool Init(const FontDef& font, const Config& config = Config())
+    {
+        height_  = 0;
+        kerning_ = config.kerning;
+        num_kerning_pairs_
+            = config.kerning != nullptr ? config.num_kerning_pairs : 0;
+        if(font.FontHeight > 32 || font.FontWidth > 16)
+            return false;
+
+        size_t num_columns = 0;
+        for(size_t g = 0; g < kNumGlyphs; g++)
+        {
+            const uint16_t* rows = &font.data[g * font.FontHeight];
+            // the columns with ink, MSB is the leftmost column
+            uint16_t ink = 0;
+            for(size_t r = 0; r < font.FontHeight; r++)
+                ink |= rows[r];
+
+            size_t first = 0, width = font.FontWidth;
+            if(config.proportional)
+            {
+                if(ink == 0)
+                {
+                    width = config.space_width > 0 ? config.space_width
+                                                   : (font.FontWidth + 1) / 2;
+                }
+                else
+                {
+                    while(!(ink & (0x8000 >> first)))
+                        first++;
+                    size_t last = 15;
+                    while(!(ink & (0x8000 >> last)))
+                        last--;
+                    width = last - first + 1;
+                }
+            }
+
+            // the gap is stored with the glyph, so that it is drawn with
+            // the background in one go
+            const size_t size = width + config.spacing;
+            if(num_columns + size > max_columns_)
+                return false;
+            offsets_[g] = num_columns;
+            widths_[g]  = width;
+            for(size_t c = 0; c < size; c++)
+            {
+                uint32_t column = 0;
+                if(c < width)
+                {
+                    const uint16_t mask = 0x8000 >> (first + c);
+                    for(size_t r = 0; r < font.FontHeight; r++)
+                        if(rows[r] & mask)
+                            column |= 1ul << r;
+                }
+                columns_[num_columns++] = column;
+            }
+        }
+        spacing_ = config.spacing;
+        height_  = font.FontHeight;
+        return true;
+    }
+
+    /** Returns the height of the glyphs, 0 before Init() */
+    uint8_t GetHeight() const { return height_; }
+
+    /** Returns true if the font has a glyph for the character */
+    static bool HasGlyph(char ch)
+    {
+        return ch >= kFirstChar && ch <= kLastChar;
+    }
+
+    /** Returns the width of a glyph without the gap after it */
+    uint8_t GetGlyphWidth(char ch) const
+    {
+        return HasGlyph(ch) ? widths_[ch - kFirstChar] : 0;
+    }
+
+    /** Returns the columns of a glyph, followed by the columns of the gap */
+    const uint32_t* GetColumns(char ch) const
+    {
+        return &columns_[offsets_[ch - kFirstChar]];
+    }
+
+    /** Returns the distance from the start of a glyph to the start of the
+     *  next one. Kerning can remove the gap, but glyphs never overlap.
+     *  \param ch the character
+     *  \param next the following character, or 0
+     */
+    uint8_t GetAdvance(char ch, char next = 0) const
+    {
+        const int width   = GetGlyphWidth(ch);
+        int       advance = width + spacing_;
+        for(size_t i = 0; i < num_kerning_pairs_; i++)
+        {
+            if(kerning_[i].first == ch && kerning_[i].second == next)
+            {
+                advance += kerning_[i].adjust;
+                break;
+            }
+        }
+        return advance < width ? width : advance;
+    }
+
+    /** Returns the width of a string in pixels, without the gap after the
+     *  last character
+     */
+    uint16_t GetTextWidth(const char* str) const
+    {
+        uint16_t width = 0;
+        for(; *str != '\0'; str++)
+        {
+            if(str[1] == '\0')
+                width += GetGlyphWidth(*str);
+            else
+                width += GetAdvance(*str, str[1]);
+        }
+        return width;
+    }
+
+    /** Writes a string at the cursor of a display and moves the cursor.
+     *  Usually called through OneBitGraphicsDisplay::WriteString().
+     *  \return the first character that couldn't be written, or 0
+     */
+    template <typename Display>
+    char WriteString(Display& display, const char* str, bool on) const
+    {
+        uint16_t       x = display.CurrentX();
+        const uint16_t y = display.CurrentY();
+        for(; *str != '\0'; str++)
+        {
+            if(!HasGlyph(*str) || height_ == 0)
+                return *str;
+            const uint8_t width = widths_[*str - kFirstChar];
+            if(x + width > display.Width() || y + height_ > display.Height())
+                return *str;
+            const uint8_t advance = GetAdvance(*str, str[1]);
+            // the glyph and its gap, up to the next glyph
+            const uint8_t num_columns
+                = advance < width + spacing_ ? advance : width + spacing_;
+            display.BlitColumns(
+                x, y, GetColumns(*str), num_columns, height_, on);
+            x += advance;
+        }
+        display.SetCursor(x, y);
+        return '\0';
+    }
+
+  protected:
+    GlyphCacheBase(uint32_t* columns, size_t max_columns)
+    : columns_(columns), max_columns_(max_columns), height_(0)
+    {
+    }
+
+  private:
+    GlyphCacheBase(const GlyphCacheBase&) {} // non copyable
+
+    static constexpr char   kFirstChar = 32;
+    static constexpr char   kLastChar  = 126;
+    static constexpr size_t kNumGlyphs = kLastChar - kFirstChar + 1;
+
+    uint32_t*          columns_;
+    size_t             max_columns_;
+    uint16_t           offsets_[kNumGlyphs];
+    uint8_t            widths_[kNumGlyphs];
+    uint8_t            height_;
+    uint8_t            spacing_;
+    const KerningPair* kerning_;
+    size_t             num_kerning_pairs_;
+};
+
+/** @brief   A GlyphCacheBase with memory for the columns
+ *  @tparam  max_columns the number of columns of all glyphs and their gaps.
+ *           A fixed width font needs 95 times its width, a proportional one
+ *           usually much less.
+ *  @ingroup device
+ */
+template <size_t max_columns>
+class GlyphCache : public GlyphCacheBase
+{
+  public:
+    GlyphCache() : GlyphCacheBase(columns_, max_columns) {}
+
+  private:
+    uint32_t columns_[max_columns];
+};
+
+} // namespace daisy
+
+#endif
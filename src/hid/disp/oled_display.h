@@ -44,15 +44,185 @@ class OledDisplay : public OneBitGraphicsDisplayImpl<OledDisplay<DisplayDriver>>
         driver_.DrawPixel(x, y, on);
     }
 
+    /**
+    Sets the pixels from (x1, y) to (x2, y), with the driver's FillSpan() if
+    it has one
+    */
+    void FillSpan(uint_fast8_t x1, uint_fast8_t x2, uint_fast8_t y, bool on)
+    {
+        FillSpan(driver_, x1, x2, y, on, 0);
+    }
+
+    /**
+    Sets the pixels of a rectangle, with the driver's FillRect() if it has
+    one
+    */
+    void FillRect(uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on)
+    {
+        FillRect(driver_, x1, y1, x2, y2, on, 0);
+    }
+
+    /**
+    Draws a 1 bit bitmap with its background, with the driver's
+    BlitBitmap() if it has one
+    */
+    void BlitBitmap(uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    width,
+                    uint_fast8_t    height,
+                    bool            on)
+    {
+        BlitBitmap(driver_, x, y, rows, width, height, on, 0);
+    }
+
+    /**
+    Draws columns of pixels with their background, with the driver's
+    BlitColumns() if it has one
+    */
+    void BlitColumns(uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    width,
+                     uint_fast8_t    height,
+                     bool            on) override
+    {
+        BlitColumns(driver_, x, y, columns, width, height, on, 0);
+    }
+
     /** 
     Writes the current display buffer to the OLED device using SPI or I2C depending on 
     how the object was initialized.
     */
     void Update() override { driver_.Update(); }
 
+    /** Called from an interrupt when an UpdateAsync() is done */
+    typedef void (*UpdateCallback)(void* context);
+
+    /**
+    Starts writing the display buffer to the OLED device with the DMA and
+    returns. Drawing can continue in the meantime. Only for drivers that
+    support it.
+    \param callback called from an interrupt when the update is done, or
+           nullptr
+    \param context passed to the callback
+    \return false if the previous update is still running
+    */
+    bool UpdateAsync(UpdateCallback callback = nullptr, void* context = nullptr)
+    {
+        return driver_.UpdateAsync(callback, context);
+    }
+
+    /** Returns true while an UpdateAsync() is running */
+    bool IsBusy() const { return driver_.IsBusy(); }
+
   private:
+    using Base = OneBitGraphicsDisplayImpl<OledDisplay<DisplayDriver>>;
+
     DisplayDriver driver_;
 
+    // The overloads taking an int are used if the driver has the function,
+    // the others fall back to drawing pixels.
+    template <typename Driver>
+    auto FillSpan(Driver&      driver,
+                  uint_fast8_t x1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y,
+                  bool         on,
+                  int) -> decltype(driver.FillSpan(x1, x2, y, on))
+    {
+        driver.FillSpan(x1, x2, y, on);
+    }
+    template <typename Driver>
+    void FillSpan(Driver&,
+                  uint_fast8_t x1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y,
+                  bool         on,
+                  long)
+    {
+        Base::FillSpan(x1, x2, y, on);
+    }
+
+    template <typename Driver>
+    auto FillRect(Driver&      driver,
+                  uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on,
+                  int) -> decltype(driver.FillRect(x1, y1, x2, y2, on))
+    {
+        driver.FillRect(x1, y1, x2, y2, on);
+    }
+    template <typename Driver>
+    void FillRect(Driver&,
+                  uint_fast8_t x1,
+                  uint_fast8_t y1,
+                  uint_fast8_t x2,
+                  uint_fast8_t y2,
+                  bool         on,
+                  long)
+    {
+        Base::FillRect(x1, y1, x2, y2, on);
+    }
+
+    template <typename Driver>
+    auto BlitBitmap(Driver&         driver,
+                    uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    width,
+                    uint_fast8_t    height,
+                    bool            on,
+                    int)
+        -> decltype(driver.BlitBitmap(x, y, rows, width, height, on))
+    {
+        driver.BlitBitmap(x, y, rows, width, height, on);
+    }
+    template <typename Driver>
+    void BlitBitmap(Driver&,
+                    uint_fast8_t    x,
+                    uint_fast8_t    y,
+                    const uint16_t* rows,
+                    uint_fast8_t    width,
+                    uint_fast8_t    height,
+                    bool            on,
+                    long)
+    {
+        Base::BlitBitmap(x, y, rows, width, height, on);
+    }
+
+    template <typename Driver>
+    auto BlitColumns(Driver&         driver,
+                     uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    width,
+                     uint_fast8_t    height,
+                     bool            on,
+                     int)
+        -> decltype(driver.BlitColumns(x, y, columns, width, height, on))
+    {
+        driver.BlitColumns(x, y, columns, width, height, on);
+    }
+    template <typename Driver>
+    void BlitColumns(Driver&,
+                     uint_fast8_t    x,
+                     uint_fast8_t    y,
+                     const uint32_t* columns,
+                     uint_fast8_t    width,
+                     uint_fast8_t    height,
+                     bool            on,
+                     long)
+    {
+        Base::BlitColumns(x, y, columns, width, height, on);
+    }
+
     void Reset() { driver_.Reset(); };
     void SendCommand(uint8_t cmd) { driver_.SendCommand(cmd); };
     void SendData(uint8_t* buff, size_t size) { driver_.SendData(buff, size); };
@@ -3,9 +3,11 @@
 namespace daisy
 {
 static constexpr size_t kDefaultMidiRxBufferSize = 256;
+static constexpr size_t kDefaultMidiTxBufferSize = 64;
 
 static uint8_t DMA_BUFFER_MEM_SECTION
     default_midi_rx_buffer[kDefaultMidiRxBufferSize];
+static uint8_t default_midi_tx_buffer[kDefaultMidiTxBufferSize];
 
 MidiUartTransport::Config::Config()
 {
@@ -14,5 +16,7 @@ MidiUartTransport::Config::Config()
     tx             = {DSY_GPIOB, 6};
     rx_buffer      = default_midi_rx_buffer;
     rx_buffer_size = kDefaultMidiRxBufferSize;
+    tx_buffer      = default_midi_tx_buffer;
+    tx_buffer_size = kDefaultMidiTxBufferSize;
 }
 } // namespace daisy
@@ -7,8 +7,9 @@
 #include <algorithm>
 #include "per/uart.h"
 #include "util/ringbuffer.h"
-#include "util/FIFO.h"
+#include "util/EventBus.h"
 #include "hid/midi_parser.h"
+#include "hid/midi_output.h"
 #include "hid/usb_midi.h"
 #include "sys/dma.h"
 #include "sys/system.h"
@@ -55,6 +56,19 @@ class MidiUartTransport
          */
         size_t rx_buffer_size;
 
+        /** Pointer to buffer for UART tx byte transfer in background,
+         *  used by TxAsync().
+         *
+         *  @details The bytes are sent by the UART interrupt, not the DMA,
+         *           so the buffer can be in any memory. By default this uses
+         *           a shared buffer, which can only be utilized for a single
+         *           UART peripheral.
+         */
+        uint8_t* tx_buffer;
+
+        /** Size in bytes of tx_buffer, the maximum size of one TxAsync() transfer */
+        size_t tx_buffer_size;
+
         Config();
     };
 
@@ -77,6 +91,9 @@ class MidiUartTransport
 
         rx_buffer      = config.rx_buffer;
         rx_buffer_size = config.rx_buffer_size;
+        tx_buffer      = config.tx_buffer;
+        tx_buffer_size = config.tx_buffer_size;
+        tx_busy_       = false;
 
         /** zero the buffer to ensure emptiness regardless of source memory */
         std::fill(rx_buffer, rx_buffer + rx_buffer_size, 0);
@@ -90,8 +107,10 @@ class MidiUartTransport
     {
         parse_context_  = context;
         parse_callback_ = parse_callback;
+#ifndef UNIT_TEST
         dsy_dma_clear_cache_for_buffer((uint8_t*)this,
                                        sizeof(MidiUartTransport));
+#endif
         uart_.DmaListenStart(
             rx_buffer, rx_buffer_size, MidiUartTransport::rxCallback, this);
     }
@@ -105,13 +124,54 @@ class MidiUartTransport
     /** @brief sends the buffer of bytes out of the UART peripheral */
     inline void Tx(uint8_t* buff, size_t size) { uart_.PollTx(buff, size); }
 
+    /** @brief Starts sending bytes in the background, without waiting for them.
+     *  The bytes are copied to the tx_buffer, so buff can be reused. They are
+     *  sent by the UART interrupt, because the DMA is held by StartRx().
+     *  Don't use Tx() while TxBusy().
+     *  @return the number of bytes that will be sent, 0 if TxBusy()
+     */
+    inline size_t TxAsync(const uint8_t* buff, size_t size)
+    {
+        if(tx_busy_ || tx_buffer == nullptr)
+            return 0;
+        size = std::min(size, tx_buffer_size);
+        std::copy(buff, buff + size, tx_buffer);
+        tx_busy_ = true;
+        if(uart_.InterruptTransmit(
+               tx_buffer, size, MidiUartTransport::txCallback, this)
+           != UartHandler::Result::OK)
+        {
+            tx_busy_ = false;
+            return 0;
+        }
+        return size;
+    }
+
+    /** @brief returns whether a TxAsync() transfer is still running */
+    inline bool TxBusy() const { return tx_busy_; }
+
+#ifdef UNIT_TEST
+    /** Host backend only: the UART, to emulate its interrupts */
+    UartHandler& GetUartForUnitTest() { return uart_; }
+#endif
+
   private:
     UartHandler         uart_;
     uint8_t*            rx_buffer;
     size_t              rx_buffer_size;
+    uint8_t*            tx_buffer;
+    size_t              tx_buffer_size;
+    volatile bool       tx_busy_;
     void*               parse_context_;
     MidiRxParseCallback parse_callback_;
 
+    /** Static callback for the end of a TxAsync() transfer */
+    static void txCallback(void* context, UartHandler::Result res)
+    {
+        (void)res;
+        reinterpret_cast<MidiUartTransport*>(context)->tx_busy_ = false;
+    }
+
     /** Static callback for Uart MIDI that occurs when
          *  new data is available from the peripheral.
          *  The new data is transferred from the peripheral to the
@@ -143,23 +203,38 @@ class MidiUartTransport
 /**
     @brief Simple MIDI Handler \n
     Parses bytes from an input into valid MidiEvents. \n
-    The MidiEvents fill a FIFO queue that the user can pop messages from.
+    The MidiEvents fill a queue that the user can pop messages from.
+    The queue is lock-free, so events can be parsed in an interrupt while
+    the main loop reads them.
+    The data of SysEx messages is kept in a separate arena, see GetSysEx().
+    Messages can also be scheduled to be sent later and in the background,
+    see ScheduleMessage().
+    @tparam sysex_arena_size bytes of SysEx data that are kept, a power of two
+    @tparam output_queue_size number of scheduled messages, a power of two
     @author shensley
     @date March 2020
     @ingroup midi
 */
-template <typename Transport>
+template <typename Transport,
+          size_t sysex_arena_size  = 1024,
+          size_t output_queue_size = 64>
 class MidiHandler
 {
   public:
     MidiHandler() {}
     ~MidiHandler() {}
 
+    using OutputScheduler = MidiOutputScheduler<output_queue_size>;
+
     struct Config
     {
-        typename Transport::Config transport_config;
+        typename Transport::Config       transport_config;
+        typename OutputScheduler::Config output_config;
     };
 
+    /** Function that is called with each parsed event, see SetEventCallback() */
+    typedef void (*EventCallback)(const MidiEvent& event, void* context);
+
     /** Initializes the MidiHandler
      *  \param config Configuration structure used to define specifics to the MIDI Handler.
      */
@@ -167,7 +242,9 @@ class MidiHandler
     {
         config_ = config;
         transport_.Init(config_.transport_config);
-        parser_.Init();
+        parser_.Init(&sysex_);
+        output_.Init(config_.output_config);
+        tx_pending_size_ = 0;
     }
 
     /** Starts listening on the selected input mode(s).
@@ -194,14 +271,62 @@ class MidiHandler
     /** Checks if there are unhandled messages in the queue
     \return True if there are events to be handled, else false.
      */
-    bool HasEvents() const { return event_q_.GetNumElements() > 0; }
+    bool HasEvents() const { return !event_q_.IsEmpty(); }
 
     bool RxActive() { return transport_.RxActive(); }
 
     /** Pops the oldest unhandled MidiEvent from the internal queue
     \return The event to be handled
      */
-    MidiEvent PopEvent() { return event_q_.PopFront(); }
+    MidiEvent PopEvent()
+    {
+        MidiEvent event = MidiEvent();
+        event_q_.TryRead(event);
+        return event;
+    }
+
+    /** Removes all unhandled MidiEvents from the queue and passes them to
+    a function, which is faster than popping them one by one.
+    \param sink called as sink(const MidiEvent&) for every event
+    \return the number of events
+     */
+    template <typename Sink>
+    size_t DrainEvents(Sink&& sink)
+    {
+        return event_q_.Drain(sink);
+    }
+
+    /** Copies the data of a SysEx event.
+        The data stays available until sysex_arena_size more bytes of SysEx
+        have been received.
+        \param event a SysEx event popped from the queue
+        \param dst destination for the data
+        \param max_len number of bytes that fit into dst
+        \return the number of bytes copied, 0 if the data was overwritten
+     */
+    size_t GetSysEx(const MidiEvent& event, uint8_t* dst, size_t max_len) const
+    {
+        return sysex_.Read(event, dst, max_len);
+    }
+
+    /** Returns the first SYSEX_BUFFER_LEN bytes of a SysEx event */
+    SystemExclusiveEvent AsSystemExclusive(const MidiEvent& event) const
+    {
+        return sysex_.AsSystemExclusive(event);
+    }
+
+    /** Sets a function that is called with every parsed event instead of
+        adding it to the queue, which avoids copying events through the queue.
+        The callback runs wherever the bytes are parsed, e.g. in the UART DMA
+        interrupt, so it should be quick.
+        \param callback the function, or nullptr to use the queue again
+        \param context passed to the callback
+     */
+    void SetEventCallback(EventCallback callback, void* context = nullptr)
+    {
+        event_context_  = context;
+        event_callback_ = callback;
+    }
 
     /** SendMessage
     Send raw bytes as message
@@ -211,8 +336,42 @@ class MidiHandler
         transport_.Tx(bytes, size);
     }
 
+    /** Schedules a message to be sent by ProcessOutput().
+        This doesn't block, so it can be used in the audio callback.
+        Don't use SendMessage() while scheduled messages are sent.
+        \param event the message
+        \param time when to send it, e.g. in samples or microseconds, in the
+                    units of the time passed to ProcessOutput()
+        \return false if the queue is full or the message can't be sent
+     */
+    bool ScheduleMessage(const MidiEvent& event, uint32_t time)
+    {
+        return output_.Schedule(event, time);
+    }
+
+    /** Starts sending the scheduled messages that are due, if the previous
+        transfer has finished. Messages that were superseded while waiting,
+        e.g. by a newer value for the same CC, are left out.
+        Call this regularly, e.g. from the main loop.
+        \param now the current time in the units used for ScheduleMessage()
+     */
+    void ProcessOutput(uint32_t now)
+    {
+        if(tx_pending_size_ == 0 && !transport_.TxBusy())
+            tx_pending_size_
+                = output_.Render(now, tx_pending_, sizeof(tx_pending_));
+        if(tx_pending_size_ == 0)
+            return;
+        const size_t sent = transport_.TxAsync(tx_pending_, tx_pending_size_);
+        tx_pending_size_ -= sent;
+        memmove(tx_pending_, tx_pending_ + sent, tx_pending_size_);
+    }
+
+    /** Returns the scheduler for the messages of ScheduleMessage() */
+    const OutputScheduler& GetOutputScheduler() const { return output_; }
+
     /** Feed in bytes to parser state machine from an external source.
-        Populates internal FIFO queue with MIDI Messages.
+        Populates the internal event queue with MIDI Messages.
 
         \note  Normally application code won't need to use this method directly.
         \param byte MIDI byte to be parsed
@@ -222,23 +381,46 @@ class MidiHandler
         MidiEvent event;
         if(parser_.Parse(byte, &event))
         {
-            event_q_.PushBack(event);
+            HandleEvent(event);
         }
     }
 
+    /** Feed in a block of bytes to the parser from an external source.
+        This is faster than parsing them one by one.
+        \param data MIDI bytes to be parsed
+        \param size number of bytes
+    */
+    void Parse(const uint8_t* data, size_t size)
+    {
+        parser_.ParseBlock(data, size, [this](const MidiEvent& event) {
+            HandleEvent(event);
+        });
+    }
+
   private:
-    Config               config_;
-    Transport            transport_;
-    MidiParser           parser_;
-    FIFO<MidiEvent, 256> event_q_;
+    Config                           config_;
+    Transport                        transport_;
+    MidiParser                       parser_;
+    MpscQueue<MidiEvent, 256>        event_q_;
+    MidiSysExArena<sysex_arena_size> sysex_;
+    EventCallback                    event_callback_ = nullptr;
+    void*                            event_context_  = nullptr;
+    OutputScheduler                  output_;
+    uint8_t                          tx_pending_[64];
+    size_t                           tx_pending_size_ = 0;
+
+    void HandleEvent(const MidiEvent& event)
+    {
+        if(event_callback_ != nullptr)
+            event_callback_(event, event_context_);
+        else
+            event_q_.Post(event);
+    }
 
     static void ParseCallback(uint8_t* data, size_t size, void* context)
     {
         MidiHandler* handler = reinterpret_cast<MidiHandler*>(context);
-        for(size_t i = 0; i < size; i++)
-        {
-            handler->Parse(data[i]);
-        }
+        handler->Parse(data, size);
     }
 };
 
@@ -0,0 +1,372 @@
+#pragma once
+#ifndef DSY_MIDI_MPE_H
+#define DSY_MIDI_MPE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "hid/MidiEvent.h"
+#include "hid/midi_ump.h"
+
+namespace daisy
+{
+/** @brief   Assigns the notes of an MPE controller to voices
+ *  @details MIDI Polyphonic Expression sends every note on its own member
+ *           channel, so the pitch bend, pressure and timbre (CC 74) of the
+ *           channel only apply to that note. The member channels belong to
+ *           a zone: the lower zone has master channel 1 and member channels
+ *           from 2 up, the upper zone has master channel 16 and member
+ *           channels from 15 down. Messages on a master channel, such as
+ *           pitch bend, apply to all notes of the zone. Channels outside of
+ *           both zones work like regular MIDI channels.
+ *
+ *           The zones are configured with Config, and with the MPE
+ *           Configuration Message (RPN 6) the controller sends. MIDI 2.0
+ *           per-note pitch bend is supported as well.
+ *
+ *           Values have the 32 bit resolution of UmpEvent, MIDI 1.0 events
+ *           are scaled up. All state is kept in fixed-size tables, so
+ *           Process() can be called from an interrupt.
+ *  @tparam  num_voices number of voices, at most 254
+ *  @ingroup midi
+ */
+template <size_t num_voices = 16>
+class MpeVoiceAllocator
+{
+    static_assert(num_voices > 0 && num_voices < 255,
+                  "An MpeVoiceAllocator has between 1 and 254 voices");
+
+  public:
+    enum class Zone : uint8_t
+    {
+        NONE,
+        LOWER,
+        UPPER,
+    };
+
+    struct Config
+    {
+        /** Number of member channels of the lower zone, 0 to 15 */
+        uint8_t lower_member_channels = 15;
+        /** Number of member channels of the upper zone, 0 to 15 */
+        uint8_t upper_member_channels = 0;
+        /** Pitch bend range of member channels in semitones */
+        float member_bend_range = 48.f;
+        /** Pitch bend range of master channels in semitones */
+        float master_bend_range = 2.f;
+    };
+
+    /** The state of a voice */
+    struct Voice
+    {
+        bool     active; /**< The note is held */
+        Zone     zone;
+        uint8_t  channel;
+        uint8_t  note;
+        uint32_t velocity;         /**< Note On velocity */
+        uint32_t release_velocity; /**< Note Off velocity */
+        /** Pitch bend of the note, MIDI 2.0 per-note pitch bend */
+        uint32_t note_bend;
+        /** Last channel or poly pressure */
+        uint32_t pressure;
+        /** Last CC 74 of the channel, centered at 0x80000000 */
+        uint32_t timbre;
+        /** Increases with every Note On, to find the oldest voice */
+        uint32_t age;
+    };
+
+    MpeVoiceAllocator() { Init(); }
+
+    void Init(Config config = Config())
+    {
+        config_ = config;
+        age_    = 0;
+        for(size_t i = 0; i < num_voices; i++)
+        {
+            voices_[i]        = Voice();
+            voices_[i].timbre = UmpEvent::kCenter;
+        }
+        for(size_t ch = 0; ch < 16; ch++)
+        {
+            channels_[ch]        = ChannelState();
+            channels_[ch].bend   = UmpEvent::kCenter;
+            channels_[ch].timbre = UmpEvent::kCenter;
+            channels_[ch].rpn    = kNoRpn;
+        }
+        memset(voice_of_, kNoVoice, sizeof(voice_of_));
+        SetZones(config_.lower_member_channels, config_.upper_member_channels);
+    }
+
+    /** Processes a MIDI 1.0 event */
+    void Process(const MidiEvent& event)
+    {
+        Process(UmpEvent::FromMidiEvent(event));
+    }
+
+    /** Processes a MIDI 1.0 or MIDI 2.0 event */
+    void Process(const UmpEvent& event)
+    {
+        const uint8_t ch = event.channel & 0x0f;
+        switch(event.type)
+        {
+            case NoteOn: NoteOnEvent(event); break;
+            case NoteOff: Release(ch, event.note, event.value); break;
+            case PolyphonicKeyPressure:
+                if(Voice* voice = Find(ch, event.note))
+                    voice->pressure = event.value;
+                break;
+            case ChannelPressure:
+                channels_[ch].pressure = event.value;
+                ForEachVoice(ch, [&](Voice& v) { v.pressure = event.value; });
+                break;
+            case PitchBend:
+                if(!event.per_note)
+                    channels_[ch].bend = event.value;
+                else if(Voice* voice = Find(ch, event.note))
+                    voice->note_bend = event.value;
+                break;
+            case ControlChange:
+                if(!event.per_note)
+                    ControlChangeEvent(ch, event.index, event.value);
+                break;
+            default: break;
+        }
+    }
+
+    /** Returns a voice */
+    const Voice& GetVoice(size_t idx) const { return voices_[idx]; }
+
+    /** Returns the number of voices */
+    static constexpr size_t GetNumVoices() { return num_voices; }
+
+    /** Returns the pitch of a voice in semitones: the note with the pitch
+     *  bend of the note, its channel and the master channel of its zone.
+     */
+    float GetPitch(size_t idx) const
+    {
+        const Voice& voice = voices_[idx];
+        const bool   member
+            = voice.zone != Zone::NONE && !IsMaster(voice.channel);
+        const float range
+            = member ? config_.member_bend_range : config_.master_bend_range;
+        float pitch = voice.note
+                      + range * Bipolar(channels_[voice.channel].bend)
+                      + config_.member_bend_range * Bipolar(voice.note_bend);
+        if(member)
+            pitch += config_.master_bend_range
+                     * Bipolar(channels_[MasterChannel(voice.zone)].bend);
+        return pitch;
+    }
+
+    /** Returns the pressure of a voice from 0 to 1 */
+    float GetPressure(size_t idx) const
+    {
+        return voices_[idx].pressure / 4294967295.f;
+    }
+
+    /** Returns the timbre (CC 74) of a voice from 0 to 1 */
+    float GetTimbre(size_t idx) const
+    {
+        return voices_[idx].timbre / 4294967295.f;
+    }
+
+    /** Returns the zone a channel belongs to */
+    Zone GetZone(uint8_t channel) const { return zone_of_[channel & 0x0f]; }
+
+    /** Returns the number of member channels of a zone */
+    uint8_t GetNumMemberChannels(Zone zone) const
+    {
+        return zone == Zone::LOWER   ? lower_members_
+               : zone == Zone::UPPER ? upper_members_
+                                     : 0;
+    }
+
+    /** Releases all voices */
+    void AllNotesOff()
+    {
+        for(size_t ch = 0; ch < 16; ch++)
+            ReleaseChannel(ch);
+    }
+
+  private:
+    struct ChannelState
+    {
+        uint32_t bend;
+        uint32_t pressure;
+        uint32_t timbre;
+        uint16_t rpn; /**< selected RPN, MSB and LSB */
+    };
+
+    static constexpr uint8_t  kNoVoice      = 0xff;
+    static constexpr uint16_t kNoRpn        = 0x3fff;
+    static constexpr uint16_t kRpnBendRange = 0x0000;
+    static constexpr uint16_t kRpnMpeConfig = 0x0006;
+
+    static float Bipolar(uint32_t value)
+    {
+        return static_cast<int32_t>(value - UmpEvent::kCenter) / 2147483648.f;
+    }
+
+    static uint8_t MasterChannel(Zone zone)
+    {
+        return zone == Zone::UPPER ? 15 : 0;
+    }
+
+    bool IsMaster(uint8_t channel) const
+    {
+        return zone_of_[channel] != Zone::NONE
+               && channel == MasterChannel(zone_of_[channel]);
+    }
+
+    void SetZones(uint8_t lower, uint8_t upper)
+    {
+        lower_members_ = lower > 15 ? 15 : lower;
+        upper_members_ = upper > 15 ? 15 : upper;
+        // If the zones overlap, the upper zone gives up channels
+        if(lower_members_ > 0 && lower_members_ + upper_members_ > 14)
+            upper_members_ = lower_members_ >= 14 ? 0 : 14 - lower_members_;
+        for(uint8_t ch = 0; ch < 16; ch++)
+            zone_of_[ch] = Zone::NONE;
+        if(lower_members_ > 0)
+            for(uint8_t ch = 0; ch <= lower_members_; ch++)
+                zone_of_[ch] = Zone::LOWER;
+        if(upper_members_ > 0)
+            for(uint8_t ch = 15 - upper_members_; ch < 16; ch++)
+                zone_of_[ch] = Zone::UPPER;
+    }
+
+    Voice* Find(uint8_t channel, uint8_t note)
+    {
+        const uint8_t idx = voice_of_[channel][note & 0x7f];
+        return idx == kNoVoice ? nullptr : &voices_[idx];
+    }
+
+    template <typename Func>
+    void ForEachVoice(uint8_t channel, Func&& func)
+    {
+        for(size_t i = 0; i < num_voices; i++)
+            if(voices_[i].active && voices_[i].channel == channel)
+                func(voices_[i]);
+    }
+
+    void NoteOnEvent(const UmpEvent& event)
+    {
+        const uint8_t ch    = event.channel & 0x0f;
+        const uint8_t note  = event.note & 0x7f;
+        Voice*        voice = Find(ch, note);
+        if(voice == nullptr)
+        {
+            // The free voice that was started first, or else the oldest
+            // held voice
+            size_t best = 0;
+            for(size_t i = 1; i < num_voices; i++)
+            {
+                const Voice& v = voices_[i];
+                const Voice& b = voices_[best];
+                if(v.active != b.active ? !v.active : v.age < b.age)
+                    best = i;
+            }
+            voice = &voices_[best];
+            if(voice->active)
+                voice_of_[voice->channel][voice->note] = kNoVoice;
+            voice_of_[ch][note] = best;
+        }
+        voice->active           = true;
+        voice->zone             = zone_of_[ch];
+        voice->channel          = ch;
+        voice->note             = note;
+        voice->velocity         = event.value;
+        voice->release_velocity = 0;
+        voice->note_bend        = UmpEvent::kCenter;
+        voice->pressure         = channels_[ch].pressure;
+        voice->timbre           = channels_[ch].timbre;
+        voice->age              = ++age_;
+    }
+
+    void Release(uint8_t channel, uint8_t note, uint32_t velocity)
+    {
+        Voice* voice = Find(channel, note);
+        if(voice == nullptr)
+            return;
+        voice->active                   = false;
+        voice->release_velocity         = velocity;
+        voice_of_[channel][note & 0x7f] = kNoVoice;
+    }
+
+    void ReleaseChannel(uint8_t channel)
+    {
+        ForEachVoice(channel, [&](Voice& v) { Release(channel, v.note, 0); });
+    }
+
+    void ControlChangeEvent(uint8_t ch, uint8_t controller, uint32_t value)
+    {
+        ChannelState& state  = channels_[ch];
+        const uint8_t value7 = UmpEvent::Downscale(value, 32, 7);
+        switch(controller)
+        {
+            case 74:
+                state.timbre = value;
+                ForEachVoice(ch, [&](Voice& v) { v.timbre = value; });
+                break;
+            case 101: state.rpn = (state.rpn & 0x7f) | (value7 << 7); break;
+            case 100: state.rpn = (state.rpn & 0x3f80) | value7; break;
+            case 6: DataEntry(ch, value7); break;
+            case 120: // All Sound Off
+            case 123: // All Notes Off
+                if(IsMaster(ch))
+                {
+                    for(uint8_t other = 0; other < 16; other++)
+                        if(zone_of_[other] == zone_of_[ch])
+                            ReleaseChannel(other);
+                }
+                else
+                {
+                    ReleaseChannel(ch);
+                }
+                break;
+            default: break;
+        }
+    }
+
+    void DataEntry(uint8_t ch, uint8_t value)
+    {
+        const uint16_t rpn = channels_[ch].rpn;
+        if(rpn == kRpnMpeConfig && (ch == 0 || ch == 15))
+        {
+            // The MPE Configuration Message sets up or removes a zone
+            AllNotesOff();
+            if(ch == 0)
+            {
+                SetZones(value, upper_members_);
+            }
+            else
+            {
+                // The upper zone takes its channels from the lower zone
+                const uint8_t upper = value > 15 ? 15 : value;
+                uint8_t       lower = lower_members_;
+                if(upper > 0 && lower + upper > 14)
+                    lower = upper >= 14 ? 0 : 14 - upper;
+                SetZones(lower, upper);
+            }
+        }
+        else if(rpn == kRpnBendRange && zone_of_[ch] != Zone::NONE)
+        {
+            if(IsMaster(ch))
+                config_.master_bend_range = value;
+            else
+                config_.member_bend_range = value;
+        }
+    }
+
+    Config       config_;
+    Voice        voices_[num_voices];
+    ChannelState channels_[16];
+    Zone         zone_of_[16];
+    uint8_t      voice_of_[16][128];
+    uint8_t      lower_members_, upper_members_;
+    uint32_t     age_;
+};
+
+} // namespace daisy
+
+#endif
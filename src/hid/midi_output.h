@@ -0,0 +1,298 @@
+#pragma once
+#ifndef DSY_MIDI_OUTPUT_H
+#define DSY_MIDI_OUTPUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "hid/MidiEvent.h"
+#include "util/ringbuffer.h"
+
+namespace daisy
+{
+/** @brief   Queue of outgoing MIDI messages with timestamps
+ *  @details Messages are scheduled with the time they should be sent at,
+ *           e.g. in samples or microseconds, and Render() turns the ones
+ *           that are due into bytes that can be sent in one transfer.
+ *
+ *           Schedule() can be called from one other context than Render(),
+ *           e.g. the audio callback. Messages wait in a lock-free queue
+ *           until Render() sorts them by time.
+ *
+ *           While rendering, status bytes are left out where running status
+ *           allows it, and Control Change, Pitch Bend and pressure messages
+ *           are dropped when the next due message of their channel updates
+ *           the same controller, note or channel. Controllers whose values
+ *           aren't continuous (bank select, data entry, RPN/NRPN and the
+ *           switches 64 to 69) are always sent.
+ *  @tparam  capacity number of messages that can wait to be sent,
+ *           a power of two
+ *  @ingroup midi
+ */
+template <size_t capacity = 64>
+class MidiOutputScheduler
+{
+  public:
+    struct Config
+    {
+        /** Leave out repeated status bytes of channel messages */
+        bool running_status = true;
+        /** Drop CC, pitch bend and pressure messages that are superseded
+         *  right away
+         */
+        bool coalesce = true;
+    };
+
+    MidiOutputScheduler() { Init(); }
+
+    void Init(Config config = Config())
+    {
+        config_        = config;
+        num_pending_   = 0;
+        last_status_   = 0;
+        num_dropped_   = 0;
+        num_coalesced_ = 0;
+        incoming_.Init();
+    }
+
+    /** Schedules a message
+     *  \param event a channel, System Common or System Real Time message.
+     *         SysEx isn't supported.
+     *  \param time when to send it, in the units passed to Render()
+     *  \return false if the message can't be sent or the queue is full
+     */
+    bool Schedule(const MidiEvent& event, uint32_t time)
+    {
+        if(EncodedSize(event) == 0)
+            return false;
+        Entry entry = {event, time};
+        return incoming_.TryWrite(entry);
+    }
+
+    /** Writes the messages that are due into a buffer, oldest first.
+     *  Messages that don't fit stay queued for the next call.
+     *  \param now the current time. Messages scheduled up to 2^31 units
+     *         before or after it are handled correctly.
+     *  \param out destination for the MIDI bytes
+     *  \param max_size size of out
+     *  \return the number of bytes written
+     */
+    size_t Render(uint32_t now, uint8_t* out, size_t max_size)
+    {
+        Sort();
+
+        size_t num_due = 0;
+        while(num_due < num_pending_
+              && int32_t(pending_[num_due].time - now) <= 0)
+            num_due++;
+        if(config_.coalesce && num_due > 1)
+            Coalesce(num_due);
+
+        size_t size = 0, done = 0;
+        for(; done < num_due; done++)
+        {
+            Entry& entry = pending_[done];
+            if(entry.event.type == MessageLast) // coalesced
+                continue;
+            uint8_t       msg[3];
+            const uint8_t last_status = last_status_;
+            const size_t  len         = Encode(entry.event, msg);
+            if(size + len > max_size)
+            {
+                last_status_ = last_status;
+                break;
+            }
+            memcpy(out + size, msg, len);
+            size += len;
+        }
+        num_pending_ -= done;
+        memmove(pending_, pending_ + done, num_pending_ * sizeof(Entry));
+        return size;
+    }
+
+    /** Drops every message that wasn't sent yet */
+    void Clear()
+    {
+        incoming_.Flush();
+        num_pending_ = 0;
+        last_status_ = 0;
+    }
+
+    /** Returns the number of messages that wait to be sent.
+     *  Messages scheduled since the last Render() aren't included.
+     */
+    size_t GetNumPending() const { return num_pending_; }
+
+    /** Returns the number of messages that were dropped because more
+     *  than capacity messages were waiting to be sent
+     */
+    uint32_t GetNumDropped() const { return num_dropped_; }
+
+    /** Returns the number of messages that were superseded */
+    uint32_t GetNumCoalesced() const { return num_coalesced_; }
+
+    /** Returns the number of bytes of a message without running status,
+     *  0 if it can't be sent
+     */
+    static size_t EncodedSize(const MidiEvent& event)
+    {
+        switch(event.type)
+        {
+            case ProgramChange:
+            case ChannelPressure: return 2;
+            case SystemCommon:
+                switch(event.sc_type)
+                {
+                    case MTCQuarterFrame:
+                    case SongSelect: return 2;
+                    case SongPositionPointer: return 3;
+                    case TuneRequest: return 1;
+                    default: return 0;
+                }
+            case SystemRealTime: return 1;
+            case MessageLast: return 0;
+            default: return 3;
+        }
+    }
+
+  private:
+    struct Entry
+    {
+        MidiEvent event;
+        uint32_t  time;
+    };
+
+    /** Moves the new messages into pending_, sorted by time.
+     *  Messages with the same time keep their order.
+     */
+    void Sort()
+    {
+        Entry entry;
+        while(incoming_.TryRead(entry))
+        {
+            if(num_pending_ == capacity)
+            {
+                num_dropped_++;
+                continue;
+            }
+            size_t i = num_pending_++;
+            while(i > 0 && int32_t(pending_[i - 1].time - entry.time) > 0)
+            {
+                pending_[i] = pending_[i - 1];
+                i--;
+            }
+            pending_[i] = entry;
+        }
+    }
+
+    /** Marks due messages that are superseded by the next due message of
+     *  their channel. Messages in between, like a note or a Program Change
+     *  after a bank select, keep the order of the updates meaningful.
+     */
+    void Coalesce(size_t num_due)
+    {
+        // the next message of each channel that is sent, num_due for none
+        size_t next[16];
+        for(size_t& n : next)
+            n = num_due;
+        for(size_t i = num_due; i-- > 0;)
+        {
+            MidiEvent& event = pending_[i].event;
+            if(event.type >= SystemCommon && event.type != ChannelMode)
+                continue;
+            const size_t chn = event.channel & 0x0f;
+            if(next[chn] < num_due
+               && Supersedes(pending_[next[chn]].event, event))
+            {
+                event.type = MessageLast;
+                num_coalesced_++;
+            }
+            else
+            {
+                next[chn] = i;
+            }
+        }
+    }
+
+    /** Returns true if later makes event obsolete */
+    static bool Supersedes(const MidiEvent& later, const MidiEvent& event)
+    {
+        if(later.type != event.type)
+            return false;
+        const uint8_t data0 = event.data[0] & 0x7f;
+        switch(event.type)
+        {
+            case ControlChange:
+                return (later.data[0] & 0x7f) == data0
+                       && IsContinuousController(data0);
+            case PolyphonicKeyPressure:
+                return (later.data[0] & 0x7f) == data0;
+            case PitchBend:
+            case ChannelPressure: return true;
+            default: return false;
+        }
+    }
+
+    /** Returns false for controllers whose every value matters */
+    static bool IsContinuousController(uint8_t cc)
+    {
+        switch(cc)
+        {
+            case 0:  // bank select
+            case 32: // bank select LSB
+            case 6:  // data entry
+            case 38: // data entry LSB
+                return false;
+            default:
+                // switches (sustain etc.), data increment/decrement and
+                // NRPN/RPN numbers, channel mode
+                return !(cc >= 64 && cc <= 69) && !(cc >= 96 && cc <= 101)
+                       && cc < 120;
+        }
+    }
+
+    /** Writes the bytes of a message, leaving out the status if allowed */
+    size_t Encode(const MidiEvent& event, uint8_t* msg)
+    {
+        const size_t size = EncodedSize(event);
+        uint8_t      status;
+        switch(event.type)
+        {
+            case SystemCommon: status = 0xf0 | event.sc_type; break;
+            case SystemRealTime:
+                // can be sent between the bytes of other messages,
+                // so it doesn't change the running status
+                msg[0] = 0xf8 | event.srt_type;
+                return 1;
+            case ChannelMode: status = 0xb0 | (event.channel & 0x0f); break;
+            default:
+                status = 0x80 | (event.type << 4) | (event.channel & 0x0f);
+                break;
+        }
+        const uint8_t data0 = event.type == ChannelMode
+                                  ? uint8_t(120 + event.cm_type)
+                                  : event.data[0] & 0x7f;
+        size_t len = 0;
+        if(!config_.running_status || status != last_status_)
+            msg[len++] = status;
+        // System Common messages cancel the running status
+        last_status_ = status < 0xf0 ? status : 0;
+        if(size > 1)
+            msg[len++] = data0;
+        if(size > 2)
+            msg[len++] = event.data[1] & 0x7f;
+        return len;
+    }
+
+    Config                      config_;
+    RingBuffer<Entry, capacity> incoming_;
+    Entry                       pending_[capacity];
+    size_t                      num_pending_;
+    uint8_t                     last_status_;
+    uint32_t                    num_dropped_;
+    uint32_t                    num_coalesced_;
+};
+
+} // namespace daisy
+
+#endif
@@ -4,9 +4,24 @@ using namespace daisy;
 
 bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
 {
-    // reset parser when status byte is received
     bool did_parse = false;
 
+    // System Real Time messages can be sent anywhere, even in the middle of
+    // other messages, and don't change the parser state
+    if(byte >= kSystemRealTimeStart)
+    {
+        if(event_out != nullptr)
+        {
+            *event_out          = MidiEvent();
+            event_out->type     = SystemRealTime;
+            event_out->channel  = 0;
+            event_out->srt_type = static_cast<SystemRealTimeType>(
+                byte & kSystemRealTimeMask);
+        }
+        return true;
+    }
+
+    // reset parser when status byte is received
     if((byte & kStatusByteMask) && pstate_ != ParserSysEx)
     {
         pstate_ = ParserEmpty;
@@ -21,8 +36,6 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                 incoming_message_.channel = byte & kChannelMask;
                 incoming_message_.type
                     = static_cast<MidiMessageType>((byte & kMessageMask) >> 4);
-                if((byte & 0xF8) == 0xF8)
-                    incoming_message_.type = SystemRealTime;
 
                 // Validate, and move on.
                 if(incoming_message_.type < MessageLast)
@@ -39,6 +52,8 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                         {
                             pstate_                             = ParserSysEx;
                             incoming_message_.sysex_message_len = 0;
+                            incoming_message_.sysex_handle
+                                = sysex_ != nullptr ? sysex_->Begin() : 0;
                         }
                         //short circuit
                         else if(incoming_message_.sc_type > SongSelect)
@@ -51,20 +66,6 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                             did_parse = true;
                         }
                     }
-                    else if(incoming_message_.type == SystemRealTime)
-                    {
-                        incoming_message_.srt_type
-                            = static_cast<SystemRealTimeType>(
-                                byte & kSystemRealTimeMask);
-
-                        //short circuit to start
-                        pstate_ = ParserEmpty;
-                        if(event_out != nullptr)
-                        {
-                            *event_out = incoming_message_;
-                        }
-                        did_parse = true;
-                    }
                     else // Channel Voice or Channel Mode
                     {
                         running_status_ = incoming_message_.type;
@@ -72,16 +73,13 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                 }
                 // Else we'll keep waiting for a valid incoming status byte
             }
-            else
+            else if(running_status_ != MessageLast)
             {
                 // Handle as running status
-                incoming_message_.type    = running_status_;
+                SetRunningStatusType(byte);
                 incoming_message_.data[0] = byte & kDataByteMask;
                 //check for single byte running status, really this only applies to channel pressure though
-                if(running_status_ == ChannelPressure
-                   || running_status_ == ProgramChange
-                   || incoming_message_.sc_type == MTCQuarterFrame
-                   || incoming_message_.sc_type == SongSelect)
+                if(HasOneDataByte())
                 {
                     //Send the single byte update
                     pstate_ = ParserEmpty;
@@ -101,10 +99,7 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
             if((byte & kStatusByteMask) == 0)
             {
                 incoming_message_.data[0] = byte & kDataByteMask;
-                if(running_status_ == ChannelPressure
-                   || running_status_ == ProgramChange
-                   || incoming_message_.sc_type == MTCQuarterFrame
-                   || incoming_message_.sc_type == SongSelect)
+                if(HasOneDataByte())
                 {
                     //these are just one data byte, so we short circuit back to start
                     pstate_ = ParserEmpty;
@@ -120,13 +115,9 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                 }
 
                 //ChannelModeMessages (reserved Control Changes)
-                if(running_status_ == ControlChange
-                   && incoming_message_.data[0] > 119)
+                if(incoming_message_.type == ControlChange)
                 {
-                    incoming_message_.type    = ChannelMode;
-                    running_status_           = ChannelMode;
-                    incoming_message_.cm_type = static_cast<ChannelModeType>(
-                        incoming_message_.data[0] - 120);
+                    SetRunningStatusType(byte);
                 }
             }
             else
@@ -173,11 +164,9 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
                 }
                 did_parse = true;
             }
-            else if(incoming_message_.sysex_message_len < SYSEX_BUFFER_LEN)
+            else if(sysex_ != nullptr
+                    && sysex_->Append(incoming_message_.sysex_handle, byte))
             {
-                incoming_message_
-                    .sysex_data[incoming_message_.sysex_message_len]
-                    = byte;
                 incoming_message_.sysex_message_len++;
             }
             break;
@@ -187,8 +176,18 @@ bool MidiParser::Parse(uint8_t byte, MidiEvent* event_out)
     return did_parse;
 }
 
+bool MidiParser::HasOneDataByte() const
+{
+    if(incoming_message_.type == SystemCommon)
+        return incoming_message_.sc_type == MTCQuarterFrame
+               || incoming_message_.sc_type == SongSelect;
+    return running_status_ == ChannelPressure
+           || running_status_ == ProgramChange;
+}
+
 void MidiParser::Reset()
 {
     pstate_                = ParserEmpty;
     incoming_message_.type = MessageLast;
+    running_status_        = MessageLast;
 }
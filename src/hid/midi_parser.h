@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "hid/MidiEvent.h"
+#include "hid/midi_sysex.h"
 
 namespace daisy
 {
@@ -18,7 +19,17 @@ class MidiParser
     MidiParser(){};
     ~MidiParser() {}
 
-    inline void Init() { Reset(); }
+    /**
+     * @brief Initializes the parser
+     *
+     * @param sysex Arena that receives the data of SysEx messages.
+     *              Without one, SysEx events have no data.
+     */
+    inline void Init(MidiSysExArenaBase *sysex = nullptr)
+    {
+        sysex_ = sysex;
+        Reset();
+    }
 
     /**
      * @brief Parse one MIDI byte. If the byte completes a parsed event,
@@ -33,6 +44,53 @@ class MidiParser
      */
     bool Parse(uint8_t byte, MidiEvent *event_out);
 
+    /**
+     * @brief Parses a block of MIDI bytes, and passes every parsed event
+     *        to a sink instead of copying it out. The events are the same
+     *        as the ones from calling Parse() for every byte, but channel
+     *        messages with running status are parsed two bytes at a time.
+     *
+     * @param data  Raw MIDI bytes to parse
+     * @param size  Number of bytes
+     * @param sink  Called as sink(const MidiEvent&) for every event, e.g.
+     *              a lambda or a visitor object with an operator()
+     * @return      The number of events that were parsed
+     */
+    template <typename Sink>
+    size_t ParseBlock(const uint8_t *data, size_t size, Sink &&sink)
+    {
+        const uint8_t *end        = data + size;
+        size_t         num_events = 0;
+        MidiEvent      event;
+        while(data < end)
+        {
+            // Fast path for running status, e.g. dense CC or note streams
+            if(pstate_ == ParserEmpty && HasTwoDataBytes(running_status_))
+            {
+                while(end - data >= 2
+                      && ((data[0] | data[1]) & kStatusByteMask) == 0)
+                {
+                    SetRunningStatusType(data[0]);
+                    incoming_message_.data[0] = data[0];
+                    incoming_message_.data[1] = data[1];
+                    if(running_status_ == NoteOn && data[1] == 0)
+                        incoming_message_.type = NoteOff;
+                    sink(static_cast<const MidiEvent &>(incoming_message_));
+                    num_events++;
+                    data += 2;
+                }
+                if(data == end)
+                    break;
+            }
+            if(Parse(*data++, &event))
+            {
+                sink(static_cast<const MidiEvent &>(event));
+                num_events++;
+            }
+        }
+        return num_events;
+    }
+
     /**
      * @brief Reset parser to default state
      */
@@ -47,9 +105,34 @@ class MidiParser
         ParserSysEx,
     };
 
-    ParserState     pstate_;
-    MidiEvent       incoming_message_;
-    MidiMessageType running_status_;
+    /** True if the incoming message has a single data byte */
+    bool HasOneDataByte() const;
+
+    /** True for channel messages with two data bytes */
+    static bool HasTwoDataBytes(MidiMessageType type)
+    {
+        return type != ProgramChange && type != ChannelPressure
+               && type < SystemCommon;
+    }
+
+    /** Sets the type of a channel message from the running status,
+     *  reserved Control Changes are Channel Mode messages
+     */
+    void SetRunningStatusType(uint8_t data0)
+    {
+        incoming_message_.type = running_status_;
+        if(running_status_ == ControlChange && data0 >= kFirstChannelMode)
+        {
+            incoming_message_.type = ChannelMode;
+            incoming_message_.cm_type
+                = static_cast<ChannelModeType>(data0 - kFirstChannelMode);
+        }
+    }
+
+    ParserState         pstate_;
+    MidiEvent           incoming_message_;
+    MidiMessageType     running_status_;
+    MidiSysExArenaBase *sysex_ = nullptr;
 
     // Masks to check for message type, and byte content
     const uint8_t kStatusByteMask     = 0x80;
@@ -57,6 +140,10 @@ class MidiParser
     const uint8_t kDataByteMask       = 0x7F;
     const uint8_t kChannelMask        = 0x0F;
     const uint8_t kSystemRealTimeMask = 0x07;
+
+    // First System Real Time status byte, and first Channel Mode controller
+    static constexpr uint8_t kSystemRealTimeStart = 0xF8;
+    static constexpr uint8_t kFirstChannelMode    = 120;
 };
 
 } // namespace daisy
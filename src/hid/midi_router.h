@@ -0,0 +1,326 @@
+#pragma once
+#ifndef DSY_MIDI_ROUTER_H
+#define DSY_MIDI_ROUTER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/MidiEvent.h"
+#include "util/ringbuffer.h"
+
+namespace daisy
+{
+/** @brief   Merges the events of several MIDI inputs into one stream
+ *  @details Each input port, e.g. a MidiUartHandler and a MidiUsbHandler,
+ *           is attached with Attach(), which makes the handler deliver its
+ *           events to the router instead of its own queue. Events are
+ *           timestamped when they arrive, filtered or remapped by the
+ *           rules, and wait in a lock-free queue per port, so every port
+ *           can be fed from its own interrupt.
+ *
+ *           Pop() and Process() return the events of all ports ordered by
+ *           their timestamps, and keep statistics of every port.
+ *
+ *           The data of SysEx events stays in the arena of the handler of
+ *           the port, use RoutedEvent::port to find it.
+ *  @tparam  num_ports number of input ports, at most 8
+ *  @tparam  queue_size number of events that can wait per port,
+ *           a power of two
+ *  @ingroup midi
+ */
+template <size_t num_ports = 4, size_t queue_size = 64>
+class MidiRouter
+{
+    static_assert(num_ports > 0 && num_ports <= 8,
+                  "A MidiRouter has between 1 and 8 ports");
+
+  public:
+    /** Decides what happens to the events that match it.
+     *  The first matching rule is used, events that match no rule pass
+     *  unchanged.
+     */
+    struct Rule
+    {
+        /** Input ports the rule applies to, one bit per port */
+        uint8_t ports = 0xff;
+        /** Channels the rule applies to, one bit per channel.
+         *  System messages match every channel.
+         */
+        uint16_t channels = 0xffff;
+        /** Message types the rule applies to, one bit per MidiMessageType */
+        uint16_t types = 0xffff;
+        /** Drop the event instead of remapping it */
+        bool drop = false;
+        /** Channel to move channel messages to, -1 to keep it */
+        int8_t channel = -1;
+        /** Semitones to transpose notes and poly pressure by.
+         *  Notes that end up out of range are dropped.
+         */
+        int8_t transpose = 0;
+    };
+
+    /** An event with the port it came from */
+    struct RoutedEvent
+    {
+        MidiEvent event;
+        /** When it arrived, in the units of Config::clock */
+        uint32_t time;
+        uint8_t  port;
+    };
+
+    /** Statistics of one port */
+    struct PortStats
+    {
+        /** Events that arrived */
+        uint32_t received;
+        /** Events that were dropped by a rule */
+        uint32_t filtered;
+        /** Events that were lost because the queue of the port was full */
+        uint32_t overflowed;
+        /** Events that were returned by Pop() */
+        uint32_t dispatched;
+        /** Time from arrival to Pop(): minimum, maximum and sum.
+         *  The difference of maximum and minimum is the jitter.
+         *  Without a clock, it's counted in events that arrived meanwhile.
+         */
+        uint32_t latency_min, latency_max;
+        uint64_t latency_sum;
+
+        /** Returns the mean time from arrival to Pop() */
+        float GetMeanLatency() const
+        {
+            return dispatched > 0 ? float(latency_sum) / dispatched : 0.f;
+        }
+    };
+
+    struct Config
+    {
+        /** Returns the current time for the timestamps, e.g. System::GetUs.
+         *  Without a clock, events are numbered in the order they arrive.
+         */
+        uint32_t (*clock)() = nullptr;
+    };
+
+    static constexpr size_t kMaxRules = 16;
+
+    MidiRouter() { Init(); }
+
+    /** Initializes the router. Rules and statistics are cleared, and ports
+     *  stay attached.
+     */
+    void Init(Config config = Config())
+    {
+        config_    = config;
+        num_rules_ = 0;
+        sequence_.store(0, std::memory_order_relaxed);
+        for(size_t i = 0; i < num_ports; i++)
+        {
+            ports_[i].router = this;
+            ports_[i].index  = i;
+            ports_[i].queue.Init();
+        }
+        ResetStats();
+    }
+
+    /** Makes a MidiHandler deliver its events to a port of the router.
+     *  Its own event queue isn't used anymore.
+     *  \param port index of the port
+     *  \param handler e.g. a MidiUartHandler or MidiUsbHandler
+     */
+    template <typename Handler>
+    void Attach(size_t port, Handler& handler)
+    {
+        if(port < num_ports)
+            handler.SetEventCallback(PortCallback, &ports_[port]);
+    }
+
+    /** Adds a rule. Don't change the rules while events arrive.
+     *  \return false if there already are kMaxRules rules
+     */
+    bool AddRule(const Rule& rule)
+    {
+        if(num_rules_ == kMaxRules)
+            return false;
+        rules_[num_rules_++] = rule;
+        return true;
+    }
+
+    /** Removes all rules */
+    void ClearRules() { num_rules_ = 0; }
+
+    /** Passes an event that arrived at a port to the router.
+     *  Only one context may push to each port.
+     *  \return false if it was dropped by a rule or the queue is full
+     */
+    bool Push(size_t port, const MidiEvent& event)
+    {
+        return Push(port, event, Now());
+    }
+
+    /** Passes an event that arrived at a port at the given time */
+    bool Push(size_t port, const MidiEvent& event, uint32_t time)
+    {
+        if(port >= num_ports)
+            return false;
+        Port& p = ports_[port];
+        p.stats.received++;
+        RoutedEvent routed = {event, time, uint8_t(port)};
+        if(!ApplyRules(routed))
+        {
+            p.stats.filtered++;
+            return false;
+        }
+        if(!p.queue.TryWrite(routed))
+        {
+            p.stats.overflowed++;
+            return false;
+        }
+        return true;
+    }
+
+    /** Returns the oldest event of all ports
+     *  \return false if there is none
+     */
+    bool Pop(RoutedEvent& out)
+    {
+        Port* oldest = nullptr;
+        for(size_t i = 0; i < num_ports; i++)
+        {
+            const auto span = ports_[i].queue.PrepareRead();
+            if(span.length > 0
+               && (oldest == nullptr
+                   || int32_t(span.data->time - out.time) < 0))
+            {
+                oldest = &ports_[i];
+                out    = *span.data;
+            }
+        }
+        if(oldest == nullptr)
+            return false;
+        oldest->queue.CommitRead(1);
+
+        PortStats&     stats   = oldest->stats;
+        const uint32_t latency = GetTime() - out.time;
+        stats.dispatched++;
+        stats.latency_sum += latency;
+        if(latency < stats.latency_min)
+            stats.latency_min = latency;
+        if(latency > stats.latency_max)
+            stats.latency_max = latency;
+        return true;
+    }
+
+    /** Calls a function with every event that waits, in order
+     *  \return the number of events
+     */
+    template <typename Callback>
+    size_t Process(Callback&& callback)
+    {
+        size_t      count = 0;
+        RoutedEvent event;
+        while(Pop(event))
+        {
+            callback(event);
+            count++;
+        }
+        return count;
+    }
+
+    /** Returns the number of events that wait */
+    size_t GetNumWaiting() const
+    {
+        size_t count = 0;
+        for(size_t i = 0; i < num_ports; i++)
+            count += ports_[i].queue.readable();
+        return count;
+    }
+
+    /** Returns the statistics of a port */
+    const PortStats& GetStats(size_t port) const { return ports_[port].stats; }
+
+    void ResetStats()
+    {
+        for(size_t i = 0; i < num_ports; i++)
+        {
+            ports_[i].stats             = PortStats();
+            ports_[i].stats.latency_min = UINT32_MAX;
+        }
+    }
+
+  private:
+    struct Port
+    {
+        MidiRouter*                         router;
+        size_t                              index;
+        RingBuffer<RoutedEvent, queue_size> queue;
+        PortStats                           stats;
+    };
+
+    static void PortCallback(const MidiEvent& event, void* context)
+    {
+        Port* port = static_cast<Port*>(context);
+        port->router->Push(port->index, event);
+    }
+
+    /** Returns the timestamp for an event that arrives now */
+    uint32_t Now()
+    {
+        if(config_.clock != nullptr)
+            return config_.clock();
+        return sequence_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Returns the current time, without a clock the number of events
+     *  that arrived so far
+     */
+    uint32_t GetTime() const
+    {
+        if(config_.clock != nullptr)
+            return config_.clock();
+        return sequence_.load(std::memory_order_relaxed);
+    }
+
+    /** Applies the first matching rule
+     *  \return false if the event is dropped
+     */
+    bool ApplyRules(RoutedEvent& routed) const
+    {
+        MidiEvent&    event      = routed.event;
+        const bool    is_channel = event.type < SystemCommon
+                                || event.type == ChannelMode;
+        const uint8_t channel    = is_channel ? event.channel & 0x0f : 0;
+        for(size_t i = 0; i < num_rules_; i++)
+        {
+            const Rule& rule = rules_[i];
+            if(!(rule.ports & (1 << routed.port))
+               || !(rule.types & (1 << event.type))
+               || (is_channel && !(rule.channels & (1 << channel))))
+                continue;
+            if(rule.drop)
+                return false;
+            if(is_channel && rule.channel >= 0)
+                event.channel = rule.channel & 0x0f;
+            if(rule.transpose != 0
+               && (event.type == NoteOn || event.type == NoteOff
+                   || event.type == PolyphonicKeyPressure))
+            {
+                const int note = event.data[0] + rule.transpose;
+                if(note < 0 || note > 127)
+                    return false;
+                event.data[0] = note;
+            }
+            return true;
+        }
+        return true;
+    }
+
+    Config                config_;
+    Port                  ports_[num_ports];
+    Rule                  rules_[kMaxRules];
+    size_t                num_rules_;
+    std::atomic<uint32_t> sequence_;
+};
+
+} // namespace daisy
+
+#endif
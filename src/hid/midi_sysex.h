@@ -0,0 +1,130 @@
+#pragma once
+#ifndef DSY_MIDI_SYSEX_H
+#define DSY_MIDI_SYSEX_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/MidiEvent.h"
+
+namespace daisy
+{
+/** @brief   Byte storage for the data of received SysEx messages
+ *  @details SysEx data doesn't fit into the compact MidiEvent, so the
+ *           parser writes it into this circular arena, and the MidiEvent
+ *           references it with its `sysex_handle`. The arena is never
+ *           full: new data overwrites the oldest data, so the data of an
+ *           event stays valid until the capacity of the arena has been
+ *           received after it. Messages longer than the capacity are
+ *           truncated.
+ *
+ *           The parser (e.g. running in an interrupt) may write while
+ *           the data is read elsewhere. Read() detects if the data was
+ *           overwritten in the meantime.
+ *  @ingroup midi
+ */
+class MidiSysExArenaBase
+{
+  public:
+    /** Returns the number of bytes the arena can store */
+    size_t GetCapacity() const { return size_t(mask_) + 1; }
+
+    /** Starts a new message
+     *  \return the handle of the message
+     */
+    uint16_t Begin() const { return write_.load(std::memory_order_relaxed); }
+
+    /** Appends a byte to the message that was started with Begin()
+     *  \return false if the message already fills the arena
+     */
+    bool Append(uint16_t handle, uint8_t byte)
+    {
+        const uint16_t pos = write_.load(std::memory_order_relaxed);
+        if(uint16_t(pos - handle) > mask_)
+            return false;
+        buffer_[pos & mask_] = byte;
+        write_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Checks if the data of a SysEx event is still in the arena */
+    bool IsValid(const MidiEvent& event) const
+    {
+        return IsValid(event, write_.load(std::memory_order_acquire));
+    }
+
+    /** Copies the data of a SysEx event
+     *  \param event a SysEx event
+     *  \param dst destination for the data
+     *  \param max_len number of bytes that fit into dst
+     *  \return the number of bytes copied, 0 if the data was overwritten
+     */
+    size_t Read(const MidiEvent& event, uint8_t* dst, size_t max_len) const
+    {
+        if(!IsValid(event))
+            return 0;
+        const size_t len = event.sysex_message_len < max_len
+                               ? event.sysex_message_len
+                               : max_len;
+        for(size_t i = 0; i < len; i++)
+            dst[i] = buffer_[uint16_t(event.sysex_handle + i) & mask_];
+        // Check again, in case the parser overwrote it while copying
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return IsValid(event) ? len : 0;
+    }
+
+    /** Returns up to the first SYSEX_BUFFER_LEN bytes of a SysEx event
+     *  as a SystemExclusiveEvent. Its length is 0 if the data was
+     *  overwritten.
+     */
+    SystemExclusiveEvent AsSystemExclusive(const MidiEvent& event) const
+    {
+        SystemExclusiveEvent m = {};
+        m.length               = Read(event, m.data, SYSEX_BUFFER_LEN);
+        return m;
+    }
+
+  protected:
+    MidiSysExArenaBase(uint8_t* buffer, size_t size)
+    : buffer_(buffer), mask_(uint16_t(size - 1)), write_(0)
+    {
+    }
+
+  private:
+    MidiSysExArenaBase(const MidiSysExArenaBase&) = delete;
+    MidiSysExArenaBase& operator=(const MidiSysExArenaBase&) = delete;
+
+    bool IsValid(const MidiEvent& event, uint16_t pos) const
+    {
+        return event.type == SystemCommon && event.sc_type == SystemExclusive
+               && uint16_t(pos - event.sysex_handle) <= size_t(mask_) + 1
+               && uint16_t(pos - event.sysex_handle)
+                      >= event.sysex_message_len;
+    }
+
+    uint8_t* const        buffer_;
+    const uint16_t        mask_;
+    std::atomic<uint16_t> write_;
+};
+
+/** @brief A MidiSysExArenaBase with a fixed size
+ *  @tparam size number of bytes, a power of two of at most 32768
+ *  @ingroup midi
+ */
+template <size_t size>
+class MidiSysExArena : public MidiSysExArenaBase
+{
+    static_assert(size > 0 && size <= 32768 && (size & (size - 1)) == 0,
+                  "The size of a MidiSysExArena must be a power of two "
+                  "of at most 32768");
+
+  public:
+    MidiSysExArena() : MidiSysExArenaBase(storage_, size) {}
+
+  private:
+    uint8_t storage_[size];
+};
+
+} // namespace daisy
+
+#endif
@@ -0,0 +1,246 @@
+#include "hid/midi_ump.h"
+
+using namespace daisy;
+
+namespace
+{
+// UMP message types
+constexpr uint8_t kMidi1ChannelVoice = 0x2;
+constexpr uint8_t kMidi2ChannelVoice = 0x4;
+
+// MIDI 2.0 channel voice opcodes that aren't MIDI 1.0 status nibbles
+constexpr uint8_t kAssignablePerNoteController = 0x1;
+constexpr uint8_t kPerNotePitchBend            = 0x6;
+
+constexpr uint8_t kFirstChannelMode = 120;
+} // namespace
+
+constexpr uint32_t UmpEvent::kCenter;
+
+UmpEvent UmpEvent::FromMidiEvent(const MidiEvent& event, uint8_t group)
+{
+    UmpEvent ump = {};
+    ump.type     = event.type;
+    ump.group    = group & 0x0f;
+    ump.channel  = event.channel & 0x0f;
+    switch(event.type)
+    {
+        case NoteOn:
+            // Velocity 0 is a Note Off in MIDI 1.0 only
+            if(event.data[1] == 0)
+                ump.type = NoteOff;
+            // fall through
+        case NoteOff:
+        case PolyphonicKeyPressure:
+            ump.note  = event.data[0] & 0x7f;
+            ump.value = Upscale(event.data[1] & 0x7f, 7, 32);
+            break;
+        case ControlChange:
+            ump.index = event.data[0] & 0x7f;
+            ump.value = Upscale(event.data[1] & 0x7f, 7, 32);
+            break;
+        case ChannelMode:
+            ump.type  = ControlChange;
+            ump.index = kFirstChannelMode + event.cm_type;
+            ump.value = Upscale(event.data[1] & 0x7f, 7, 32);
+            break;
+        case ProgramChange: ump.index = event.data[0] & 0x7f; break;
+        case ChannelPressure:
+            ump.value = Upscale(event.data[0] & 0x7f, 7, 32);
+            break;
+        case PitchBend:
+            ump.value = Upscale(
+                (event.data[0] & 0x7f) | ((event.data[1] & 0x7f) << 7), 14, 32);
+            break;
+        default: ump.type = MessageLast; break;
+    }
+    return ump;
+}
+
+bool UmpEvent::ToMidiEvent(MidiEvent* event) const
+{
+    if(per_note || type >= SystemCommon)
+        return false;
+    *event         = MidiEvent();
+    event->type    = type;
+    event->channel = channel;
+    switch(type)
+    {
+        case NoteOn:
+        case NoteOff:
+        case PolyphonicKeyPressure:
+            event->data[0] = note;
+            event->data[1] = Downscale(value, 32, 7);
+            // Velocity 0 would turn a Note On into a Note Off
+            if(type == NoteOn && event->data[1] == 0)
+                event->data[1] = 1;
+            break;
+        case ControlChange:
+            if(index >= kFirstChannelMode)
+            {
+                event->type = ChannelMode;
+                event->cm_type
+                    = static_cast<ChannelModeType>(index - kFirstChannelMode);
+            }
+            event->data[0] = index;
+            event->data[1] = Downscale(value, 32, 7);
+            break;
+        case ProgramChange: event->data[0] = index; break;
+        case ChannelPressure: event->data[0] = Downscale(value, 32, 7); break;
+        case PitchBend:
+        {
+            const uint32_t bend = Downscale(value, 32, 14);
+            event->data[0]      = bend & 0x7f;
+            event->data[1]      = bend >> 7;
+            break;
+        }
+        default: return false;
+    }
+    return true;
+}
+
+size_t UmpEvent::Encode(uint32_t* words) const
+{
+    uint8_t  opcode;
+    uint8_t  byte2 = 0, byte3 = 0;
+    uint32_t data  = value;
+    switch(type)
+    {
+        case NoteOff:
+        case NoteOn:
+            opcode = type == NoteOn ? 0x9 : 0x8;
+            byte2  = note;
+            data   = value & 0xffff0000; // 16 bit velocity, no attribute
+            break;
+        case PolyphonicKeyPressure:
+            opcode = 0xa;
+            byte2  = note;
+            break;
+        case ControlChange:
+            opcode = per_note ? kAssignablePerNoteController : 0xb;
+            byte2  = per_note ? note : index;
+            byte3  = per_note ? index : 0;
+            break;
+        case ProgramChange:
+            opcode = 0xc;
+            data   = uint32_t(index) << 24;
+            break;
+        case ChannelPressure: opcode = 0xd; break;
+        case PitchBend:
+            opcode = per_note ? kPerNotePitchBend : 0xe;
+            byte2  = per_note ? note : 0;
+            break;
+        default: return 0;
+    }
+    words[0] = (uint32_t(kMidi2ChannelVoice) << 28)
+               | (uint32_t(group & 0x0f) << 24)
+               | (uint32_t(opcode) << 20) | (uint32_t(channel & 0x0f) << 16)
+               | (uint32_t(byte2 & 0x7f) << 8) | byte3;
+    words[1] = data;
+    return 2;
+}
+
+uint32_t UmpEvent::Upscale(uint32_t value, uint8_t src_bits, uint8_t dst_bits)
+{
+    const uint8_t  scale_bits = dst_bits - src_bits;
+    uint32_t       result     = value << scale_bits;
+    const uint32_t center     = 1u << (src_bits - 1);
+    if(value <= center)
+        return result;
+
+    // Above the center, the lower bits are repeated so the maximum
+    // stays the maximum
+    const uint8_t repeat_bits = src_bits - 1;
+    uint32_t      repeat      = value & ((1u << repeat_bits) - 1);
+    if(scale_bits > repeat_bits)
+        repeat <<= scale_bits - repeat_bits;
+    else
+        repeat >>= repeat_bits - scale_bits;
+    while(repeat != 0)
+    {
+        result |= repeat;
+        repeat >>= repeat_bits;
+    }
+    return result;
+}
+
+size_t UmpParser::GetPacketSize(uint32_t first_word)
+{
+    static const uint8_t kPacketSizes[16]
+        = {1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4};
+    return kPacketSizes[first_word >> 28];
+}
+
+bool UmpParser::Parse(uint32_t word, UmpEvent* event_out)
+{
+    words_[num_words_++] = word;
+    if(num_words_ < GetPacketSize(words_[0]))
+        return false;
+    num_words_ = 0;
+
+    const uint32_t first   = words_[0];
+    const uint8_t  mt      = first >> 28;
+    const uint8_t  group   = (first >> 24) & 0x0f;
+    const uint8_t  opcode  = (first >> 20) & 0x0f;
+    const uint8_t  channel = (first >> 16) & 0x0f;
+    const uint8_t  byte2   = (first >> 8) & 0x7f;
+    const uint8_t  byte3   = first & 0x7f;
+
+    if(mt == kMidi1ChannelVoice)
+    {
+        if(opcode < 0x8 || opcode > 0xe)
+            return false;
+        MidiEvent event = {};
+        event.type      = static_cast<MidiMessageType>(opcode - 0x8);
+        event.channel   = channel;
+        event.data[0]   = byte2;
+        event.data[1]   = byte3;
+        *event_out      = UmpEvent::FromMidiEvent(event, group);
+        return true;
+    }
+    if(mt != kMidi2ChannelVoice)
+        return false;
+
+    UmpEvent event = {};
+    event.group    = group;
+    event.channel  = channel;
+    event.value    = words_[1];
+    switch(opcode)
+    {
+        case kAssignablePerNoteController:
+            event.type     = ControlChange;
+            event.per_note = true;
+            event.note     = byte2;
+            event.index    = byte3;
+            break;
+        case kPerNotePitchBend:
+            event.type     = PitchBend;
+            event.per_note = true;
+            event.note     = byte2;
+            break;
+        case 0x8:
+        case 0x9:
+            event.type  = opcode == 0x9 ? NoteOn : NoteOff;
+            event.note  = byte2;
+            event.value = UmpEvent::Upscale(words_[1] >> 16, 16, 32);
+            break;
+        case 0xa:
+            event.type = PolyphonicKeyPressure;
+            event.note = byte2;
+            break;
+        case 0xb:
+            event.type  = ControlChange;
+            event.index = byte2;
+            break;
+        case 0xc:
+            event.type  = ProgramChange;
+            event.index = (words_[1] >> 24) & 0x7f;
+            event.value = 0;
+            break;
+        case 0xd: event.type = ChannelPressure; break;
+        case 0xe: event.type = PitchBend; break;
+        default: return false; // (N)RPN, relative and management messages
+    }
+    *event_out = event;
+    return true;
+}
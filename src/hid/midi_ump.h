@@ -0,0 +1,137 @@
+#pragma once
+#ifndef DSY_MIDI_UMP_H
+#define DSY_MIDI_UMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hid/MidiEvent.h"
+
+namespace daisy
+{
+/** @brief   A channel voice message with MIDI 2.0 resolution
+ *  @details Values have 32 bits, so MIDI 1.0 and MIDI 2.0 messages can be
+ *           handled the same way. MIDI 1.0 values are scaled up as the
+ *           MIDI 2.0 spec describes, so the center value of a 7 or 14 bit
+ *           controller stays the center.
+ *  @ingroup midi
+ */
+struct UmpEvent
+{
+    /** NoteOff, NoteOn, PolyphonicKeyPressure, ControlChange, ProgramChange,
+     *  ChannelPressure or PitchBend. MessageLast if there is no event.
+     *  Channel mode messages are Control Changes 120 to 127.
+     */
+    MidiMessageType type;
+    uint8_t         group;   /**< UMP group, 0 to 15 */
+    uint8_t         channel; /**< 0 to 15 */
+    /** Note of note and poly pressure messages, and of per-note messages */
+    uint8_t note;
+    /** Controller of Control Change, program of Program Change */
+    uint8_t index;
+    /** For PitchBend and ControlChange: the message only applies to
+     *  `note`. These are the MIDI 2.0 per-note pitch bend and assignable
+     *  per-note controller messages.
+     */
+    bool per_note;
+    /** Velocity, controller value, pressure or pitch bend.
+     *  Pitch bend is centered at 0x80000000.
+     */
+    uint32_t value;
+
+    /** Center of pitch bend and bipolar controllers */
+    static constexpr uint32_t kCenter = 0x80000000;
+
+    /** Converts a MIDI 1.0 event
+     *  \param event the event
+     *  \param group the UMP group to use
+     *  \return an event of type MessageLast if it isn't a channel voice message
+     */
+    static UmpEvent FromMidiEvent(const MidiEvent& event, uint8_t group = 0);
+
+    /** Converts to a MIDI 1.0 event, losing resolution
+     *  \return false for per-note messages, which don't exist in MIDI 1.0
+     */
+    bool ToMidiEvent(MidiEvent* event) const;
+
+    /** Writes the event as a MIDI 2.0 channel voice packet
+     *  \param words destination for the 2 words of the packet
+     *  \return the number of words written, 0 if there is no event
+     */
+    size_t Encode(uint32_t* words) const;
+
+    /** Returns a pitch bend value from -1 to 1 */
+    float GetBipolar() const
+    {
+        return static_cast<int32_t>(value - kCenter) / 2147483648.f;
+    }
+
+    /** Returns a value from 0 to 1 */
+    float GetUnipolar() const { return value / 4294967295.f; }
+
+    /** Scales a value up to more bits with the min-center-max scaling of
+     *  the MIDI 2.0 spec
+     */
+    static uint32_t Upscale(uint32_t value, uint8_t src_bits, uint8_t dst_bits);
+
+    /** Scales a value down to fewer bits */
+    static uint32_t
+    Downscale(uint32_t value, uint8_t src_bits, uint8_t dst_bits)
+    {
+        return value >> (src_bits - dst_bits);
+    }
+};
+
+/** @brief   Parses Universal MIDI Packets (UMP) into UmpEvents
+ *  @details Takes one 32 bit word at a time. MIDI 1.0 (message type 0x2)
+ *           and MIDI 2.0 (message type 0x4) channel voice messages become
+ *           events, all other packets are skipped.
+ *  @ingroup midi
+ */
+class UmpParser
+{
+  public:
+    UmpParser() { Reset(); }
+
+    /** Parses a word of a packet
+     *  \param word the next word
+     *  \param event_out receives the event if the word completed one
+     *  \return true if an event was parsed
+     */
+    bool Parse(uint32_t word, UmpEvent* event_out);
+
+    /** Parses a block of words and passes every event to a sink
+     *  \param words the words
+     *  \param size number of words
+     *  \param sink called as sink(const UmpEvent&) for every event
+     *  \return the number of events
+     */
+    template <typename Sink>
+    size_t ParseBlock(const uint32_t* words, size_t size, Sink&& sink)
+    {
+        size_t   num_events = 0;
+        UmpEvent event;
+        for(size_t i = 0; i < size; i++)
+        {
+            if(Parse(words[i], &event))
+            {
+                sink(static_cast<const UmpEvent&>(event));
+                num_events++;
+            }
+        }
+        return num_events;
+    }
+
+    /** Forgets a partly received packet */
+    void Reset() { num_words_ = 0; }
+
+    /** Returns the number of words of a packet from its first word */
+    static size_t GetPacketSize(uint32_t first_word);
+
+  private:
+    uint32_t words_[4];
+    size_t   num_words_;
+};
+
+} // namespace daisy
+
+#endif
@@ -2,6 +2,7 @@
 #include "usbd_cdc.h"
 #include "usbh_midi.h"
 #include "hid/usb_midi.h"
+#include "hid/usb_midi_packetizer.h"
 #include <cassert>
 
 extern "C"
@@ -26,16 +27,34 @@ class MidiUsbTransport::Impl
         parse_context_  = context;
     }
 
-    bool RxActive() { return rx_active_; }
-    void FlushRx() { rx_buffer_.Flush(); }
-    void Tx(uint8_t* buffer, size_t size);
+    bool   RxActive() { return rx_active_; }
+    void   FlushRx() { rx_buffer_.Flush(); }
+    void   Tx(uint8_t* buffer, size_t size);
+    size_t TxAsync(const uint8_t* buffer, size_t size);
+    void   FlushTx() { StartTransmit(); }
+    bool   TxBusy() const
+    {
+        return tx_size_ + UsbMidiPacketizer::kPacketSize > kTxBufferSize;
+    }
 
     void UsbToMidi(uint8_t* buffer, uint8_t length);
-    void MidiToUsb(uint8_t* buffer, size_t length);
     void Parse();
 
   private:
-    void MidiToUsbSingle(uint8_t* buffer, size_t length);
+    /** Converts as many bytes as fit into the packets to send next */
+    size_t Append(const uint8_t* buffer, size_t size);
+
+    /** Starts sending the collected packets, unless the last transfer
+     *  is still running
+     *  \return false if the packets couldn't be sent yet
+     */
+    bool StartTransmit();
+
+    /** Calls StartTransmit(), retrying up to tx_retry_count times */
+    bool Transmit();
+
+    /** Discards the packets that couldn't be sent */
+    void DropTx();
 
     /** USB Handle for CDC transfers
          */
@@ -49,9 +68,12 @@ class MidiUsbTransport::Impl
     MidiRxParseCallback              parse_callback_;
     void*                            parse_context_;
 
-    // simple, self-managed buffer
-    uint8_t tx_buffer_[kBufferSize];
-    size_t  tx_ptr_;
+    // Packets are collected in one buffer while the other one is sent
+    static constexpr size_t kTxBufferSize = 256;
+    UsbMidiPacketizer       packetizer_;
+    uint8_t                 tx_buffer_[2][kTxBufferSize];
+    size_t                  tx_size_;
+    uint8_t                 tx_fill_;
 
     // MIDI message size determined by the
     // code index number. You can find this
@@ -105,6 +127,9 @@ void MidiUsbTransport::Impl::Init(Config config)
 
     config_    = config;
     rx_active_ = false;
+    tx_size_   = 0;
+    tx_fill_   = 0;
+    packetizer_.Init();
 
     if(config_.periph == Config::HOST)
     {
@@ -129,35 +154,89 @@ void MidiUsbTransport::Impl::Init(Config config)
 
 void MidiUsbTransport::Impl::Tx(uint8_t* buffer, size_t size)
 {
-    int  attempt_count = config_.tx_retry_count;
-    bool should_retry;
-
-    MidiToUsb(buffer, size);
-    do
+    size_t done = Append(buffer, size);
+    while(done < size)
     {
-        if(config_.periph == Config::HOST)
+        // The buffer is full, so it has to be sent first
+        if(!Transmit())
         {
-            MIDI_ErrorTypeDef result;
-            result       = USBH_MIDI_Transmit(pUSB_Host, tx_buffer_, tx_ptr_);
-            should_retry = (result == MIDI_BUSY) && attempt_count--;
+            DropTx();
+            return;
         }
+        done += Append(buffer + done, size - done);
+    }
+
+    // With batching, the packets wait for the next transfer if the
+    // last one is still running
+    if(config_.tx_batching)
+        StartTransmit();
+    else if(!Transmit())
+        DropTx();
+}
+
+size_t MidiUsbTransport::Impl::TxAsync(const uint8_t* buffer, size_t size)
+{
+    size_t done = Append(buffer, size);
+    if(StartTransmit() && done < size)
+        done += Append(buffer + done, size - done);
+    return done;
+}
+
+size_t MidiUsbTransport::Impl::Append(const uint8_t* buffer, size_t size)
+{
+    return packetizer_.Packetize(
+        buffer, size, tx_buffer_[tx_fill_], kTxBufferSize, tx_size_);
+}
+
+bool MidiUsbTransport::Impl::StartTransmit()
+{
+    if(tx_size_ == 0)
+        return true;
+
+    bool started;
+    if(config_.periph == Config::HOST)
+    {
+        started = USBH_MIDI_Transmit(pUSB_Host, tx_buffer_[tx_fill_], tx_size_)
+                  == MIDI_OK;
+    }
+    else
+    {
+        UsbHandle::Result result;
+        if(config_.periph == Config::EXTERNAL)
+            result = usb_handle_.TransmitExternal(tx_buffer_[tx_fill_],
+                                                  tx_size_);
         else
-        {
-            UsbHandle::Result result;
-            if(config_.periph == Config::EXTERNAL)
-                result = usb_handle_.TransmitExternal(tx_buffer_, tx_ptr_);
-            else
-                result = usb_handle_.TransmitInternal(tx_buffer_, tx_ptr_);
-            should_retry
-                = (result == UsbHandle::Result::ERR) && attempt_count--;
-        }
+            result = usb_handle_.TransmitInternal(tx_buffer_[tx_fill_],
+                                                  tx_size_);
+        started = result == UsbHandle::Result::OK;
+    }
 
+    // The transfer could only start if the previous one has finished,
+    // so the other buffer is free now
+    if(started)
+    {
+        tx_fill_ ^= 1;
+        tx_size_ = 0;
+    }
+    return started;
+}
 
-        if(should_retry)
-            System::DelayUs(100);
-    } while(should_retry);
+bool MidiUsbTransport::Impl::Transmit()
+{
+    int attempt_count = config_.tx_retry_count;
+    while(!StartTransmit())
+    {
+        if(attempt_count-- <= 0)
+            return false;
+        System::DelayUs(100);
+    }
+    return true;
+}
 
-    tx_ptr_ = 0;
+void MidiUsbTransport::Impl::DropTx()
+{
+    tx_size_ = 0;
+    packetizer_.Init();
 }
 
 void MidiUsbTransport::Impl::UsbToMidi(uint8_t* buffer, uint8_t length)
@@ -184,9 +263,7 @@ void MidiUsbTransport::Impl::UsbToMidi(uint8_t* buffer, uint8_t length)
     // Only writing as many bytes as necessary
     for(uint8_t i = 0; i < code_index_size_[code_index]; i++)
     {
-        if(rx_buffer_.writable() > 0)
-            rx_buffer_.Write(buffer[1 + i]);
-        else
+        if(!rx_buffer_.TryWrite(buffer[1 + i]))
         {
             rx_active_ = false; // disable on overflow
             break;
@@ -194,139 +271,12 @@ void MidiUsbTransport::Impl::UsbToMidi(uint8_t* buffer, uint8_t length)
     }
 }
 
-void MidiUsbTransport::Impl::MidiToUsbSingle(uint8_t* buffer, size_t size)
-{
-    if(size == 0)
-        return;
-
-    // Channel voice messages
-    if((buffer[0] & 0xF0) != 0xF0)
-    {
-        // Check message validity
-        if((buffer[0] & 0xF0) == 0xC0 || (buffer[0] & 0xF0) == 0xD0)
-        {
-            if(size != 2)
-                return; // error
-        }
-        else
-        {
-            if(size != 3)
-                return; //error
-        }
-
-        // CIN is the same as status byte for channel voice messages
-        tx_buffer_[tx_ptr_ + 0] = (buffer[0] & 0xF0) >> 4;
-        tx_buffer_[tx_ptr_ + 1] = buffer[0];
-        tx_buffer_[tx_ptr_ + 2] = buffer[1];
-        tx_buffer_[tx_ptr_ + 3] = size == 3 ? buffer[2] : 0;
-
-        tx_ptr_ += 4;
-    }
-    else // buffer[0] & 0xF0 == 0xF0 aka System common or realtime
-    {
-        if(0xF2 == buffer[0])
-        // three byte message
-        {
-            if(size != 3)
-                return; // error
-
-            tx_buffer_[tx_ptr_ + 0] = 0x03;
-            tx_buffer_[tx_ptr_ + 1] = buffer[0];
-            tx_buffer_[tx_ptr_ + 2] = buffer[1];
-            tx_buffer_[tx_ptr_ + 3] = buffer[2];
-
-            tx_ptr_ += 4;
-        }
-        if(0xF1 == buffer[0] || 0xF3 == buffer[0])
-        // two byte messages
-        {
-            if(size != 2)
-                return; // error
-
-            tx_buffer_[tx_ptr_ + 0] = 0x02;
-            tx_buffer_[tx_ptr_ + 1] = buffer[0];
-            tx_buffer_[tx_ptr_ + 2] = buffer[1];
-            tx_buffer_[tx_ptr_ + 3] = 0;
-
-            tx_ptr_ += 4;
-        }
-        else if(0xF4 <= buffer[0])
-        // one byte message
-        {
-            if(size != 1)
-                return; // error
-
-            tx_buffer_[tx_ptr_ + 0] = 0x05;
-            tx_buffer_[tx_ptr_ + 1] = buffer[0];
-            tx_buffer_[tx_ptr_ + 2] = 0;
-            tx_buffer_[tx_ptr_ + 3] = 0;
-
-            tx_ptr_ += 4;
-        }
-        else // sysex
-        {
-            size_t i = 0;
-            // Sysex messages are split up into several 4 bytes packets
-            // first ones use CIN 0x04
-            // but packet containing the SysEx stop byte use a different CIN
-            for(i = 0; i + 3 < size; i += 3, tx_ptr_ += 4)
-            {
-                tx_buffer_[tx_ptr_]     = 0x04;
-                tx_buffer_[tx_ptr_ + 1] = buffer[i];
-                tx_buffer_[tx_ptr_ + 2] = buffer[i + 1];
-                tx_buffer_[tx_ptr_ + 3] = buffer[i + 2];
-            }
-
-            // Fill CIN for terminating bytes
-            // 0x05 for 1 remaining byte
-            // 0x06 for 2
-            // 0x07 for 3
-            tx_buffer_[tx_ptr_] = 0x05 + (size - i - 1);
-            tx_ptr_++;
-            for(; i < size; ++i, ++tx_ptr_)
-                tx_buffer_[tx_ptr_] = buffer[i];
-            for(; (tx_ptr_ % 4) != 0; ++tx_ptr_)
-                tx_buffer_[tx_ptr_] = 0;
-        }
-    }
-}
-
-void MidiUsbTransport::Impl::MidiToUsb(uint8_t* buffer, size_t size)
-{
-    // We'll assume your message starts with a status byte!
-    size_t status_index = 0;
-    while(status_index < size)
-    {
-        // Search for next status byte or end
-        size_t next_status = status_index;
-        for(size_t j = status_index + 1; j < size; j++)
-        {
-            if(buffer[j] & 0x80)
-            {
-                next_status = j;
-                break;
-            }
-        }
-        if(next_status == status_index)
-        {
-            // Either we're at the end or it's malformed
-            next_status = size;
-        }
-        MidiToUsbSingle(buffer + status_index, next_status - status_index);
-        status_index = next_status;
-    }
-}
-
 void MidiUsbTransport::Impl::Parse()
 {
     if(parse_callback_)
     {
-        uint8_t bytes[kBufferSize];
-        size_t  i = 0;
-        while(!rx_buffer_.isEmpty())
-        {
-            bytes[i++] = rx_buffer_.Read();
-        }
+        uint8_t      bytes[kBufferSize];
+        const size_t i = rx_buffer_.TryRead(bytes, kBufferSize);
         parse_callback_(bytes, i, parse_context_);
     }
 }
@@ -360,3 +310,18 @@ void MidiUsbTransport::Tx(uint8_t* buffer, size_t size)
 {
     pimpl_->Tx(buffer, size);
 }
+
+size_t MidiUsbTransport::TxAsync(const uint8_t* buffer, size_t size)
+{
+    return pimpl_->TxAsync(buffer, size);
+}
+
+void MidiUsbTransport::FlushTx()
+{
+    pimpl_->FlushTx();
+}
+
+bool MidiUsbTransport::TxBusy() const
+{
+    return pimpl_->TxBusy();
+}
@@ -41,7 +41,16 @@ class MidiUsbTransport
          */
         uint8_t tx_retry_count;
 
-        Config() : periph(INTERNAL), tx_retry_count(3) {}
+        /**
+         * When enabled, Tx() doesn't wait for a running transfer. Messages
+         * sent meanwhile are collected and sent together in one bulk
+         * transfer when the previous one has finished, on the next Tx()
+         * or FlushTx(). Call FlushTx() regularly, e.g. every millisecond,
+         * so the last messages don't wait.
+         */
+        bool tx_batching;
+
+        Config() : periph(INTERNAL), tx_retry_count(3), tx_batching(false) {}
     };
 
     void Init(Config config);
@@ -51,6 +60,21 @@ class MidiUsbTransport
     void FlushRx();
     void Tx(uint8_t* buffer, size_t size);
 
+    /** Starts sending bytes without waiting for the previous transfer.
+     *  Bytes that can't be sent yet are collected for the next transfer.
+     *  \return the number of bytes taken, less than size if the buffer
+     *          for the next transfer is full
+     */
+    size_t TxAsync(const uint8_t* buffer, size_t size);
+
+    /** Sends the collected messages if the previous transfer has finished */
+    void FlushTx();
+
+    /** Returns true if no more messages can be collected until the
+     *  previous transfer has finished
+     */
+    bool TxBusy() const;
+
     class Impl;
 
     MidiUsbTransport() : pimpl_(nullptr) {}
@@ -0,0 +1,183 @@
+#pragma once
+#ifndef DSY_USB_MIDI_PACKETIZER_H
+#define DSY_USB_MIDI_PACKETIZER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace daisy
+{
+/** @brief   Converts a MIDI byte stream into USB-MIDI event packets
+ *  @details Every MIDI message becomes one or more 4 byte event packets,
+ *           a code index number followed by up to 3 MIDI bytes, as described
+ *           in the USB MIDI 1.0 spec. The state is kept between calls, so
+ *           messages, running status and SysEx can be split over several
+ *           calls. Malformed data is skipped.
+ *  @ingroup midi
+ */
+class UsbMidiPacketizer
+{
+  public:
+    /** Size of a USB-MIDI event packet */
+    static constexpr size_t kPacketSize = 4;
+
+    UsbMidiPacketizer() { Init(); }
+
+    /** Resets the state, e.g. after packets were dropped */
+    void Init()
+    {
+        running_status_ = 0;
+        length_         = 0;
+        expected_       = 0;
+        sysex_          = false;
+    }
+
+    /** Converts MIDI bytes into packets
+     *  \param bytes the MIDI bytes
+     *  \param size number of bytes
+     *  \param packets destination for the packets
+     *  \param max_size size of packets in bytes
+     *  \param packets_size number of bytes in packets so far, is advanced
+     *         by the size of the new packets
+     *  \return the number of MIDI bytes that were converted. It's less than
+     *          size if packets is full.
+     */
+    size_t Packetize(const uint8_t* bytes,
+                     size_t         size,
+                     uint8_t*       packets,
+                     size_t         max_size,
+                     size_t&        packets_size)
+    {
+        size_t i = 0;
+        // Each byte completes at most one packet
+        for(; i < size && packets_size + kPacketSize <= max_size; i++)
+        {
+            uint8_t* packet = packets + packets_size;
+            if(Process(bytes[i], packet))
+                packets_size += kPacketSize;
+        }
+        return i;
+    }
+
+  private:
+    /** Adds a byte to the current message
+     *  \return true if a packet was written
+     */
+    bool Process(uint8_t byte, uint8_t* packet)
+    {
+        if(byte >= 0xf8)
+        {
+            // Real time messages can come between any other bytes
+            return Write(packet, 0x0f, byte, 0, 0);
+        }
+        if(byte == 0xf7)
+        {
+            if(!sysex_)
+                return false;
+            sysex_             = false;
+            message_[length_]  = byte;
+            const size_t count = length_ + 1;
+            length_            = 0;
+            // 0x5, 0x6 or 0x7: SysEx ends with 1, 2 or 3 bytes
+            return Write(packet,
+                         0x04 + count,
+                         message_[0],
+                         count > 1 ? message_[1] : 0,
+                         count > 2 ? message_[2] : 0);
+        }
+        if(byte & 0x80)
+            return ProcessStatus(byte, packet);
+
+        if(sysex_)
+        {
+            message_[length_++] = byte;
+            if(length_ < 3)
+                return false;
+            length_ = 0;
+            return Write(packet, 0x04, message_[0], message_[1], message_[2]);
+        }
+        if(length_ == 0)
+        {
+            if(running_status_ == 0)
+                return false; // data without status
+            message_[length_++] = running_status_;
+            expected_           = MessageLength(running_status_);
+        }
+        message_[length_++] = byte;
+        if(length_ < expected_)
+            return false;
+        length_ = 0;
+        return Write(packet,
+                     CodeIndex(message_[0]),
+                     message_[0],
+                     message_[1],
+                     expected_ > 2 ? message_[2] : 0);
+    }
+
+    bool ProcessStatus(uint8_t status, uint8_t* packet)
+    {
+        // A new status ends an unfinished message or SysEx
+        sysex_  = false;
+        length_ = 0;
+        if(status < 0xf0)
+            running_status_ = status;
+        else
+            running_status_ = 0;
+
+        switch(status)
+        {
+            case 0xf0:
+                sysex_      = true;
+                message_[0] = status;
+                length_     = 1;
+                return false;
+            case 0xf6: return Write(packet, 0x05, status, 0, 0);
+            case 0xf4:
+            case 0xf5: return false; // undefined
+            default:
+                message_[0] = status;
+                length_     = 1;
+                expected_   = MessageLength(status);
+                return false;
+        }
+    }
+
+    static bool
+    Write(uint8_t* packet, uint8_t cin, uint8_t b0, uint8_t b1, uint8_t b2)
+    {
+        packet[0] = cin;
+        packet[1] = b0;
+        packet[2] = b1;
+        packet[3] = b2;
+        return true;
+    }
+
+    /** Returns the number of bytes of a message with a status byte */
+    static uint8_t MessageLength(uint8_t status)
+    {
+        switch(status & 0xf0)
+        {
+            case 0xc0:
+            case 0xd0: return 2;
+            case 0xf0: return status == 0xf2 ? 3 : 2;
+            default: return 3;
+        }
+    }
+
+    static uint8_t CodeIndex(uint8_t status)
+    {
+        if(status < 0xf0)
+            return status >> 4; // same as the status for channel messages
+        return status == 0xf2 ? 0x03 : 0x02;
+    }
+
+    uint8_t message_[3];
+    uint8_t running_status_;
+    uint8_t length_;
+    uint8_t expected_;
+    bool    sysex_;
+};
+
+} // namespace daisy
+
+#endif
@@ -4,12 +4,16 @@
 - Only 1 file playing back at a time.
 - Not sure how this would interfere with trying to use the SDCard/FatFs outside of
 this module. However, by using the extern'd SDFile, etc. I think that would break things.
+
+For multiple voices, variable rates, stereo and 24-bit/float files, use the
+WavStreamer (hid/wavstreamer.h) with WavStreamFatFsFile.
 */
 #pragma once
 #ifndef DSY_WAVPLAYER_H
 #define DSY_WAVPLAYER_H /**< Macro */
 #include "daisy_core.h"
 #include "util/wav_format.h"
+#include "hid/wavstreamer.h"
 #include "ff.h"
 
 #define WAV_FILENAME_MAX \
@@ -30,6 +34,38 @@ TODO:
 - Make template-y to reduce memory usage.
 */
 
+/** WavStreamFile that reads from a file on a FatFs volume.
+ ** The object must not be placed in DTCM, the SD card DMA can't reach it.
+ */
+class WavStreamFatFsFile : public WavStreamFile
+{
+  public:
+    WavStreamFatFsFile() {}
+    ~WavStreamFatFsFile() {}
+
+    /** Opens the file at path for reading */
+    FRESULT Open(const char* path)
+    {
+        return f_open(&fil_, path, (FA_OPEN_EXISTING | FA_READ));
+    }
+
+    /** Closes the file */
+    FRESULT Close() { return f_close(&fil_); }
+
+    size_t Read(void* dst, size_t size) override
+    {
+        UINT bytesread = 0;
+        if(f_read(&fil_, dst, size, &bytesread) != FR_OK)
+            return 0;
+        return bytesread;
+    }
+
+    bool Seek(size_t pos) override { return f_lseek(&fil_, pos) == FR_OK; }
+
+  private:
+    FIL fil_;
+};
+
 
 /** Wav Player that will load .wav files from an SD Card,
 and then provide a method of accessing the samples with
@@ -0,0 +1,468 @@
+#pragma once
+#ifndef DSY_WAVSTREAMER_H
+#define DSY_WAVSTREAMER_H /**< & */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include "util/ringbuffer.h"
+#include "util/wav_format.h"
+
+namespace daisy
+{
+/** @brief Source of the bytes of a wav file for the WavStreamer
+ *  @ingroup audio
+ *  @details On hardware, use WavStreamFatFsFile (hid/wavplayer.h) to read
+ *  from an SD Card or USB drive.
+ */
+class WavStreamFile
+{
+  public:
+    virtual ~WavStreamFile() {}
+
+    /** Reads up to size bytes from the current position
+     ** \param dst buffer to read into
+     ** \param size number of bytes to read
+     ** \return The number of bytes read
+     */
+    virtual size_t Read(void* dst, size_t size) = 0;
+
+    /** Moves the read position
+     ** \param pos position in bytes from the start of the file
+     ** \return true on success
+     */
+    virtual bool Seek(size_t pos) = 0;
+};
+
+/** @brief A single voice of the WavStreamer
+ *  @ingroup audio
+ *  @details Streams one 16, 24 or 32 bit PCM or 32 bit float, mono or
+ *  stereo wav file at a variable rate. Decoded stereo frames are kept in a
+ *  RingBuffer of buffer_frames frames, which is refilled from the file in
+ *  num_chunks chunks (2 for double buffering, 3 for triple buffering).
+ *
+ *  The buffer is filled from the main loop (Play(), Fill()) and read from
+ *  the audio callback (Mix()). The audio callback is expected to preempt
+ *  the main loop, the way the audio interrupt does on hardware.
+ *
+ *  \tparam buffer_frames frames of decoded audio, a power of two
+ *  \tparam num_chunks number of file reads it takes to fill the buffer
+ */
+template <size_t buffer_frames, size_t num_chunks = 2>
+class WavStreamVoice
+{
+  public:
+    /** Frames decoded per file read */
+    static constexpr size_t kChunkFrames = buffer_frames / num_chunks;
+    /** Bytes of scratch memory Fill() needs for a single read */
+    static constexpr size_t kScratchBytes = kChunkFrames * 2 * 4;
+
+    static_assert(num_chunks >= 2 && kChunkFrames > 0,
+                  "at least two chunks of at least one frame are required");
+
+    enum class Result
+    {
+        OK,
+        ERR_FILE,
+        ERR_FORMAT,
+    };
+
+    WavStreamVoice() {}
+    ~WavStreamVoice() {}
+
+    /** Initializes the voice
+     ** \param samplerate sample rate of the audio engine in Hz
+     */
+    void Init(float samplerate)
+    {
+        samplerate_ = samplerate;
+        file_       = nullptr;
+        looping_    = false;
+        rate_       = 1.f;
+        rate_scale_ = 1.f;
+        gain_       = 1.f;
+        underruns_  = 0;
+        playing_.store(false);
+        eof_.store(true);
+    }
+
+    /** Reads the header of a wav file and prepares it for playback.
+     ** Stops the voice. The file must stay open while it is in use.
+     ** \param file file to stream, positioned anywhere
+     */
+    Result Open(WavStreamFile* file)
+    {
+        Stop();
+        file_ = nullptr;
+        if(file == nullptr || !file->Seek(0))
+            return Result::ERR_FILE;
+
+        uint32_t riff[3];
+        if(file->Read(riff, sizeof(riff)) != sizeof(riff))
+            return Result::ERR_FILE;
+        if(riff[0] != kWavFileChunkId || riff[2] != kWavFileWaveId)
+            return Result::ERR_FORMAT;
+
+        // Walk the chunks, skipping anything that isn't "fmt " or "data"
+        size_t   pos    = sizeof(riff);
+        uint16_t format = 0, bits = 0;
+        uint32_t samplerate = 0;
+        channels_           = 0;
+        while(true)
+        {
+            uint32_t chunk[2];
+            if(file->Read(chunk, sizeof(chunk)) != sizeof(chunk))
+                return Result::ERR_FORMAT;
+            pos += sizeof(chunk);
+            if(chunk[0] == kWavFileSubChunk2Id)
+            {
+                data_start_ = pos;
+                data_size_  = chunk[1];
+                break;
+            }
+            if(chunk[0] == kWavFileSubChunk1Id && chunk[1] >= 16)
+            {
+                uint8_t fmt[26] = {};
+                size_t  len = chunk[1] < sizeof(fmt) ? chunk[1] : sizeof(fmt);
+                if(file->Read(fmt, len) != len)
+                    return Result::ERR_FILE;
+                memcpy(&format, &fmt[0], 2);
+                memcpy(&channels_, &fmt[2], 2);
+                memcpy(&samplerate, &fmt[4], 4);
+                memcpy(&bits, &fmt[14], 2);
+                if(format == WAVE_FORMAT_EXTENSIBLE && len >= 26)
+                    memcpy(&format, &fmt[24], 2);
+            }
+            // chunks are padded to an even size
+            pos += chunk[1] + (chunk[1] & 1);
+            if(!file->Seek(pos))
+                return Result::ERR_FILE;
+        }
+
+        bytes_    = bits / 8;
+        is_float_ = format == WAVE_FORMAT_IEEE_FLOAT;
+        const bool pcm_ok
+            = format == WAVE_FORMAT_PCM && bytes_ >= 2 && bytes_ <= 4;
+        const bool float_ok = is_float_ && bytes_ == 4;
+        if((!pcm_ok && !float_ok) || channels_ < 1 || channels_ > 2
+           || samplerate == 0)
+            return Result::ERR_FORMAT;
+
+        frame_bytes_ = channels_ * bytes_;
+        data_size_ -= data_size_ % frame_bytes_;
+        rate_scale_ = float(samplerate) / samplerate_;
+        file_       = file;
+        return Result::OK;
+    }
+
+    /** Starts playback from the beginning of the file. Call from the main
+     ** loop. The audio starts once the buffer has been filled by Fill().
+     */
+    Result Play()
+    {
+        Stop();
+        if(file_ == nullptr || !file_->Seek(data_start_))
+            return Result::ERR_FILE;
+        read_pos_ = 0;
+        buffer_.Init();
+        primed_   = false;
+        draining_ = false;
+        phase_    = 0.f;
+        eof_.store(false);
+        playing_.store(true);
+        return Result::OK;
+    }
+
+    /** Stops playback immediately */
+    void Stop() { playing_.store(false); }
+
+    /** \return true while the voice is playing */
+    bool IsPlaying() const { return playing_.load(); }
+
+    /** Sets whether the file repeats after completing playback */
+    void SetLooping(bool loop) { looping_ = loop; }
+
+    /** \return Whether the voice is looping or not */
+    bool GetLooping() const { return looping_; }
+
+    /** Sets the playback rate. 1.0 plays the file at its own sample rate,
+     ** 0.5 an octave lower, 2.0 an octave higher.
+     */
+    void SetRate(float rate) { rate_ = rate > 0.f ? rate : 0.f; }
+
+    /** \return The playback rate */
+    float GetRate() const { return rate_; }
+
+    /** Sets the gain applied in Mix() */
+    void SetGain(float gain) { gain_ = gain; }
+
+    /** \return The number of decoded frames waiting to be played */
+    size_t GetBufferedFrames() const { return buffer_.readable() / 2; }
+
+    /** \return The number of times the buffer ran empty during playback */
+    uint32_t GetNumUnderruns() const { return underruns_; }
+
+    /** \return true if the voice is playing and has room for a chunk */
+    bool NeedsData() const
+    {
+        return playing_.load() && !eof_.load()
+               && buffer_.writable() / 2 >= kChunkFrames;
+    }
+
+    /** \return The number of output frames until the buffer runs empty */
+    float GetFramesUntilEmpty() const
+    {
+        const float inc = rate_ * rate_scale_;
+        return inc > 0.f ? float(GetBufferedFrames()) / inc : 1e30f;
+    }
+
+    /** Reads and decodes up to one chunk from the file. Call from the main
+     ** loop, or leave it to the WavStreamer.
+     ** \param scratch at least kScratchBytes of memory the file can be read
+     **                into (must be DMA accessible on hardware)
+     ** \return The number of frames added to the buffer
+     */
+    size_t Fill(uint8_t* scratch)
+    {
+        if(!NeedsData())
+            return 0;
+        size_t frames = buffer_.writable() / 2;
+        frames        = frames < kChunkFrames ? frames : kChunkFrames;
+        size_t bytes  = frames * frame_bytes_;
+        if(bytes > data_size_ - read_pos_)
+            bytes = data_size_ - read_pos_;
+
+        const size_t got = file_->Read(scratch, bytes);
+        frames           = got / frame_bytes_;
+        read_pos_ += got;
+        Decode(scratch, frames);
+
+        if(got < bytes || read_pos_ >= data_size_)
+        {
+            if(looping_ && file_->Seek(data_start_) && data_size_ > 0)
+                read_pos_ = 0;
+            else
+                eof_.store(true);
+        }
+        return frames;
+    }
+
+    /** Adds the next size stereo frames to an interleaved buffer.
+     ** Call from the audio callback.
+     */
+    void Mix(float* out, size_t size)
+    {
+        if(!playing_.load())
+            return;
+        if(!primed_ && !Prime())
+            return;
+
+        const float inc  = rate_ * rate_scale_;
+        const float gain = gain_;
+        for(size_t i = 0; i < size; i++)
+        {
+            out[2 * i] += (x0_[0] + (x1_[0] - x0_[0]) * phase_) * gain;
+            out[2 * i + 1] += (x0_[1] + (x1_[1] - x0_[1]) * phase_) * gain;
+            phase_ += inc;
+            while(phase_ >= 1.f)
+            {
+                phase_ -= 1.f;
+                x0_[0] = x1_[0];
+                x0_[1] = x1_[1];
+                if(buffer_.TryRead(x1_, 2) == 2)
+                    continue;
+                if(!AtEnd())
+                {
+                    // Resume when there is enough data again
+                    primed_ = false;
+                    underruns_++;
+                    return;
+                }
+                if(draining_)
+                {
+                    playing_.store(false);
+                    return;
+                }
+                // Hold the last frame for one more period
+                draining_ = true;
+                x1_[0]    = x0_[0];
+                x1_[1]    = x0_[1];
+            }
+        }
+    }
+
+  private:
+    // True once the whole file has been read and played.
+    // eof_ is set after the last frames are written, so check it first.
+    bool AtEnd() const { return eof_.load() && buffer_.readable() < 2; }
+
+    // Loads both ends of the interpolation, returns false if it couldn't
+    bool Prime()
+    {
+        const bool eof = eof_.load();
+        const auto n   = buffer_.readable();
+        if(n < 4 && !(eof && n == 2))
+        {
+            if(eof)
+                playing_.store(false);
+            return false;
+        }
+        buffer_.TryRead(x0_, 2);
+        if(buffer_.TryRead(x1_, 2) != 2)
+        {
+            draining_ = true;
+            x1_[0]    = x0_[0];
+            x1_[1]    = x0_[1];
+        }
+        primed_ = true;
+        return true;
+    }
+
+    float DecodeSample(const uint8_t* src) const
+    {
+        if(is_float_)
+        {
+            float f;
+            memcpy(&f, src, 4);
+            return f;
+        }
+        // Shift up to the top of the word to sign extend
+        int32_t word = 0;
+        memcpy(reinterpret_cast<uint8_t*>(&word) + 4 - bytes_, src, bytes_);
+        return float(word) * (1.f / 2147483648.f);
+    }
+
+    void Decode(const uint8_t* src, size_t frames)
+    {
+        const size_t right = channels_ > 1 ? bytes_ : 0;
+        while(frames > 0)
+        {
+            auto   span = buffer_.PrepareWrite();
+            size_t n    = span.length / 2 < frames ? span.length / 2 : frames;
+            for(size_t i = 0; i < n; i++)
+            {
+                span.data[2 * i]     = DecodeSample(src);
+                span.data[2 * i + 1] = DecodeSample(src + right);
+                src += frame_bytes_;
+            }
+            buffer_.CommitWrite(2 * n);
+            frames -= n;
+        }
+    }
+
+    RingBuffer<float, buffer_frames * 2> buffer_;
+    WavStreamFile*                       file_;
+    float                                samplerate_;
+    uint16_t                             channels_;
+    size_t                               bytes_, frame_bytes_;
+    bool                                 is_float_;
+    size_t                               data_start_, data_size_, read_pos_;
+    bool                                 looping_;
+    std::atomic<bool>                    playing_, eof_;
+    volatile float                       rate_, rate_scale_, gain_;
+    bool                                 primed_, draining_;
+    float                                x0_[2], x1_[2], phase_;
+    uint32_t                             underruns_;
+};
+
+/** @brief Streams several wav files at once
+ *  @ingroup audio
+ *  @details Each voice has its own buffer, and Prepare() decides which
+ *  voice to read for next: the playing voice that will run out of data
+ *  first, taking its fill level and playback rate into account.
+ *
+ *  Usage:
+ *      static WavStreamer<8> DSY_SDRAM_BSS streamer;
+ *      streamer.Init(samplerate);
+ *      file.Open("kick.wav");
+ *      streamer.GetVoice(0).Open(&file);
+ *      streamer.GetVoice(0).Play();
+ *      // main loop
+ *      streamer.Prepare();
+ *      // audio callback
+ *      streamer.Stream(out, size);
+ *
+ *  \tparam max_voices number of voices
+ *  \tparam buffer_frames frames buffered per voice, a power of two
+ *  \tparam num_chunks number of file reads it takes to fill a buffer
+ */
+template <size_t max_voices, size_t buffer_frames = 4096, size_t num_chunks = 2>
+class WavStreamer
+{
+  public:
+    using Voice = WavStreamVoice<buffer_frames, num_chunks>;
+
+    WavStreamer() {}
+    ~WavStreamer() {}
+
+    /** Initializes all voices
+     ** \param samplerate sample rate of the audio engine in Hz
+     */
+    void Init(float samplerate)
+    {
+        for(auto& voice : voices_)
+            voice.Init(samplerate);
+    }
+
+    /** \return The voice at idx (clamped to the last voice) */
+    Voice& GetVoice(size_t idx)
+    {
+        return voices_[idx < max_voices ? idx : max_voices - 1];
+    }
+
+    /** \return The number of voices */
+    size_t GetNumVoices() const { return max_voices; }
+
+    /** Mixes all voices into an interleaved stereo buffer.
+     ** Call from the audio callback.
+     ** \param out size interleaved stereo frames
+     ** \param size number of frames
+     */
+    void Stream(float* out, size_t size)
+    {
+        for(size_t i = 0; i < size * 2; i++)
+            out[i] = 0.f;
+        for(auto& voice : voices_)
+            voice.Mix(out, size);
+    }
+
+    /** Refills the buffers of the voices that need it most. Call from the
+     ** main loop.
+     ** \param max_reads maximum number of file reads
+     ** \return The number of file reads that were made
+     */
+    size_t Prepare(size_t max_reads = 1)
+    {
+        size_t reads = 0;
+        while(reads < max_reads)
+        {
+            Voice* next    = nullptr;
+            float  soonest = 0.f;
+            for(auto& voice : voices_)
+            {
+                if(!voice.NeedsData())
+                    continue;
+                const float frames = voice.GetFramesUntilEmpty();
+                if(next == nullptr || frames < soonest)
+                {
+                    next    = &voice;
+                    soonest = frames;
+                }
+            }
+            if(next == nullptr)
+                break;
+            next->Fill(scratch_);
+            reads++;
+        }
+        return reads;
+    }
+
+  private:
+    Voice   voices_[max_voices];
+    uint8_t scratch_[Voice::kScratchBytes];
+};
+
+} // namespace daisy
+
+#endif
@@ -1,6 +1,7 @@
 #include "per/i2c.h"
 #include "sys/system.h"
 #include "util/scopedirqblocker.h"
+#include "util/PriorityJobQueue.h"
 extern "C"
 {
 #include "util/hal_map.h"
@@ -51,51 +52,76 @@ class I2CHandle::Impl
                                          uint16_t data_size,
                                          uint32_t timeout);
 
+    I2CHandle::Result
+    QueueTransaction(const I2CHandle::Transaction& transaction);
+
+    size_t GetNumQueuedTransactions() const { return queue_.GetNumJobs(); }
+
     // =========================================================
     // scheduling and global functions
-    struct DmaJob
+    using TransactionQueue
+        = PriorityJobQueue<I2CHandle::Transaction,
+                           I2CHandle::kTransactionQueueSize>;
+
+    // a finished transaction, whose callback is made after the interrupts
+    // are enabled again
+    struct Completion
     {
-        uint16_t                       slave_address    = 0x10;
-        uint8_t*                       data             = nullptr;
-        uint16_t                       size             = 0;
-        I2CHandle::CallbackFunctionPtr callback         = nullptr;
-        void*                          callback_context = nullptr;
-        I2CHandle::Direction direction = I2CHandle::Direction::TRANSMIT;
-
-        bool IsValidJob() const { return data != nullptr; }
-        void Invalidate() { data = nullptr; }
+        I2CHandle::CallbackFunctionPtr callback;
+        void*                          callback_context;
+        I2CHandle::Result              result;
+
+        void Call() const
+        {
+            if(callback != nullptr)
+                callback(callback_context, result);
+        }
     };
+
     static void GlobalInit();
     static bool IsDmaActive();
-    static bool IsDmaTransferQueuedFor(size_t i2c_peripheral_idx);
-    static void QueueDmaTransfer(size_t i2c_peripheral_idx, const DmaJob& job);
-    static void DmaTransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
-                                    I2CHandle::Result  result);
+    static void ScheduleNext();
+    static bool StartQueued(Completion* failed);
+    static void TransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
+                                 I2CHandle::Result  result);
 
-    static constexpr uint8_t              kNumI2CWithDma = 3;
-    static volatile int8_t                dma_active_peripheral_;
-    static DmaJob                         queued_dma_transfers_[kNumI2CWithDma];
-    static I2CHandle::CallbackFunctionPtr next_callback_;
-    static void*                          next_callback_context_;
+    static constexpr uint8_t kNumI2CWithDma = 3;
+    static volatile int8_t   dma_active_peripheral_;
 
     // =========================================================
     // pivate functions and member variables
-    I2CHandle::Config config_;
-    DMA_HandleTypeDef i2c_dma_tc_handle_;
-    I2C_HandleTypeDef i2c_hal_handle_;
+    I2CHandle::Config      config_;
+    DMA_HandleTypeDef      i2c_dma_tc_handle_;
+    I2C_HandleTypeDef      i2c_hal_handle_;
+    TransactionQueue       queue_;
+    I2CHandle::Transaction current_;    /**< the running transaction */
+    volatile bool          busy_;       /**< current_ is running */
+    bool                   rx_pending_; /**< current_ reads after writing */
+    volatile bool          paused_;     /**< a blocking transfer runs */
+
+    // I2C4 has no connection to DMA1 and uses interrupts
+    bool UsesDma() const
+    {
+        return config_.periph != I2CHandle::Config::Peripheral::I2C_4;
+    }
 
-    I2CHandle::Result
-    StartDmaTransmission(uint16_t                       address,
-                         uint8_t*                       data,
-                         uint16_t                       size,
-                         I2CHandle::CallbackFunctionPtr callback,
-                         void*                          callback_context);
+    bool              CanStartNext();
+    I2CHandle::Result StartNext(Completion* failed);
+    Completion        FinishTransaction(I2CHandle::Result result);
+    void              PauseQueue();
+    void              ResumeQueue();
 
-    I2CHandle::Result StartDmaReception(uint16_t                       address,
-                                        uint8_t*                       data,
-                                        uint16_t                       size,
-                                        I2CHandle::CallbackFunctionPtr callback,
-                                        void* callback_context);
+    I2CHandle::Result StartTransmission(uint16_t address,
+                                        uint8_t* data,
+                                        uint16_t size,
+                                        uint32_t xfer_options);
+
+    I2CHandle::Result StartReception(uint16_t address,
+                                     uint8_t* data,
+                                     uint16_t size,
+                                     uint32_t xfer_options);
+
+    I2CHandle::Result InitDma(I2CHandle::Direction direction);
 
     void InitPins();
     void DeinitPins();
@@ -123,10 +149,15 @@ static I2CHandle::Impl i2c_handles[4];
 
 void I2CHandle::Impl::GlobalInit()
 {
-    // init the scheduler queue
+    // init the scheduler queues
     dma_active_peripheral_ = -1;
-    for(int per = 0; per < kNumI2CWithDma; per++)
-        queued_dma_transfers_[per] = I2CHandle::Impl::DmaJob();
+    for(auto& handle : i2c_handles)
+    {
+        handle.queue_.Clear();
+        handle.busy_       = false;
+        handle.rx_pending_ = false;
+        handle.paused_     = false;
+    }
 }
 
 bool I2CHandle::Impl::IsDmaActive()
@@ -134,79 +165,161 @@ bool I2CHandle::Impl::IsDmaActive()
     return dma_active_peripheral_ >= 0;
 }
 
-bool I2CHandle::Impl::IsDmaTransferQueuedFor(size_t i2c_peripheral_idx)
+void I2CHandle::Impl::ScheduleNext()
 {
-    return queued_dma_transfers_[i2c_peripheral_idx].IsValidJob();
+    // a transaction that fails to start is reported, then the next one is
+    // tried
+    Completion failed;
+    while(StartQueued(&failed))
+        failed.Call();
 }
 
-void I2CHandle::Impl::QueueDmaTransfer(size_t i2c_peripheral_idx,
-                                       const I2CHandle::Impl::DmaJob& job)
+bool I2CHandle::Impl::StartQueued(Completion* failed)
 {
-    // wait for any previous job on this peripheral to finish
-    // and the queue position to bevome free
-    while(IsDmaTransferQueuedFor(i2c_peripheral_idx)) {};
-
-    // queue the job
     ScopedIrqBlocker block;
-    queued_dma_transfers_[i2c_peripheral_idx] = job;
+
+    // I2C4 works through its own queue
+    Impl& i2c4 = i2c_handles[3];
+    while(i2c4.CanStartNext())
+        if(i2c4.StartNext(failed) != I2CHandle::Result::OK)
+            return true;
+
+    // The other peripherals share the DMA stream. Start the most urgent
+    // of their transactions.
+    while(!IsDmaActive())
+    {
+        int best = -1;
+        for(int per = 0; per < kNumI2CWithDma; per++)
+        {
+            if(!i2c_handles[per].CanStartNext())
+                continue;
+            const I2CHandle::Transaction* next = i2c_handles[per].queue_.Peek();
+            if(best < 0
+               || TransactionQueue::IsMoreUrgent(
+                   *next, *i2c_handles[best].queue_.Peek()))
+                best = per;
+        }
+        if(best < 0)
+            return false;
+        if(i2c_handles[best].StartNext(failed) != I2CHandle::Result::OK)
+            return true;
+    }
+    return false;
 }
 
-void I2CHandle::Impl::DmaTransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
-                                          I2CHandle::Result  result)
+bool I2CHandle::Impl::CanStartNext()
 {
-    ScopedIrqBlocker block;
+    // While a blocking transfer runs, or the HAL is otherwise busy, the
+    // jobs stay queued until ResumeQueue() or the end of the transfer.
+    return !busy_ && !paused_ && !queue_.IsEmpty()
+           && HAL_I2C_GetState(&i2c_hal_handle_) == HAL_I2C_STATE_READY;
+}
+
+void I2CHandle::Impl::PauseQueue()
+{
+    {
+        ScopedIrqBlocker block;
+        paused_ = true;
+    }
+    // wait for the running transaction to complete
+    while(busy_) {}
+}
+
+void I2CHandle::Impl::ResumeQueue()
+{
+    {
+        ScopedIrqBlocker block;
+        paused_ = false;
+    }
+    ScheduleNext();
+}
+
+I2CHandle::Result I2CHandle::Impl::StartNext(Completion* failed)
+{
+    if(!queue_.Pop(&current_))
+        return I2CHandle::Result::ERR;
 
+    busy_ = true;
+    if(UsesDma())
+        dma_active_peripheral_ = int(config_.periph);
+
+    // A write followed by a read is sent as one sequence, with a repeated
+    // start in between
+    rx_pending_ = current_.tx_size > 0 && current_.rx_size > 0;
+    I2CHandle::Result result;
+    if(current_.tx_size > 0)
+        result = StartTransmission(current_.address,
+                                   current_.tx_data,
+                                   current_.tx_size,
+                                   rx_pending_ ? I2C_FIRST_FRAME
+                                               : I2C_FIRST_AND_LAST_FRAME);
+    else
+        result = StartReception(current_.address,
+                                current_.rx_data,
+                                current_.rx_size,
+                                I2C_FIRST_AND_LAST_FRAME);
+
+    if(result != I2CHandle::Result::OK)
+        *failed = FinishTransaction(result);
+    return result;
+}
+
+I2CHandle::Impl::Completion
+I2CHandle::Impl::FinishTransaction(I2CHandle::Result result)
+{
     // on an error, reinit the peripheral to clear any flags
     if(result != I2CHandle::Result::OK)
-        HAL_I2C_Init(hal_i2c_handle);
+        HAL_I2C_Init(&i2c_hal_handle_);
 
-    dma_active_peripheral_ = -1;
+    rx_pending_ = false;
+    busy_       = false;
+    if(UsesDma())
+        dma_active_peripheral_ = -1;
 
-    if(next_callback_ != nullptr)
+    return {current_.callback, current_.callback_context, result};
+}
+
+void I2CHandle::Impl::TransferFinished(I2C_HandleTypeDef* hal_i2c_handle,
+                                       I2CHandle::Result  result)
+{
+    Completion done;
+    Completion failed;
+    bool       start_failed;
     {
-        // the callback may setup another transmission, hence we shouldn't reset this to
-        // nullptr after the callback - it might overwrite the new transmission.
-        auto callback  = next_callback_;
-        next_callback_ = nullptr;
-        // make the callback
-        callback(next_callback_context_, result);
-    }
+        ScopedIrqBlocker block;
 
-    // the callback could have started a new transmission right away...
-    if(IsDmaActive())
-        return;
+        Impl* handle = nullptr;
+        for(auto& h : i2c_handles)
+            if(&h.i2c_hal_handle_ == hal_i2c_handle)
+                handle = &h;
+        if(handle == nullptr || !handle->busy_)
+            return;
 
-    // dma is still idle. Check if another i2c peripheral waits for a job.
-    for(int per = 0; per < kNumI2CWithDma; per++)
-        if(IsDmaTransferQueuedFor(per))
+        if(result == I2CHandle::Result::OK && handle->rx_pending_)
         {
-            I2CHandle::Result result;
-            if(queued_dma_transfers_[per].direction
-               == I2CHandle::Direction::TRANSMIT)
-            {
-                result = i2c_handles[per].StartDmaTransmission(
-                    queued_dma_transfers_[per].slave_address,
-                    queued_dma_transfers_[per].data,
-                    queued_dma_transfers_[per].size,
-                    queued_dma_transfers_[per].callback,
-                    queued_dma_transfers_[per].callback_context);
-            }
-            else
-            {
-                result = i2c_handles[per].StartDmaReception(
-                    queued_dma_transfers_[per].slave_address,
-                    queued_dma_transfers_[per].data,
-                    queued_dma_transfers_[per].size,
-                    queued_dma_transfers_[per].callback,
-                    queued_dma_transfers_[per].callback_context);
-            }
+            // the write is done, continue with the read
+            const I2CHandle::Transaction& t = handle->current_;
+            handle->rx_pending_             = false;
+            result                          = handle->StartReception(
+                t.address, t.rx_data, t.rx_size, I2C_LAST_FRAME);
             if(result == I2CHandle::Result::OK)
-            {
-                // remove the job from the queue
-                queued_dma_transfers_[per].Invalidate();
                 return;
-            }
         }
+
+        // the next transaction starts before the callback is made
+        done         = handle->FinishTransaction(result);
+        start_failed = StartQueued(&failed);
+    }
+
+    // the callbacks are made with interrupts enabled, so e.g. decoding a
+    // sensor reading doesn't hold back other interrupts. They may queue
+    // another transaction.
+    done.Call();
+    if(start_failed)
+    {
+        failed.Call();
+        ScheduleNext();
+    }
 }
 
 // ================================================================
@@ -292,6 +405,7 @@ I2CHandle::Result I2CHandle::Impl::TransmitBlocking(uint16_t address,
                                                     uint32_t timeout)
 {
     // wait for previous transfer to be finished
+    PauseQueue();
     while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
 
     HAL_StatusTypeDef status;
@@ -304,6 +418,7 @@ I2CHandle::Result I2CHandle::Impl::TransmitBlocking(uint16_t address,
     {
         status = HAL_I2C_Slave_Transmit(&i2c_hal_handle_, data, size, timeout);
     }
+    ResumeQueue();
     if(status != HAL_OK)
         return I2CHandle::Result::ERR;
 
@@ -317,35 +432,13 @@ I2CHandle::Impl::TransmitDma(uint16_t                       address,
                              I2CHandle::CallbackFunctionPtr callback,
                              void*                          callback_context)
 {
-    // I2C4 has no DMA yet.
-    if(config_.periph == I2CHandle::Config::Peripheral::I2C_4)
-        return I2CHandle::Result::ERR;
-
-    const int i2cIdx = int(config_.periph);
-
-    I2CHandle::Direction direction = I2CHandle::Direction::TRANSMIT;
-
-    // if dma is currently running - queue a job
-    if(IsDmaActive())
-    {
-        DmaJob job;
-        job.slave_address    = address;
-        job.data             = data;
-        job.size             = size;
-        job.direction        = direction;
-        job.callback         = callback;
-        job.callback_context = callback_context;
-        // queue a job (blocks until the queue position is free)
-        QueueDmaTransfer(i2cIdx, job);
-        // TODO: the user can't tell if he got returned "OK"
-        // because the transfer was executed or because it was queued...
-        // should we change that?
-        return I2CHandle::Result::OK;
-    }
-    else
-        // start transmission right away
-        return StartDmaTransmission(
-            address, data, size, callback, callback_context);
+    I2CHandle::Transaction transaction;
+    transaction.address          = address;
+    transaction.tx_data          = data;
+    transaction.tx_size          = size;
+    transaction.callback         = callback;
+    transaction.callback_context = callback_context;
+    return QueueTransaction(transaction);
 }
 
 I2CHandle::Result I2CHandle::Impl::ReceiveBlocking(uint16_t address,
@@ -354,6 +447,7 @@ I2CHandle::Result I2CHandle::Impl::ReceiveBlocking(uint16_t address,
                                                    uint32_t timeout)
 {
     // wait for previous transfer to be finished
+    PauseQueue();
     while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
 
     HAL_StatusTypeDef status;
@@ -364,6 +458,7 @@ I2CHandle::Result I2CHandle::Impl::ReceiveBlocking(uint16_t address,
     }
     else
         status = HAL_I2C_Slave_Receive(&i2c_hal_handle_, data, size, timeout);
+    ResumeQueue();
 
     if(status != HAL_OK)
         return I2CHandle::Result::ERR;
@@ -378,35 +473,38 @@ I2CHandle::Impl::ReceiveDma(uint16_t                       address,
                             I2CHandle::CallbackFunctionPtr callback,
                             void*                          callback_context)
 {
-    // I2C4 has no DMA yet.
-    if(config_.periph == I2CHandle::Config::Peripheral::I2C_4)
-        return I2CHandle::Result::ERR;
+    I2CHandle::Transaction transaction;
+    transaction.address          = address;
+    transaction.rx_data          = data;
+    transaction.rx_size          = size;
+    transaction.callback         = callback;
+    transaction.callback_context = callback_context;
+    return QueueTransaction(transaction);
+}
 
-    const int i2cIdx = int(config_.periph);
+I2CHandle::Result
+I2CHandle::Impl::QueueTransaction(const I2CHandle::Transaction& transaction)
+{
+    const bool has_tx = transaction.tx_data != nullptr && transaction.tx_size;
+    const bool has_rx = transaction.rx_data != nullptr && transaction.rx_size;
+    if(!has_tx && !has_rx)
+        return I2CHandle::Result::ERR;
+    // a slave can't choose to send and then receive
+    if(has_tx && has_rx
+       && config_.mode != I2CHandle::Config::Mode::I2C_MASTER)
+        return I2CHandle::Result::ERR;
 
-    I2CHandle::Direction direction = I2CHandle::Direction::RECEIVE;
+    I2CHandle::Transaction job = transaction;
+    if(!has_tx)
+        job.tx_size = 0;
+    if(!has_rx)
+        job.rx_size = 0;
+    if(!queue_.Push(job))
+        return I2CHandle::Result::ERR;
 
-    // if dma is currently running - queue a job
-    if(IsDmaActive())
-    {
-        DmaJob job;
-        job.slave_address    = address;
-        job.data             = data;
-        job.size             = size;
-        job.direction        = direction;
-        job.callback         = callback;
-        job.callback_context = callback_context;
-        // queue a job (blocks until the queue position is free)
-        QueueDmaTransfer(i2cIdx, job);
-        // TODO: the user can't tell if he got returned "OK"
-        // because the transfer was executed or because it was queued...
-        // should we change that?
-        return I2CHandle::Result::OK;
-    }
-    else
-        // start reception right away
-        return StartDmaReception(
-            address, data, size, callback, callback_context);
+    // start right away if the peripheral (and the DMA) is idle
+    ScheduleNext();
+    return I2CHandle::Result::OK;
 }
 
 I2CHandle::Result I2CHandle::Impl::ReadDataAtAddress(uint16_t address,
@@ -421,18 +519,19 @@ I2CHandle::Result I2CHandle::Impl::ReadDataAtAddress(uint16_t address,
         return I2CHandle::Result::ERR;
 
     // wait for previous transfer to be finished
+    PauseQueue();
     while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
-    if(HAL_I2C_Mem_Read(&i2c_hal_handle_,
-                        address,
-                        mem_address,
-                        mem_address_size,
-                        data,
-                        data_size,
-                        timeout)
-       != HAL_OK)
-    {
+    const HAL_StatusTypeDef status
+        = HAL_I2C_Mem_Read(&i2c_hal_handle_,
+                           address,
+                           mem_address,
+                           mem_address_size,
+                           data,
+                           data_size,
+                           timeout);
+    ResumeQueue();
+    if(status != HAL_OK)
         return I2CHandle::Result::ERR;
-    }
     return I2CHandle::Result::OK;
 }
 
@@ -448,52 +547,47 @@ I2CHandle::Result I2CHandle::Impl::WriteDataAtAddress(uint16_t address,
         return I2CHandle::Result::ERR;
 
     // wait for previous transfer to be finished
+    PauseQueue();
     while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
-    if(HAL_I2C_Mem_Write(&i2c_hal_handle_,
-                         address,
-                         mem_address,
-                         mem_address_size,
-                         data,
-                         data_size,
-                         timeout)
-       != HAL_OK)
-    {
+    const HAL_StatusTypeDef status
+        = HAL_I2C_Mem_Write(&i2c_hal_handle_,
+                            address,
+                            mem_address,
+                            mem_address_size,
+                            data,
+                            data_size,
+                            timeout);
+    ResumeQueue();
+    if(status != HAL_OK)
         return I2CHandle::Result::ERR;
-    }
     return I2CHandle::Result::OK;
 }
 
-I2CHandle::Result
-I2CHandle::Impl::StartDmaTransmission(uint16_t                       address,
-                                      uint8_t*                       data,
-                                      uint16_t                       size,
-                                      I2CHandle::CallbackFunctionPtr callback,
-                                      void* callback_context)
+I2CHandle::Result I2CHandle::Impl::InitDma(I2CHandle::Direction direction)
 {
-    // this could be called from both the scheduler ISR
-    // and from user code via dsy_i2c_transmit_dma()
-    // TODO: Add some sort of locking mechanism.
-
-    // wait for previous transfer to be finished
-    while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
+    const bool receive = direction == I2CHandle::Direction::RECEIVE;
 
     // reinit the DMA
     i2c_dma_tc_handle_.Instance = DMA1_Stream6;
     switch(config_.periph)
     {
         case I2CHandle::Config::Peripheral::I2C_1:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C1_TX;
+            i2c_dma_tc_handle_.Init.Request
+                = receive ? DMA_REQUEST_I2C1_RX : DMA_REQUEST_I2C1_TX;
             break;
         case I2CHandle::Config::Peripheral::I2C_2:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C2_TX;
+            i2c_dma_tc_handle_.Init.Request
+                = receive ? DMA_REQUEST_I2C2_RX : DMA_REQUEST_I2C2_TX;
             break;
         case I2CHandle::Config::Peripheral::I2C_3:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C3_TX;
+            i2c_dma_tc_handle_.Init.Request
+                = receive ? DMA_REQUEST_I2C3_RX : DMA_REQUEST_I2C3_TX;
             break;
-        // I2C4 has no DMA yet. TODO
+        // I2C4 is only connected to the BDMA
         default: return I2CHandle::Result::ERR;
     }
-    i2c_dma_tc_handle_.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+    i2c_dma_tc_handle_.Init.Direction
+        = receive ? DMA_PERIPH_TO_MEMORY : DMA_MEMORY_TO_PERIPH;
     i2c_dma_tc_handle_.Init.PeriphInc           = DMA_PINC_DISABLE;
     i2c_dma_tc_handle_.Init.MemInc              = DMA_MINC_ENABLE;
     i2c_dma_tc_handle_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
@@ -509,105 +603,84 @@ I2CHandle::Impl::StartDmaTransmission(uint16_t                       address,
         Error_Handler();
     }
 
-    __HAL_LINKDMA(&i2c_hal_handle_, hdmatx, i2c_dma_tc_handle_);
-
-    // start the transfer and block irq until return
-    ScopedIrqBlocker block;
-
-    dma_active_peripheral_ = int(config_.periph);
-    next_callback_         = callback;
-    next_callback_context_ = callback_context;
-
-    HAL_StatusTypeDef status;
-    if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER)
+    if(receive)
     {
-        status = HAL_I2C_Master_Transmit_DMA(
-            &i2c_hal_handle_, address << 1, data, size);
+        __HAL_LINKDMA(&i2c_hal_handle_, hdmarx, i2c_dma_tc_handle_);
     }
     else
     {
-        status = HAL_I2C_Slave_Transmit_DMA(&i2c_hal_handle_, data, size);
-    }
-
-    if(status != HAL_OK)
-    {
-        dma_active_peripheral_ = -1;
-        next_callback_         = NULL;
-        next_callback_context_ = NULL;
-        return I2CHandle::Result::ERR;
+        __HAL_LINKDMA(&i2c_hal_handle_, hdmatx, i2c_dma_tc_handle_);
     }
     return I2CHandle::Result::OK;
 }
 
-I2CHandle::Result
-I2CHandle::Impl::StartDmaReception(uint16_t                       address,
-                                   uint8_t*                       data,
-                                   uint16_t                       size,
-                                   I2CHandle::CallbackFunctionPtr callback,
-                                   void* callback_context)
+I2CHandle::Result I2CHandle::Impl::StartTransmission(uint16_t address,
+                                                     uint8_t* data,
+                                                     uint16_t size,
+                                                     uint32_t xfer_options)
 {
-    // wait for previous transfer to be finished
-    while(HAL_I2C_GetState(&i2c_hal_handle_) != HAL_I2C_STATE_READY) {};
+    if(UsesDma()
+       && InitDma(I2CHandle::Direction::TRANSMIT) != I2CHandle::Result::OK)
+        return I2CHandle::Result::ERR;
 
-    // reinit the DMA
-    i2c_dma_tc_handle_.Instance = DMA1_Stream6;
-    switch(config_.periph)
+    HAL_StatusTypeDef status;
+    if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER)
     {
-        case I2CHandle::Config::Peripheral::I2C_1:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C1_RX;
-            break;
-        case I2CHandle::Config::Peripheral::I2C_2:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C2_RX;
-            break;
-        case I2CHandle::Config::Peripheral::I2C_3:
-            i2c_dma_tc_handle_.Init.Request = DMA_REQUEST_I2C3_RX;
-            break;
-        // I2C4 has no DMA yet. TODO
-        default: return I2CHandle::Result::ERR;
+        status = UsesDma() ? HAL_I2C_Master_Seq_Transmit_DMA(&i2c_hal_handle_,
+                                                             address << 1,
+                                                             data,
+                                                             size,
+                                                             xfer_options)
+                           : HAL_I2C_Master_Seq_Transmit_IT(&i2c_hal_handle_,
+                                                            address << 1,
+                                                            data,
+                                                            size,
+                                                            xfer_options);
     }
-    i2c_dma_tc_handle_.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-    i2c_dma_tc_handle_.Init.PeriphInc           = DMA_PINC_DISABLE;
-    i2c_dma_tc_handle_.Init.MemInc              = DMA_MINC_ENABLE;
-    i2c_dma_tc_handle_.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
-    i2c_dma_tc_handle_.Init.MemDataAlignment    = DMA_MDATAALIGN_BYTE;
-    i2c_dma_tc_handle_.Init.Mode                = DMA_NORMAL;
-    i2c_dma_tc_handle_.Init.Priority            = DMA_PRIORITY_LOW;
-    i2c_dma_tc_handle_.Init.FIFOMode            = DMA_FIFOMODE_DISABLE;
-    i2c_dma_tc_handle_.Init.MemBurst            = DMA_MBURST_SINGLE;
-    i2c_dma_tc_handle_.Init.PeriphBurst         = DMA_PBURST_SINGLE;
-
-    if(HAL_DMA_Init(&i2c_dma_tc_handle_) != HAL_OK)
+    else
     {
-        Error_Handler();
+        status = UsesDma()
+                     ? HAL_I2C_Slave_Transmit_DMA(&i2c_hal_handle_, data, size)
+                     : HAL_I2C_Slave_Transmit_IT(&i2c_hal_handle_, data, size);
     }
 
-    __HAL_LINKDMA(&i2c_hal_handle_, hdmarx, i2c_dma_tc_handle_);
-
-    // start the transfer and block irq until return
-    ScopedIrqBlocker block;
+    if(status != HAL_OK)
+        return I2CHandle::Result::ERR;
+    return I2CHandle::Result::OK;
+}
 
-    dma_active_peripheral_ = int(config_.periph);
-    next_callback_         = callback;
-    next_callback_context_ = callback_context;
+I2CHandle::Result I2CHandle::Impl::StartReception(uint16_t address,
+                                                  uint8_t* data,
+                                                  uint16_t size,
+                                                  uint32_t xfer_options)
+{
+    if(UsesDma()
+       && InitDma(I2CHandle::Direction::RECEIVE) != I2CHandle::Result::OK)
+        return I2CHandle::Result::ERR;
 
     HAL_StatusTypeDef status;
     if(config_.mode == I2CHandle::Config::Mode::I2C_MASTER)
     {
-        status = HAL_I2C_Master_Receive_DMA(
-            &i2c_hal_handle_, address << 1, data, size);
+        status = UsesDma() ? HAL_I2C_Master_Seq_Receive_DMA(&i2c_hal_handle_,
+                                                            address << 1,
+                                                            data,
+                                                            size,
+                                                            xfer_options)
+                           : HAL_I2C_Master_Seq_Receive_IT(&i2c_hal_handle_,
+                                                           address << 1,
+                                                           data,
+                                                           size,
+                                                           xfer_options);
     }
     else
     {
-        status = HAL_I2C_Slave_Receive_DMA(&i2c_hal_handle_, data, size);
+        status = UsesDma()
+                     ? HAL_I2C_Slave_Receive_DMA(&i2c_hal_handle_, data, size)
+                     : HAL_I2C_Slave_Receive_IT(&i2c_hal_handle_, data, size);
     }
 
     if(status != HAL_OK)
-    {
-        dma_active_peripheral_ = -1;
-        next_callback_         = NULL;
-        next_callback_context_ = NULL;
         return I2CHandle::Result::ERR;
-    }
     return I2CHandle::Result::OK;
 }
 
@@ -656,10 +729,7 @@ void I2CHandle::Impl::DeinitPins()
     HAL_GPIO_DeInit(port, pin);
 }
 
-volatile int8_t         I2CHandle::Impl::dma_active_peripheral_;
-I2CHandle::Impl::DmaJob I2CHandle::Impl::queued_dma_transfers_[kNumI2CWithDma];
-I2CHandle::CallbackFunctionPtr I2CHandle::Impl::next_callback_;
-void*                          I2CHandle::Impl::next_callback_context_;
+volatile int8_t I2CHandle::Impl::dma_active_peripheral_;
 
 // ======================================================================
 // HAL service functions
@@ -676,6 +746,8 @@ extern "C" void HAL_I2C_MspInit(I2C_HandleTypeDef* i2c_handle)
 
         HAL_NVIC_SetPriority(I2C1_EV_IRQn, 0, 0);
         HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+        HAL_NVIC_SetPriority(I2C1_ER_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
     }
     else if(i2c_handle->Instance == I2C2)
     {
@@ -687,6 +759,8 @@ extern "C" void HAL_I2C_MspInit(I2C_HandleTypeDef* i2c_handle)
 
         HAL_NVIC_SetPriority(I2C2_EV_IRQn, 0, 0);
         HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
+        HAL_NVIC_SetPriority(I2C2_ER_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
     }
     else if(i2c_handle->Instance == I2C3)
     {
@@ -697,6 +771,8 @@ extern "C" void HAL_I2C_MspInit(I2C_HandleTypeDef* i2c_handle)
 
         HAL_NVIC_SetPriority(I2C3_EV_IRQn, 0, 0);
         HAL_NVIC_EnableIRQ(I2C3_EV_IRQn);
+        HAL_NVIC_SetPriority(I2C3_ER_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(I2C3_ER_IRQn);
     }
     else if(i2c_handle->Instance == I2C4)
     {
@@ -704,8 +780,11 @@ extern "C" void HAL_I2C_MspInit(I2C_HandleTypeDef* i2c_handle)
         i2c_handles[3].InitPins();
         __HAL_RCC_I2C4_CLK_ENABLE();
 
-        // I2C4 needs BMDA
-        // TODO
+        // I2C4 is only connected to the BDMA, it transfers with interrupts
+        HAL_NVIC_SetPriority(I2C4_EV_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(I2C4_EV_IRQn);
+        HAL_NVIC_SetPriority(I2C4_ER_IRQn, 0, 0);
+        HAL_NVIC_EnableIRQ(I2C4_ER_IRQn);
     }
 }
 
@@ -772,29 +851,54 @@ extern "C" void I2C3_EV_IRQHandler()
     HAL_I2C_EV_IRQHandler(&i2c_handles[2].i2c_hal_handle_);
 }
 
+extern "C" void I2C4_EV_IRQHandler()
+{
+    HAL_I2C_EV_IRQHandler(&i2c_handles[3].i2c_hal_handle_);
+}
+
+extern "C" void I2C1_ER_IRQHandler()
+{
+    HAL_I2C_ER_IRQHandler(&i2c_handles[0].i2c_hal_handle_);
+}
+
+extern "C" void I2C2_ER_IRQHandler()
+{
+    HAL_I2C_ER_IRQHandler(&i2c_handles[1].i2c_hal_handle_);
+}
+
+extern "C" void I2C3_ER_IRQHandler()
+{
+    HAL_I2C_ER_IRQHandler(&i2c_handles[2].i2c_hal_handle_);
+}
+
+extern "C" void I2C4_ER_IRQHandler()
+{
+    HAL_I2C_ER_IRQHandler(&i2c_handles[3].i2c_hal_handle_);
+}
+
 extern "C" void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef* i2c_handle)
 {
-    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
+    I2CHandle::Impl::TransferFinished(i2c_handle, I2CHandle::Result::OK);
 }
 
 extern "C" void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef* i2c_handle)
 {
-    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
+    I2CHandle::Impl::TransferFinished(i2c_handle, I2CHandle::Result::OK);
 }
 
 extern "C" void HAL_I2C_SlaveTxCpltCallback(I2C_HandleTypeDef* i2c_handle)
 {
-    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
+    I2CHandle::Impl::TransferFinished(i2c_handle, I2CHandle::Result::OK);
 }
 
 extern "C" void HAL_I2C_SlaveRxCpltCallback(I2C_HandleTypeDef* i2c_handle)
 {
-    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::OK);
+    I2CHandle::Impl::TransferFinished(i2c_handle, I2CHandle::Result::OK);
 }
 
 extern "C" void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* i2c_handle)
 {
-    I2CHandle::Impl::DmaTransferFinished(i2c_handle, I2CHandle::Result::ERR);
+    I2CHandle::Impl::TransferFinished(i2c_handle, I2CHandle::Result::ERR);
 }
 
 // ======================================================================
@@ -848,6 +952,16 @@ I2CHandle::Result I2CHandle::ReceiveDma(uint16_t                       address,
     return pimpl_->ReceiveDma(address, data, size, callback, callback_context);
 }
 
+I2CHandle::Result I2CHandle::QueueTransaction(const Transaction& transaction)
+{
+    return pimpl_->QueueTransaction(transaction);
+}
+
+size_t I2CHandle::GetNumQueuedTransactions() const
+{
+    return pimpl_->GetNumQueuedTransactions();
+}
+
 
 I2CHandle::Result I2CHandle::ReadDataAtAddress(uint16_t address,
                                                uint16_t mem_address,
@@ -118,6 +118,37 @@ class I2CHandle
     /** A callback to be executed when a dma transfer is complete. */
     typedef void (*CallbackFunctionPtr)(void* context, Result result);
 
+    /** A transfer for QueueTransaction().
+     *  Writes tx_data, then reads rx_data after a repeated start, e.g. to
+     *  read registers from a sensor. Either part can be left out.
+     *  The buffers have the same requirements as for TransmitDma() and must
+     *  stay valid until the callback is made.
+     */
+    struct Transaction
+    {
+        /** The slave device address. Unused in slave mode. */
+        uint16_t address = 0x10;
+        /** Data to write first, or nullptr */
+        uint8_t* tx_data = nullptr;
+        uint16_t tx_size = 0; /**< & */
+        /** Buffer for the data to read, or nullptr */
+        uint8_t* rx_data = nullptr;
+        uint16_t rx_size = 0; /**< & */
+        /** Transactions with a higher priority run first */
+        uint8_t priority = 0;
+        /** System::GetNow() time by which the transaction should be done,
+         *  or 0 for none. Transactions of the same priority run earliest
+         *  deadline first. Late transactions still run.
+         */
+        uint32_t deadline = 0;
+        /** Called when the transaction is done, or nullptr */
+        CallbackFunctionPtr callback         = nullptr;
+        void*               callback_context = nullptr; /**< & */
+    };
+
+    /** Number of transactions that can be queued per I2C peripheral */
+    static constexpr size_t kTransactionQueueSize = 8;
+
     /** Transmits data with a DMA and returns immediately. Use this for larger transmissions.
      *  The pointer to data must be located in the D2 memory domain by adding the 
      *  `DMA_BUFFER_MEM_SECTION` attribute like this:
@@ -126,10 +157,9 @@ class I2CHandle
      *  the buffer, before initiating the dma transfer by calling 
      *  `dsy_dma_clear_cache_for_buffer(buffer, size);`
      * 
-     *  A single DMA is shared across I2C1, I2C2 and I2C3. I2C4 has no DMA support (yet).
-     *  If the DMA is busy with another transfer, the job will be queued and executed later.
-     *  If there is a job waiting to be executed for this I2C peripheral, this function
-     *  will block until the queue is free and the job can be queued.
+     *  A single DMA is shared across I2C1, I2C2 and I2C3. I2C4 transfers use interrupts.
+     *  If the DMA is busy with another transfer, the job will be queued and executed later,
+     *  see QueueTransaction(). This function never blocks.
      * 
      *  \param address      The slave device address. Unused in slave mode.
      *  \param data         A pointer to the data to be sent.
@@ -151,10 +181,9 @@ class I2CHandle
      *  the buffer, before initiating the dma transfer by calling 
      *  `dsy_dma_clear_cache_for_buffer(buffer, size);`
      * 
-     *  A single DMA is shared across I2C, I2C2 and I2C3. I2C4 has no DMA support (yet).
-     *  If the DMA is busy with another transfer, the job will be queued and executed later.
-     *  If there is a job waiting to be executed for this I2C peripheral, this function
-     *  will block until the queue is free and the job can be queued.
+     *  A single DMA is shared across I2C1, I2C2 and I2C3. I2C4 transfers use interrupts.
+     *  If the DMA is busy with another transfer, the job will be queued and executed later,
+     *  see QueueTransaction(). This function never blocks.
      * 
      *  \param address      The slave device address. Unused in slave mode.
      *  \param data         A pointer to the data buffer.
@@ -168,6 +197,27 @@ class I2CHandle
                       CallbackFunctionPtr callback,
                       void*               callback_context);
 
+    /** Queues a transaction and returns immediately.
+     *  Each I2C peripheral has a queue of kTransactionQueueSize transactions.
+     *  Whenever a transfer finishes, the most urgent queued transaction of
+     *  I2C1..I2C3, which share a DMA stream, is started, so several devices
+     *  can be read without waiting in the main loop. I2C4 runs its queue on
+     *  its own, with interrupts. A blocking transfer waits for the running
+     *  transaction, and queued transactions of that peripheral wait until
+     *  it is done.
+     *  The callback is made from an interrupt once the whole transaction is
+     *  done, and may queue the next transaction. Interrupts are enabled
+     *  while it runs, and the next queued transaction is already running.
+     *
+     *  \param transaction  The transaction, copied into the queue.
+     *  \return ERR if the queue is full or the transaction is empty. A write
+     *          followed by a read is only possible in master mode.
+     */
+    Result QueueTransaction(const Transaction& transaction);
+
+    /** Returns the number of queued transactions that haven't started yet */
+    size_t GetNumQueuedTransactions() const;
+
     /** Reads an amount of data from a specific memory address. 
     *   This method will return an error if the I2C peripheral is in slave mode. 
     * 
@@ -1,12 +1,17 @@
 #include "per/sai.h"
 #include "daisy_core.h"
+#ifndef UNIT_TEST
 extern "C"
 {
 #include "util/hal_map.h"
 }
+#else
+#include <cstring>
+#endif
 
 namespace daisy
 {
+#ifndef UNIT_TEST
 class SaiHandle::Impl
 {
   public:
@@ -30,6 +35,7 @@ class SaiHandle::Impl
     float  GetSampleRate();
     size_t GetBlockSize();
     float  GetBlockRate();
+    size_t GetNumPendingTransfers();
 
     SaiHandle::Config config_;
     SAI_HandleTypeDef sai_a_handle_, sai_b_handle_;
@@ -81,6 +87,9 @@ SaiHandle::Result SaiHandle::Impl::Init(const SaiHandle::Config& config)
     const int sai_idx = int(config.periph);
     if(sai_idx >= 2)
         return Result::ERR;
+    if(config.num_slots < 2 || config.num_slots > 16
+       || (config.num_slots & 1))
+        return Result::ERR;
 
     // Default Buffer states
     buff_rx_   = nullptr;
@@ -189,13 +198,17 @@ SaiHandle::Result SaiHandle::Impl::Init(const SaiHandle::Config& config)
     sai_b_handle_.Init.MonoStereoMode = SAI_STEREOMODE;
     sai_b_handle_.Init.CompandingMode = SAI_NOCOMPANDING;
     sai_b_handle_.Init.TriState       = SAI_OUTPUT_NOTRELEASED;
-    if(HAL_SAI_InitProtocol(&sai_a_handle_, protocol, bd, 2) != HAL_OK)
+    // With more than 2 slots this is TDM with a 50% duty cycle frame sync,
+    // the slots split evenly between the two halves of the frame.
+    if(HAL_SAI_InitProtocol(&sai_a_handle_, protocol, bd, config.num_slots)
+       != HAL_OK)
     {
         Error_Handler();
         return Result::ERR;
     }
 
-    if(HAL_SAI_InitProtocol(&sai_b_handle_, protocol, bd, 2) != HAL_OK)
+    if(HAL_SAI_InitProtocol(&sai_b_handle_, protocol, bd, config.num_slots)
+       != HAL_OK)
     {
         Error_Handler();
         return Result::ERR;
@@ -297,6 +310,24 @@ void SaiHandle::Impl::InternalCallback(size_t offset)
         callback_(in, out, buff_size_ / 2);
 }
 
+size_t SaiHandle::Impl::GetNumPendingTransfers()
+{
+    if(buff_rx_ == nullptr)
+        return 0;
+    // The callbacks come from the receiving block's stream. The HAL clears
+    // a flag right before its callback, so a set flag is a transfer that
+    // finished while the callback ran, or before it could start.
+    DMA_HandleTypeDef* hdma = config_.a_dir == Config::Direction::RECEIVE
+                                  ? &sai_a_dma_handle_
+                                  : &sai_b_dma_handle_;
+    size_t num = 0;
+    if(__HAL_DMA_GET_FLAG(hdma, __HAL_DMA_GET_HT_FLAG_INDEX(hdma)))
+        num++;
+    if(__HAL_DMA_GET_FLAG(hdma, __HAL_DMA_GET_TC_FLAG_INDEX(hdma)))
+        num++;
+    return num;
+}
+
 SaiHandle::Result
 SaiHandle::Impl::StartDmaTransfer(int32_t*                       buffer_rx,
                                   int32_t*                       buffer_tx,
@@ -351,8 +382,8 @@ float SaiHandle::Impl::GetSampleRate()
 }
 size_t SaiHandle::Impl::GetBlockSize()
 {
-    // Buffer handled in halves, 2 samples per frame (1 per channel)
-    return buff_size_ / 2 / 2;
+    // Buffer handled in halves, 1 sample per slot in each frame
+    return buff_size_ / 2 / config_.num_slots;
 }
 float SaiHandle::Impl::GetBlockRate()
 {
@@ -532,6 +563,136 @@ extern "C" void HAL_SAI_RxCpltCallback(SAI_HandleTypeDef* hsai)
     }
 }
 
+#else // ifndef UNIT_TEST
+
+// ================================================================
+// Host backend for unit tests
+// ================================================================
+
+/** There is no SAI peripheral or DMA engine on the host. StartDma only 
+ *  records the buffers and the callback; the DMA half/complete interrupts
+ *  are emulated by SimulateDmaCallbackForUnitTest, one half-buffer at a time.
+ */
+class SaiHandle::Impl
+{
+  public:
+    SaiHandle::Result Init(const SaiHandle::Config& config)
+    {
+        if(int(config.periph) >= 2)
+            return Result::ERR;
+        if(config.num_slots < 2 || config.num_slots > 16
+           || (config.num_slots & 1))
+            return Result::ERR;
+        buff_rx_     = nullptr;
+        buff_tx_     = nullptr;
+        buff_size_   = 0;
+        callback_    = nullptr;
+        dma_offset   = 0;
+        next_offset_ = 0;
+        num_pending_ = 0;
+        config_      = config;
+        return Result::OK;
+    }
+
+    SaiHandle::Result        DeInit() { return StopDmaTransfer(); }
+    const SaiHandle::Config& GetConfig() const { return config_; }
+
+    SaiHandle::Result StartDmaTransfer(int32_t*                       buffer_rx,
+                                       int32_t*                       buffer_tx,
+                                       size_t                         size,
+                                       SaiHandle::CallbackFunctionPtr callback)
+    {
+        buff_rx_     = buffer_rx;
+        buff_tx_     = buffer_tx;
+        buff_size_   = size;
+        callback_    = callback;
+        dma_offset   = 0;
+        next_offset_ = 0;
+        return Result::OK;
+    }
+
+    SaiHandle::Result StopDmaTransfer()
+    {
+        buff_rx_  = nullptr;
+        buff_tx_  = nullptr;
+        callback_ = nullptr;
+        return Result::OK;
+    }
+
+    SaiHandle::Result SimulateDmaCallback(const int32_t* rx)
+    {
+        if(buff_rx_ == nullptr || buff_tx_ == nullptr)
+            return Result::ERR;
+        dma_offset   = next_offset_;
+        next_offset_ = dma_offset == 0 ? buff_size_ / 2 : 0;
+        if(rx)
+            std::memcpy(
+                buff_rx_ + dma_offset, rx, (buff_size_ / 2) * sizeof(int32_t));
+        if(callback_)
+            callback_(buff_rx_ + dma_offset,
+                      buff_tx_ + dma_offset,
+                      buff_size_ / 2);
+        return Result::OK;
+    }
+
+    SaiHandle::Result ReadTx(int32_t* tx) const
+    {
+        if(buff_tx_ == nullptr || tx == nullptr)
+            return Result::ERR;
+        std::memcpy(
+            tx, buff_tx_ + dma_offset, (buff_size_ / 2) * sizeof(int32_t));
+        return Result::OK;
+    }
+
+    float GetSampleRate()
+    {
+        switch(config_.sr)
+        {
+            case Config::SampleRate::SAI_8KHZ: return 8000.f;
+            case Config::SampleRate::SAI_16KHZ: return 16000.f;
+            case Config::SampleRate::SAI_32KHZ: return 32000.f;
+            case Config::SampleRate::SAI_48KHZ: return 48000.f;
+            case Config::SampleRate::SAI_96KHZ: return 96000.f;
+            default: return 48000.f;
+        }
+    }
+    size_t GetBlockSize() { return buff_size_ / 2 / config_.num_slots; }
+    float  GetBlockRate() { return GetSampleRate() / GetBlockSize(); }
+    size_t GetNumPendingTransfers() { return num_pending_; }
+
+    SaiHandle::Config              config_;
+    int32_t *                      buff_rx_, *buff_tx_;
+    size_t                         buff_size_;
+    SaiHandle::CallbackFunctionPtr callback_;
+    size_t                         dma_offset;
+    size_t                         next_offset_;
+    size_t                         num_pending_;
+};
+
+static SaiHandle::Impl sai_handles[2];
+
+SaiHandle::Result SaiHandle::SimulateDmaCallbackForUnitTest(const int32_t* rx)
+{
+    if(!IsInitialized())
+        return Result::ERR;
+    return pimpl_->SimulateDmaCallback(rx);
+}
+
+SaiHandle::Result SaiHandle::ReadTxForUnitTest(int32_t* tx) const
+{
+    if(!IsInitialized())
+        return Result::ERR;
+    return pimpl_->ReadTx(tx);
+}
+
+void SaiHandle::SetNumPendingTransfersForUnitTest(size_t num)
+{
+    if(IsInitialized())
+        pimpl_->num_pending_ = num;
+}
+
+#endif // ifndef UNIT_TEST
+
 // ================================================================
 // SaiHandle -> SaiHandle::Pimpl
 // ================================================================
@@ -585,5 +746,10 @@ size_t SaiHandle::GetOffset() const
     return pimpl_->dma_offset;
 }
 
+size_t SaiHandle::GetNumPendingTransfers() const
+{
+    return pimpl_->GetNumPendingTransfers();
+}
+
 
 } // namespace daisy
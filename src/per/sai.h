@@ -96,6 +96,14 @@ class SaiHandle
         BitDepth   bit_depth;
         Sync       a_sync, b_sync;
         Direction  a_dir, b_dir;
+
+        /** Number of audio slots (channels) per frame, 2 to 16, must be even.
+         ** 2 is standard stereo I2S, more than 2 selects TDM. Samples in the
+         ** DMA buffers are interleaved by slot: { S0, S1, . . . SN, S0, . . . }
+         ** The total frame length is limited to 256 bits by the peripheral,
+         ** so 16 slots are only possible with 16 bit samples.
+         */
+        uint8_t num_slots = 2;
     };
 
     /** Return values for SAI functions */
@@ -142,7 +150,7 @@ class SaiHandle
     float GetSampleRate();
 
     /** Returns the number of samples per audio block 
-     ** Calculated as Buffer Size / 2 / number of channels */
+     ** Calculated as Buffer Size / 2 / number of slots */
     size_t GetBlockSize();
 
     /** Returns the Block Rate of the current stream based on the size 
@@ -153,11 +161,36 @@ class SaiHandle
     /** Returns the current offset within the SAI buffer, will be either 0 or size/2 */
     size_t GetOffset() const;
 
+    /** Returns the number of DMA half/complete transfers that have finished
+     ** but whose callback hasn't run yet, 0 to 2. Checked at the end of the
+     ** callback, anything but 0 means it has missed its deadline.
+     */
+    size_t GetNumPendingTransfers() const;
+
     inline bool IsInitialized() const
     {
         return pimpl_ == nullptr ? false : true;
     }
 
+#ifdef UNIT_TEST
+    /** Host backend only: emulates one DMA half/complete interrupt.
+     ** The offset advances to the next half of the buffer, \p rx (size / 2 
+     ** words, as passed to StartDma) is copied into that half of the receive
+     ** buffer, and the callback passed to StartDma is dispatched.
+     */
+    Result SimulateDmaCallbackForUnitTest(const int32_t* rx);
+
+    /** Host backend only: copies the current half of the transmit buffer
+     ** (size / 2 words) into \p tx. 
+     */
+    Result ReadTxForUnitTest(int32_t* tx) const;
+
+    /** Host backend only: sets the value returned by 
+     ** GetNumPendingTransfers(), as there are no DMA flags to read.
+     */
+    void SetNumPendingTransfersForUnitTest(size_t num);
+#endif
+
     class Impl; /**< Private Implementation class */
 
   private:
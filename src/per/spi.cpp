@@ -43,6 +43,10 @@ class SpiHandle::Impl
     const SpiHandle::Config& GetConfig() const { return config_; }
     int                      CheckError();
 
+    Result SetClockConfig(Config::ClockPolarity clock_polarity,
+                          Config::ClockPhase    clock_phase,
+                          Config::BaudPrescaler baud_prescaler);
+
     Result BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout);
     Result BlockingReceive(uint8_t* buffer, uint16_t size, uint32_t timeout);
     Result BlockingTransmitAndReceive(uint8_t* tx_buff,
@@ -143,6 +147,70 @@ void SpiHandle::Impl::GlobalInit()
         queued_dma_transfers_[per] = SpiHandle::Impl::SpiDmaJob();
 }
 
+// maps the clock settings to the HAL's values. Returns false if one is
+// invalid.
+static bool GetHalClockConfig(SpiHandle::Config::ClockPolarity polarity,
+                              SpiHandle::Config::ClockPhase    phase,
+                              SpiHandle::Config::BaudPrescaler prescaler,
+                              uint32_t*                        clock_polarity,
+                              uint32_t*                        clock_phase,
+                              uint32_t*                        baud_prescaler)
+{
+    using Config = SpiHandle::Config;
+
+    switch(polarity)
+    {
+        case Config::ClockPolarity::LOW:
+            *clock_polarity = SPI_POLARITY_LOW;
+            break;
+        case Config::ClockPolarity::HIGH:
+            *clock_polarity = SPI_POLARITY_HIGH;
+            break;
+        default: return false;
+    }
+
+    switch(phase)
+    {
+        case Config::ClockPhase::ONE_EDGE:
+            *clock_phase = SPI_PHASE_1EDGE;
+            break;
+        case Config::ClockPhase::TWO_EDGE:
+            *clock_phase = SPI_PHASE_2EDGE;
+            break;
+        default: return false;
+    }
+
+    switch(prescaler)
+    {
+        case Config::BaudPrescaler::PS_2:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_2;
+            break;
+        case Config::BaudPrescaler::PS_4:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_4;
+            break;
+        case Config::BaudPrescaler::PS_8:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_8;
+            break;
+        case Config::BaudPrescaler::PS_16:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_16;
+            break;
+        case Config::BaudPrescaler::PS_32:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_32;
+            break;
+        case Config::BaudPrescaler::PS_64:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_64;
+            break;
+        case Config::BaudPrescaler::PS_128:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_128;
+            break;
+        case Config::BaudPrescaler::PS_256:
+            *baud_prescaler = SPI_BAUDRATEPRESCALER_256;
+            break;
+        default: return false;
+    }
+    return true;
+}
+
 SpiHandle::Result SpiHandle::Impl::Init(const Config& config)
 {
     config_ = config;
@@ -194,24 +262,15 @@ SpiHandle::Result SpiHandle::Impl::Init(const Config& config)
         return Result::ERR;
     }
 
-    uint32_t clock_polarity;
-    switch(config_.clock_polarity)
+    uint32_t clock_polarity, clock_phase, baud_prescaler;
+    if(!GetHalClockConfig(config_.clock_polarity,
+                          config_.clock_phase,
+                          config_.baud_prescaler,
+                          &clock_polarity,
+                          &clock_phase,
+                          &baud_prescaler))
     {
-        case Config::ClockPolarity::LOW:
-            clock_polarity = SPI_POLARITY_LOW;
-            break;
-        case Config::ClockPolarity::HIGH:
-            clock_polarity = SPI_POLARITY_HIGH;
-            break;
-        default: return Result::ERR;
-    }
-
-    uint32_t clock_phase;
-    switch(config_.clock_phase)
-    {
-        case Config::ClockPhase::ONE_EDGE: clock_phase = SPI_PHASE_1EDGE; break;
-        case Config::ClockPhase::TWO_EDGE: clock_phase = SPI_PHASE_2EDGE; break;
-        default: return Result::ERR;
+        return Result::ERR;
     }
 
     uint32_t nss;
@@ -223,36 +282,6 @@ SpiHandle::Result SpiHandle::Impl::Init(const Config& config)
         default: return Result::ERR;
     }
 
-    uint32_t baud_prescaler;
-    switch(config_.baud_prescaler)
-    {
-        case Config::BaudPrescaler::PS_2:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_2;
-            break;
-        case Config::BaudPrescaler::PS_4:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_4;
-            break;
-        case Config::BaudPrescaler::PS_8:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_8;
-            break;
-        case Config::BaudPrescaler::PS_16:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_16;
-            break;
-        case Config::BaudPrescaler::PS_32:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_32;
-            break;
-        case Config::BaudPrescaler::PS_64:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_64;
-            break;
-        case Config::BaudPrescaler::PS_128:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_128;
-            break;
-        case Config::BaudPrescaler::PS_256:
-            baud_prescaler = SPI_BAUDRATEPRESCALER_256;
-            break;
-        default: return Result::ERR;
-    }
-
     hspi_.Instance               = periph;
     hspi_.Init.Mode              = mode;
     hspi_.Init.Direction         = direction;
@@ -367,24 +396,33 @@ SpiHandle::Result SpiHandle::Impl::InitDma()
 void SpiHandle::Impl::DmaTransferFinished(SPI_HandleTypeDef* hspi,
                                           SpiHandle::Result  result)
 {
-    ScopedIrqBlocker block;
+    SpiHandle::EndCallbackFunctionPtr callback;
+    void*                             context;
+    {
+        ScopedIrqBlocker block;
 
-    // on an error, reinit the peripheral to clear any flags
-    if(result != SpiHandle::Result::OK)
-        HAL_SPI_Init(hspi);
+        // on an error, reinit the peripheral to clear any flags
+        if(result != SpiHandle::Result::OK)
+            HAL_SPI_Init(hspi);
 
-    dma_active_peripheral_ = -1;
+        dma_active_peripheral_ = -1;
 
-    if(next_end_callback_ != nullptr)
-    {
-        // the callback may setup another transmission, hence we shouldn't reset this to
-        // nullptr after the callback - it might overwrite the new transmission.
-        auto callback      = next_end_callback_;
-        next_end_callback_ = nullptr;
-        // make the callback
-        callback(next_callback_context_, result);
+        // the callback may setup another transmission, hence we shouldn't
+        // reset this to nullptr after the callback - it might overwrite the
+        // new transmission.
+        callback               = next_end_callback_;
+        context                = next_callback_context_;
+        next_end_callback_     = nullptr;
+        next_callback_context_ = nullptr;
     }
 
+    // make the callback with interrupts enabled, so it doesn't hold back
+    // other interrupts
+    if(callback != nullptr)
+        callback(context, result);
+
+    ScopedIrqBlocker block;
+
     // the callback could have started a new transmission right away...
     if(IsDmaBusy())
         return;
@@ -434,6 +472,44 @@ void SpiHandle::Impl::DmaTransferFinished(SPI_HandleTypeDef* hspi,
 }
 
 
+SpiHandle::Result
+SpiHandle::Impl::SetClockConfig(Config::ClockPolarity clock_polarity,
+                                Config::ClockPhase    clock_phase,
+                                Config::BaudPrescaler baud_prescaler)
+{
+    if(clock_polarity == config_.clock_polarity
+       && clock_phase == config_.clock_phase
+       && baud_prescaler == config_.baud_prescaler)
+        return SpiHandle::Result::OK;
+
+    uint32_t polarity, phase, prescaler;
+    if(!GetHalClockConfig(clock_polarity,
+                          clock_phase,
+                          baud_prescaler,
+                          &polarity,
+                          &phase,
+                          &prescaler)
+       || HAL_SPI_GetState(&hspi_) != HAL_SPI_STATE_READY)
+        return SpiHandle::Result::ERR;
+
+    config_.clock_polarity       = clock_polarity;
+    config_.clock_phase          = clock_phase;
+    config_.baud_prescaler       = baud_prescaler;
+    hspi_.Init.CLKPolarity       = polarity;
+    hspi_.Init.CLKPhase          = phase;
+    hspi_.Init.BaudRatePrescaler = prescaler;
+
+    // the configuration registers can be written while the peripheral is
+    // disabled, as it is between transfers. This is much faster than
+    // HAL_SPI_Init().
+    __HAL_SPI_DISABLE(&hspi_);
+    MODIFY_REG(hspi_.Instance->CFG1, SPI_CFG1_MBR, prescaler);
+    MODIFY_REG(
+        hspi_.Instance->CFG2, SPI_CFG2_CPOL | SPI_CFG2_CPHA, polarity | phase);
+    return SpiHandle::Result::OK;
+}
+
+
 int SpiHandle::Impl::CheckError()
 {
     return HAL_SPI_GetError(&hspi_);
@@ -1166,6 +1242,14 @@ int SpiHandle::CheckError()
     return pimpl_->CheckError();
 }
 
+SpiHandle::Result
+SpiHandle::SetClockConfig(Config::ClockPolarity clock_polarity,
+                          Config::ClockPhase    clock_phase,
+                          Config::BaudPrescaler baud_prescaler)
+{
+    return pimpl_->SetClockConfig(clock_polarity, clock_phase, baud_prescaler);
+}
+
 
 SpiHandle::Result
 SpiHandle::BlockingTransmit(uint8_t* buff, size_t size, uint32_t timeout)
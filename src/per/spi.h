@@ -215,6 +215,18 @@ class SpiHandle
     /** \return the result of HAL_SPI_GetError() to the user. */
     int CheckError();
 
+    /** Changes the clock settings, e.g. for another device on the bus.
+    Only the changed settings are written, which is quick enough to do from
+    the end callback of a DMA transfer.
+    \param clock_polarity the new clock polarity
+    \param clock_phase the new clock phase
+    \param baud_prescaler the new prescaler
+    \return ERR if a transfer is running
+    */
+    Result SetClockConfig(Config::ClockPolarity clock_polarity,
+                          Config::ClockPhase    clock_phase,
+                          Config::BaudPrescaler baud_prescaler);
+
     class Impl; /**< SPI implementation */
 
   private:
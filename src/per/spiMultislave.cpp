@@ -1,4 +1,5 @@
 #include "spiMultislave.h"
+#include "util/scopedirqblocker.h"
 
 namespace daisy
 {
@@ -16,9 +17,17 @@ SpiHandle::Result MultiSlaveSpiHandle::Init(const Config& config)
         nss_pins[i].pull = DSY_GPIO_NOPULL;
         dsy_gpio_init(&nss_pins[i]);
         DisableDevice(i);
+
+        device_clocks_[i].clock_polarity = config_.clock_polarity;
+        device_clocks_[i].clock_phase    = config_.clock_phase;
+        device_clocks_[i].baud_prescaler = config_.baud_prescaler;
     }
 
     current_dma_transfer_.Invalidate();
+    current_dma_transfer_.is_scan_step = false;
+    scheduler_.Reset();
+    scan_callback_ = nullptr;
+    paused_        = false;
 
     SpiHandle::Config spi_config;
     spi_config.baud_prescaler  = config.baud_prescaler;
@@ -44,12 +53,15 @@ SpiHandle::Result MultiSlaveSpiHandle::BlockingTransmit(size_t   device_index,
     if(device_index >= config_.num_devices)
         return SpiHandle::Result::ERR;
 
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
-
-    EnableDevice(device_index);
-    const auto result = spiHandle_.BlockingTransmit(buff, size, timeout);
-    DisableDevice(device_index);
+    PauseDma();
+    auto result = ApplyDeviceClockConfig(device_index);
+    if(result == SpiHandle::Result::OK)
+    {
+        EnableDevice(device_index);
+        result = spiHandle_.BlockingTransmit(buff, size, timeout);
+        DisableDevice(device_index);
+    }
+    ResumeDma();
     return result;
 }
 
@@ -61,12 +73,15 @@ SpiHandle::Result MultiSlaveSpiHandle::BlockingReceive(size_t   device_index,
     if(device_index >= config_.num_devices)
         return SpiHandle::Result::ERR;
 
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
-
-    EnableDevice(device_index);
-    const auto result = spiHandle_.BlockingReceive(buff, size, timeout);
-    DisableDevice(device_index);
+    PauseDma();
+    auto result = ApplyDeviceClockConfig(device_index);
+    if(result == SpiHandle::Result::OK)
+    {
+        EnableDevice(device_index);
+        result = spiHandle_.BlockingReceive(buff, size, timeout);
+        DisableDevice(device_index);
+    }
+    ResumeDma();
     return result;
 }
 
@@ -80,13 +95,16 @@ MultiSlaveSpiHandle::BlockingTransmitAndReceive(size_t   device_index,
     if(device_index >= config_.num_devices)
         return SpiHandle::Result::ERR;
 
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
-
-    EnableDevice(device_index);
-    const auto result = spiHandle_.BlockingTransmitAndReceive(
-        tx_buff, rx_buff, size, timeout);
-    DisableDevice(device_index);
+    PauseDma();
+    auto result = ApplyDeviceClockConfig(device_index);
+    if(result == SpiHandle::Result::OK)
+    {
+        EnableDevice(device_index);
+        result = spiHandle_.BlockingTransmitAndReceive(
+            tx_buff, rx_buff, size, timeout);
+        DisableDevice(device_index);
+    }
+    ResumeDma();
     return result;
 }
 
@@ -98,18 +116,13 @@ SpiHandle::Result MultiSlaveSpiHandle::DmaTransmit(
     SpiHandle::EndCallbackFunctionPtr   end_callback,
     void*                               callback_context)
 {
-    if(device_index >= config_.num_devices)
-        return SpiHandle::Result::ERR;
-
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
-
-    current_dma_transfer_.device_index     = device_index;
-    current_dma_transfer_.start_callback   = start_callback;
-    current_dma_transfer_.end_callback     = end_callback;
-    current_dma_transfer_.callback_context = callback_context;
-    return spiHandle_.DmaTransmit(
-        buff, size, &DmaStartCallback, &DmaEndCallback, this);
+    return DmaTransmitAndReceive(device_index,
+                                 buff,
+                                 nullptr,
+                                 size,
+                                 start_callback,
+                                 end_callback,
+                                 callback_context);
 }
 
 SpiHandle::Result MultiSlaveSpiHandle::DmaReceive(
@@ -120,18 +133,13 @@ SpiHandle::Result MultiSlaveSpiHandle::DmaReceive(
     SpiHandle::EndCallbackFunctionPtr   end_callback,
     void*                               callback_context)
 {
-    if(device_index >= config_.num_devices)
-        return SpiHandle::Result::ERR;
-
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
-
-    current_dma_transfer_.device_index     = device_index;
-    current_dma_transfer_.start_callback   = start_callback;
-    current_dma_transfer_.end_callback     = end_callback;
-    current_dma_transfer_.callback_context = callback_context;
-    return spiHandle_.DmaReceive(
-        buff, size, &DmaStartCallback, &DmaEndCallback, this);
+    return DmaTransmitAndReceive(device_index,
+                                 nullptr,
+                                 buff,
+                                 size,
+                                 start_callback,
+                                 end_callback,
+                                 callback_context);
 }
 
 SpiHandle::Result MultiSlaveSpiHandle::DmaTransmitAndReceive(
@@ -142,19 +150,93 @@ SpiHandle::Result MultiSlaveSpiHandle::DmaTransmitAndReceive(
     SpiHandle::StartCallbackFunctionPtr start_callback,
     SpiHandle::EndCallbackFunctionPtr   end_callback,
     void*                               callback_context)
+{
+    Transaction transaction;
+    transaction.device_index     = device_index;
+    transaction.tx_data          = tx_buff;
+    transaction.rx_data          = rx_buff;
+    transaction.size             = size;
+    transaction.start_callback   = start_callback;
+    transaction.end_callback     = end_callback;
+    transaction.callback_context = callback_context;
+
+    // waiting for a free place could hang, e.g. when called from an end
+    // callback, whose interrupt is the one that empties the queue
+    return QueueTransaction(transaction);
+}
+
+SpiHandle::Result
+MultiSlaveSpiHandle::QueueTransaction(const Transaction& transaction)
+{
+    if(transaction.device_index >= config_.num_devices || transaction.size == 0
+       || (transaction.tx_data == nullptr && transaction.rx_data == nullptr))
+        return SpiHandle::Result::ERR;
+
+    ScopedIrqBlocker block;
+    if(!scheduler_.Queue(transaction))
+        return SpiHandle::Result::ERR;
+    StartNext();
+    return SpiHandle::Result::OK;
+}
+
+void MultiSlaveSpiHandle::SetDeviceClockConfig(
+    size_t                           device_index,
+    SpiHandle::Config::ClockPolarity clock_polarity,
+    SpiHandle::Config::ClockPhase    clock_phase,
+    SpiHandle::Config::BaudPrescaler baud_prescaler)
 {
     if(device_index >= config_.num_devices)
+        return;
+
+    ScopedIrqBlocker block;
+    device_clocks_[device_index].clock_polarity = clock_polarity;
+    device_clocks_[device_index].clock_phase    = clock_phase;
+    device_clocks_[device_index].baud_prescaler = baud_prescaler;
+}
+
+SpiHandle::Result
+MultiSlaveSpiHandle::StartScanList(const ScanStep*         steps,
+                                   size_t                  num_steps,
+                                   bool                    continuous,
+                                   uint8_t                 priority,
+                                   ScanCallbackFunctionPtr callback,
+                                   void*                   callback_context)
+{
+    if(steps == nullptr || num_steps == 0)
         return SpiHandle::Result::ERR;
+    for(size_t i = 0; i < num_steps; i++)
+    {
+        const ScanStep& step = steps[i];
+        if(step.device_index >= config_.num_devices || step.size == 0
+           || (step.tx_data[0] == nullptr && step.rx_data[0] == nullptr))
+            return SpiHandle::Result::ERR;
+    }
 
-    // wait for previous DMA transfer to complete
-    while(current_dma_transfer_.IsValid()) {}
+    ScopedIrqBlocker block;
+    // a step of a previous list that still runs finishes on its own
+    current_dma_transfer_.is_scan_step = false;
+
+    scheduler_.StartScanList(steps, num_steps, continuous, priority);
+    scan_callback_         = callback;
+    scan_callback_context_ = callback_context;
+    StartNext();
+    return SpiHandle::Result::OK;
+}
+
+SpiHandle::Result MultiSlaveSpiHandle::TriggerScan()
+{
+    ScopedIrqBlocker block;
+    if(!scheduler_.Trigger())
+        return SpiHandle::Result::ERR;
+    StartNext();
+    return SpiHandle::Result::OK;
+}
 
-    current_dma_transfer_.device_index     = device_index;
-    current_dma_transfer_.start_callback   = start_callback;
-    current_dma_transfer_.end_callback     = end_callback;
-    current_dma_transfer_.callback_context = callback_context;
-    return spiHandle_.DmaTransmitAndReceive(
-        tx_buff, rx_buff, size, &DmaStartCallback, &DmaEndCallback, this);
+void MultiSlaveSpiHandle::StopScanList()
+{
+    ScopedIrqBlocker block;
+    current_dma_transfer_.is_scan_step = false;
+    scheduler_.StopScanList();
 }
 
 int MultiSlaveSpiHandle::CheckError()
@@ -172,6 +254,96 @@ void MultiSlaveSpiHandle::DisableDevice(size_t device_index)
     dsy_gpio_write(&nss_pins[device_index], 1);
 }
 
+SpiHandle::Result
+MultiSlaveSpiHandle::ApplyDeviceClockConfig(size_t device_index)
+{
+    // only writes the peripheral if the settings differ from the last device
+    const auto& clock = device_clocks_[device_index];
+    return spiHandle_.SetClockConfig(
+        clock.clock_polarity, clock.clock_phase, clock.baud_prescaler);
+}
+
+void MultiSlaveSpiHandle::PauseDma()
+{
+    {
+        ScopedIrqBlocker block;
+        paused_ = true;
+    }
+    // wait for the running DMA transfer to complete
+    while(current_dma_transfer_.IsValid()) {}
+}
+
+void MultiSlaveSpiHandle::ResumeDma()
+{
+    ScopedIrqBlocker block;
+    paused_ = false;
+    StartNext();
+}
+
+void MultiSlaveSpiHandle::StartNext()
+{
+    // called with interrupts blocked
+    while(!paused_ && !current_dma_transfer_.IsValid())
+    {
+        Transaction job;
+        bool        is_scan_step;
+        if(!scheduler_.GetNextJob(&job, &is_scan_step))
+            return;
+
+        if(ApplyDeviceClockConfig(job.device_index) != SpiHandle::Result::OK)
+        {
+            FailJob(job, is_scan_step);
+            continue;
+        }
+
+        current_dma_transfer_.device_index = job.device_index;
+        current_dma_transfer_.is_scan_step = is_scan_step;
+        current_dma_transfer_.transaction  = job;
+
+        // on errors, the SpiHandle makes the end callback, which finishes the
+        // job and starts the next one
+        if(job.tx_data != nullptr && job.rx_data != nullptr)
+            spiHandle_.DmaTransmitAndReceive(job.tx_data,
+                                             job.rx_data,
+                                             job.size,
+                                             &DmaStartCallback,
+                                             &DmaEndCallback,
+                                             this);
+        else if(job.tx_data != nullptr)
+            spiHandle_.DmaTransmit(job.tx_data,
+                                   job.size,
+                                   &DmaStartCallback,
+                                   &DmaEndCallback,
+                                   this);
+        else
+            spiHandle_.DmaReceive(job.rx_data,
+                                  job.size,
+                                  &DmaStartCallback,
+                                  &DmaEndCallback,
+                                  this);
+        return;
+    }
+}
+
+void MultiSlaveSpiHandle::FailJob(const Transaction& job, bool is_scan_step)
+{
+    // the clock settings of the device were rejected, so the transfer never
+    // started
+    if(!is_scan_step)
+    {
+        if(job.end_callback)
+            job.end_callback(job.callback_context, SpiHandle::Result::ERR);
+        return;
+    }
+
+    // every following pass would fail the same way
+    const size_t buffer_index = scheduler_.GetScanBufferIndex();
+    scheduler_.StopScanList();
+    if(scan_callback_)
+        scan_callback_(
+            scan_callback_context_, buffer_index, SpiHandle::Result::ERR);
+}
+
 void MultiSlaveSpiHandle::DmaStartCallback(void* context)
 {
     auto&      handle       = *reinterpret_cast<MultiSlaveSpiHandle*>(context);
@@ -179,24 +351,56 @@ void MultiSlaveSpiHandle::DmaStartCallback(void* context)
     if(device_index >= 0)
     {
         handle.EnableDevice(device_index);
-        if(handle.current_dma_transfer_.start_callback)
-            handle.current_dma_transfer_.start_callback(
-                handle.current_dma_transfer_.callback_context);
+        const auto& transaction = handle.current_dma_transfer_.transaction;
+        if(transaction.start_callback)
+            transaction.start_callback(transaction.callback_context);
     }
 }
+
 void MultiSlaveSpiHandle::DmaEndCallback(void*             context,
                                          SpiHandle::Result result)
 {
-    auto&      handle       = *reinterpret_cast<MultiSlaveSpiHandle*>(context);
-    const auto device_index = handle.current_dma_transfer_.device_index;
-    handle.current_dma_transfer_.Invalidate();
-    if(device_index >= 0)
+    auto& handle = *reinterpret_cast<MultiSlaveSpiHandle*>(context);
+
+    Transaction transaction;
+    bool        is_scan_step = false;
+    bool        pass_done    = false;
+    ScanPass    pass;
     {
+        ScopedIrqBlocker block;
+        auto&            current      = handle.current_dma_transfer_;
+        const auto       device_index = current.device_index;
+        if(device_index < 0)
+            return;
+
+        transaction  = current.transaction;
+        is_scan_step = current.is_scan_step;
+        current.Invalidate();
         handle.DisableDevice(device_index);
-        if(handle.current_dma_transfer_.end_callback)
-            handle.current_dma_transfer_.end_callback(
-                handle.current_dma_transfer_.callback_context, result);
+
+        if(is_scan_step)
+        {
+            bool pass_ok = true;
+            pass_done    = handle.scheduler_.FinishScanStep(
+                result == SpiHandle::Result::OK, &pass.buffer_index, &pass_ok);
+
+            pass.callback         = handle.scan_callback_;
+            pass.callback_context = handle.scan_callback_context_;
+            pass.result           = pass_ok ? SpiHandle::Result::OK
+                                            : SpiHandle::Result::ERR;
+        }
+
+        // chain the next transfer right away
+        handle.StartNext();
     }
+
+    // the SpiHandle reports finished transfers with interrupts enabled, so
+    // the user callbacks don't block other interrupts. They can queue
+    // transactions or restart the scan list.
+    if(pass_done && pass.callback)
+        pass.callback(pass.callback_context, pass.buffer_index, pass.result);
+    else if(!is_scan_step && transaction.end_callback)
+        transaction.end_callback(transaction.callback_context, result);
 }
 
-} // namespace daisy
\ No newline at end of file
+} // namespace daisy
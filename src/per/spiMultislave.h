@@ -5,6 +5,7 @@
 #include "daisy_core.h"
 #include "spi.h"
 #include "gpio.h"
+#include "util/ScanListScheduler.h"
 
 namespace daisy
 {
@@ -16,6 +17,12 @@ namespace daisy
  * Handler for a serial peripheral interface that connects to multiple devices on one bus
  * such that up to 4 devices can share the same MOSI, MISO and SCLK pins.
  * Each device has its own NSS/CS pin which is software driven by the MultiSlaveSpiHandle. 
+ *
+ * DMA transfers are queued and run one after another: when a transfer
+ * finishes, the next one is started from its interrupt, so the main loop
+ * doesn't have to sequence the devices. See QueueTransaction() for single
+ * transfers and StartScanList() for transfers that repeat, like refreshing
+ * a DAC or reading an ADC at a fixed rate.
  */
 class MultiSlaveSpiHandle
 {
@@ -92,7 +99,8 @@ class MultiSlaveSpiHandle
      * \param start_callback   A callback to execute when the transfer starts, or NULL.
      * \param end_callback     A callback to execute when the transfer finishes, or NULL.
      * \param callback_context A pointer that will be passed back to you in the callbacks.     
-     * \return Whether the transmit was successful or not
+     * \return Whether the transmit was successful or not. ERR if the
+     *         transaction queue is full, see QueueTransaction().
      */
     SpiHandle::Result
     DmaTransmit(size_t                              device_index,
@@ -109,7 +117,8 @@ class MultiSlaveSpiHandle
      * \param start_callback   A callback to execute when the transfer starts, or NULL.
      * \param end_callback     A callback to execute when the transfer finishes, or NULL.
      * \param callback_context A pointer that will be passed back to you in the callbacks.    
-     * \return Whether the receive was successful or not
+     * \return Whether the receive was successful or not. ERR if the
+     *         transaction queue is full, see QueueTransaction().
      */
     SpiHandle::Result
     DmaReceive(size_t                              device_index,
@@ -127,7 +136,8 @@ class MultiSlaveSpiHandle
      * \param start_callback   A callback to execute when the transfer starts, or NULL.
      * \param end_callback     A callback to execute when the transfer finishes, or NULL.
      * \param callback_context A pointer that will be passed back to you in the callbacks.    
-     * \return Whether the receive was successful or not
+     * \return Whether the receive was successful or not. ERR if the
+     *         transaction queue is full, see QueueTransaction().
      */
     SpiHandle::Result
     DmaTransmitAndReceive(size_t                              device_index,
@@ -138,6 +148,136 @@ class MultiSlaveSpiHandle
                           SpiHandle::EndCallbackFunctionPtr   end_callback,
                           void*                               callback_context);
 
+    /** A transfer for QueueTransaction().
+     *  Transmits tx_data and receives rx_data at the same time. Either buffer
+     *  can be left out. The buffers have the same requirements as for
+     *  SpiHandle::DmaTransmit() and must stay valid until the callback is
+     *  made.
+     */
+    struct Transaction
+    {
+        /** The index of the device */
+        size_t device_index = 0;
+        /** Data to transmit, or nullptr */
+        uint8_t* tx_data = nullptr;
+        /** Buffer for the received data, or nullptr */
+        uint8_t* rx_data = nullptr;
+        /** Number of bytes to transfer */
+        size_t size = 0;
+        /** Transactions with a higher priority run first */
+        uint8_t priority = 0;
+        /** System::GetNow() time by which the transaction should be done,
+         *  or 0 for none. Transactions of the same priority run earliest
+         *  deadline first. Late transactions still run.
+         */
+        uint32_t deadline = 0;
+        /** Called right before the transfer starts, or nullptr */
+        SpiHandle::StartCallbackFunctionPtr start_callback = nullptr;
+        /** Called when the transfer is done, or nullptr */
+        SpiHandle::EndCallbackFunctionPtr end_callback     = nullptr;
+        void*                             callback_context = nullptr; /**< & */
+    };
+
+    /** Number of transactions that can be queued */
+    static constexpr size_t kTransactionQueueSize = 8;
+
+    /** Queues a DMA transfer and returns immediately.
+     *  The most urgent queued transaction is started whenever the previous
+     *  transfer finishes, with the clock settings of its device (see
+     *  SetDeviceClockConfig()). The callbacks are made from an interrupt,
+     *  and the end callback may queue the next transaction. If the
+     *  SpiHandle rejects the clock settings, the transaction doesn't start
+     *  and its end callback gets ERR.
+     *  \param transaction  The transaction, copied into the queue.
+     *  \return ERR if the queue is full, the device index is invalid or the
+     *          transaction is empty
+     */
+    SpiHandle::Result QueueTransaction(const Transaction& transaction);
+
+    /** Returns the number of queued transactions that haven't started yet */
+    size_t GetNumQueuedTransactions() const
+    {
+        return scheduler_.GetNumQueuedJobs();
+    }
+
+    /** Sets the clock settings of a device, for devices that can't use the
+     *  settings of the Config. They are applied before each transfer to the
+     *  device, and only written to the peripheral if they differ from the
+     *  previous transfer's.
+     *  \param device_index the index of the device
+     *  \param clock_polarity its clock polarity
+     *  \param clock_phase its clock phase
+     *  \param baud_prescaler its prescaler
+     */
+    void SetDeviceClockConfig(size_t                           device_index,
+                              SpiHandle::Config::ClockPolarity clock_polarity,
+                              SpiHandle::Config::ClockPhase    clock_phase,
+                              SpiHandle::Config::BaudPrescaler baud_prescaler);
+
+    /** One transfer of a scan list.
+     *  The buffers are double buffered: passes alternate between index 0 and
+     *  1, so one half can be prepared or read while the other is transferred.
+     *  Leave the second pointer nullptr to use the first in every pass, e.g.
+     *  for a constant command.
+     */
+    struct ScanStep
+    {
+        /** The index of the device */
+        size_t device_index;
+        /** Data to transmit in even and odd passes, or nullptr */
+        uint8_t* tx_data[2];
+        /** Buffers for the received data of even and odd passes, or nullptr */
+        uint8_t* rx_data[2];
+        /** Number of bytes to transfer */
+        size_t size;
+    };
+
+    /** Called from an interrupt when a pass of a scan list is done.
+     *  buffer_index is the buffer half the pass used. It can be read and
+     *  refilled until the pass after the next one starts.
+     */
+    typedef void (*ScanCallbackFunctionPtr)(void*             context,
+                                            size_t            buffer_index,
+                                            SpiHandle::Result result);
+
+    /** Starts running a list of transfers, one pass after another.
+     *  A pass runs the steps in order, with no CPU work in between. Queued
+     *  transactions with a higher priority than the scan list run between
+     *  steps, others run between passes. A continuous scan list starts its
+     *  next pass right away, otherwise TriggerScan() starts it, e.g. from a
+     *  timer to refresh at a fixed rate.
+     *  The first pass starts immediately, with buffer index 0. If the
+     *  SpiHandle rejects the clock settings of a step's device, the list
+     *  stops and the callback gets ERR.
+     *  \param steps the steps, must stay valid while the list runs
+     *  \param num_steps number of steps
+     *  \param continuous true to repeat the passes without a trigger
+     *  \param priority priority of the steps, compared to Transaction::priority
+     *  \param callback called when a pass is done, or nullptr
+     *  \param callback_context passed to the callback
+     *  \return ERR if a step has an invalid device index
+     */
+    SpiHandle::Result StartScanList(const ScanStep*         steps,
+                                    size_t                  num_steps,
+                                    bool                    continuous,
+                                    uint8_t                 priority,
+                                    ScanCallbackFunctionPtr callback,
+                                    void*                   callback_context);
+
+    /** Starts the next pass of a scan list that isn't continuous.
+     *  \return ERR if the previous pass is still running (the pass is
+     *          skipped) or no scan list was started
+     */
+    SpiHandle::Result TriggerScan();
+
+    /** Stops the scan list after the current step */
+    void StopScanList();
+
+    /** Returns the number of passes of the scan list that were skipped
+     *  because the previous one wasn't done
+     */
+    uint32_t GetNumScanOverruns() const { return scheduler_.GetNumOverruns(); }
+
     /** \return the result of HAL_SPI_GetError() to the user. */
     int CheckError();
 
@@ -147,25 +287,54 @@ class MultiSlaveSpiHandle
         return *this;
     };
 
-    void        EnableDevice(size_t device_index);
-    void        DisableDevice(size_t device_index);
-    static void DmaStartCallback(void* context);
-    static void DmaEndCallback(void* context, SpiHandle::Result result);
+    // a finished pass of the scan list, reported after the interrupts are
+    // enabled again
+    struct ScanPass
+    {
+        ScanCallbackFunctionPtr callback;
+        void*                   callback_context;
+        size_t                  buffer_index;
+        SpiHandle::Result       result;
+    };
+
+    void              EnableDevice(size_t device_index);
+    void              DisableDevice(size_t device_index);
+    SpiHandle::Result ApplyDeviceClockConfig(size_t device_index);
+    void              PauseDma();
+    void              ResumeDma();
+    void              StartNext();
+    void              FailJob(const Transaction& job, bool is_scan_step);
+    static void       DmaStartCallback(void* context);
+    static void       DmaEndCallback(void* context, SpiHandle::Result result);
 
     Config    config_;
     SpiHandle spiHandle_;
     dsy_gpio  nss_pins[max_num_devices_];
 
+    struct DeviceClockConfig
+    {
+        SpiHandle::Config::ClockPolarity clock_polarity;
+        SpiHandle::Config::ClockPhase    clock_phase;
+        SpiHandle::Config::BaudPrescaler baud_prescaler;
+    } device_clocks_[max_num_devices_];
+
+    ScanListScheduler<Transaction, ScanStep, kTransactionQueueSize>
+                            scheduler_;
+    ScanCallbackFunctionPtr scan_callback_;
+    void*                   scan_callback_context_;
+
     struct DmaTransfer
     {
-        int8_t                              device_index;
-        SpiHandle::StartCallbackFunctionPtr start_callback;
-        SpiHandle::EndCallbackFunctionPtr   end_callback;
-        void*                               callback_context;
+        volatile int8_t device_index;
+        bool            is_scan_step;
+        Transaction     transaction;
 
         void Invalidate() { device_index = -1; }
         bool IsValid() const { return device_index >= 0; }
     } current_dma_transfer_;
+
+    // set while a blocking transfer runs
+    volatile bool paused_;
 };
 
 /** @} */
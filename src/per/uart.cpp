@@ -1,17 +1,23 @@
+#include "per/uart.h"
+#include "util/scopedirqblocker.h"
+#ifndef UNIT_TEST
 #include <stm32h7xx_hal.h>
 #include "stm32h7xx_ll_dma.h"
-#include "per/uart.h"
 #include "sys/dma.h"
 #include "util/ringbuffer.h"
-#include "util/scopedirqblocker.h"
 
 extern "C"
 {
 #include "util/hal_map.h"
 }
+#else
+#include <cstring>
+#endif
 
 using namespace daisy;
 
+#ifndef UNIT_TEST
+
 #define UART_RX_BUFF_SIZE 256
 
 // the fifo buffer to be DMA read into
@@ -71,6 +77,17 @@ class UartHandler::Impl
                       EndCallbackFunctionPtr   end_callback,
                       void*                    callback_context);
 
+    /** Starts a transmission with the UART interrupt. It doesn't touch
+     *  the shared DMA state, so it can run while this UART listens.
+     */
+    Result InterruptTransmit(uint8_t*               buff,
+                             size_t                 size,
+                             EndCallbackFunctionPtr end_callback,
+                             void*                  callback_context);
+
+    /** Ends the transmission of InterruptTransmit() and makes the callback */
+    void InterruptTransmitFinished(Result result);
+
     /** Starts the DMA Reception in "Listen" mode. 
      *  In this mode the DMA is configured for circular 
      *  behavior, and the IDLE interrupt is enabled.
@@ -148,6 +165,11 @@ class UartHandler::Impl
     size_t                        circular_rx_last_pos_;
     bool                          listener_mode_;
 
+    /** The transmission of InterruptTransmit(), which doesn't use the DMA */
+    volatile bool          it_tx_active_;
+    EndCallbackFunctionPtr it_tx_end_callback_;
+    void*                  it_tx_callback_context_;
+
     Config             config_;
     UART_HandleTypeDef huart_;
     DMA_HandleTypeDef  hdma_rx_;
@@ -281,6 +303,7 @@ UartHandler::Result UartHandler::Impl::Init(const UartHandler::Config& config)
 
     /** New listener mode to replace old "Fifo" stuff */
     listener_mode_ = false;
+    it_tx_active_  = false;
 
     return Result::OK;
 }
@@ -551,6 +574,38 @@ bool UartHandler::Impl::IsListening() const
     return listener_mode_;
 }
 
+UartHandler::Result UartHandler::Impl::InterruptTransmit(
+    uint8_t*                            buff,
+    size_t                              size,
+    UartHandler::EndCallbackFunctionPtr end_callback,
+    void*                               callback_context)
+{
+    ScopedIrqBlocker block;
+
+    if(it_tx_active_)
+        return UartHandler::Result::ERR;
+
+    it_tx_active_           = true;
+    it_tx_end_callback_     = end_callback;
+    it_tx_callback_context_ = callback_context;
+
+    // BUSY while a blocking or DMA transmission runs on this UART
+    if(HAL_UART_Transmit_IT(&huart_, buff, size) != HAL_OK)
+    {
+        it_tx_active_ = false;
+        return UartHandler::Result::ERR;
+    }
+    return UartHandler::Result::OK;
+}
+
+void UartHandler::Impl::InterruptTransmitFinished(UartHandler::Result result)
+{
+    // the callback may start the next transmission
+    it_tx_active_ = false;
+    if(it_tx_end_callback_ != nullptr)
+        it_tx_end_callback_(it_tx_callback_context_, result);
+}
+
 UartHandler::Result UartHandler::Impl::StartDmaTx(
     uint8_t*                              buff,
     size_t                                size,
@@ -1080,7 +1135,12 @@ extern "C" void DMA2_Stream4_IRQHandler(void)
 
 extern "C" void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
 {
-    UartHandler::Impl::DmaTransferFinished(huart, UartHandler::Result::OK);
+    auto* handle = MapInstanceToHandle(huart->Instance);
+    // an InterruptTransmit() doesn't hold the DMA, e.g. during listen mode
+    if(handle->it_tx_active_)
+        handle->InterruptTransmitFinished(UartHandler::Result::OK);
+    else
+        UartHandler::Impl::DmaTransferFinished(huart, UartHandler::Result::OK);
 }
 
 extern "C" void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart)
@@ -1109,11 +1169,25 @@ extern "C" void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef* huart)
 
 extern "C" void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
 {
-    /** TODO: This hooks into the "Normal" DMA completion, 
-     *  might want to change this to have a different fallthrough
-     *  for "listener_mode_"
-     */
-    UartHandler::Impl::DmaTransferFinished(huart, UartHandler::Result::ERR);
+    auto* handle = MapInstanceToHandle(huart->Instance);
+    if(handle->listener_mode_)
+    {
+        /** Reception errors don't end an InterruptTransmit(), and the
+         *  circular reception keeps the DMA. If the HAL aborted the 
+         *  reception (e.g. on an overrun), IsListening() returns false
+         *  so that it can be restarted.
+         */
+        if(huart->RxState == HAL_UART_STATE_READY)
+        {
+            __HAL_UART_DISABLE_IT(huart, UART_IT_IDLE);
+            handle->listener_mode_ = false;
+        }
+        return;
+    }
+    /** Only the UART that holds the DMA has a transfer to end */
+    if(UartHandler::Impl::dma_active_peripheral_ == int(handle->config_.periph))
+        UartHandler::Impl::DmaTransferFinished(huart,
+                                               UartHandler::Result::ERR);
 }
 
 extern "C" void HAL_UART_AbortCpltCallback(UART_HandleTypeDef* huart)
@@ -1131,6 +1205,287 @@ extern "C" void HAL_UART_AbortReceiveCpltCallback(UART_HandleTypeDef* huart)
     //    asm("bkpt 255");
 }
 
+#else // ifndef UNIT_TEST
+
+// ================================================================
+// Host backend for unit tests
+// ================================================================
+
+/** There is no UART peripheral on the host. The DMA is shared like on the
+ *  hardware: DmaListenStart() and DmaTransmit() hold it, and DmaTransmit()
+ *  jobs wait until it's free. The bytes of all transmissions are collected
+ *  for ReadTxForUnitTest(); the interrupts are emulated by 
+ *  SimulateRxForUnitTest() and SimulateTxCompleteForUnitTest().
+ *  DmaReceive() and BlockingReceive() have nothing to receive.
+ */
+class UartHandler::Impl
+{
+  public:
+    struct UartDmaJob
+    {
+        uint8_t*                 data_tx          = nullptr;
+        size_t                   size             = 0;
+        StartCallbackFunctionPtr start_callback   = nullptr;
+        EndCallbackFunctionPtr   end_callback     = nullptr;
+        void*                    callback_context = nullptr;
+    };
+
+    UartHandler::Result Init(const UartHandler::Config& config)
+    {
+        if(int(config.periph) >= kNumUartWithDma)
+            return Result::ERR;
+        // the DMA is released, e.g. after a test that was listening
+        if(dma_active_peripheral_ == int(config.periph))
+            dma_active_peripheral_ = -1;
+        config_        = config;
+        queued_        = UartDmaJob();
+        listener_mode_ = false;
+        dma_tx_active_ = false;
+        it_tx_active_  = false;
+        tx_size_       = 0;
+        return Result::OK;
+    }
+
+    const UartHandler::Config& GetConfig() const { return config_; }
+
+    UartHandler::Result BlockingTransmit(uint8_t* buff, size_t size, uint32_t)
+    {
+        if(dma_tx_active_ || it_tx_active_)
+            return Result::ERR;
+        Record(buff, size);
+        return Result::OK;
+    }
+
+    UartHandler::Result BlockingReceive(uint8_t*, size_t, uint32_t)
+    {
+        return Result::ERR;
+    }
+
+    UartHandler::Result DmaTransmit(uint8_t*                 buff,
+                                    size_t                   size,
+                                    StartCallbackFunctionPtr start_callback,
+                                    EndCallbackFunctionPtr   end_callback,
+                                    void*                    callback_context)
+    {
+        if(dma_active_peripheral_ >= 0)
+        {
+            // the hardware waits for the queue position, which can't be
+            // freed while the test waits
+            if(queued_.data_tx != nullptr)
+                return Result::ERR;
+            queued_.data_tx          = buff;
+            queued_.size             = size;
+            queued_.start_callback   = start_callback;
+            queued_.end_callback     = end_callback;
+            queued_.callback_context = callback_context;
+            return Result::OK;
+        }
+        return StartDmaTx(
+            buff, size, start_callback, end_callback, callback_context);
+    }
+
+    UartHandler::Result DmaReceive(uint8_t*,
+                                   size_t,
+                                   StartCallbackFunctionPtr,
+                                   EndCallbackFunctionPtr,
+                                   void*)
+    {
+        return Result::ERR;
+    }
+
+    UartHandler::Result InterruptTransmit(uint8_t*               buff,
+                                          size_t                 size,
+                                          EndCallbackFunctionPtr end_callback,
+                                          void* callback_context)
+    {
+        if(dma_tx_active_ || it_tx_active_)
+            return Result::ERR;
+        it_tx_active_           = true;
+        it_tx_end_callback_     = end_callback;
+        it_tx_callback_context_ = callback_context;
+        Record(buff, size);
+        return Result::OK;
+    }
+
+    UartHandler::Result DmaListenStart(uint8_t*                      buff,
+                                       size_t                        size,
+                                       CircularRxCallbackFunctionPtr cb,
+                                       void* callback_context)
+    {
+        circular_rx_buff_       = buff;
+        circular_rx_total_size_ = size;
+        circular_rx_callback_   = cb;
+        circular_rx_context_    = callback_context;
+        circular_rx_last_pos_   = 0;
+        listener_mode_          = true;
+        dma_active_peripheral_  = int(config_.periph);
+        return Result::OK;
+    }
+
+    UartHandler::Result DmaListenStop()
+    {
+        listener_mode_ = false;
+        return Result::OK;
+    }
+
+    bool IsListening() const { return listener_mode_; }
+    int  CheckError() { return 0; }
+
+    UartHandler::Result SimulateRx(const uint8_t* data, size_t size)
+    {
+        if(!listener_mode_)
+            return Result::ERR;
+        // the bytes are passed on in one piece, or two if they wrap around
+        while(size > 0)
+        {
+            size_t   chunk  = circular_rx_total_size_ - circular_rx_last_pos_;
+            uint8_t* buffer = &circular_rx_buff_[circular_rx_last_pos_];
+            chunk           = size < chunk ? size : chunk;
+            std::memcpy(buffer, data, chunk);
+            circular_rx_last_pos_
+                = (circular_rx_last_pos_ + chunk) % circular_rx_total_size_;
+            data += chunk;
+            size -= chunk;
+            if(circular_rx_callback_)
+                circular_rx_callback_(
+                    buffer, chunk, circular_rx_context_, Result::OK);
+        }
+        return Result::OK;
+    }
+
+    UartHandler::Result SimulateTxComplete()
+    {
+        if(it_tx_active_)
+        {
+            it_tx_active_ = false;
+            if(it_tx_end_callback_ != nullptr)
+                it_tx_end_callback_(it_tx_callback_context_, Result::OK);
+            return Result::OK;
+        }
+        if(dma_tx_active_)
+        {
+            dma_tx_active_ = false;
+            DmaTransferFinished();
+            return Result::OK;
+        }
+        return Result::ERR;
+    }
+
+    size_t ReadTx(uint8_t* dst, size_t max_size)
+    {
+        const size_t size = tx_size_ < max_size ? tx_size_ : max_size;
+        std::memcpy(dst, tx_, size);
+        std::memmove(tx_, tx_ + size, tx_size_ - size);
+        tx_size_ -= size;
+        return size;
+    }
+
+    static constexpr int kNumUartWithDma = 9;
+
+  private:
+    UartHandler::Result StartDmaTx(uint8_t*                 buff,
+                                   size_t                   size,
+                                   StartCallbackFunctionPtr start_callback,
+                                   EndCallbackFunctionPtr   end_callback,
+                                   void*                    callback_context)
+    {
+        if(dma_tx_active_ || it_tx_active_)
+        {
+            if(end_callback)
+                end_callback(callback_context, Result::ERR);
+            return Result::ERR;
+        }
+        dma_active_peripheral_ = int(config_.periph);
+        dma_tx_active_         = true;
+        dma_end_callback_      = end_callback;
+        dma_callback_context_  = callback_context;
+        if(start_callback)
+            start_callback(callback_context);
+        Record(buff, size);
+        return Result::OK;
+    }
+
+    static void DmaTransferFinished();
+
+    void Record(const uint8_t* buff, size_t size)
+    {
+        size = size < sizeof(tx_) - tx_size_ ? size : sizeof(tx_) - tx_size_;
+        std::memcpy(tx_ + tx_size_, buff, size);
+        tx_size_ += size;
+    }
+
+    UartHandler::Config config_;
+    UartDmaJob          queued_;
+
+    CircularRxCallbackFunctionPtr circular_rx_callback_;
+    void*                         circular_rx_context_;
+    uint8_t*                      circular_rx_buff_;
+    size_t                        circular_rx_total_size_;
+    size_t                        circular_rx_last_pos_;
+    bool                          listener_mode_;
+
+    bool                   dma_tx_active_;
+    EndCallbackFunctionPtr dma_end_callback_;
+    void*                  dma_callback_context_;
+    bool                   it_tx_active_;
+    EndCallbackFunctionPtr it_tx_end_callback_;
+    void*                  it_tx_callback_context_;
+
+    uint8_t tx_[256];
+    size_t  tx_size_;
+
+    static int dma_active_peripheral_;
+};
+
+static UartHandler::Impl uart_handles[UartHandler::Impl::kNumUartWithDma];
+
+int UartHandler::Impl::dma_active_peripheral_ = -1;
+
+void UartHandler::Impl::DmaTransferFinished()
+{
+    Impl& finished         = uart_handles[dma_active_peripheral_];
+    dma_active_peripheral_ = -1;
+    if(finished.dma_end_callback_ != nullptr)
+        finished.dma_end_callback_(finished.dma_callback_context_,
+                                   Result::OK);
+
+    // the callback could have started a new transmission right away...
+    if(dma_active_peripheral_ >= 0)
+        return;
+    for(Impl& handle : uart_handles)
+    {
+        if(handle.queued_.data_tx != nullptr)
+        {
+            const UartDmaJob job = handle.queued_;
+            handle.queued_       = UartDmaJob();
+            handle.StartDmaTx(job.data_tx,
+                              job.size,
+                              job.start_callback,
+                              job.end_callback,
+                              job.callback_context);
+            return;
+        }
+    }
+}
+
+UartHandler::Result
+UartHandler::SimulateRxForUnitTest(const uint8_t* data, size_t size)
+{
+    return pimpl_->SimulateRx(data, size);
+}
+
+UartHandler::Result UartHandler::SimulateTxCompleteForUnitTest()
+{
+    return pimpl_->SimulateTxComplete();
+}
+
+size_t UartHandler::ReadTxForUnitTest(uint8_t* dst, size_t max_size)
+{
+    return pimpl_->ReadTx(dst, max_size);
+}
+
+#endif // ifndef UNIT_TEST
+
 // ======================================================================
 // UartHandler > UartHandlePimpl
 // ======================================================================
@@ -1181,6 +1536,16 @@ UartHandler::DmaReceive(uint8_t*                              buff,
         buff, size, start_callback, end_callback, callback_context);
 }
 
+UartHandler::Result
+UartHandler::InterruptTransmit(uint8_t*                            buff,
+                               size_t                              size,
+                               UartHandler::EndCallbackFunctionPtr end_callback,
+                               void* callback_context)
+{
+    return pimpl_->InterruptTransmit(
+        buff, size, end_callback, callback_context);
+}
+
 UartHandler::Result
 UartHandler::DmaListenStart(uint8_t*                                   buff,
                             size_t                                     size,
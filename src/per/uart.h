@@ -161,6 +161,8 @@ class UartHandler
                             The callback is called from an interrupt, so keep it fast.
     \param callback_context A pointer that will be passed back to you in the callbacks.     
     \return Whether the transmit was successful or not
+    \note The DMA is shared by all UARTs. While one of them listens with
+          DmaListenStart(), the transfer stays queued; use InterruptTransmit().
     */
     Result DmaTransmit(uint8_t*                              buff,
                        size_t                                size,
@@ -184,6 +186,21 @@ class UartHandler
                       UartHandler::EndCallbackFunctionPtr   end_callback,
                       void*                                 callback_context);
 
+    /** Interrupt-based transmit
+    It doesn't use the DMA, so it can run while this UART listens with
+    DmaListenStart(). One interrupt is used per byte.
+    \param *buff input buffer, which must stay valid until the transfer ends
+    \param size  buffer size
+    \param end_callback     A callback to execute when the transfer finishes, or NULL.
+                            The callback is called from an interrupt, so keep it fast.
+    \param callback_context A pointer that will be passed back to you in the callback.
+    \return ERR if another transmission is running on this UART
+    */
+    Result InterruptTransmit(uint8_t*                            buff,
+                             size_t                              size,
+                             UartHandler::EndCallbackFunctionPtr end_callback,
+                             void* callback_context);
+
     /** Starts the DMA Reception in "Listen" mode. 
      *  In this mode the DMA is configured for circular 
      *  behavior, and the IDLE interrupt is enabled.
@@ -218,6 +235,25 @@ class UartHandler
     /** Will be deprecated soon! Wrapper for BlockingTransmit */
     Result PollTx(uint8_t* buff, size_t size);
 
+#ifdef UNIT_TEST
+    /** Host backend only: emulates the reception of \p size bytes while
+     ** listening. They are copied into the buffer passed to DmaListenStart,
+     ** and its callback is dispatched like after an IDLE interrupt.
+     */
+    Result SimulateRxForUnitTest(const uint8_t* data, size_t size);
+
+    /** Host backend only: emulates the transfer complete interrupt of the
+     ** running DmaTransmit() or InterruptTransmit(). 
+     */
+    Result SimulateTxCompleteForUnitTest();
+
+    /** Host backend only: moves the bytes that were transmitted since the
+     ** last call into \p dst.
+     ** \return the number of bytes
+     */
+    size_t ReadTxForUnitTest(uint8_t* dst, size_t max_size);
+#endif
+
     class Impl; /**< & */
 
   private:
@@ -276,6 +276,21 @@ class System
         return testIsolator_.GetStateForCurrentTest()->tickFreqHz_;
     }
 
+    /** Advances the time of the test that's currently running instead of
+     *  waiting.
+     */
+    static void Delay(uint32_t delay_ms)
+    {
+        testIsolator_.GetStateForCurrentTest()->currentUs_ += delay_ms * 1000;
+    }
+    /** Advances the tick of the test that's currently running instead of
+     *  waiting.
+     */
+    static void DelayTicks(uint32_t delay_ticks)
+    {
+        testIsolator_.GetStateForCurrentTest()->currentTick_ += delay_ticks;
+    }
+
     /** Sets the current "tick" value for the test that's currently running. */
     static void SetTickForUnitTest(uint32_t tick)
     {
@@ -65,6 +65,21 @@ struct UiCanvasDescriptor
     FlushFuncPtr flushFunction_;
 };
 
+/** @brief A flush function that updates a display in the background.
+ *  @ingroup ui
+ *
+ *  Use it for displays with an UpdateAsync() function, e.g. OledDisplay:
+ *  `canvas.flushFunction_ = &FlushDisplayAsync<MyDisplayType>;`
+ *  The display buffer is then sent with the DMA and UI::Process() doesn't
+ *  wait for it. If the previous update is still running, the changes are
+ *  sent with the next flush.
+ */
+template <typename DisplayType>
+void FlushDisplayAsync(const UiCanvasDescriptor& canvas)
+{
+    static_cast<DisplayType*>(canvas.handle_)->UpdateAsync();
+}
+
 class OneBitGraphicsLookAndFeel;
 
 /** @brief The base class for a page in the UI system.
@@ -14,10 +14,22 @@ namespace daisy
  *  Then at the beginning of the audio callback, call `OnBlockStart()`, 
  *  and at the end of the audio callback, call `OnBlockEnd()`.
  *  You can then read out the minimum, maximum and average CPU load.
+ * 
+ *  A block that takes longer than its own duration has missed its deadline
+ *  and is counted as an overrun. The load only covers the callback itself,
+ *  so if the caller knows how many blocks the hardware has finished in the
+ *  meantime (e.g. from the DMA flags), it can pass that to `OnBlockEnd()`
+ *  to also catch blocks that started late. A histogram of the load of each
+ *  block is kept, in steps of 10%, with the overruns in the last bin.
  */
 class CpuLoadMeter
 {
   public:
+    /** Number of bins in the load histogram: 10 for 0..100% in steps of 10%,
+     *  and one for blocks that missed their deadline.
+     */
+    static constexpr size_t kNumHistogramBins = 11;
+
     CpuLoadMeter(){};
 
     /** Initializes the CpuLoadMeter for a particular sample rate and block size.
@@ -48,14 +60,35 @@ class CpuLoadMeter
     /** Call this at the beginning of your audio callback */
     void OnBlockStart() { currentBlockStartTicks_ = System::GetTick(); }
 
-    /** Call this at the end of your audio callback */
-    void OnBlockEnd()
+    /** Call this at the end of your audio callback
+     *  @param numMissedBlocks  The number of blocks the hardware has finished
+     *                          since this one was due, if known. Each counts
+     *                          as an overrun. Otherwise, the block is an
+     *                          overrun if its load is above 100%.
+     */
+    void OnBlockEnd(uint32_t numMissedBlocks = 0)
     {
         const auto end         = System::GetTick();
         const auto ticksPassed = end - currentBlockStartTicks_;
         const auto currentBlockLoad
             = float(ticksPassed) * ticksPerBlockInv_; // usPassed / usPerBlock
 
+        // A block above 100% has let the next one pass as well, so it is
+        // already included in numMissedBlocks when that is known.
+        if(numMissedBlocks == 0 && currentBlockLoad > 1.0f)
+            numMissedBlocks = 1;
+        if(numMissedBlocks > 0)
+        {
+            overruns_ += numMissedBlocks;
+            histogram_[kNumHistogramBins - 1] += numMissedBlocks;
+        }
+        else
+        {
+            const auto bin = size_t(currentBlockLoad * 10.0f);
+            histogram_[bin < kNumHistogramBins - 1 ? bin
+                                                   : kNumHistogramBins - 2]++;
+        }
+
         if(firstCycle_)
         {
             max_ = min_ = avg_ = currentBlockLoad;
@@ -79,22 +112,41 @@ class CpuLoadMeter
     float GetMinCpuLoad() const { return min_; }
     /** Returns the maximum CPU load observed since the last call to Reset(). */
     float GetMaxCpuLoad() const { return max_; }
+    /** Returns the number of blocks that missed their deadline since the 
+     *  last call to Reset(). 
+     */
+    uint32_t GetNumOverruns() const { return overruns_; }
+    /** Returns the number of blocks in a bin of the load histogram.
+     *  Bin i < 10 counts the blocks with a load of i*10% up to (i+1)*10%,
+     *  bin 10 counts the overruns.
+     */
+    uint32_t GetHistogramBin(size_t bin) const
+    {
+        return bin < kNumHistogramBins ? histogram_[bin] : 0;
+    }
 
-    /** Resets the minimun, maximum and average load readings. */
+    /** Resets the minimun, maximum and average load readings, 
+     *  the overrun count and the histogram. 
+     */
     void Reset()
     {
         firstCycle_ = true;
+        overruns_   = 0;
         avg_ = max_ = min_ = NAN;
+        for(auto& bin : histogram_)
+            bin = 0;
     }
 
   private:
-    bool     firstCycle_;
-    float    ticksPerBlockInv_;
-    uint32_t currentBlockStartTicks_;
-    float    min_;
-    float    max_;
-    float    avg_;
-    float    smoothingConstant_;
+    bool              firstCycle_;
+    float             ticksPerBlockInv_;
+    uint32_t          currentBlockStartTicks_;
+    float             min_;
+    float             max_;
+    float             avg_;
+    float             smoothingConstant_;
+    volatile uint32_t overruns_;
+    volatile uint32_t histogram_[kNumHistogramBins];
 
     CpuLoadMeter(const CpuLoadMeter&) = delete;
     CpuLoadMeter& operator=(const CpuLoadMeter&) = delete;
@@ -0,0 +1,267 @@
+#pragma once
+#ifndef DSY_EVENTBUS_H
+#define DSY_EVENTBUS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/**
+A lock-free multi-producer/single-consumer queue
+
+Any number of contexts, e.g. several interrupts of different priority, may
+post while one context (usually the main loop) reads, without disabling
+interrupts. Posting claims a slot with a single compare-and-swap and never
+waits for other producers: if a producer is interrupted while it writes an
+element, the reader only sees the elements behind it once it's done.
+
+Every slot has a sequence number that tells the reader whether it has been
+written (bounded queue by D. Vyukov). The size must be a power of two, and
+the whole queue can be filled. Elements are dropped if the queue is full.
+*/
+template <typename T, size_t size>
+class MpscQueue
+{
+    static_assert(size > 1 && size <= 0x80000000 && (size & (size - 1)) == 0,
+                  "MpscQueue size must be a power of two");
+
+  public:
+    MpscQueue() { Init(); }
+
+    /** Empties the queue. Must not be called while others post to it. */
+    void Init()
+    {
+        for(uint32_t i = 0; i < size; i++)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        read_pos_.store(0, std::memory_order_relaxed);
+        write_pos_.store(0, std::memory_order_relaxed);
+        num_dropped_.store(0, std::memory_order_release);
+    }
+
+    /** Adds an element. Safe to call from any context.
+    \param element the element
+    \return false if the queue was full and the element was dropped
+     */
+    bool Post(const T& element)
+    {
+        uint32_t pos = write_pos_.load(std::memory_order_relaxed);
+        Slot*    slot;
+        for(;;)
+        {
+            slot               = &slots_[pos & kMask];
+            const uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+            const int32_t  diff = static_cast<int32_t>(seq - pos);
+            if(diff == 0)
+            {
+                // the slot is free, claim it. On failure pos is reloaded.
+                if(write_pos_.compare_exchange_weak(
+                       pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+            {
+                // the reader hasn't released this slot yet
+                num_dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                // another producer claimed it first
+                pos = write_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        slot->element = element;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Removes the oldest element. Called by the consumer only.
+    \param element receives the element
+    \return false if there is no element
+     */
+    bool TryRead(T& element)
+    {
+        const uint32_t pos  = read_pos_.load(std::memory_order_relaxed);
+        Slot&          slot = slots_[pos & kMask];
+        if(slot.sequence.load(std::memory_order_acquire) != pos + 1)
+            return false;
+        element = slot.element;
+        slot.sequence.store(pos + size, std::memory_order_release);
+        read_pos_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Removes up to max_elements elements and passes them to a sink.
+    Called by the consumer only.
+    \param sink called as sink(const T&) for every element
+    \param max_elements the most elements to remove
+    \return the number of elements removed
+     */
+    template <typename Sink>
+    size_t Drain(Sink&& sink, size_t max_elements = size)
+    {
+        size_t   num = 0;
+        uint32_t pos = read_pos_.load(std::memory_order_relaxed);
+        while(num < max_elements)
+        {
+            Slot& slot = slots_[pos & kMask];
+            if(slot.sequence.load(std::memory_order_acquire) != pos + 1)
+                break;
+            sink(static_cast<const T&>(slot.element));
+            slot.sequence.store(pos + size, std::memory_order_release);
+            pos++;
+            num++;
+        }
+        read_pos_.store(pos, std::memory_order_release);
+        return num;
+    }
+
+    /** \return the number of posted elements that haven't been read. This
+    includes elements that are still being written.
+     */
+    size_t GetNumElements() const
+    {
+        return write_pos_.load(std::memory_order_acquire)
+               - read_pos_.load(std::memory_order_acquire);
+    }
+
+    /** \return true if no element has been posted since the last read */
+    bool IsEmpty() const { return GetNumElements() == 0; }
+
+    /** \return the number of elements dropped because the queue was full */
+    uint32_t GetNumDropped() const
+    {
+        return num_dropped_.load(std::memory_order_relaxed);
+    }
+
+    /** \return the number of elements the queue can hold */
+    static constexpr size_t GetCapacity() { return size; }
+
+  private:
+    static constexpr uint32_t kMask = size - 1;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> sequence;
+        T                     element;
+    };
+
+    Slot                  slots_[size];
+    std::atomic<uint32_t> read_pos_;
+    std::atomic<uint32_t> write_pos_;
+    std::atomic<uint32_t> num_dropped_;
+};
+
+/**
+An event bus with priorities
+
+Drivers and interrupt handlers post events, and the main loop drains them in
+batches. Each priority has its own MpscQueue, so all memory is allocated up
+front and a flood of low priority events can't push out urgent ones. Events
+of the same priority are read in the order they were posted.
+
+The bus carries one type of event; subsystems with several kinds of events
+use a tagged event type, like UiEventQueue::Event, or a bus each.
+
+\tparam T the event type, copied in and out of the bus
+\tparam size number of events per priority, a power of two
+\tparam num_priorities number of priorities. 0 is the lowest.
+*/
+template <typename T, size_t size, size_t num_priorities = 1>
+class EventBus
+{
+    static_assert(num_priorities > 0, "EventBus needs a priority");
+
+  public:
+    EventBus() {}
+
+    /** Empties the bus. Must not be called while others post to it. */
+    void Init()
+    {
+        for(auto& queue : queues_)
+            queue.Init();
+    }
+
+    /** Posts an event. Safe to call from any context, including interrupts.
+    \param event the event
+    \param priority priority of the event, clamped to num_priorities - 1
+    \return false if the queue of the priority was full and the event was
+            dropped
+     */
+    bool Post(const T& event, size_t priority = 0)
+    {
+        if(priority >= num_priorities)
+            priority = num_priorities - 1;
+        return queues_[priority].Post(event);
+    }
+
+    /** Removes the next event, of the highest priority that has one.
+    Called by the consumer only.
+    \param event receives the event
+    \return false if there is no event
+     */
+    bool TryRead(T& event)
+    {
+        for(size_t p = num_priorities; p > 0; p--)
+            if(queues_[p - 1].TryRead(event))
+                return true;
+        return false;
+    }
+
+    /** Removes events and passes them to a sink, highest priority first.
+    Events that are posted with a higher priority while the bus is drained
+    are handled in the next call. Called by the consumer only.
+    \param sink called as sink(const T&) for every event
+    \param max_events the most events to remove, to limit the time spent
+    \return the number of events removed
+     */
+    template <typename Sink>
+    size_t Drain(Sink&& sink, size_t max_events = size * num_priorities)
+    {
+        size_t num = 0;
+        for(size_t p = num_priorities; p > 0 && num < max_events; p--)
+            num += queues_[p - 1].Drain(sink, max_events - num);
+        return num;
+    }
+
+    /** \return the number of unread events of all priorities */
+    size_t GetNumEvents() const
+    {
+        size_t num = 0;
+        for(const auto& queue : queues_)
+            num += queue.GetNumElements();
+        return num;
+    }
+
+    /** \return true if there are no unread events */
+    bool IsEmpty() const { return GetNumEvents() == 0; }
+
+    /** \return the number of events dropped because a queue was full */
+    uint32_t GetNumDropped() const
+    {
+        uint32_t num = 0;
+        for(const auto& queue : queues_)
+            num += queue.GetNumDropped();
+        return num;
+    }
+
+    /** \return the queue of a priority */
+    const MpscQueue<T, size>& GetQueue(size_t priority) const
+    {
+        return queues_[priority];
+    }
+
+  private:
+    MpscQueue<T, size> queues_[num_priorities];
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
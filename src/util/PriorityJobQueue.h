@@ -0,0 +1,147 @@
+#pragma once
+#ifndef DSY_PRIORITYJOBQUEUE_H
+#define DSY_PRIORITYJOBQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "scopedirqblocker.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/**
+A bounded queue of jobs for a peripheral, ordered by priority and deadline
+
+Jobs are read back with the highest priority first. Jobs of the same
+priority are ordered by their deadline (earliest first), jobs without a
+deadline come after those with one, and the order of jobs that are
+otherwise equal is kept.
+
+Jobs may be pushed from the main loop and from interrupts (e.g. from the
+completion callback of another job) and are usually popped in an interrupt,
+so every access briefly blocks interrupts. The queue is meant for a handful
+of jobs: Push() is constant time, Pop() searches all jobs.
+
+\tparam Job the job type. It needs the members `uint8_t priority` (higher
+            is more urgent) and `uint32_t deadline` (a time in any
+            wrapping unit, 0 for none).
+\tparam size the maximum number of jobs
+*/
+template <typename Job, size_t size>
+class PriorityJobQueue
+{
+    static_assert(size > 0 && size < 256,
+                  "PriorityJobQueue holds between 1 and 255 jobs");
+
+  public:
+    PriorityJobQueue() { Clear(); }
+
+    /** Removes all jobs */
+    void Clear()
+    {
+        ScopedIrqBlocker block;
+        num_jobs_ = 0;
+        next_seq_ = 0;
+    }
+
+    /** Adds a job
+    \return false if the queue is full
+     */
+    bool Push(const Job& job)
+    {
+        ScopedIrqBlocker block;
+        if(num_jobs_ >= size)
+            return false;
+        slots_[num_jobs_].job = job;
+        slots_[num_jobs_].seq = next_seq_++;
+        num_jobs_++;
+        return true;
+    }
+
+    /** Returns the next job without removing it, or nullptr if the queue is
+    empty. Only valid until the queue is changed.
+     */
+    const Job* Peek() const
+    {
+        ScopedIrqBlocker block;
+        return num_jobs_ > 0 ? &slots_[Next()].job : nullptr;
+    }
+
+    /** Removes the next job
+    \param job receives the job
+    \return false if the queue is empty
+     */
+    bool Pop(Job* job)
+    {
+        ScopedIrqBlocker block;
+        if(num_jobs_ == 0)
+            return false;
+        const size_t next = Next();
+        *job              = slots_[next].job;
+        // moving the last job into the gap keeps Push() constant time.
+        // The sequence numbers keep the order.
+        slots_[next] = slots_[--num_jobs_];
+        return true;
+    }
+
+    /** Returns the number of queued jobs */
+    size_t GetNumJobs() const { return num_jobs_; }
+
+    /** Returns true if there are no jobs */
+    bool IsEmpty() const { return num_jobs_ == 0; }
+
+    /** Returns the maximum number of jobs */
+    static constexpr size_t GetCapacity() { return size; }
+
+    /** Returns true if job a should run before job b, e.g. to choose between
+    the queues of several peripherals that share a DMA stream.
+    Returns false for jobs of equal urgency.
+     */
+    static bool IsMoreUrgent(const Job& a, const Job& b)
+    {
+        if(a.priority != b.priority)
+            return a.priority > b.priority;
+        if(a.deadline == 0 || b.deadline == 0)
+            return a.deadline != 0 && b.deadline == 0;
+        // compares correctly across a wrap of the time base
+        return static_cast<int32_t>(a.deadline - b.deadline) < 0;
+    }
+
+  private:
+    struct Slot
+    {
+        Job      job;
+        uint32_t seq;
+    };
+
+    size_t Next() const
+    {
+        size_t best = 0;
+        for(size_t i = 1; i < num_jobs_; i++)
+        {
+            const Slot& s = slots_[i];
+            const Slot& b = slots_[best];
+            if(IsMoreUrgent(s.job, b.job)
+               || (!IsMoreUrgent(b.job, s.job) && IsOlder(s.seq, b.seq)))
+                best = i;
+        }
+        return best;
+    }
+
+    static bool IsOlder(uint32_t a, uint32_t b)
+    {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    Slot             slots_[size];
+    volatile uint8_t num_jobs_;
+    uint32_t         next_seq_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
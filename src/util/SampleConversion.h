@@ -0,0 +1,214 @@
+#pragma once
+#ifndef DSY_SAMPLE_CONVERSION_H
+#define DSY_SAMPLE_CONVERSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "daisy_core.h"
+
+#if defined(__ARM_FEATURE_SAT)
+#include <arm_acle.h>
+#endif
+
+namespace daisy
+{
+/** @brief Block conversion between integer and float samples
+ *  @ingroup utility
+ *  @details The bit depth is a template parameter so that there is no
+ *  branching inside the loops, and gain is folded into the scaling
+ *  constant, so every sample costs one multiply.
+ *
+ *  Integer samples are stored right-justified in 32 bit words, the way the
+ *  SAI moves them. 24 bit samples are sign extended from bit 23, regardless
+ *  of what the upper byte contains.
+ *
+ *  Float to integer conversion scales like f2s16/f2s24/f2s32. On cores
+ *  with the saturating instructions (Cortex-M7), 16 and 24 bit samples
+ *  saturate with SSAT, so samples beyond +/- FBIPMAX become the full-scale
+ *  values instead of the slightly lower ones of f2s16/f2s24. Elsewhere the
+ *  portable version clamps like f2s16/f2s24/f2s32.
+ *
+ *  \tparam bits 16, 24 or 32
+ */
+template <int bits>
+struct SampleConversion
+{
+    static_assert(bits == 16 || bits == 24 || bits == 32,
+                  "only 16, 24 and 32 bit samples are supported");
+
+    /** Scale from a full-scale integer to +/- 1.0 */
+    static constexpr float kToFloatScale = bits == 16   ? S162F_SCALE
+                                           : bits == 24 ? S242F_SCALE
+                                                        : S322F_SCALE;
+
+    /** Converts a single sample to float, with scale (incl. gain) applied */
+    static FORCE_INLINE float ToFloat(int32_t x, float scale)
+    {
+        if(bits == 16)
+            return (float)(int16_t)x * scale;
+        if(bits == 24)
+            return (float)((int32_t)((uint32_t)x << 8) >> 8) * scale;
+        return (float)x * scale;
+    }
+
+    /** Converts a single sample that has already been multiplied by its gain */
+    static FORCE_INLINE int32_t FromFloat(float x)
+    {
+#if defined(__ARM_FEATURE_SAT)
+        return FromFloatSaturating(x);
+#else
+        x = x <= FBIPMIN ? FBIPMIN : x;
+        x = x >= FBIPMAX ? FBIPMAX : x;
+        if(bits == 16)
+            return (int16_t)(x * F2S16_SCALE);
+        if(bits == 24)
+            return (int32_t)(x * F2S24_SCALE);
+        return (int32_t)(x * F2S32_SCALE);
+#endif
+    }
+
+    /** The version of FromFloat() for cores with SSAT. It's public so that
+     *  it can be tested on the host, where Ssat() is emulated.
+     */
+    static FORCE_INLINE int32_t FromFloatSaturating(float x)
+    {
+        if(bits == 32)
+        {
+            // 2^31 - 1 is 2^31 as a float, there is nothing to saturate
+            x = x <= FBIPMIN ? FBIPMIN : x;
+            x = x >= FBIPMAX ? FBIPMAX : x;
+            return (int32_t)(x * F2S32_SCALE);
+        }
+        // The conversion of a float out of the int32 range is undefined.
+        // This clamp (VMINNM/VMAXNM) only keeps it in range, SSAT saturates.
+        x = x <= -2.f ? -2.f : x;
+        x = x >= 2.f ? 2.f : x;
+        if(bits == 16)
+            return Ssat((int32_t)(x * F2S16_SCALE));
+        return Ssat((int32_t)(x * F2S24_SCALE));
+    }
+
+    /** Converts n samples to float
+     *  \param in integer samples
+     *  \param out float samples
+     *  \param n number of samples
+     *  \param gain applied to every sample
+     */
+    static void
+    ToFloat(const int32_t* in, float* out, size_t n, float gain = 1.f)
+    {
+        const float scale = kToFloatScale * gain;
+        size_t      i     = 0;
+        for(; i + 4 <= n; i += 4)
+        {
+            out[i]     = ToFloat(in[i], scale);
+            out[i + 1] = ToFloat(in[i + 1], scale);
+            out[i + 2] = ToFloat(in[i + 2], scale);
+            out[i + 3] = ToFloat(in[i + 3], scale);
+        }
+        for(; i < n; i++)
+            out[i] = ToFloat(in[i], scale);
+    }
+
+    /** Converts n float samples to integers
+     *  \param in float samples
+     *  \param out integer samples
+     *  \param n number of samples
+     *  \param gain applied to every sample before saturation
+     */
+    static void
+    FromFloat(const float* in, int32_t* out, size_t n, float gain = 1.f)
+    {
+        size_t i = 0;
+        for(; i + 4 <= n; i += 4)
+        {
+            out[i]     = FromFloat(in[i] * gain);
+            out[i + 1] = FromFloat(in[i + 1] * gain);
+            out[i + 2] = FromFloat(in[i + 2] * gain);
+            out[i + 3] = FromFloat(in[i + 3] * gain);
+        }
+        for(; i < n; i++)
+            out[i] = FromFloat(in[i] * gain);
+    }
+
+    /** Converts an interleaved integer buffer to one float buffer per channel
+     *  \param in frames * chns interleaved integer samples
+     *  \param out chns pointers to buffers of frames float samples
+     *  \param frames number of frames
+     *  \param chns number of interleaved channels
+     *  \param gain applied to every sample
+     */
+    static void DeinterleaveToFloat(const int32_t* in,
+                                    float* const*  out,
+                                    size_t         frames,
+                                    size_t         chns,
+                                    float          gain = 1.f)
+    {
+        const float scale = kToFloatScale * gain;
+        if(chns == 2)
+        {
+            float* l = out[0];
+            float* r = out[1];
+            for(size_t i = 0; i < frames; i++)
+            {
+                l[i] = ToFloat(in[2 * i], scale);
+                r[i] = ToFloat(in[2 * i + 1], scale);
+            }
+            return;
+        }
+        for(size_t c = 0; c < chns; c++)
+        {
+            float* dst = out[c];
+            for(size_t i = 0; i < frames; i++)
+                dst[i] = ToFloat(in[i * chns + c], scale);
+        }
+    }
+
+    /** Converts one float buffer per channel to an interleaved integer buffer
+     *  \param in chns pointers to buffers of frames float samples
+     *  \param out frames * chns interleaved integer samples
+     *  \param frames number of frames
+     *  \param chns number of interleaved channels
+     *  \param gain applied to every sample before saturation
+     */
+    static void InterleaveFromFloat(const float* const* in,
+                                    int32_t*            out,
+                                    size_t              frames,
+                                    size_t              chns,
+                                    float               gain = 1.f)
+    {
+        if(chns == 2)
+        {
+            const float* l = in[0];
+            const float* r = in[1];
+            for(size_t i = 0; i < frames; i++)
+            {
+                out[2 * i]     = FromFloat(l[i] * gain);
+                out[2 * i + 1] = FromFloat(r[i] * gain);
+            }
+            return;
+        }
+        for(size_t c = 0; c < chns; c++)
+        {
+            const float* src = in[c];
+            for(size_t i = 0; i < frames; i++)
+                out[i * chns + c] = FromFloat(src[i] * gain);
+        }
+    }
+
+  private:
+    /** Saturates to the signed range of bits */
+    static FORCE_INLINE int32_t Ssat(int32_t x)
+    {
+#if defined(__ARM_FEATURE_SAT)
+        return __ssat(x, bits);
+#else
+        constexpr int32_t kMax = int32_t((uint32_t(1) << (bits - 1)) - 1);
+        return x > kMax ? kMax : (x < -kMax - 1 ? -kMax - 1 : x);
+#endif
+    }
+};
+
+} // namespace daisy
+
+#endif
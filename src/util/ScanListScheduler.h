@@ -0,0 +1,216 @@
+#pragma once
+#ifndef DSY_SCANLISTSCHEDULER_H
+#define DSY_SCANLISTSCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PriorityJobQueue.h"
+
+namespace daisy
+{
+/** @addtogroup utility
+    @{
+*/
+
+/**
+Chooses the next transfer of a bus from queued jobs and a scan list
+
+A scan list is a list of steps that runs in passes, e.g. to refresh a DAC
+or read an ADC at a fixed rate. The steps are double buffered: passes
+alternate between buffer index 0 and 1. Queued jobs with a higher priority
+than the scan list run between its steps, others between its passes. A
+continuous list starts its next pass right away, but the jobs that were
+queued during a pass run first, so it can't hold them back forever.
+Otherwise Trigger() starts the next pass.
+
+There is no hardware access: the bus driver starts the jobs returned by
+GetNextJob() and reports each finished scan step to FinishScanStep(). All
+functions are meant to be called with interrupts blocked.
+
+\tparam Job the job type. It needs the members `size_t device_index`,
+            `uint8_t* tx_data`, `uint8_t* rx_data`, `size_t size`,
+            `uint8_t priority` and `uint32_t deadline`.
+\tparam Step the step type. It needs the members `size_t device_index`,
+             `uint8_t* tx_data[2]`, `uint8_t* rx_data[2]` and `size_t size`.
+\tparam queue_size the maximum number of queued jobs
+*/
+template <typename Job, typename Step, size_t queue_size>
+class ScanListScheduler
+{
+  public:
+    ScanListScheduler() { Reset(); }
+
+    /** Removes all jobs and the scan list */
+    void Reset()
+    {
+        queue_.Clear();
+        StopScanList();
+        num_overruns_ = 0;
+    }
+
+    /** Queues a job
+    \return false if the queue is full
+     */
+    bool Queue(const Job& job) { return queue_.Push(job); }
+
+    /** Returns the number of queued jobs */
+    size_t GetNumQueuedJobs() const { return queue_.GetNumJobs(); }
+
+    /** Replaces the scan list and starts its first pass, with buffer index 0
+    \param steps the steps, must stay valid while the list runs
+    \param num_steps number of steps, at least 1
+    \param continuous true to repeat the passes without a trigger
+    \param priority priority of the steps, compared to the jobs'
+     */
+    void StartScanList(const Step* steps,
+                       size_t      num_steps,
+                       bool        continuous,
+                       uint8_t     priority)
+    {
+        steps_        = steps;
+        num_steps_    = num_steps;
+        continuous_   = continuous;
+        priority_     = priority;
+        running_      = true;
+        next_step_    = 0;
+        buffer_index_ = 0;
+        pass_failed_  = false;
+        num_deferred_ = 0;
+        num_overruns_ = 0;
+    }
+
+    /** Starts the next pass of a scan list that isn't continuous
+    \return false if there is no scan list or a pass is running. The
+            trigger is counted as an overrun in the latter case.
+     */
+    bool Trigger()
+    {
+        if(steps_ == nullptr)
+            return false;
+        if(running_)
+        {
+            if(!continuous_)
+                num_overruns_++;
+            return false;
+        }
+        running_   = true;
+        next_step_ = 0;
+        return true;
+    }
+
+    /** Removes the scan list. A step that was already started still has to
+    be finished by the driver, but isn't reported here.
+     */
+    void StopScanList()
+    {
+        steps_        = nullptr;
+        running_      = false;
+        num_deferred_ = 0;
+    }
+
+    /** Returns true while a pass runs */
+    bool IsScanRunning() const { return running_; }
+
+    /** Returns the buffer index of the current or next pass */
+    size_t GetScanBufferIndex() const { return buffer_index_; }
+
+    /** Returns the number of triggers that came while a pass was running */
+    uint32_t GetNumOverruns() const { return num_overruns_; }
+
+    /** Removes the next job to run
+    \param job receives the job. For a scan step, only the members of the
+               step and the priority are set.
+    \param is_scan_step set to true if the job is a step of the scan list,
+                        to be finished with FinishScanStep()
+    \return false if there is nothing to do
+     */
+    bool GetNextJob(Job* job, bool* is_scan_step)
+    {
+        // jobs that were queued while a continuous pass ran go first
+        if(running_ && num_deferred_ == 0)
+        {
+            const Step&  step = steps_[next_step_];
+            const size_t i    = buffer_index_;
+
+            Job scan_job;
+            scan_job.device_index = step.device_index;
+            scan_job.tx_data      = GetBuffer(step.tx_data, i);
+            scan_job.rx_data      = GetBuffer(step.rx_data, i);
+            scan_job.size         = step.size;
+            scan_job.priority     = priority_;
+
+            const Job* queued = queue_.Peek();
+            if(queued == nullptr
+               || !JobQueue::IsMoreUrgent(*queued, scan_job))
+            {
+                *job          = scan_job;
+                *is_scan_step = true;
+                return true;
+            }
+        }
+
+        if(!queue_.Pop(job))
+        {
+            num_deferred_ = 0;
+            return false;
+        }
+        if(num_deferred_ > 0)
+            num_deferred_--;
+        *is_scan_step = false;
+        return true;
+    }
+
+    /** Reports a finished scan step
+    \param ok false if the transfer failed
+    \param buffer_index receives the buffer index of the pass when it's done
+    \param pass_ok receives false if a step of the pass failed
+    \return true if the pass is done
+     */
+    bool FinishScanStep(bool ok, size_t* buffer_index, bool* pass_ok)
+    {
+        if(!ok)
+            pass_failed_ = true;
+        if(!running_ || ++next_step_ < num_steps_)
+            return false;
+
+        *buffer_index = buffer_index_;
+        *pass_ok      = !pass_failed_;
+        buffer_index_ ^= 1;
+        next_step_   = 0;
+        pass_failed_ = false;
+        if(continuous_)
+            num_deferred_ = queue_.GetNumJobs();
+        else
+            running_ = false;
+        return true;
+    }
+
+  private:
+    typedef PriorityJobQueue<Job, queue_size> JobQueue;
+
+    // the buffer of a pass, or the first one if the step isn't double
+    // buffered
+    static uint8_t* GetBuffer(uint8_t* const buffers[2], size_t index)
+    {
+        return buffers[index] != nullptr ? buffers[index] : buffers[0];
+    }
+
+    JobQueue    queue_;
+    const Step* steps_;
+    size_t      num_steps_;
+    bool        continuous_;
+    uint8_t     priority_;
+
+    volatile bool running_; // a pass is running
+    size_t        next_step_;
+    size_t        buffer_index_;
+    bool          pass_failed_;
+    // queued jobs that run before the next continuous pass
+    size_t   num_deferred_;
+    uint32_t num_overruns_;
+};
+
+/** @} */
+} // namespace daisy
+
+#endif
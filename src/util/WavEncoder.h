@@ -0,0 +1,221 @@
+#pragma once
+#ifndef DSY_WAV_ENCODER_H
+#define DSY_WAV_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "util/SampleConversion.h"
+#include "util/wav_format.h"
+
+namespace daisy
+{
+/** @brief   Sample packing and header of the WAV files of WavWriter
+ *  @ingroup utility
+ *  @details Converts float audio into the sample format of the file and
+ *           builds its 512 byte header. There is no file access, the
+ *           WavWriter writes the bytes.
+ *
+ *           The header is RIFF, then ds64 (RF64 only), JUNK padding,
+ *           fmt, fact (float only) and data, so the audio always starts at
+ *           kHeaderSize. When the data grows beyond 4 GB, the header is
+ *           RF64 and the sizes are in the ds64 chunk.
+ */
+class WavEncoder
+{
+  public:
+    /** Sample formats of the file */
+    enum class Format
+    {
+        NONE,
+        S16,
+        S24,
+        S32,
+        F32,
+    };
+
+    static constexpr int32_t kMaxChannels = 32;
+    static constexpr size_t  kHeaderSize  = 512;
+
+    WavEncoder() : format_(Format::NONE) {}
+
+    /** Sets the format of the file
+     *  \param samplerate frames per second
+     *  \param channels 1 to kMaxChannels
+     *  \param bitspersample 16, 24 or 32
+     *  \param use_float 32 bit IEEE float instead of integer
+     *  \return false if the format isn't supported
+     */
+    bool Init(float   samplerate,
+              int32_t channels,
+              int32_t bitspersample,
+              bool    use_float)
+    {
+        samplerate_    = samplerate;
+        channels_      = channels;
+        bitspersample_ = bitspersample;
+        if(use_float)
+            format_ = bitspersample == 32 ? Format::F32 : Format::NONE;
+        else if(bitspersample == 16)
+            format_ = Format::S16;
+        else if(bitspersample == 24)
+            format_ = Format::S24;
+        else if(bitspersample == 32)
+            format_ = Format::S32;
+        else
+            format_ = Format::NONE;
+        if(channels < 1 || channels > kMaxChannels)
+            format_ = Format::NONE;
+        frame_bytes_ = format_ == Format::NONE ? 0
+                                               : channels * bitspersample / 8;
+        return format_ != Format::NONE;
+    }
+
+    /** Returns the sample format */
+    Format GetFormat() const { return format_; }
+
+    /** Returns the size of one frame in the file */
+    size_t GetFrameBytes() const { return frame_bytes_; }
+
+    /** Converts frames to the sample format of the file.
+     *  \param interleaved frames * channels interleaved samples, or nullptr
+     *  \param planar one buffer per channel, used if interleaved is nullptr
+     *  \param offset the first frame of the input that is converted
+     *  \param frames number of frames
+     *  \param out frames * GetFrameBytes() bytes
+     */
+    void Pack(const float *const  interleaved,
+              const float *const *planar,
+              size_t              offset,
+              size_t              frames,
+              uint8_t            *out) const
+    {
+        switch(format_)
+        {
+            case Format::S16:
+                PackFrames<16>(interleaved, planar, offset, frames, out);
+                break;
+            case Format::S24:
+                PackFrames<24>(interleaved, planar, offset, frames, out);
+                break;
+            case Format::S32:
+                PackFrames<32>(interleaved, planar, offset, frames, out);
+                break;
+            case Format::F32:
+                PackFrames<0>(interleaved, planar, offset, frames, out);
+                break;
+            default: break;
+        }
+    }
+
+    /** Builds the header for a recording
+     *  \param num_frames length of the recording
+     *  \param header kHeaderSize bytes
+     */
+    void BuildHeader(uint64_t num_frames, uint8_t *header) const
+    {
+        // non-PCM data needs a fact chunk with the number of frames
+        const uint64_t data_bytes = num_frames * frame_bytes_;
+        const uint64_t riff_size  = kHeaderSize - 8 + data_bytes;
+        const bool     rf64       = riff_size > 0xffffffff;
+        const bool     is_float   = format_ == Format::F32;
+        const size_t   fmt_size   = is_float ? 18 : 16;
+        const size_t   fact_size  = is_float ? 12 : 0;
+        const size_t   fmt_pos = kHeaderSize - 8 - fact_size - (8 + fmt_size);
+        uint8_t       *h       = header;
+        size_t         pos     = 12;
+        memset(h, 0, kHeaderSize);
+
+        Put32(h, rf64 ? kWavFileRF64Id : kWavFileChunkId);
+        Put32(h + 4, rf64 ? 0xffffffff : uint32_t(riff_size));
+        Put32(h + 8, kWavFileWaveId);
+        if(rf64)
+        {
+            Put32(h + pos, kWavFileDs64Id);
+            Put32(h + pos + 4, 28);
+            Put64(h + pos + 8, riff_size);
+            Put64(h + pos + 16, data_bytes);
+            Put64(h + pos + 24, num_frames);
+            Put32(h + pos + 32, 0); // no table
+            pos += 36;
+        }
+        Put32(h + pos, kWavFileJunkId);
+        Put32(h + pos + 4, fmt_pos - pos - 8);
+
+        h += fmt_pos;
+        Put32(h, kWavFileSubChunk1Id);
+        Put32(h + 4, fmt_size);
+        Put16(h + 8, is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+        Put16(h + 10, channels_);
+        Put32(h + 12, static_cast<uint32_t>(samplerate_));
+        Put32(h + 16,
+              static_cast<uint32_t>(samplerate_) * channels_ * bitspersample_
+                  / 8);
+        Put16(h + 20, frame_bytes_);
+        Put16(h + 22, bitspersample_);
+        // the float format has an (empty) extension, its size is already 0
+
+        if(is_float)
+        {
+            // for RF64, the number of frames is in the ds64 chunk
+            h += 8 + fmt_size;
+            Put32(h, kWavFileFactId);
+            Put32(h + 4, 4);
+            Put32(h + 8, rf64 ? 0xffffffff : uint32_t(num_frames));
+        }
+
+        h = header + kHeaderSize - 8;
+        Put32(h, kWavFileSubChunk2Id);
+        Put32(h + 4, rf64 ? 0xffffffff : uint32_t(data_bytes));
+    }
+
+  private:
+    /** Stores one sample, bits == 0 for float */
+    template <int bits>
+    static inline void Store(float x, uint8_t *out)
+    {
+        if(bits == 0)
+        {
+            memcpy(out, &x, 4);
+            return;
+        }
+        // little endian, so the sample is in the low bytes of the word
+        const int32_t v = SampleConversion<bits ? bits : 32>::FromFloat(x);
+        memcpy(out, &v, bits / 8);
+    }
+
+    template <int bits>
+    void PackFrames(const float *const  interleaved,
+                    const float *const *planar,
+                    size_t              offset,
+                    size_t              frames,
+                    uint8_t            *out) const
+    {
+        constexpr size_t kBytes = bits ? bits / 8 : 4;
+        const size_t     chns   = channels_;
+        if(interleaved)
+        {
+            const float *in = interleaved + offset * chns;
+            for(size_t i = 0; i < frames * chns; i++)
+                Store<bits>(in[i], out + i * kBytes);
+            return;
+        }
+        for(size_t i = 0; i < frames; i++)
+            for(size_t c = 0; c < chns; c++, out += kBytes)
+                Store<bits>(planar[c][offset + i], out);
+    }
+
+    static inline void Put16(uint8_t *dst, uint16_t v) { memcpy(dst, &v, 2); }
+    static inline void Put32(uint8_t *dst, uint32_t v) { memcpy(dst, &v, 4); }
+    static inline void Put64(uint8_t *dst, uint64_t v) { memcpy(dst, &v, 8); }
+
+    float   samplerate_;
+    int32_t channels_;
+    int32_t bitspersample_;
+    size_t  frame_bytes_;
+    Format  format_;
+};
+
+} // namespace daisy
+
+#endif
@@ -1,37 +1,51 @@
 #pragma once
-#pragma once
+#include <string.h>
 #include "fatfs.h"
+#include "util/ringbuffer.h"
+#include "util/WavEncoder.h"
 
 namespace daisy
 {
 /** Audio Recording Module
- ** 
- ** Record audio into a working buffer that is gradually written to a WAV file on an SD Card. 
  **
- ** Recordings are made with floating point input, and will be converted to the 
- ** specified bits per sample internally 
+ ** Record audio into a working buffer that is gradually written to a WAV file on an SD Card.
  **
- ** For now only 16-bit and 32-bit (signed int) formats are supported
- ** f32 and s24 formats will be added next
+ ** Recordings are made with floating point input, and will be converted to the
+ ** specified format internally: 16, 24 or 32 bit signed integer, or 32 bit float.
+ ** Whole audio blocks can be recorded at once with SampleBlock(), which picks
+ ** the conversion once per block instead of once per sample.
  **
  ** The transfer size determines the amount of internal memory used, and can have an
  ** effect on the performance of the streaming behavior of the WavWriter.
  ** Memory use can be calculated as: (2 * transfer_size) bytes
+ ** The transfer size must be a power of two, and at least 512.
  ** Performance optimal with sizes: 16384, 32768
- ** 
+ **
+ ** The header is padded to 512 bytes with a "JUNK" chunk, and the data is
+ ** written in transfer_size pieces at file offsets that are multiples of
+ ** transfer_size, so each write lines up with the sectors and clusters of
+ ** the card. If the recording grows beyond 4 GB (which requires exFAT), the
+ ** padding is turned into a "ds64" chunk and the file is saved as RF64.
+ ** The samples and the header are encoded by WavEncoder.
+ **
  ** To use:
  ** 1. Create a WavWriter<size> object (e.g. WavWriter<32768> writer)
  ** 2. Configure the settings as desired by creating a WavWriter<32768>::Config struct and setting the settings.
  ** 3. Initialize the object with the configuration struct.
  ** 4. Open a new file for writing with: writer.OpenFile("FileName.wav")
- ** 5. Write to it within your audio callback using: writer.Sample(value)
+ ** 5. Write to it within your audio callback using: writer.SampleBlock(in, size)
+ **    or writer.Sample(value) for a single frame
  ** 6. Fill the Wav File on the SD Card with data from your main loop by running: writer.Write()
  ** 7. When finished with the recording finalize, and close the file with: writer.SaveFile();
- ** 
+ **
  ** */
 template <size_t transfer_size>
 class WavWriter
 {
+    static_assert(transfer_size >= 512
+                      && (transfer_size & (transfer_size - 1)) == 0,
+                  "transfer_size must be a power of two of at least 512");
+
   public:
     WavWriter() {}
     ~WavWriter() {}
@@ -48,106 +62,87 @@ class WavWriter
     struct Config
     {
         float   samplerate;
-        int32_t channels;
-        int32_t bitspersample;
+        int32_t channels;          /**< 1 to 32 */
+        int32_t bitspersample;     /**< 16, 24 or 32 */
+        bool    use_float = false; /**< 32 bit IEEE float instead of integer */
     };
 
-    /** State of the internal Writing mechanism. 
-     ** When the buffer is a certain amount full one section will write its contents
-     ** while the other is still being written to. This is performed circularly
-     ** so that audio will be uninterrupted during writing. */
-    enum class BufferState
-    {
-        IDLE,
-        FLUSH0,
-        FLUSH1,
-    };
-
-    /**  Initializes the WavFile header, and prepares the object for recording. */
-    void Init(const Config &cfg)
+    /**  Initializes the WavFile header, and prepares the object for recording.
+     ** \return ERROR if the format isn't supported
+     */
+    Result Init(const Config &cfg)
     {
         cfg_       = cfg;
         num_samps_ = 0;
-        // Prep the wav header according to config.
-        // Certain things (i.e. Size, etc. will have to wait until the finalization of the file, or be updated while streaming).
-        wavheader_.ChunkId       = kWavFileChunkId;     /** "RIFF" */
-        wavheader_.FileFormat    = kWavFileWaveId;      /** "WAVE" */
-        wavheader_.SubChunk1ID   = kWavFileSubChunk1Id; /** "fmt " */
-        wavheader_.SubChunk1Size = 16;                  // for PCM
-        wavheader_.AudioFormat   = WAVE_FORMAT_PCM;
-        wavheader_.NbrChannels   = cfg.channels;
-        wavheader_.SampleRate    = static_cast<int>(cfg.samplerate);
-        wavheader_.ByteRate      = CalcByteRate();
-        wavheader_.BlockAlign    = cfg_.channels * cfg_.bitspersample / 8;
-        wavheader_.BitPerSample  = cfg_.bitspersample;
-        wavheader_.SubChunk2ID   = kWavFileSubChunk2Id; /** "data" */
-        /** Also calcs SubChunk2Size */
-        wavheader_.FileSize = CalcFileSize();
-        // This is calculated as part of the subchunk size
+        dropped_   = 0;
+        recording_ = false;
+        if(!encoder_.Init(
+               cfg.samplerate, cfg.channels, cfg.bitspersample, cfg.use_float))
+            return Result::ERROR;
+        frame_bytes_ = encoder_.GetFrameBytes();
+        encoder_.BuildHeader(num_samps_, header_);
+        return Result::OK;
     }
 
-    /** Records the current sample into the working buffer,
-     ** queues writes to media when necessary. 
-     ** 
+    /** Records a single frame into the working buffer.
+     **
      ** \param in should be a pointer to an array of samples */
-    void Sample(const float *in)
+    void Sample(const float *in) { Record(in, nullptr, 1); }
+
+    /** Records a block of interleaved frames into the working buffer.
+     ** If there is no room for the whole block, it is dropped and counted
+     ** by GetNumDroppedFrames().
+     ** \param in frames * channels interleaved samples
+     ** \param frames number of frames
+     */
+    void SampleBlock(const float *in, size_t frames)
     {
-        for(size_t i = 0; i < cfg_.channels; i++)
-        {
-            switch(cfg_.bitspersample)
-            {
-                case 16:
-                {
-                    int16_t *tp;
-                    tp            = (int16_t *)transfer_buff;
-                    tp[wptr_ + i] = f2s16(in[i]);
-                }
-                break;
-                case 32: transfer_buff[wptr_ + i] = f2s32(in[i]); break;
-                default: break;
-            }
-        }
-        num_samps_++;
-        wptr_ += cfg_.channels;
-        size_t cap_point
-            = cfg_.bitspersample == 16 ? kTransferSamps * 2 : kTransferSamps;
-        if(wptr_ == cap_point)
-        {
-            bstate_ = BufferState::FLUSH0;
-        }
-        if(wptr_ >= cap_point * 2)
-        {
-            wptr_   = 0;
-            bstate_ = BufferState::FLUSH1;
-        }
+        Record(in, nullptr, frames);
     }
 
-    /** Check buffer state and write */
-    void Write()
+    /** Records a block with one buffer per channel, as passed to the
+     ** AudioHandle::AudioCallback.
+     ** \param in one pointer to frames samples per channel
+     ** \param frames number of frames
+     */
+    void SampleBlock(const float *const *in, size_t frames)
     {
-        if(bstate_ != BufferState::IDLE && IsRecording())
+        Record(nullptr, in, frames);
+    }
+
+    /** Writes every full transfer_size piece of the working buffer to the
+     ** file. Call this from the main loop.
+     */
+    Result Write()
+    {
+        while(IsRecording() && buffer_.readable() >= transfer_size)
         {
-            uint32_t     offset;
-            unsigned int bw = 0;
-            //offset          = bstate_ == BufferState::FLUSH0 ? 0 : transfer_size;
-            offset  = bstate_ == BufferState::FLUSH0 ? 0 : kTransferSamps;
-            bstate_ = BufferState::IDLE;
-            f_write(&fp_, &transfer_buff[offset], transfer_size, &bw);
+            // Pieces never wrap, the buffer holds exactly two of them
+            auto span = buffer_.PrepareRead();
+            if(WriteToFile(span.data, transfer_size) != Result::OK)
+                return Result::ERROR;
+            buffer_.CommitRead(transfer_size);
         }
+        return Result::OK;
     }
 
     /** Finalizes the writing of the WAV file.
-     ** This overwrites the WAV Header with the correct
+     ** This writes whatever is left in the working buffer,
+     ** overwrites the WAV Header with the correct
      ** final size, and closes the fptr. */
     void SaveFile()
     {
         unsigned int bw = 0;
         recording_      = false;
-        // We _should_ flush whatever's left in the transfer buff
-        // TODO: that.
-        wavheader_.FileSize = CalcFileSize();
+        while(buffer_.readable() > 0)
+        {
+            auto span = buffer_.PrepareRead();
+            WriteToFile(span.data, span.length);
+            buffer_.CommitRead(span.length);
+        }
+        encoder_.BuildHeader(num_samps_, header_);
         f_lseek(&fp_, 0);
-        f_write(&fp_, &wavheader_, sizeof(wavheader_), &bw);
+        f_write(&fp_, header_, kHeaderSize, &bw);
         f_close(&fp_);
     }
 
@@ -156,12 +151,14 @@ class WavWriter
     {
         if(f_open(&fp_, name, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK)
         {
-            unsigned int bw = 0;
-            if(f_write(&fp_, &wavheader_, sizeof(wavheader_), &bw) == FR_OK)
-            {
-                recording_ = true;
-                num_samps_ = 0;
-            }
+            num_samps_ = 0;
+            dropped_   = 0;
+            encoder_.BuildHeader(num_samps_, header_);
+            // The header goes out with the first piece of audio, so that
+            // the buffer positions match the file offsets.
+            buffer_.Init();
+            buffer_.TryWrite(header_, kHeaderSize);
+            recording_ = true;
         }
     }
 
@@ -177,30 +174,64 @@ class WavWriter
         return (float)num_samps_ / (float)cfg_.samplerate;
     }
 
+    /** Returns the number of frames that were dropped because Write()
+     ** didn't keep up with the recording.
+     */
+    inline uint32_t GetNumDroppedFrames() const { return dropped_; }
+
   private:
-    /** Calculate the file size based on current recording */
-    inline uint32_t CalcFileSize()
+    static constexpr size_t kHeaderSize  = WavEncoder::kHeaderSize;
+    static constexpr size_t kScratchSize = 512;
+
+    /** Converts and queues frames from either interleaved or planar input */
+    void
+    Record(const float *interleaved, const float *const *planar, size_t frames)
     {
-        wavheader_.SubCHunk2Size
-            = num_samps_ * cfg_.channels * cfg_.bitspersample / 8;
-        return 36 + wavheader_.SubCHunk2Size;
+        if(!IsRecording())
+            return;
+        const size_t bytes = frames * frame_bytes_;
+        if(buffer_.writable() < bytes)
+        {
+            dropped_ += frames;
+            return;
+        }
+        auto span = buffer_.PrepareWrite();
+        if(span.length >= bytes)
+        {
+            encoder_.Pack(interleaved, planar, 0, frames, span.data);
+            buffer_.CommitWrite(bytes);
+        }
+        else
+        {
+            // The block wraps around the end of the buffer
+            uint8_t      scratch[kScratchSize];
+            const size_t chunk = kScratchSize / frame_bytes_;
+            for(size_t pos = 0; pos < frames; pos += chunk)
+            {
+                const size_t n = frames - pos < chunk ? frames - pos : chunk;
+                encoder_.Pack(interleaved, planar, pos, n, scratch);
+                buffer_.TryWrite(scratch, n * frame_bytes_);
+            }
+        }
+        num_samps_ += frames;
     }
 
-    /** Compute the byte rate given the user settings. */
-    inline uint32_t CalcByteRate()
+    Result WriteToFile(const uint8_t *data, size_t size)
     {
-        return cfg_.samplerate * cfg_.channels * cfg_.bitspersample / 8;
+        unsigned int bw = 0;
+        if(f_write(&fp_, data, size, &bw) != FR_OK || bw != size)
+            return Result::ERROR;
+        return Result::OK;
     }
 
-    static constexpr int kTransferSamps = transfer_size / sizeof(int32_t);
-
-    WAV_FormatTypeDef wavheader_;
-    uint32_t          num_samps_, wptr_;
-    Config            cfg_;
-    int32_t           transfer_buff[kTransferSamps * 2];
-    BufferState       bstate_;
-    bool              recording_;
-    FIL               fp_;
+    RingBuffer<uint8_t, 2 * transfer_size> buffer_;
+    uint8_t                                header_[kHeaderSize];
+    uint32_t                               num_samps_, dropped_;
+    size_t                                 frame_bytes_;
+    Config                                 cfg_;
+    WavEncoder                             encoder_;
+    volatile bool                          recording_;
+    FIL                                    fp_;
 };
 
 } // namespace daisy
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "WaveTableLoader.h"
 #include "daisy_core.h"
 namespace daisy
@@ -8,6 +9,10 @@ void WaveTableLoader::Init(float *mem, size_t mem_size)
     buf_size_        = mem_size;
     samps_per_table_ = 256;
     num_tables_      = 1;
+    tables_          = mem;
+    mode_            = Mode::IMPORT;
+    file_open_       = false;
+    num_slots_       = 0;
 }
 
 WaveTableLoader::Result WaveTableLoader::SetWaveTableInfo(size_t samps,
@@ -22,54 +27,239 @@ WaveTableLoader::Result WaveTableLoader::SetWaveTableInfo(size_t samps,
 
 WaveTableLoader::Result WaveTableLoader::Import(const char *filename)
 {
-    if(f_open(&fp_, filename, FA_READ | FA_OPEN_EXISTING) == FR_OK)
+    Close();
+    mode_   = Mode::IMPORT;
+    tables_ = buf_;
+    if(f_open(&fp_, filename, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return Result::ERR_FILE_READ;
+    file_open_ = true;
+    Result res = ReadHeader();
+    if(res == Result::OK)
     {
-        // First Grab the Wave header info
-        unsigned int br;
-        f_read(&fp_, &header_, sizeof(header_), &br);
-        uint32_t wptr = 0;
-        do
-        {
-            f_read(&fp_, workspace, kWorkspaceSize * sizeof(workspace[0]), &br);
-            // Fill mem
-            switch(header_.BitPerSample)
-            {
-                case 16:
-                {
-                    int16_t *wsp;
-                    wsp = (int16_t *)workspace;
-                    for(size_t i = 0; i < kWorkspaceSize * 2; i++)
-                    {
-                        buf_[wptr] = s162f(wsp[i]);
-                        wptr++;
-                    }
-                }
-                break;
-                case 32:
-                {
-                    float *wsp;
-                    wsp = (float *)workspace;
-                    for(size_t i = 0; i < kWorkspaceSize; i++)
-                    {
-                        buf_[wptr] = wsp[i];
-                    }
-                }
-                break;
-                default: break;
-            }
-        } while(!f_eof(&fp_) || wptr <= buf_size_ - 1);
-        f_close(&fp_);
+        const size_t count = data_samps_ < buf_size_ ? data_samps_ : buf_size_;
+        res                = ReadSamples(buf_, 0, count);
     }
-    else
-    {
+    Close();
+    return res;
+}
+
+WaveTableLoader::Result
+WaveTableLoader::Open(const char *filename, size_t samps, size_t count)
+{
+    Close();
+    if(samps == 0 || samps > buf_size_)
+        return Result::ERR_TABLE_INFO_OVERFLOW;
+    if(f_open(&fp_, filename, FA_READ | FA_OPEN_EXISTING) != FR_OK)
         return Result::ERR_FILE_READ;
+    file_open_ = true;
+    Result res = ReadHeader();
+    if(res != Result::OK)
+    {
+        Close();
+        return res;
+    }
+    const size_t in_file = data_samps_ / samps;
+    mode_                = Mode::LAZY;
+    tables_              = buf_;
+    samps_per_table_     = samps;
+    num_tables_          = (count == 0 || count > in_file) ? in_file : count;
+    num_slots_           = buf_size_ / samps;
+    num_slots_ = num_slots_ < kMaxCacheSlots ? num_slots_ : kMaxCacheSlots;
+    use_count_ = 0;
+    for(size_t i = 0; i < num_slots_; i++)
+    {
+        slot_table_[i] = -1;
+        slot_used_[i]  = 0;
     }
     return Result::OK;
 }
 
+WaveTableLoader::Result WaveTableLoader::Map(const void *data)
+{
+    Close();
+    BinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+    if(header.magic != kBinaryMagic || header.samps_per_table == 0)
+        return Result::ERR_GENERIC;
+    // The tables are read-only, GetTable() documents that
+    const uint8_t *tables = static_cast<const uint8_t *>(data) + sizeof(header);
+    tables_          = reinterpret_cast<float *>(const_cast<uint8_t *>(tables));
+    mode_            = Mode::MAPPED;
+    samps_per_table_ = header.samps_per_table;
+    num_tables_      = header.num_tables;
+    return Result::OK;
+}
+
+WaveTableLoader::Result WaveTableLoader::ExportBinary(const char *filename)
+{
+    FIL          out;
+    unsigned int bw;
+    BinaryHeader header;
+    header.magic           = kBinaryMagic;
+    header.samps_per_table = samps_per_table_;
+    header.num_tables      = num_tables_;
+    header.reserved        = 0;
+    if(f_open(&out, filename, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+        return Result::ERR_FILE_READ;
+    Result res = f_write(&out, &header, sizeof(header), &bw) == FR_OK
+                         && bw == sizeof(header)
+                     ? Result::OK
+                     : Result::ERR_GENERIC;
+    const size_t bytes = samps_per_table_ * sizeof(float);
+    for(size_t i = 0; i < num_tables_ && res == Result::OK; i++)
+    {
+        const float *table = GetTable(i);
+        if(table == nullptr || f_write(&out, table, bytes, &bw) != FR_OK
+           || bw != bytes)
+            res = Result::ERR_GENERIC;
+    }
+    f_close(&out);
+    return res;
+}
+
+void WaveTableLoader::Close()
+{
+    if(file_open_)
+        f_close(&fp_);
+    file_open_ = false;
+}
+
 /** Returns pointer to specific table start or nullptr if invalid idx */
 float *WaveTableLoader::GetTable(size_t idx)
 {
-    return idx < num_tables_ ? &buf_[idx * samps_per_table_] : nullptr;
+    if(mode_ != Mode::LAZY || idx >= num_tables_)
+        return GetLoadedTable(idx);
+
+    // Only this function updates the recency, see GetLoadedTable()
+    const int found = FindSlot(idx);
+    if(found >= 0)
+    {
+        slot_used_[found] = ++use_count_;
+        return &buf_[found * samps_per_table_];
+    }
+
+    // Load into the least recently used slot
+    size_t slot = 0;
+    for(size_t i = 1; i < num_slots_; i++)
+        if(slot_used_[i] < slot_used_[slot])
+            slot = i;
+    float *table      = &buf_[slot * samps_per_table_];
+    slot_table_[slot] = -1;
+    if(ReadSamples(table, idx * samps_per_table_, samps_per_table_)
+       != Result::OK)
+        return nullptr;
+    slot_table_[slot] = idx;
+    slot_used_[slot]  = ++use_count_;
+    return table;
+}
+
+float *WaveTableLoader::GetLoadedTable(size_t idx)
+{
+    if(idx >= num_tables_)
+        return nullptr;
+    if(mode_ != Mode::LAZY)
+        return &tables_[idx * samps_per_table_];
+    const int slot = FindSlot(idx);
+    return slot < 0 ? nullptr : &buf_[slot * samps_per_table_];
+}
+
+int WaveTableLoader::FindSlot(size_t idx) const
+{
+    for(size_t i = 0; i < num_slots_; i++)
+        if(slot_table_[i] == int32_t(idx))
+            return i;
+    return -1;
+}
+
+WaveTableLoader::Result WaveTableLoader::ReadHeader()
+{
+    unsigned int br;
+    uint32_t     riff[3];
+    if(f_read(&fp_, riff, sizeof(riff), &br) != FR_OK || br != sizeof(riff)
+       || riff[0] != kWavFileChunkId || riff[2] != kWavFileWaveId)
+        return Result::ERR_FILE_READ;
+
+    // Walk the chunks, skipping anything that isn't "fmt " or "data"
+    uint16_t format = 0, bits = 0;
+    FSIZE_t  data_size = 0;
+    while(true)
+    {
+        uint32_t chunk[2];
+        if(f_read(&fp_, chunk, sizeof(chunk), &br) != FR_OK
+           || br != sizeof(chunk))
+            return Result::ERR_FILE_READ;
+        if(chunk[0] == kWavFileSubChunk2Id)
+        {
+            data_start_ = f_tell(&fp_);
+            data_size   = chunk[1];
+            break;
+        }
+        const FSIZE_t next = f_tell(&fp_) + chunk[1] + (chunk[1] & 1);
+        if(chunk[0] == kWavFileSubChunk1Id && chunk[1] >= 16)
+        {
+            uint8_t fmt[26] = {};
+            size_t  len = chunk[1] < sizeof(fmt) ? chunk[1] : sizeof(fmt);
+            if(f_read(&fp_, fmt, len, &br) != FR_OK || br != len)
+                return Result::ERR_FILE_READ;
+            memcpy(&format, &fmt[0], 2);
+            memcpy(&bits, &fmt[14], 2);
+            if(format == WAVE_FORMAT_EXTENSIBLE && len >= 26)
+                memcpy(&format, &fmt[24], 2);
+        }
+        if(f_lseek(&fp_, next) != FR_OK)
+            return Result::ERR_FILE_READ;
+    }
+
+    // Recordings that weren't closed properly have no valid data size
+    const FSIZE_t remaining = f_size(&fp_) - data_start_;
+    if(data_size == 0 || data_size > remaining)
+        data_size = remaining;
+    bytes_per_samp_ = bits / 8;
+    is_float_       = format == WAVE_FORMAT_IEEE_FLOAT;
+    if(!(format == WAVE_FORMAT_PCM && bytes_per_samp_ >= 2
+         && bytes_per_samp_ <= 4)
+       && !(is_float_ && bytes_per_samp_ == 4))
+        return Result::ERR_GENERIC;
+    data_samps_ = data_size / bytes_per_samp_;
+    return Result::OK;
+}
+
+WaveTableLoader::Result
+WaveTableLoader::ReadSamples(float *dst, size_t offset, size_t count)
+{
+    if(offset + count > data_samps_
+       || f_lseek(&fp_, data_start_ + offset * bytes_per_samp_) != FR_OK)
+        return Result::ERR_FILE_READ;
+    const size_t   per_read = sizeof(workspace) / bytes_per_samp_;
+    const uint8_t *src      = reinterpret_cast<const uint8_t *>(workspace);
+    while(count > 0)
+    {
+        const size_t n = count < per_read ? count : per_read;
+        unsigned int br;
+        if(f_read(&fp_, workspace, n * bytes_per_samp_, &br) != FR_OK
+           || br != n * bytes_per_samp_)
+            return Result::ERR_FILE_READ;
+        for(size_t i = 0; i < n; i++)
+            dst[i] = DecodeSample(src + i * bytes_per_samp_);
+        dst += n;
+        count -= n;
+    }
+    return Result::OK;
+}
+
+float WaveTableLoader::DecodeSample(const uint8_t *src) const
+{
+    if(is_float_)
+    {
+        float f;
+        memcpy(&f, src, 4);
+        return f;
+    }
+    // Shift up to the top of the word to sign extend
+    int32_t word = 0;
+    memcpy(reinterpret_cast<uint8_t *>(&word) + 4 - bytes_per_samp_,
+           src,
+           bytes_per_samp_);
+    return s322f(word);
 }
 } // namespace daisy
@@ -3,12 +3,21 @@
 #include "util/wav_format.h"
 namespace daisy
 {
-/** Loads a bank of wavetables into memory. 
- ** Pointers to the start of each waveform will be provided, 
+/** Loads a bank of wavetables into memory.
+ ** Pointers to the start of each waveform will be provided,
  ** but the user can do whatever they want with the data once
- ** it's imported. 
+ ** it's imported.
  **
- ** A internal 4kB workspace is used for reading from the file, and conveting to the correct memory location. 
+ ** There are three ways to get at the tables:
+ ** - Import() converts the whole file into the memory passed to Init().
+ ** - Open() only reads the header. Tables are loaded when GetTable() first
+ **   touches them, and the memory passed to Init() (e.g. in SDRAM) is used
+ **   as a least-recently-used cache of tables. The bank can be larger than
+ **   the memory, and boot time doesn't depend on the size of the bank.
+ ** - Map() uses tables that were already converted to float, e.g. by
+ **   ExportBinary(), in place from memory mapped storage such as QSPI.
+ **
+ ** A internal 4kB workspace is used for reading from the file, and conveting to the correct memory location.
  ** */
 class WaveTableLoader
 {
@@ -20,6 +29,21 @@ class WaveTableLoader
         ERR_FILE_READ,
         ERR_GENERIC,
     };
+
+    /** Header of the binary table files written by ExportBinary().
+     ** It is followed by num_tables * samps_per_table floats.
+     */
+    struct BinaryHeader
+    {
+        uint32_t magic; /**< kBinaryMagic */
+        uint32_t samps_per_table;
+        uint32_t num_tables;
+        uint32_t reserved;
+    };
+
+    /** "DWTB", identifies a binary table file */
+    static constexpr uint32_t kBinaryMagic = 0x42545744;
+
     WaveTableLoader() {}
     ~WaveTableLoader() {}
 
@@ -29,29 +53,92 @@ class WaveTableLoader
     /** Sets the size of the tables to allow access to the specific waveforms */
     Result SetWaveTableInfo(size_t samps, size_t count);
 
-    /** Opens and loads the file 
+    /** Opens and loads the file
      ** The data will be converted from its original type to float
-     ** And the wavheader data will be stored internally to the class, 
+     ** And the wavheader data will be stored internally to the class,
      ** but will not be stored in the user-provided buffer.
      **
-     ** Currently only 16-bit and 32-bit data is supported.
-     ** The importer also assumes data is mono so stereo data will be loaded as-is 
+     ** 16, 24 and 32-bit PCM and 32-bit float data is supported.
+     ** The importer also assumes data is mono so stereo data will be loaded as-is
      ** (i.e. interleaved)
      ** */
     Result Import(const char *filename);
 
-    /** Returns pointer to specific table start or nullptr if invalid idx */
+    /** Opens the file for loading tables on demand.
+     ** The file stays open until Close() is called.
+     ** \param filename wav file with the tables
+     ** \param samps samples per table
+     ** \param count number of tables, 0 to use every table in the file
+     ** \return ERR_TABLE_INFO_OVERFLOW if not even one table fits in memory
+     */
+    Result Open(const char *filename, size_t samps, size_t count = 0);
+
+    /** Uses tables that are already in memory in the binary format,
+     ** without copying them.
+     ** \param data a BinaryHeader followed by the tables, 4 byte aligned
+     */
+    Result Map(const void *data);
+
+    /** Writes all tables to a binary table file that can be used by Map()
+     ** once it has been copied to memory mapped storage.
+     */
+    Result ExportBinary(const char *filename);
+
+    /** Closes the file opened by Open() */
+    void Close();
+
+    /** Returns pointer to specific table start or nullptr if invalid idx.
+     ** After Open(), this loads the table if it isn't in the cache, which
+     ** reads from the file and can evict the least recently used table.
+     ** Pointers to other tables are only valid until the next call, so
+     ** don't call this from the audio callback, use GetLoadedTable() there.
+     ** After Map(), the data is read-only.
+     */
     float *GetTable(size_t idx);
 
+    /** Returns pointer to a table if it can be used without loading it,
+     ** otherwise nullptr. Never reads from the file, and doesn't change
+     ** anything: only GetTable() counts as a use of a table when the least
+     ** recently used one is evicted. Tables that the audio callback needs
+     ** should be touched with GetTable() in the main loop.
+     */
+    float *GetLoadedTable(size_t idx);
+
+    /** Returns the number of tables in the bank */
+    size_t GetNumTables() const { return num_tables_; }
+
   private:
-    static constexpr int kWorkspaceSize = 1024;
-    float *              buf_;
-    size_t               buf_size_;
-    WAV_FormatTypeDef    header_;
-    size_t               samps_per_table_;
-    size_t               num_tables_;
-    int32_t              workspace[kWorkspaceSize];
-    FIL                  fp_;
+    enum class Mode
+    {
+        IMPORT,
+        LAZY,
+        MAPPED,
+    };
+
+    Result ReadHeader();
+    /** Returns the cache slot that holds a table, or -1 */
+    int    FindSlot(size_t idx) const;
+    Result ReadSamples(float *dst, size_t offset, size_t count);
+    float  DecodeSample(const uint8_t *src) const;
+
+    static constexpr int    kWorkspaceSize = 1024;
+    static constexpr size_t kMaxCacheSlots = 64;
+    float *                 buf_;
+    size_t                  buf_size_;
+    float *                 tables_;
+    size_t                  samps_per_table_;
+    size_t                  num_tables_;
+    Mode                    mode_;
+    bool                    file_open_;
+    uint16_t                bytes_per_samp_;
+    bool                    is_float_;
+    size_t                  data_start_, data_samps_;
+    size_t                  num_slots_;
+    int32_t                 slot_table_[kMaxCacheSlots];
+    uint32_t                slot_used_[kMaxCacheSlots];
+    uint32_t                use_count_;
+    int32_t                 workspace[kWorkspaceSize];
+    FIL                     fp_;
 };
 
 } // namespace daisy
@@ -3,6 +3,8 @@
 #define DSY_RINGBUFFER_H
 
 #include <algorithm>
+#include <atomic>
+#include <stddef.h>
 
 namespace daisy
 {
@@ -11,142 +13,278 @@ namespace daisy
 */
 
 /**
-Utility Ring Buffer \n 
+Utility Ring Buffer \n
 imported from pichenettes/stmlib
+
+A wait-free single-producer/single-consumer queue. One context (e.g. an
+interrupt) may write while another (e.g. the main loop) reads, without
+disabling interrupts.
+
+The read and write positions are free running counters, and the size must
+be a power of two so that they can be wrapped with a mask. The whole
+buffer can be filled, so capacity() equals size.
+
+The producer may call the write functions (TryWrite, Write, PrepareWrite,
+CommitWrite, Advance), the consumer the read functions (TryRead, Read,
+ImmediateRead, PrepareRead, CommitRead, Flush). Overwrite and Swallow
+discard unread data, which moves the read position, so they must not be
+used while the consumer is reading from another context.
 */
 template <typename T, size_t size>
 class RingBuffer
 {
+    static_assert(size > 0 && (size & (size - 1)) == 0,
+                  "RingBuffer size must be a power of two");
+
   public:
-    RingBuffer() {}
+    /** A contiguous region of the buffer that can be written to */
+    struct WriteSpan
+    {
+        T*     data;
+        size_t length;
+    };
+
+    /** A contiguous region of the buffer that can be read from */
+    struct ReadSpan
+    {
+        const T* data;
+        size_t   length;
+    };
+
+    RingBuffer() { Init(); }
 
     /** Initializes the Ring Buffer */
-    inline void Init() { read_ptr_ = write_ptr_ = 0; }
+    inline void Init()
+    {
+        read_ptr_.store(0, std::memory_order_relaxed);
+        write_ptr_.store(0, std::memory_order_release);
+    }
 
     /** \return The total size of the ring buffer */
     inline size_t capacity() const { return size; }
 
     /** \return the number of samples that can be written to ring buffer without overwriting unread data. */
-    inline size_t writable() const
-    {
-        return (read_ptr_ - write_ptr_ - 1) % size;
-    }
+    inline size_t writable() const { return size - readable(); }
 
     /** \return number of unread elements in ring buffer */
-    inline size_t readable() const { return (write_ptr_ - read_ptr_) % size; }
+    inline size_t readable() const
+    {
+        return write_ptr_.load(std::memory_order_acquire)
+               - read_ptr_.load(std::memory_order_acquire);
+    }
 
     /** \returns True, if the buffer is empty. */
-    inline bool isEmpty() const { return write_ptr_ == read_ptr_; }
+    inline bool isEmpty() const { return readable() == 0; }
+
+    /** Writes an element if there is space for it. Never blocks.
+    \param v Value to write
+    \return true if the element was written
+    */
+    inline bool TryWrite(const T& v)
+    {
+        const size_t w = write_ptr_.load(std::memory_order_relaxed);
+        if(w - read_ptr_.load(std::memory_order_acquire) == size)
+            return false;
+        buffer_[w & kMask] = v;
+        write_ptr_.store(w + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Writes as many elements as there is space for. Never blocks.
+    \param source Input buffer
+    \param num_elements Number of elements in source
+    \return The number of elements written
+     */
+    inline size_t TryWrite(const T* source, size_t num_elements)
+    {
+        const size_t w = write_ptr_.load(std::memory_order_relaxed);
+        const size_t free
+            = size - (w - read_ptr_.load(std::memory_order_acquire));
+        const size_t n     = std::min(num_elements, free);
+        const size_t first = std::min(n, size - (w & kMask));
+        std::copy(source, source + first, &buffer_[w & kMask]);
+        std::copy(source + first, source + n, &buffer_[0]);
+        write_ptr_.store(w + n, std::memory_order_release);
+        return n;
+    }
 
-    /** Writes the value to the next available position in the ring buffer
+    /** Writes the value to the next available position in the ring buffer.
+    Waits for the consumer if the buffer is full, so it must never be
+    called from a context that can preempt the consumer.
     \param v Value to write
     */
     inline void Write(T v)
     {
-        while(!writable())
-            ;
-        Overwrite(v);
+        while(!TryWrite(v)) {}
     }
 
-    /** Writes the new element to the ring buffer, overwriting unread data if necessary. 
+    /** Writes the new element to the ring buffer, discarding the oldest
+    unread element if necessary.
     \param v Value to overwrite
      */
     inline void Overwrite(T v)
     {
-        size_t w   = write_ptr_;
-        buffer_[w] = v;
-        write_ptr_ = (w + 1) % size;
+        Swallow(1);
+        TryWrite(v);
     }
 
-    /** Reads the first available element from the ring buffer
-    \return read value
+    /** Writes a number of elements, discarding the oldest unread elements
+    if necessary. If num_elements exceeds the capacity, only the last
+    capacity() elements of source are kept.
+    \param source Input buffer
+    \param num_elements Number of elements in source
      */
-    inline T Read()
+    inline void Overwrite(const T* source, size_t num_elements)
+    {
+        if(num_elements > size)
+        {
+            source += num_elements - size;
+            num_elements = size;
+        }
+        Swallow(num_elements);
+        TryWrite(source, num_elements);
+    }
+
+    /** Returns the contiguous free region at the write position, for
+    writing in place. Its size can be smaller than writable() when the
+    free space wraps around the end of the buffer.
+    Call CommitWrite() to publish the written elements.
+     */
+    inline WriteSpan PrepareWrite()
     {
-        while(!readable())
-            ;
-        return ImmediateRead();
+        const size_t w = write_ptr_.load(std::memory_order_relaxed);
+        const size_t free
+            = size - (w - read_ptr_.load(std::memory_order_acquire));
+        return {&buffer_[w & kMask], std::min(free, size - (w & kMask))};
     }
 
-    /** Reads next element from ring buffer immediately
+    /** Publishes elements written to the region returned by PrepareWrite()
+    \param num_elements number of elements written, at most the size of
+                        the region
+     */
+    inline void CommitWrite(size_t num_elements)
+    {
+        write_ptr_.store(write_ptr_.load(std::memory_order_relaxed)
+                             + num_elements,
+                         std::memory_order_release);
+    }
+
+    /** Reads an element if one is available. Never blocks.
+    \param v receives the element
+    \return true if an element was read
+     */
+    inline bool TryRead(T& v)
+    {
+        const size_t r = read_ptr_.load(std::memory_order_relaxed);
+        if(write_ptr_.load(std::memory_order_acquire) == r)
+            return false;
+        v = buffer_[r & kMask];
+        read_ptr_.store(r + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Reads as many elements as are available, up to num_elements.
+    Never blocks.
+    \param destination buffer to write to
+    \param num_elements size of the destination buffer
+    \return The number of elements read
+     */
+    inline size_t TryRead(T* destination, size_t num_elements)
+    {
+        const size_t r     = read_ptr_.load(std::memory_order_relaxed);
+        const size_t avail = write_ptr_.load(std::memory_order_acquire) - r;
+        const size_t n     = std::min(num_elements, avail);
+        const size_t first = std::min(n, size - (r & kMask));
+        const T*     src   = &buffer_[r & kMask];
+        std::copy(src, src + first, destination);
+        std::copy(&buffer_[0], &buffer_[n - first], destination + first);
+        read_ptr_.store(r + n, std::memory_order_release);
+        return n;
+    }
+
+    /** Reads the first available element from the ring buffer.
+    Waits for the producer if the buffer is empty, so it must never be
+    called from a context that can preempt the producer.
     \return read value
      */
-    inline T ImmediateRead()
+    inline T Read()
     {
-        size_t r      = read_ptr_;
-        T      result = buffer_[r];
-        read_ptr_     = (r + 1) % size;
+        T result;
+        while(!TryRead(result)) {}
         return result;
     }
 
-    /** Flushes unread elements from the ring buffer */
-    inline void Flush() { write_ptr_ = read_ptr_; }
-
-    /** Read enough samples to make it possible to read 1 sample. 
-    \param n Size of T ?
+    /** Reads next element from ring buffer immediately
+    \return read value, or a default constructed T if the buffer is empty
      */
-    inline void Swallow(size_t n)
+    inline T ImmediateRead()
     {
-        if(writable() >= n)
-        {
-            return;
-        }
-        read_ptr_ = (write_ptr_ + 1 + n) % size;
+        T result = T();
+        TryRead(result);
+        return result;
     }
 
     /** Reads a number of elements into a buffer immediately
     \param destination buffer to write to
-    \param num_elements number of elements in buffer    
+    \param num_elements number of elements in buffer
+    \return The number of elements read, which is less than num_elements
+            if fewer were available
      */
-    inline void ImmediateRead(T* destination, size_t num_elements)
+    inline size_t ImmediateRead(T* destination, size_t num_elements)
     {
-        size_t r    = read_ptr_;
-        size_t read = num_elements;
+        return TryRead(destination, num_elements);
+    }
 
-        if(r + read > size)
-        {
-            read = size - r;
-        }
-        std::copy(&buffer_[r], &buffer_[r + read], destination);
-        if(read != num_elements)
-        {
-            std::copy(
-                &buffer_[0], &buffer_[num_elements - read], destination + read);
-        }
-        read_ptr_ = (r + num_elements) % size;
+    /** Returns the contiguous unread region at the read position, for
+    reading in place. Its size can be smaller than readable() when the
+    data wraps around the end of the buffer.
+    Call CommitRead() to release the elements that have been consumed.
+     */
+    inline ReadSpan PrepareRead() const
+    {
+        const size_t r     = read_ptr_.load(std::memory_order_relaxed);
+        const size_t avail = write_ptr_.load(std::memory_order_acquire) - r;
+        return {&buffer_[r & kMask], std::min(avail, size - (r & kMask))};
     }
 
-    /** Overwrites a number of elements using the source buffer as input. 
-    \param source Input buffer
-    \param num_elements Number of elements in source
+    /** Releases elements read from the region returned by PrepareRead()
+    \param num_elements number of elements consumed, at most the size of
+                        the region
      */
-    inline void Overwrite(const T* source, size_t num_elements)
+    inline void CommitRead(size_t num_elements)
     {
-        size_t w       = write_ptr_;
-        size_t written = num_elements;
+        read_ptr_.store(read_ptr_.load(std::memory_order_relaxed)
+                            + num_elements,
+                        std::memory_order_release);
+    }
 
-        if(w + written > size)
-        {
-            written = size - w;
-        }
-        std::copy(source, source + written, &buffer_[w]);
-        if(written != num_elements)
-        {
-            std::copy(source + written, source + num_elements, &buffer_[0]);
-        }
+    /** Flushes unread elements from the ring buffer. Called by the consumer. */
+    inline void Flush()
+    {
+        read_ptr_.store(write_ptr_.load(std::memory_order_acquire),
+                        std::memory_order_release);
+    }
 
-        write_ptr_ = (w + num_elements) % size;
+    /** Discards the oldest unread elements, so that at least n elements
+    can be written.
+    \param n Number of elements to make room for
+     */
+    inline void Swallow(size_t n)
+    {
+        n                   = std::min(n, size);
+        const size_t unread = readable();
+        if(size - unread >= n)
+            return;
+        read_ptr_.store(read_ptr_.load(std::memory_order_relaxed)
+                            + (n - (size - unread)),
+                        std::memory_order_release);
     }
 
-    /**Advances the write pointer, for when a peripheral is writing to the buffer. */
+    /**Advances the write pointer, for when a peripheral is writing to the
+     * buffer. Clamped to the free space. */
     inline void Advance(size_t num_elements)
     {
-        size_t free;
-        free         = this->writable();
-        num_elements = num_elements < free ? num_elements : free;
-        write_ptr_   = write_ptr_ + num_elements;
-        if(write_ptr_ > size)
-            write_ptr_ = write_ptr_ - size;
+        CommitWrite(std::min(num_elements, writable()));
     }
 
     /**Returns a pointer to the actual Ring Buffer
@@ -154,9 +292,11 @@ class RingBuffer
     inline T* GetMutableBuffer() { return buffer_; }
 
   private:
-    T               buffer_[size];
-    volatile size_t read_ptr_;
-    volatile size_t write_ptr_;
+    static constexpr size_t kMask = size - 1;
+
+    T                   buffer_[size];
+    std::atomic<size_t> read_ptr_;
+    std::atomic<size_t> write_ptr_;
 };
 
 /** Utility Ring Buffer
@@ -172,18 +312,30 @@ class RingBuffer<T, 0>
     inline size_t capacity() const { return 0; } /**< \return 0 */
     inline size_t writable() const { return 0; } /**< \return 0 */
     inline size_t readable() const { return 0; } /**< \return 0 */
+    inline bool   isEmpty() const { return true; } /**< \return true */
     inline void   Write(T v) { (void)(v); } /**<  \param v Value to write */
-    inline void   Overwrite(T v)
+    inline bool   TryWrite(const T& v)
+    {
+        (void)(v);
+        return false;
+    } /**< \param v Value to write \return false */
+    inline void Overwrite(T v)
     {
         (void)(v);
     }                                   /**< \param v Value to overwrite */
     inline T    Read() { return T(0); } /**< \return Read value */
     inline T    ImmediateRead() { return T(0); } /**< \return Read value */
+    inline bool TryRead(T& v)
+    {
+        (void)(v);
+        return false;
+    } /**< \param v & \return false */
     inline void Flush() {}                       /**< Flush the buffer */
-    inline void ImmediateRead(T* destination, size_t num_elements)
+    inline size_t ImmediateRead(T* destination, size_t num_elements)
     {
         (void)(destination);
         (void)(num_elements);
+        return 0;
     } /**< \param destination & \param num_elements & */
     inline void Overwrite(const T* source, size_t num_elements)
     {
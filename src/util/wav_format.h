@@ -16,6 +16,10 @@ const uint32_t kWavFileChunkId     = 0x46464952; /**< "RIFF" */
 const uint32_t kWavFileWaveId      = 0x45564157; /**< "WAVE" */
 const uint32_t kWavFileSubChunk1Id = 0x20746d66; /**< "fmt " */
 const uint32_t kWavFileSubChunk2Id = 0x61746164; /**< "data" */
+const uint32_t kWavFileRF64Id      = 0x34364652; /**< "RF64" */
+const uint32_t kWavFileDs64Id      = 0x34367364; /**< "ds64" */
+const uint32_t kWavFileJunkId      = 0x4b4e554a; /**< "JUNK" */
+const uint32_t kWavFileFactId      = 0x74636166; /**< "fact" */
 
 /** Standard Format codes for the waveform data.
  ** 
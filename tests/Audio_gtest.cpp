@@ -0,0 +1,366 @@
+#include "hid/audio_host.h"
+#include "util/CpuLoadMeter.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+SaiHandle MakeSai(SaiHandle::Config::Peripheral periph,
+                  SaiHandle::Config::BitDepth  bd
+                  = SaiHandle::Config::BitDepth::SAI_24BIT)
+{
+    SaiHandle::Config cfg;
+    cfg.periph    = periph;
+    cfg.sr        = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.bit_depth = bd;
+    cfg.a_sync    = SaiHandle::Config::Sync::MASTER;
+    cfg.b_sync    = SaiHandle::Config::Sync::SLAVE;
+    cfg.a_dir     = SaiHandle::Config::Direction::TRANSMIT;
+    cfg.b_dir     = SaiHandle::Config::Direction::RECEIVE;
+    SaiHandle sai;
+    sai.Init(cfg);
+    return sai;
+}
+
+AudioHandle::Config MakeConfig(size_t blocksize)
+{
+    AudioHandle::Config cfg;
+    cfg.blocksize = blocksize;
+    return cfg;
+}
+
+// scale every channel by (channel index + 1) / 8
+void ScaleByChannel(AudioHandle::InputBuffer  in,
+                    AudioHandle::OutputBuffer out,
+                    size_t                    size)
+{
+    for(size_t c = 0; c < 4; c++)
+        for(size_t i = 0; i < size; i++)
+            out[c][i] = in[c][i] * (c + 1) / 8.f;
+}
+
+void ScaleTenChannels(AudioHandle::InputBuffer  in,
+                      AudioHandle::OutputBuffer out,
+                      size_t                    size)
+{
+    for(size_t c = 0; c < 10; c++)
+        for(size_t i = 0; i < size; i++)
+            out[c][i] = in[c][i] * (c + 1) / 8.f;
+}
+
+void PassThroughStereo(AudioHandle::InputBuffer  in,
+                       AudioHandle::OutputBuffer out,
+                       size_t                    size)
+{
+    for(size_t i = 0; i < size; i++)
+    {
+        out[0][i] = in[0][i];
+        out[1][i] = in[1][i];
+    }
+}
+
+// swaps left and right
+void SwapInterleaved(AudioHandle::InterleavingInputBuffer  in,
+                     AudioHandle::InterleavingOutputBuffer out,
+                     size_t                                size)
+{
+    for(size_t i = 0; i < size; i += 2)
+    {
+        out[i]     = in[i + 1];
+        out[i + 1] = in[i];
+    }
+}
+
+// takes 1.5 blocks worth of ticks when the tick runs at 1 MHz and the
+// block rate is 1 kHz
+void OverrunningCallback(AudioHandle::InputBuffer  in,
+                         AudioHandle::OutputBuffer out,
+                         size_t                    size)
+{
+    PassThroughStereo(in, out, size);
+    System::SetTickForUnitTest(System::GetTick() + 1500);
+}
+
+std::vector<float> MakeRamp(size_t length, float step)
+{
+    std::vector<float> ramp(length);
+    for(size_t i = 0; i < length; i++)
+        ramp[i] = -0.5f + step * (i % 64);
+    return ramp;
+}
+} // namespace
+
+TEST(hid_Audio, a_passThroughStereo)
+{
+    SaiHandle   sai = MakeSai(SaiHandle::Config::Peripheral::SAI_1);
+    AudioHandle audio;
+    ASSERT_EQ(audio.Init(MakeConfig(16), sai), AudioHandle::Result::OK);
+    audio.Start(PassThroughStereo);
+    EXPECT_EQ(audio.GetChannels(), 2u);
+
+    AudioHostRenderer renderer;
+    ASSERT_EQ(renderer.Init(sai), AudioHostRenderer::Result::OK);
+    EXPECT_EQ(renderer.GetChannels(), 2u);
+
+    // 10 frames more than a multiple of the blocksize
+    const size_t       frames = 16 * 8 + 10;
+    std::vector<float> in     = MakeRamp(frames * 2, 1.f / 64.f);
+    std::vector<float> out(frames * 2);
+    ASSERT_EQ(renderer.Render(in.data(), out.data(), frames),
+              AudioHostRenderer::Result::OK);
+    EXPECT_EQ(renderer.GetBlocksRendered(), 9u);
+    for(size_t i = 0; i < in.size(); i++)
+        EXPECT_NEAR(out[i], in[i], 1e-6f);
+}
+
+TEST(hid_Audio, b_postGainIsTransparent)
+{
+    SaiHandle           sai = MakeSai(SaiHandle::Config::Peripheral::SAI_1,
+                                SaiHandle::Config::BitDepth::SAI_16BIT);
+    AudioHandle         audio;
+    AudioHandle::Config cfg = MakeConfig(8);
+    cfg.postgain            = 2.f;
+    ASSERT_EQ(audio.Init(cfg, sai), AudioHandle::Result::OK);
+    audio.Start(PassThroughStereo);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai);
+    std::vector<float> in = MakeRamp(64 * 2, 1.f / 128.f);
+    std::vector<float> out(in.size());
+    renderer.Render(in.data(), out.data(), 64);
+    for(size_t i = 0; i < in.size(); i++)
+        EXPECT_NEAR(out[i], in[i], 1.f / 16384.f);
+}
+
+TEST(hid_Audio, c_fourChannelsOnTwoSais)
+{
+    SaiHandle   sai1 = MakeSai(SaiHandle::Config::Peripheral::SAI_1);
+    SaiHandle   sai2 = MakeSai(SaiHandle::Config::Peripheral::SAI_2);
+    AudioHandle audio;
+    ASSERT_EQ(audio.Init(MakeConfig(4), sai1, sai2), AudioHandle::Result::OK);
+    audio.Start(ScaleByChannel);
+    EXPECT_EQ(audio.GetChannels(), 4u);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai1, sai2);
+    ASSERT_EQ(renderer.GetChannels(), 4u);
+
+    const size_t       frames = 32;
+    std::vector<float> in(frames * 4, 0.5f);
+    std::vector<float> out(frames * 4);
+    renderer.Render(in.data(), out.data(), frames);
+    for(size_t f = 0; f < frames; f++)
+        for(size_t c = 0; c < 4; c++)
+            EXPECT_NEAR(out[f * 4 + c], 0.5f * (c + 1) / 8.f, 1e-6f);
+}
+
+TEST(hid_Audio, d_interleavedCallback)
+{
+    SaiHandle   sai = MakeSai(SaiHandle::Config::Peripheral::SAI_1,
+                            SaiHandle::Config::BitDepth::SAI_32BIT);
+    AudioHandle audio;
+    audio.Init(MakeConfig(32), sai);
+    audio.Start(SwapInterleaved);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai);
+    std::vector<float> in = MakeRamp(64 * 2, 1.f / 64.f);
+    std::vector<float> out(in.size());
+    renderer.Render(in.data(), out.data(), 64);
+    for(size_t i = 0; i < in.size(); i += 2)
+    {
+        EXPECT_NEAR(out[i], in[i + 1], 1e-6f);
+        EXPECT_NEAR(out[i + 1], in[i], 1e-6f);
+    }
+}
+
+TEST(hid_Audio, e_renderWavFile)
+{
+    SaiHandle   sai = MakeSai(SaiHandle::Config::Peripheral::SAI_1);
+    AudioHandle audio;
+    audio.Init(MakeConfig(48), sai);
+    audio.Start(PassThroughStereo);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai);
+
+    // write a mono 16 bit file
+    const std::string    in_path  = testing::TempDir() + "audio_in.wav";
+    const std::string    out_path = testing::TempDir() + "audio_out.wav";
+    std::vector<int16_t> samples(100);
+    for(size_t i = 0; i < samples.size(); i++)
+        samples[i] = int16_t(i * 300) - 15000;
+    WAV_FormatTypeDef hdr;
+    hdr.ChunkId       = kWavFileChunkId;
+    hdr.FileFormat    = kWavFileWaveId;
+    hdr.SubChunk1ID   = kWavFileSubChunk1Id;
+    hdr.SubChunk1Size = 16;
+    hdr.AudioFormat   = WAVE_FORMAT_PCM;
+    hdr.NbrChannels   = 1;
+    hdr.SampleRate    = 48000;
+    hdr.BitPerSample  = 16;
+    hdr.BlockAlign    = 2;
+    hdr.ByteRate      = 48000 * 2;
+    hdr.SubChunk2ID   = kWavFileSubChunk2Id;
+    hdr.SubCHunk2Size = samples.size() * 2;
+    hdr.FileSize      = sizeof(hdr) - 8 + hdr.SubCHunk2Size;
+    FILE* f           = fopen(in_path.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(&hdr, sizeof(hdr), 1, f);
+    fwrite(samples.data(), 2, samples.size(), f);
+    fclose(f);
+
+    ASSERT_EQ(renderer.RenderWavFile(in_path.c_str(), out_path.c_str()),
+              AudioHostRenderer::Result::OK);
+
+    // read back the stereo 24 bit result
+    f = fopen(out_path.c_str(), "rb");
+    ASSERT_NE(f, nullptr);
+    WAV_FormatTypeDef out_hdr;
+    ASSERT_EQ(fread(&out_hdr, sizeof(out_hdr), 1, f), 1u);
+    EXPECT_EQ(out_hdr.NbrChannels, 2);
+    EXPECT_EQ(out_hdr.BitPerSample, 24);
+    EXPECT_EQ(out_hdr.SubCHunk2Size, samples.size() * 2 * 3);
+    for(size_t i = 0; i < samples.size() * 2; i++)
+    {
+        int32_t word = 0;
+        ASSERT_EQ(fread(reinterpret_cast<uint8_t*>(&word) + 1, 3, 1, f), 1u);
+        EXPECT_EQ(word >> 8, int32_t(samples[i / 2]) << 8);
+    }
+    fclose(f);
+    std::remove(in_path.c_str());
+    std::remove(out_path.c_str());
+}
+
+namespace
+{
+// inverts the raw 24 bit words of both SAIs
+void InvertNative24(AudioHandle::NativeInputBuffer  in,
+                    AudioHandle::NativeOutputBuffer out,
+                    size_t                          size)
+{
+    for(size_t s = 0; s < 2; s++)
+        for(size_t i = 0; i < size * 2; i++)
+            out[s][i] = (-in[s][i]) & 0x00ffffff;
+}
+} // namespace
+
+TEST(hid_Audio, f_nativeCallbackUsesDmaBuffers)
+{
+    SaiHandle   sai1 = MakeSai(SaiHandle::Config::Peripheral::SAI_1);
+    SaiHandle   sai2 = MakeSai(SaiHandle::Config::Peripheral::SAI_2);
+    AudioHandle audio;
+    audio.Init(MakeConfig(8), sai1, sai2);
+    ASSERT_EQ(audio.Start(InvertNative24), AudioHandle::Result::OK);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai1, sai2);
+    const size_t         frames = 24;
+    std::vector<int32_t> in(frames * 4), out(frames * 4);
+    for(size_t i = 0; i < in.size(); i++)
+        in[i] = (int32_t(i) * 4001 - 100000) & 0x00ffffff;
+    ASSERT_EQ(renderer.RenderNative(in.data(), out.data(), frames),
+              AudioHostRenderer::Result::OK);
+    for(size_t i = 0; i < in.size(); i++)
+        EXPECT_EQ(out[i], (-in[i]) & 0x00ffffff);
+
+    // switching back to a float callback works as before
+    ASSERT_EQ(audio.ChangeCallback(ScaleByChannel), AudioHandle::Result::OK);
+    std::vector<float> fin(frames * 4, 0.25f), fout(frames * 4);
+    renderer.Render(fin.data(), fout.data(), frames);
+    for(size_t i = 0; i < fout.size(); i++)
+        EXPECT_NEAR(fout[i], 0.25f * (i % 4 + 1) / 8.f, 1e-6f);
+}
+
+TEST(hid_Audio, g_tdmSlotsAndMixedSais)
+{
+    // 8 slot TDM on SAI1, stereo I2S on SAI2
+    SaiHandle::Config cfg;
+    cfg.periph    = SaiHandle::Config::Peripheral::SAI_1;
+    cfg.sr        = SaiHandle::Config::SampleRate::SAI_48KHZ;
+    cfg.bit_depth = SaiHandle::Config::BitDepth::SAI_32BIT;
+    cfg.num_slots = 8;
+    SaiHandle sai1;
+    ASSERT_EQ(sai1.Init(cfg), SaiHandle::Result::OK);
+    SaiHandle sai2 = MakeSai(SaiHandle::Config::Peripheral::SAI_2,
+                             SaiHandle::Config::BitDepth::SAI_32BIT);
+
+    AudioHandle audio;
+    audio.Init(MakeConfig(64), sai1, sai2);
+    EXPECT_EQ(audio.GetChannels(), 10u);
+    // 8 slots leave room for 1024 / 2 / 8 = 64 frames per block
+    EXPECT_EQ(audio.SetBlockSize(65), AudioHandle::Result::ERR);
+    EXPECT_EQ(audio.SetBlockSize(16), AudioHandle::Result::OK);
+    ASSERT_EQ(audio.Start(ScaleTenChannels), AudioHandle::Result::OK);
+
+    AudioHostRenderer renderer;
+    renderer.Init(sai1, sai2);
+    ASSERT_EQ(renderer.GetChannels(), 10u);
+
+    // every channel carries its own index
+    const size_t       frames = 40;
+    std::vector<float> in(frames * 10), out(frames * 10);
+    for(size_t i = 0; i < in.size(); i++)
+        in[i] = (i % 10) / 16.f;
+    renderer.Render(in.data(), out.data(), frames);
+    for(size_t i = 0; i < out.size(); i++)
+        EXPECT_NEAR(out[i], in[i] * (i % 10 + 1) / 8.f, 1e-6f);
+}
+
+TEST(hid_Audio, h_invalidSlotCounts)
+{
+    SaiHandle::Config cfg;
+    cfg.periph = SaiHandle::Config::Peripheral::SAI_1;
+    SaiHandle sai;
+    cfg.num_slots = 3;
+    EXPECT_EQ(sai.Init(cfg), SaiHandle::Result::ERR);
+    cfg.num_slots = 18;
+    EXPECT_EQ(sai.Init(cfg), SaiHandle::Result::ERR);
+    cfg.num_slots = 16;
+    EXPECT_EQ(sai.Init(cfg), SaiHandle::Result::OK);
+}
+
+TEST(hid_Audio, i_callbackLoadIsMeasured)
+{
+    System::SetTickFreqForUnitTest(1000000u);
+    System::SetTickForUnitTest(0);
+    SaiHandle sai = MakeSai(SaiHandle::Config::Peripheral::SAI_1);
+
+    AudioHandle audio;
+    audio.Init(MakeConfig(48), sai); // 1 kHz block rate at 48 kHz
+    ASSERT_EQ(audio.Start(PassThroughStereo), AudioHandle::Result::OK);
+    AudioHostRenderer renderer;
+    renderer.Init(sai);
+
+    // the tick doesn't move, so every block is well within its deadline
+    std::vector<float> in(48 * 4 * 2, 0.5f), out(48 * 4 * 2);
+    renderer.Render(in.data(), out.data(), 48 * 4);
+    CpuLoadMeter& meter = audio.GetCpuLoadMeter();
+    EXPECT_EQ(meter.GetNumOverruns(), 0u);
+    EXPECT_EQ(meter.GetHistogramBin(0), 4u);
+
+    // a slow callback misses the deadline on every block
+    ASSERT_EQ(audio.ChangeCallback(OverrunningCallback),
+              AudioHandle::Result::OK);
+    renderer.Render(in.data(), out.data(), 48 * 3);
+    EXPECT_EQ(meter.GetNumOverruns(), 3u);
+    EXPECT_EQ(meter.GetHistogramBin(CpuLoadMeter::kNumHistogramBins - 1), 3u);
+    EXPECT_GT(meter.GetMaxCpuLoad(), 1.f);
+
+    // transfers that finished during the callback are overruns, too
+    ASSERT_EQ(audio.ChangeCallback(PassThroughStereo),
+              AudioHandle::Result::OK);
+    sai.SetNumPendingTransfersForUnitTest(2);
+    renderer.Render(in.data(), out.data(), 48);
+    sai.SetNumPendingTransfersForUnitTest(0);
+    EXPECT_EQ(meter.GetNumOverruns(), 5u);
+
+    // restarting resets the meter
+    audio.Stop();
+    ASSERT_EQ(audio.Start(PassThroughStereo), AudioHandle::Result::OK);
+    EXPECT_EQ(audio.GetCpuLoadMeter().GetNumOverruns(), 0u);
+}
@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "hid/disp/color_canvas.h"
+#include "hid/disp/color_compositor.h"
+
+using namespace daisy;
+
+namespace
+{
+constexpr uint16_t kRed   = Rgb565(255, 0, 0);
+constexpr uint16_t kGreen = Rgb565(0, 255, 0);
+constexpr uint16_t kBlue  = Rgb565(0, 0, 255);
+constexpr uint16_t kWhite = Rgb565(255, 255, 255);
+
+/** Blends the channels one by one, with floats */
+uint16_t ReferenceBlend(uint16_t dst, uint16_t src, uint8_t alpha)
+{
+    uint16_t result = 0;
+    for(int shift : {11, 5, 0})
+    {
+        const int   mask = shift == 5 ? 0x3f : 0x1f;
+        const float d    = (dst >> shift) & mask;
+        const float s    = (src >> shift) & mask;
+        const int   c    = int(d + (s - d) * alpha / 255.f + 0.5f);
+        result |= c << shift;
+    }
+    return result;
+}
+
+/** Returns the difference of the channel that is furthest off */
+int MaxChannelDifference(uint16_t a, uint16_t b)
+{
+    int result = 0;
+    for(int shift : {11, 5, 0})
+    {
+        const int mask = shift == 5 ? 0x3f : 0x1f;
+        const int diff = abs(((a >> shift) & mask) - ((b >> shift) & mask));
+        result         = diff > result ? diff : result;
+    }
+    return result;
+}
+
+class RectLayer : public ColorLayer
+{
+  public:
+    RectLayer(const Rectangle& rect, uint16_t color, uint8_t alpha)
+    : rect_(rect), color_(color), alpha_(alpha)
+    {
+    }
+
+    void Draw(Rgb565Canvas& canvas) override
+    {
+        canvas.FillRect(rect_, color_, alpha_);
+    }
+
+  private:
+    Rectangle rect_;
+    uint16_t  color_;
+    uint8_t   alpha_;
+};
+
+class SpriteLayer : public ColorLayer
+{
+  public:
+    SpriteLayer(int16_t x, int16_t y, const Rgb565Sprite& sprite)
+    : x_(x), y_(y), sprite_(sprite)
+    {
+    }
+
+    void Draw(Rgb565Canvas& canvas) override
+    {
+        canvas.DrawSprite(x_, y_, sprite_);
+    }
+
+  private:
+    int16_t      x_, y_;
+    Rgb565Sprite sprite_;
+};
+
+/** Collects the pixels that a compositor sends into a frame */
+class MockStreamDriver
+{
+  public:
+    size_t Width() const { return 40; }
+    size_t Height() const { return 30; }
+
+    void SetWindow(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1)
+    {
+        EXPECT_FALSE(busy_);
+        window_x0_ = x0;
+        window_x1_ = x1;
+        window_y1_ = y1;
+        x_         = x0;
+        y_         = y0;
+    }
+
+    bool WritePixelsDma(const uint16_t* pixels, size_t num_pixels)
+    {
+        EXPECT_FALSE(busy_);
+        for(size_t i = 0; i < num_pixels; i++)
+        {
+            EXPECT_LE(y_, window_y1_);
+            if(y_ > window_y1_)
+                break;
+            // sent high byte first
+            const uint16_t pixel = (pixels[i] << 8) | (pixels[i] >> 8);
+            frame[y_ * 40 + x_]  = pixel;
+            if(++x_ > window_x1_)
+            {
+                x_ = window_x0_;
+                y_++;
+            }
+        }
+        num_transfers++;
+        // finishes when it's polled
+        busy_ = true;
+        return true;
+    }
+
+    bool IsBusy()
+    {
+        const bool busy = busy_;
+        busy_           = false;
+        return busy;
+    }
+
+    uint16_t frame[40 * 30] = {};
+    int      num_transfers  = 0;
+
+  private:
+    bool   busy_ = false;
+    size_t window_x0_, window_x1_, window_y1_, x_, y_;
+};
+} // namespace
+
+TEST(hid_ColorCanvas, a_blend)
+{
+    EXPECT_EQ(Rgb565(255, 255, 255), 0xffff);
+    EXPECT_EQ(kRed, 0xf800);
+    EXPECT_EQ(kGreen, 0x07e0);
+    EXPECT_EQ(kBlue, 0x001f);
+
+    const uint16_t colors[] = {0x0000, 0xffff, kRed, kGreen, kBlue, 0x1234};
+    for(uint16_t dst : colors)
+    {
+        for(uint16_t src : colors)
+        {
+            EXPECT_EQ(BlendRgb565(dst, src, 0), dst);
+            EXPECT_EQ(BlendRgb565(dst, src, 255), src);
+            // the alpha has 5 bits, which is off by up to 2 steps of green
+            for(int alpha = 0; alpha < 256; alpha += 15)
+                EXPECT_LE(MaxChannelDifference(BlendRgb565(dst, src, alpha),
+                                               ReferenceBlend(dst, src, alpha)),
+                          2);
+        }
+    }
+}
+
+TEST(hid_ColorCanvas, b_fillRect)
+{
+    uint16_t     pixels[8 * 4];
+    Rgb565Canvas canvas(pixels, Rectangle(8, 4));
+    canvas.Fill(kBlue);
+    canvas.FillRect(Rectangle(2, 1, 3, 2), kRed);
+    canvas.FillRect(Rectangle(4, 2, 10, 10), kWhite, 128);
+
+    EXPECT_EQ(pixels[0], kBlue);
+    EXPECT_EQ(pixels[1 * 8 + 2], kRed);
+    EXPECT_EQ(pixels[1 * 8 + 4], kRed);
+    EXPECT_EQ(pixels[1 * 8 + 5], kBlue);
+    EXPECT_EQ(pixels[2 * 8 + 4], BlendRgb565(kRed, kWhite, 128));
+    EXPECT_EQ(pixels[3 * 8 + 7], BlendRgb565(kBlue, kWhite, 128));
+    EXPECT_EQ(pixels[3 * 8 + 3], kBlue);
+
+    // outside of the canvas
+    canvas.SetPixel(-1, 0, kRed);
+    canvas.SetPixel(8, 0, kRed);
+    canvas.FillRect(Rectangle(-5, -5, 5, 20), kRed);
+    for(int x = 0; x < 8; x++)
+        EXPECT_NE(pixels[x], kRed);
+}
+
+TEST(hid_ColorCanvas, c_sprites)
+{
+    constexpr uint16_t k = 0x1234; // transparent
+    const uint16_t     sprite_pixels[] = {k, kRed, kRed, k, kGreen, kGreen};
+    const uint8_t      sprite_alpha[]  = {255, 255, 0, 128, 255, 64};
+    Rgb565Sprite sprite = {3, 2, sprite_pixels, nullptr, k, true};
+
+    uint16_t     pixels[4 * 3];
+    Rgb565Canvas canvas(pixels, Rectangle(4, 3));
+    canvas.Fill(kBlue);
+    canvas.DrawSprite(1, 1, sprite);
+    const uint16_t expected[] = {kBlue,
+                                 kBlue,
+                                 kBlue,
+                                 kBlue,
+                                 kBlue,
+                                 kBlue,
+                                 kRed,
+                                 kRed,
+                                 kBlue,
+                                 kBlue,
+                                 kGreen,
+                                 kGreen};
+    for(int i = 0; i < 12; i++)
+        EXPECT_EQ(pixels[i], expected[i]) << i;
+
+    // alpha mask, clipped on the left
+    sprite.alpha   = sprite_alpha;
+    sprite.has_key = false;
+    canvas.Fill(kBlue);
+    canvas.DrawSprite(-1, 0, sprite);
+    EXPECT_EQ(pixels[0], kRed);
+    EXPECT_EQ(pixels[1], kBlue);
+    EXPECT_EQ(pixels[4], kGreen);
+    EXPECT_EQ(pixels[5], BlendRgb565(kBlue, kGreen, 64));
+
+    // the alpha of the sprite is multiplied
+    canvas.Fill(kBlue);
+    canvas.DrawSprite(0, 0, sprite, 128);
+    EXPECT_EQ(pixels[0], BlendRgb565(kBlue, k, 128));
+    EXPECT_EQ(pixels[4], BlendRgb565(kBlue, k, 64));
+    EXPECT_EQ(pixels[5], BlendRgb565(kBlue, kGreen, 128));
+    EXPECT_EQ(pixels[6], BlendRgb565(kBlue, kGreen, 32));
+}
+
+TEST(hid_ColorCanvas, d_bandOrigin)
+{
+    // a band of rows 10 to 13 draws in display coordinates
+    uint16_t     pixels[6 * 4];
+    Rgb565Canvas canvas(pixels, Rectangle(2, 10, 6, 4));
+    canvas.Fill(0);
+    canvas.SetPixel(2, 10, kRed);
+    canvas.SetPixel(1, 10, kGreen);
+    canvas.SetPixel(2, 9, kGreen);
+    canvas.FillRect(Rectangle(0, 13, 4, 10), kWhite);
+    EXPECT_EQ(pixels[0], kRed);
+    EXPECT_EQ(pixels[1], 0);
+    EXPECT_EQ(pixels[3 * 6 + 0], kWhite);
+    EXPECT_EQ(pixels[3 * 6 + 1], kWhite);
+    EXPECT_EQ(pixels[3 * 6 + 2], 0);
+}
+
+TEST(hid_ColorCompositor, a_matchesFullFrame)
+{
+    const uint16_t sprite_pixels[] = {kRed, kGreen, kBlue, kWhite};
+    const Rgb565Sprite sprite      = {2, 2, sprite_pixels, nullptr, 0, false};
+    RectLayer          meter(Rectangle(5, 3, 10, 20), kGreen, 255);
+    RectLayer          overlay(Rectangle(0, 6, 40, 5), kWhite, 100);
+    SpriteLayer        icon(38, 28, sprite);
+    ColorLayer*        layers[] = {&meter, &overlay, &icon};
+
+    // the same layers, drawn into a frame
+    std::vector<uint16_t> expected(40 * 30);
+    Rgb565Canvas          frame(expected.data(), Rectangle(40, 30));
+    frame.Fill(kBlue);
+    for(ColorLayer* layer : layers)
+        layer->Draw(frame);
+
+    ColorCompositor<40, 4, 3> compositor;
+    compositor.Init(kBlue);
+    for(ColorLayer* layer : layers)
+        EXPECT_TRUE(compositor.AddLayer(layer));
+    EXPECT_FALSE(compositor.AddLayer(&icon));
+
+    MockStreamDriver driver;
+    compositor.Render(driver);
+    EXPECT_EQ(driver.num_transfers, 8); // 30 rows in bands of 4
+    EXPECT_EQ(std::vector<uint16_t>(driver.frame, driver.frame + 40 * 30),
+              expected);
+
+    // a region is sent through a window
+    MockStreamDriver partial;
+    compositor.Render(partial, Rectangle(4, 5, 12, 3));
+    EXPECT_EQ(partial.num_transfers, 1);
+    for(int y = 0; y < 30; y++)
+    {
+        for(int x = 0; x < 40; x++)
+        {
+            const bool inside = x >= 4 && x < 16 && y >= 5 && y < 8;
+            EXPECT_EQ(partial.frame[y * 40 + x],
+                      inside ? expected[y * 40 + x] : 0);
+        }
+    }
+}
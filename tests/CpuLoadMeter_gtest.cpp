@@ -152,4 +152,53 @@ TEST(util_CpuLoadMeter, e_tolerateTickOverflow)
     // check results - meter should have tolerated the overflow
     EXPECT_FLOAT_EQ(meter.GetMinCpuLoad(), 0.5f);
     EXPECT_FLOAT_EQ(meter.GetMaxCpuLoad(), 0.5f);
-}
\ No newline at end of file
+}
+
+TEST(util_CpuLoadMeter, f_overrunsAndHistogram)
+{
+    System::SetTickFreqForUnitTest(1000000u); // 1us tick duration
+    CpuLoadMeter meter;
+    meter.Init(48000.0f, 48); // 1kHz block rate, 1000 ticks per block
+
+    const auto processBlock = [&](uint32_t durationInTicks) {
+        System::SetTickForUnitTest(0);
+        meter.OnBlockStart();
+        System::SetTickForUnitTest(durationInTicks);
+        meter.OnBlockEnd();
+    };
+
+    processBlock(50);   // 5%
+    processBlock(250);  // 25%
+    processBlock(270);  // 27%
+    processBlock(1000); // exactly 100% still makes it in time
+    processBlock(1500); // 150% missed the deadline
+    EXPECT_EQ(meter.GetNumOverruns(), 1u);
+    EXPECT_EQ(meter.GetHistogramBin(0), 1u);
+    EXPECT_EQ(meter.GetHistogramBin(2), 2u);
+    EXPECT_EQ(meter.GetHistogramBin(9), 1u);
+    EXPECT_EQ(meter.GetHistogramBin(10), 1u);
+    EXPECT_EQ(meter.GetHistogramBin(11), 0u); // out of range
+
+    // each block the hardware finished in the meantime is an overrun, even
+    // if the callback itself was fast enough (e.g. it started late)
+    System::SetTickForUnitTest(0);
+    meter.OnBlockStart();
+    System::SetTickForUnitTest(500);
+    meter.OnBlockEnd(2);
+    EXPECT_EQ(meter.GetNumOverruns(), 3u);
+    EXPECT_EQ(meter.GetHistogramBin(5), 0u);
+    EXPECT_EQ(meter.GetHistogramBin(10), 3u);
+
+    // a slow block is already included in that number
+    System::SetTickForUnitTest(0);
+    meter.OnBlockStart();
+    System::SetTickForUnitTest(1500);
+    meter.OnBlockEnd(1);
+    EXPECT_EQ(meter.GetNumOverruns(), 4u);
+    EXPECT_EQ(meter.GetHistogramBin(10), 4u);
+
+    meter.Reset();
+    EXPECT_EQ(meter.GetNumOverruns(), 0u);
+    for(size_t i = 0; i < CpuLoadMeter::kNumHistogramBins; i++)
+        EXPECT_EQ(meter.GetHistogramBin(i), 0u);
+}
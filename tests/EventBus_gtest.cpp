@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "util/EventBus.h"
+
+using namespace daisy;
+
+namespace
+{
+struct TestEvent
+{
+    uint16_t producer;
+    uint32_t sequence;
+};
+} // namespace
+
+TEST(util_MpscQueue, a_postAndRead)
+{
+    MpscQueue<int, 4> queue;
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_EQ(queue.GetCapacity(), 4u);
+
+    // the whole queue can be filled
+    for(int i = 0; i < 4; i++)
+        EXPECT_TRUE(queue.Post(i));
+    EXPECT_FALSE(queue.Post(100));
+    EXPECT_EQ(queue.GetNumElements(), 4u);
+    EXPECT_EQ(queue.GetNumDropped(), 1u);
+
+    int v;
+    for(int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(queue.TryRead(v));
+        EXPECT_EQ(v, i);
+    }
+    EXPECT_FALSE(queue.TryRead(v));
+    EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST(util_MpscQueue, b_drainWrapsAround)
+{
+    MpscQueue<int, 8> queue;
+    std::vector<int>  out;
+    const auto        sink = [&](const int& v) { out.push_back(v); };
+
+    for(int round = 0; round < 5; round++)
+    {
+        for(int i = 0; i < 5; i++)
+            queue.Post(round * 10 + i);
+        // drain in two batches
+        EXPECT_EQ(queue.Drain(sink, 3), 3u);
+        EXPECT_EQ(queue.Drain(sink), 2u);
+    }
+    ASSERT_EQ(out.size(), 25u);
+    for(int i = 0; i < 25; i++)
+        EXPECT_EQ(out[i], (i / 5) * 10 + i % 5);
+    EXPECT_EQ(queue.Drain(sink), 0u);
+    EXPECT_EQ(queue.GetNumDropped(), 0u);
+}
+
+TEST(util_EventBus, a_priorities)
+{
+    EventBus<int, 4, 3> bus;
+    EXPECT_TRUE(bus.Post(1, 0));
+    EXPECT_TRUE(bus.Post(2, 1));
+    EXPECT_TRUE(bus.Post(3, 2));
+    EXPECT_TRUE(bus.Post(4, 1));
+    EXPECT_TRUE(bus.Post(5, 7)); // clamped to the highest priority
+    EXPECT_EQ(bus.GetNumEvents(), 5u);
+
+    std::vector<int> out;
+    EXPECT_EQ(bus.Drain([&](const int& v) { out.push_back(v); }), 5u);
+    const std::vector<int> expected = {3, 5, 2, 4, 1};
+    EXPECT_EQ(out, expected);
+    EXPECT_TRUE(bus.IsEmpty());
+}
+
+TEST(util_EventBus, b_fullPriorityDoesntBlockOthers)
+{
+    EventBus<int, 2, 2> bus;
+    EXPECT_TRUE(bus.Post(1));
+    EXPECT_TRUE(bus.Post(2));
+    EXPECT_FALSE(bus.Post(3));
+    EXPECT_TRUE(bus.Post(10, 1));
+    EXPECT_EQ(bus.GetNumDropped(), 1u);
+    EXPECT_EQ(bus.GetQueue(0).GetNumDropped(), 1u);
+
+    int v;
+    EXPECT_TRUE(bus.TryRead(v));
+    EXPECT_EQ(v, 10);
+    EXPECT_TRUE(bus.TryRead(v));
+    EXPECT_EQ(v, 1);
+
+    // the batch size is limited
+    size_t num = 0;
+    EXPECT_EQ(bus.Drain([&](const int&) { num++; }, 0), 0u);
+    EXPECT_EQ(bus.GetNumEvents(), 1u);
+
+    bus.Init();
+    EXPECT_TRUE(bus.IsEmpty());
+    EXPECT_EQ(bus.GetNumDropped(), 0u);
+}
+
+TEST(util_EventBusThreads, a_concurrentProducers)
+{
+    // several producers, like interrupt handlers, post while the consumer
+    // drains. Every event must arrive once, in order per producer.
+    constexpr uint16_t                numProducers = 4;
+    constexpr uint32_t                numEvents    = 200000;
+    static EventBus<TestEvent, 64, 2> bus;
+    bus.Init();
+
+    std::vector<std::thread> producers;
+    for(uint16_t p = 0; p < numProducers; p++)
+    {
+        producers.emplace_back([p]() {
+            for(uint32_t i = 0; i < numEvents; i++)
+            {
+                // yield instead of spinning, so that this also runs on a
+                // single core
+                while(!bus.Post({p, i}, p % 2))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    uint32_t next[numProducers] = {};
+    uint32_t errors             = 0;
+    uint32_t received           = 0;
+    while(received < numProducers * numEvents)
+    {
+        const size_t num = bus.Drain(
+            [&](const TestEvent& e) {
+                errors += e.producer >= numProducers
+                          || e.sequence != next[e.producer];
+                next[e.producer] = e.sequence + 1;
+            },
+            32);
+        received += num;
+        if(num == 0)
+            std::this_thread::yield();
+    }
+    for(auto& producer : producers)
+        producer.join();
+
+    EXPECT_EQ(errors, 0u);
+    for(uint16_t p = 0; p < numProducers; p++)
+        EXPECT_EQ(next[p], numEvents);
+    EXPECT_TRUE(bus.IsEmpty());
+}
+
+TEST(util_EventBusThreads, b_droppedEventsAreCounted)
+{
+    // producers that never wait: every event is either read or dropped
+    constexpr uint16_t              numProducers = 4;
+    constexpr uint32_t              numEvents    = 100000;
+    static MpscQueue<TestEvent, 16> queue;
+    queue.Init();
+
+    std::atomic<uint32_t>    posted{0};
+    std::atomic<int>         running{numProducers};
+    std::vector<std::thread> producers;
+    for(uint16_t p = 0; p < numProducers; p++)
+    {
+        producers.emplace_back([&, p]() {
+            for(uint32_t i = 0; i < numEvents; i++)
+                posted += queue.Post({p, i});
+            running--;
+        });
+    }
+
+    uint32_t  last[numProducers] = {};
+    bool      seen[numProducers] = {};
+    uint32_t  errors             = 0;
+    uint32_t  received           = 0;
+    TestEvent e;
+    while(running > 0 || !queue.IsEmpty())
+    {
+        if(!queue.TryRead(e))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        // events of a producer are in order, with gaps where they were
+        // dropped
+        errors += seen[e.producer] && e.sequence <= last[e.producer];
+        seen[e.producer] = true;
+        last[e.producer] = e.sequence;
+        received++;
+    }
+    for(auto& producer : producers)
+        producer.join();
+
+    EXPECT_EQ(errors, 0u);
+    EXPECT_EQ(received, posted.load());
+    EXPECT_EQ(received + queue.GetNumDropped(), numProducers * numEvents);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <string.h>
+#include "hid/disp/display.h"
+
+using namespace daisy;
+
+namespace
+{
+/** A display that draws pixel by pixel into an array */
+class PixelDisplay : public OneBitGraphicsDisplayImpl<PixelDisplay>
+{
+  public:
+    PixelDisplay() { Fill(false); }
+
+    uint16_t Height() const override { return 32; }
+    uint16_t Width() const override { return 64; }
+
+    void Fill(bool on) override { memset(pixels_, on, sizeof(pixels_)); }
+    void DrawPixel(uint_fast8_t x, uint_fast8_t y, bool on) override
+    {
+        if(x < 64 && y < 32)
+            pixels_[y][x] = on;
+    }
+    void Update() override {}
+
+    bool operator==(const PixelDisplay& other) const
+    {
+        return memcmp(pixels_, other.pixels_, sizeof(pixels_)) == 0;
+    }
+
+    /** Returns the first column with a pixel that is on */
+    int GetFirstColumn() const
+    {
+        for(int x = 0; x < 64; x++)
+            for(int y = 0; y < 32; y++)
+                if(pixels_[y][x])
+                    return x;
+        return -1;
+    }
+
+  private:
+    bool pixels_[32][64];
+};
+} // namespace
+
+TEST(hid_GlyphCache, a_proportionalWidths)
+{
+    GlyphCache<95 * 7> font;
+    EXPECT_EQ(font.GetHeight(), 0);
+    ASSERT_TRUE(font.Init(Font_7x10));
+    EXPECT_EQ(font.GetHeight(), 10);
+    EXPECT_LT(font.GetGlyphWidth('i'), font.GetGlyphWidth('W'));
+    EXPECT_LT(font.GetGlyphWidth('W'), 7);
+    EXPECT_EQ(font.GetGlyphWidth(' '), 4);
+    EXPECT_EQ(font.GetGlyphWidth('\n'), 0);
+    EXPECT_EQ(font.GetAdvance('i'), font.GetGlyphWidth('i') + 1);
+    EXPECT_EQ(font.GetTextWidth("iW"),
+              font.GetGlyphWidth('i') + 1 + font.GetGlyphWidth('W'));
+
+    // fixed width
+    GlyphCacheBase::Config config;
+    config.proportional = false;
+    config.spacing      = 0;
+    ASSERT_TRUE(font.Init(Font_7x10, config));
+    EXPECT_EQ(font.GetGlyphWidth('i'), 7);
+    EXPECT_EQ(font.GetTextWidth("iW"), 14);
+
+    // doesn't fit
+    GlyphCache<100> small;
+    EXPECT_FALSE(small.Init(Font_7x10, config));
+    EXPECT_EQ(small.GetHeight(), 0);
+}
+
+TEST(hid_GlyphCache, b_kerning)
+{
+    const GlyphCacheBase::KerningPair pairs[]
+        = {{'A', 'V', -1}, {'T', 'o', -9}};
+    GlyphCacheBase::Config config;
+    config.kerning           = pairs;
+    config.num_kerning_pairs = 2;
+    GlyphCache<95 * 7> font;
+    ASSERT_TRUE(font.Init(Font_7x10, config));
+
+    EXPECT_EQ(font.GetAdvance('A', 'V'), font.GetGlyphWidth('A'));
+    EXPECT_EQ(font.GetAdvance('A', 'B'), font.GetGlyphWidth('A') + 1);
+    // glyphs don't overlap
+    EXPECT_EQ(font.GetAdvance('T', 'o'), font.GetGlyphWidth('T'));
+}
+
+TEST(hid_GlyphCache, c_fixedWidthMatchesFontDef)
+{
+    GlyphCacheBase::Config config;
+    config.proportional = false;
+    config.spacing      = 0;
+    GlyphCache<95 * 7> font;
+    ASSERT_TRUE(font.Init(Font_7x10, config));
+
+    PixelDisplay expected, display;
+    expected.SetCursor(3, 5);
+    expected.WriteString("Hi, 42%", Font_7x10, true);
+    display.SetCursor(3, 5);
+    EXPECT_EQ(display.WriteString("Hi, 42%", font, true), '\0');
+    EXPECT_TRUE(display == expected);
+    EXPECT_EQ(display.CurrentX(), expected.CurrentX());
+
+    // through the interface, inverted
+    expected.SetCursor(0, 20);
+    expected.WriteString("ok", Font_7x10, false);
+    OneBitGraphicsDisplay& base = display;
+    base.SetCursor(0, 20);
+    base.WriteString("ok", font, false);
+    EXPECT_TRUE(display == expected);
+}
+
+TEST(hid_GlyphCache, d_proportionalText)
+{
+    GlyphCache<95 * 7> font;
+    ASSERT_TRUE(font.Init(Font_7x10));
+
+    // the empty columns left of the glyph are removed
+    PixelDisplay display;
+    display.SetCursor(10, 0);
+    display.WriteString("l", font, true);
+    EXPECT_EQ(display.GetFirstColumn(), 10);
+    EXPECT_EQ(display.CurrentX(), 10u + font.GetAdvance('l'));
+
+    // text that doesn't fit stops at the first character that doesn't
+    display.SetCursor(60, 0);
+    EXPECT_EQ(display.WriteString("iW", font, true), 'W');
+
+    // aligned text
+    PixelDisplay aligned;
+    const auto   rect = aligned.WriteStringAligned(
+        "abc", font, aligned.GetBounds(), Alignment::centered, true);
+    EXPECT_EQ(rect.GetWidth(), font.GetTextWidth("abc"));
+    EXPECT_EQ(rect.GetHeight(), 10);
+    EXPECT_NEAR(rect.GetX(), (64 - rect.GetWidth()) / 2, 1);
+    EXPECT_EQ(aligned.GetFirstColumn(), rect.GetX());
+}
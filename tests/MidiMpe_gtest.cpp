@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+#include "hid/midi_mpe.h"
+
+using namespace daisy;
+
+namespace
+{
+using Allocator = MpeVoiceAllocator<4>;
+using Zone      = Allocator::Zone;
+
+MidiEvent Midi1(MidiMessageType type, uint8_t chn, uint8_t d0, uint8_t d1)
+{
+    MidiEvent event = {};
+    event.type      = type;
+    event.channel   = chn;
+    event.data[0]   = d0;
+    event.data[1]   = d1;
+    return event;
+}
+
+/** Sends an RPN with its data entry MSB */
+void SendRpn(Allocator& mpe, uint8_t chn, uint8_t rpn, uint8_t value)
+{
+    mpe.Process(Midi1(ControlChange, chn, 101, 0));
+    mpe.Process(Midi1(ControlChange, chn, 100, rpn));
+    mpe.Process(Midi1(ControlChange, chn, 6, value));
+}
+} // namespace
+
+TEST(hid_MidiMpe, defaultLowerZone)
+{
+    Allocator mpe;
+    EXPECT_EQ(mpe.GetZone(0), Zone::LOWER);
+    EXPECT_EQ(mpe.GetZone(15), Zone::LOWER);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::LOWER), 15);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::UPPER), 0);
+}
+
+TEST(hid_MidiMpe, perNoteExpression)
+{
+    Allocator mpe;
+    mpe.Process(Midi1(NoteOn, 1, 60, 100));
+    mpe.Process(Midi1(NoteOn, 2, 64, 100));
+
+    // member channel bend only moves its own note, 48 semitones range
+    mpe.Process(Midi1(PitchBend, 1, 0, 0x50)); // +0.25
+    mpe.Process(Midi1(ChannelPressure, 2, 127, 0));
+    mpe.Process(Midi1(ControlChange, 2, 74, 0));
+
+    EXPECT_TRUE(mpe.GetVoice(0).active);
+    EXPECT_EQ(mpe.GetVoice(0).channel, 1);
+    EXPECT_NEAR(mpe.GetPitch(0), 72.f, 0.01f);
+    EXPECT_NEAR(mpe.GetPitch(1), 64.f, 0.01f);
+    EXPECT_FLOAT_EQ(mpe.GetPressure(0), 0.f);
+    EXPECT_FLOAT_EQ(mpe.GetPressure(1), 1.f);
+    EXPECT_NEAR(mpe.GetTimbre(0), 0.5f, 0.01f);
+    EXPECT_FLOAT_EQ(mpe.GetTimbre(1), 0.f);
+
+    // master channel bend moves the whole zone, 2 semitones range
+    mpe.Process(Midi1(PitchBend, 0, 0x7f, 0x7f));
+    EXPECT_NEAR(mpe.GetPitch(0), 74.f, 0.01f);
+    EXPECT_NEAR(mpe.GetPitch(1), 66.f, 0.01f);
+}
+
+TEST(hid_MidiMpe, expressionBeforeNoteOn)
+{
+    // MPE controllers send the initial pressure and timbre first
+    Allocator mpe;
+    mpe.Process(Midi1(ChannelPressure, 3, 64, 0));
+    mpe.Process(Midi1(ControlChange, 3, 74, 127));
+    mpe.Process(Midi1(NoteOn, 3, 60, 100));
+    EXPECT_NEAR(mpe.GetPressure(0), 0.5f, 0.01f);
+    EXPECT_FLOAT_EQ(mpe.GetTimbre(0), 1.f);
+}
+
+TEST(hid_MidiMpe, noteOffAndStealing)
+{
+    Allocator mpe;
+    for(uint8_t i = 0; i < 4; i++)
+        mpe.Process(Midi1(NoteOn, 1 + i, 60 + i, 100));
+
+    // the fifth note takes the oldest voice
+    mpe.Process(Midi1(NoteOn, 5, 70, 100));
+    EXPECT_EQ(mpe.GetVoice(0).note, 70);
+    EXPECT_EQ(mpe.GetVoice(0).channel, 5);
+
+    // the stolen note can't be released anymore
+    mpe.Process(Midi1(NoteOff, 1, 60, 0));
+    EXPECT_TRUE(mpe.GetVoice(0).active);
+
+    mpe.Process(Midi1(NoteOff, 3, 62, 64));
+    EXPECT_FALSE(mpe.GetVoice(2).active);
+    EXPECT_EQ(mpe.GetVoice(2).release_velocity,
+              UmpEvent::Upscale(64, 7, 32));
+
+    // a free voice is used before stealing
+    mpe.Process(Midi1(NoteOn, 6, 72, 100));
+    EXPECT_EQ(mpe.GetVoice(2).note, 72);
+    EXPECT_TRUE(mpe.GetVoice(1).active);
+}
+
+TEST(hid_MidiMpe, allNotesOffOnMaster)
+{
+    Allocator mpe;
+    mpe.Process(Midi1(NoteOn, 1, 60, 100));
+    mpe.Process(Midi1(NoteOn, 2, 61, 100));
+    mpe.Process(Midi1(ControlChange, 2, 123, 0));
+    EXPECT_TRUE(mpe.GetVoice(0).active);
+    EXPECT_FALSE(mpe.GetVoice(1).active);
+
+    mpe.Process(Midi1(ControlChange, 0, 123, 0));
+    EXPECT_FALSE(mpe.GetVoice(0).active);
+}
+
+TEST(hid_MidiMpe, configurationMessage)
+{
+    Allocator mpe;
+    // lower zone with 7 member channels, then upper zone with 7
+    SendRpn(mpe, 0, 6, 7);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::LOWER), 7);
+    EXPECT_EQ(mpe.GetZone(8), Zone::NONE);
+    SendRpn(mpe, 15, 6, 7);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::UPPER), 7);
+    EXPECT_EQ(mpe.GetZone(7), Zone::LOWER);
+    EXPECT_EQ(mpe.GetZone(8), Zone::UPPER);
+
+    // a larger upper zone takes channels from the lower zone
+    SendRpn(mpe, 15, 6, 10);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::UPPER), 10);
+    EXPECT_EQ(mpe.GetNumMemberChannels(Zone::LOWER), 4);
+
+    // upper zone master bend only applies to the upper zone
+    mpe.Process(Midi1(NoteOn, 2, 60, 100));
+    mpe.Process(Midi1(NoteOn, 14, 60, 100));
+    mpe.Process(Midi1(PitchBend, 15, 0, 0));
+    EXPECT_NEAR(mpe.GetPitch(0), 60.f, 0.01f);
+    EXPECT_NEAR(mpe.GetPitch(1), 58.f, 0.01f);
+
+    // 0 member channels turn a zone off
+    SendRpn(mpe, 15, 6, 0);
+    EXPECT_EQ(mpe.GetZone(15), Zone::NONE);
+}
+
+TEST(hid_MidiMpe, pitchBendSensitivity)
+{
+    Allocator mpe;
+    SendRpn(mpe, 1, 0, 24);
+    mpe.Process(Midi1(NoteOn, 1, 60, 100));
+    mpe.Process(Midi1(PitchBend, 1, 0, 0x50));
+    EXPECT_NEAR(mpe.GetPitch(0), 66.f, 0.01f);
+}
+
+TEST(hid_MidiMpe, midi2PerNotePitchBend)
+{
+    Allocator mpe;
+    mpe.Process(Midi1(NoteOn, 1, 60, 100));
+    mpe.Process(Midi1(NoteOn, 1, 67, 100));
+
+    UmpEvent bend = {};
+    bend.type     = PitchBend;
+    bend.channel  = 1;
+    bend.note     = 67;
+    bend.per_note = true;
+    bend.value    = 0xa0000000; // +0.25
+    mpe.Process(bend);
+    EXPECT_NEAR(mpe.GetPitch(0), 60.f, 0.01f);
+    EXPECT_NEAR(mpe.GetPitch(1), 79.f, 0.01f);
+
+    // high resolution velocity
+    UmpEvent note = {};
+    note.type     = NoteOn;
+    note.channel  = 2;
+    note.note     = 50;
+    note.value    = 0x12345678;
+    mpe.Process(note);
+    EXPECT_EQ(mpe.GetVoice(2).velocity, 0x12345678u);
+}
@@ -0,0 +1,369 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "hid/midi.h"
+
+using namespace daisy;
+
+namespace
+{
+MidiEvent Channel(MidiMessageType type, uint8_t chn, uint8_t d0, uint8_t d1)
+{
+    MidiEvent event = {};
+    event.type      = type;
+    event.channel   = chn;
+    event.data[0]   = d0;
+    event.data[1]   = d1;
+    return event;
+}
+
+MidiEvent RealTime(SystemRealTimeType srt_type)
+{
+    MidiEvent event = {};
+    event.type      = SystemRealTime;
+    event.srt_type  = srt_type;
+    return event;
+}
+
+std::vector<uint8_t> Render(MidiOutputScheduler<>& sched,
+                            uint32_t               now,
+                            size_t                 max_size = 64)
+{
+    uint8_t      buff[256];
+    const size_t size = sched.Render(now, buff, max_size);
+    return std::vector<uint8_t>(buff, buff + size);
+}
+
+using Bytes = std::vector<uint8_t>;
+} // namespace
+
+TEST(hid_MidiOutput, sortsByTime)
+{
+    MidiOutputScheduler<> sched;
+    EXPECT_TRUE(sched.Schedule(Channel(NoteOn, 0, 62, 100), 20));
+    EXPECT_TRUE(sched.Schedule(Channel(NoteOn, 1, 60, 100), 10));
+    EXPECT_TRUE(sched.Schedule(Channel(NoteOff, 1, 60, 0), 20));
+
+    EXPECT_EQ(Render(sched, 30),
+              Bytes({0x91, 60, 100, 0x90, 62, 100, 0x81, 60, 0}));
+    EXPECT_EQ(sched.GetNumPending(), 0u);
+}
+
+TEST(hid_MidiOutput, holdsBackFutureMessages)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 100);
+    sched.Schedule(Channel(NoteOff, 0, 60, 0), 200);
+
+    EXPECT_EQ(Render(sched, 99), Bytes());
+    EXPECT_EQ(sched.GetNumPending(), 2u);
+    EXPECT_EQ(Render(sched, 100), Bytes({0x90, 60, 100}));
+    EXPECT_EQ(Render(sched, 150), Bytes());
+    EXPECT_EQ(Render(sched, 250), Bytes({0x80, 60, 0}));
+}
+
+TEST(hid_MidiOutput, timeWrapsAround)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(NoteOn, 0, 61, 100), 5);
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0xfffffff0);
+
+    EXPECT_EQ(Render(sched, 0xfffffff8), Bytes({0x90, 60, 100}));
+    EXPECT_EQ(Render(sched, 10), Bytes({61, 100}));
+}
+
+TEST(hid_MidiOutput, runningStatus)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(NoteOn, 2, 60, 100), 0);
+    sched.Schedule(Channel(NoteOn, 2, 64, 100), 0);
+    sched.Schedule(RealTime(TimingClock), 0);
+    sched.Schedule(Channel(NoteOn, 2, 67, 100), 0);
+    sched.Schedule(Channel(ProgramChange, 2, 5, 0), 0);
+    EXPECT_EQ(Render(sched, 0),
+              Bytes({0x92, 60, 100, 64, 100, 0xf8, 67, 100, 0xc2, 5}));
+
+    // still active in the next render
+    sched.Schedule(Channel(ProgramChange, 2, 6, 0), 1);
+    EXPECT_EQ(Render(sched, 1), Bytes({6}));
+
+    MidiOutputScheduler<>::Config config;
+    config.running_status = false;
+    sched.Init(config);
+    sched.Schedule(Channel(NoteOn, 2, 60, 100), 0);
+    sched.Schedule(Channel(NoteOn, 2, 64, 100), 0);
+    EXPECT_EQ(Render(sched, 0), Bytes({0x92, 60, 100, 0x92, 64, 100}));
+}
+
+TEST(hid_MidiOutput, systemCommonCancelsRunningStatus)
+{
+    MidiOutputScheduler<> sched;
+    MidiEvent             song = {};
+    song.type                  = SystemCommon;
+    song.sc_type               = SongSelect;
+    song.data[0]               = 3;
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0);
+    sched.Schedule(song, 0);
+    sched.Schedule(Channel(NoteOn, 0, 62, 100), 0);
+    EXPECT_EQ(Render(sched, 0),
+              Bytes({0x90, 60, 100, 0xf3, 3, 0x90, 62, 100}));
+}
+
+TEST(hid_MidiOutput, channelMode)
+{
+    MidiOutputScheduler<> sched;
+    MidiEvent             event = Channel(ChannelMode, 4, 0, 0);
+    event.cm_type               = AllNotesOff;
+    sched.Schedule(Channel(ControlChange, 4, 7, 100), 0);
+    sched.Schedule(event, 0);
+    EXPECT_EQ(Render(sched, 0), Bytes({0xb4, 7, 100, 123, 0}));
+}
+
+TEST(hid_MidiOutput, coalescesControllers)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(ControlChange, 0, 1, 10), 0);
+    sched.Schedule(Channel(ControlChange, 1, 1, 10), 0); // other channel
+    sched.Schedule(Channel(ControlChange, 0, 1, 11), 1);
+    sched.Schedule(RealTime(TimingClock), 1);
+    sched.Schedule(Channel(ControlChange, 0, 1, 12), 1);
+    sched.Schedule(Channel(PitchBend, 0, 0, 10), 2);
+    sched.Schedule(Channel(PitchBend, 0, 0, 11), 2);
+    sched.Schedule(Channel(ControlChange, 0, 2, 10), 2);
+    sched.Schedule(Channel(ControlChange, 0, 2, 13), 100); // not due yet
+
+    EXPECT_EQ(
+        Render(sched, 10),
+        Bytes({0xb1, 1, 10, 0xf8, 0xb0, 1, 12, 0xe0, 0, 11, 0xb0, 2, 10}));
+    EXPECT_EQ(sched.GetNumCoalesced(), 3u);
+    EXPECT_EQ(sched.GetNumPending(), 1u);
+}
+
+TEST(hid_MidiOutput, keepsInterleavedUpdates)
+{
+    // an update of another controller or a note in between keeps both
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(ControlChange, 0, 1, 10), 0);
+    sched.Schedule(Channel(ControlChange, 0, 7, 100), 0);
+    sched.Schedule(Channel(ControlChange, 0, 1, 11), 0);
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0);
+    sched.Schedule(Channel(ControlChange, 0, 1, 12), 0);
+    EXPECT_EQ(Render(sched, 0),
+              Bytes({0xb0, 1, 10, 7, 100, 1, 11, 0x90, 60, 100, 0xb0, 1, 12}));
+    EXPECT_EQ(sched.GetNumCoalesced(), 0u);
+}
+
+TEST(hid_MidiOutput, keepsParameterSequences)
+{
+    MidiOutputScheduler<> sched;
+    // pitch bend range with RPN 0, then fine tuning with RPN 1. The data
+    // entry of each is sent twice.
+    const Bytes rpn = {101, 0, 100, 0, 6, 12, 6, 12, 38, 0,
+                       101, 0, 100, 1, 6, 64, 6, 64, 38, 0};
+    for(size_t i = 0; i < rpn.size(); i += 2)
+        sched.Schedule(Channel(ControlChange, 3, rpn[i], rpn[i + 1]), 0);
+    Bytes expected = {0xb3};
+    expected.insert(expected.end(), rpn.begin(), rpn.end());
+    EXPECT_EQ(Render(sched, 0), expected);
+
+    // NRPN numbers, written twice in a row
+    sched.Schedule(Channel(ControlChange, 3, 99, 1), 1);
+    sched.Schedule(Channel(ControlChange, 3, 99, 2), 1);
+    sched.Schedule(Channel(ControlChange, 3, 98, 5), 1);
+    sched.Schedule(Channel(ControlChange, 3, 98, 6), 1);
+    EXPECT_EQ(Render(sched, 1), Bytes({99, 1, 99, 2, 98, 5, 98, 6}));
+    EXPECT_EQ(sched.GetNumCoalesced(), 0u);
+}
+
+TEST(hid_MidiOutput, keepsBankSelectAndSwitches)
+{
+    MidiOutputScheduler<> sched;
+    // bank select before each program change
+    sched.Schedule(Channel(ControlChange, 0, 0, 1), 0);
+    sched.Schedule(Channel(ControlChange, 0, 32, 0), 0);
+    sched.Schedule(Channel(ProgramChange, 0, 5, 0), 0);
+    sched.Schedule(Channel(ControlChange, 0, 0, 2), 0);
+    sched.Schedule(Channel(ControlChange, 0, 0, 3), 0);
+    sched.Schedule(Channel(ControlChange, 0, 32, 0), 0);
+    sched.Schedule(Channel(ProgramChange, 0, 6, 0), 0);
+    EXPECT_EQ(Render(sched, 0),
+              Bytes({0xb0, 0, 1, 32, 0, 0xc0, 5, 0xb0, 0, 2, 0, 3, 32, 0,
+                     0xc0, 6}));
+
+    // sustain released and pressed again around a note
+    sched.Schedule(Channel(ControlChange, 0, 64, 127), 1);
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 1);
+    sched.Schedule(Channel(ControlChange, 0, 64, 0), 1);
+    sched.Schedule(Channel(ControlChange, 0, 64, 127), 1);
+    EXPECT_EQ(Render(sched, 1),
+              Bytes({0xb0, 64, 127, 0x90, 60, 100, 0xb0, 64, 0, 64, 127}));
+    EXPECT_EQ(sched.GetNumCoalesced(), 0u);
+}
+
+TEST(hid_MidiOutput, keepsNotes)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0);
+    sched.Schedule(Channel(NoteOff, 0, 60, 0), 0);
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0);
+    EXPECT_EQ(Render(sched, 0),
+              Bytes({0x90, 60, 100, 0x80, 60, 0, 0x90, 60, 100}));
+    EXPECT_EQ(sched.GetNumCoalesced(), 0u);
+
+    MidiOutputScheduler<>::Config config;
+    config.coalesce = false;
+    sched.Init(config);
+    sched.Schedule(Channel(ControlChange, 0, 1, 10), 0);
+    sched.Schedule(Channel(ControlChange, 0, 1, 11), 0);
+    EXPECT_EQ(Render(sched, 0), Bytes({0xb0, 1, 10, 1, 11}));
+}
+
+TEST(hid_MidiOutput, carriesOverWhatDoesNotFit)
+{
+    MidiOutputScheduler<> sched;
+    sched.Schedule(Channel(NoteOn, 0, 60, 100), 0);
+    sched.Schedule(Channel(NoteOn, 1, 61, 100), 0);
+    sched.Schedule(Channel(NoteOn, 1, 62, 100), 0);
+
+    EXPECT_EQ(Render(sched, 0, 5), Bytes({0x90, 60, 100}));
+    EXPECT_EQ(sched.GetNumPending(), 2u);
+    // The status that didn't fit is sent with the next message
+    EXPECT_EQ(Render(sched, 0, 5), Bytes({0x91, 61, 100, 62, 100}));
+}
+
+TEST(hid_MidiOutput, rejectsWhatCannotBeSent)
+{
+    MidiOutputScheduler<4> sched;
+    MidiEvent              sysex = {};
+    sysex.type                   = SystemCommon;
+    sysex.sc_type                = SystemExclusive;
+    EXPECT_FALSE(sched.Schedule(sysex, 0));
+    EXPECT_FALSE(sched.Schedule(Channel(MessageLast, 0, 0, 0), 0));
+
+    for(int i = 0; i < 4; i++)
+    {
+        EXPECT_TRUE(sched.Schedule(Channel(NoteOn, 0, 60, 1), 0));
+    }
+    EXPECT_FALSE(sched.Schedule(Channel(NoteOn, 0, 60, 1), 0));
+}
+
+namespace
+{
+/** Records what the handler sends, one transfer at a time */
+struct AsyncTxState
+{
+    bool                 busy         = false;
+    size_t               max_transfer = 4;
+    std::vector<uint8_t> sent;
+} async_tx;
+
+class MidiAsyncTestTransport
+{
+  public:
+    struct Config
+    {
+    };
+
+    void Init(Config) { async_tx = AsyncTxState(); }
+    void StartRx(MidiUartTransport::MidiRxParseCallback, void*) {}
+    bool RxActive() { return true; }
+    void FlushRx() {}
+    void Tx(uint8_t* buff, size_t size) { TxAsync(buff, size); }
+
+    size_t TxAsync(const uint8_t* buff, size_t size)
+    {
+        if(async_tx.busy)
+            return 0;
+        size = std::min(size, async_tx.max_transfer);
+        async_tx.sent.insert(async_tx.sent.end(), buff, buff + size);
+        async_tx.busy = true;
+        return size;
+    }
+    bool TxBusy() const { return async_tx.busy; }
+};
+} // namespace
+
+TEST(hid_MidiOutput, handlerSendsInBackground)
+{
+    MidiHandler<MidiAsyncTestTransport>         midi;
+    MidiHandler<MidiAsyncTestTransport>::Config config;
+    midi.Init(config);
+
+    EXPECT_TRUE(midi.ScheduleMessage(Channel(NoteOn, 0, 60, 100), 10));
+    EXPECT_TRUE(midi.ScheduleMessage(Channel(NoteOn, 0, 64, 100), 10));
+    midi.ProcessOutput(5);
+    EXPECT_TRUE(async_tx.sent.empty());
+
+    midi.ProcessOutput(10);
+    EXPECT_EQ(async_tx.sent, Bytes({0x90, 60, 100, 64}));
+    midi.ProcessOutput(11); // still busy
+    EXPECT_EQ(async_tx.sent.size(), 4u);
+
+    async_tx.busy = false;
+    midi.ProcessOutput(12);
+    EXPECT_EQ(async_tx.sent, Bytes({0x90, 60, 100, 64, 100}));
+}
+
+namespace
+{
+Bytes uart_received;
+
+void CollectUartRx(uint8_t* data, size_t size, void*)
+{
+    uart_received.insert(uart_received.end(), data, data + size);
+}
+
+Bytes ReadUartTx(UartHandler& uart)
+{
+    uint8_t      buffer[64];
+    const size_t size = uart.ReadTxForUnitTest(buffer, sizeof(buffer));
+    return Bytes(buffer, buffer + size);
+}
+} // namespace
+
+TEST(hid_MidiOutput, uartSendsWhileListening)
+{
+    uint8_t                   rx_buffer[8];
+    MidiUartTransport         transport;
+    MidiUartTransport::Config config;
+    config.rx_buffer      = rx_buffer;
+    config.rx_buffer_size = sizeof(rx_buffer);
+    transport.Init(config);
+    transport.StartRx(CollectUartRx, nullptr);
+    EXPECT_TRUE(transport.RxActive());
+    UartHandler& uart = transport.GetUartForUnitTest();
+    uart_received.clear();
+
+    // the listening reception holds the DMA, a DMA transfer would wait for it
+    uint8_t clock = 0xf8;
+    EXPECT_EQ(uart.DmaTransmit(&clock, 1, nullptr, nullptr, nullptr),
+              UartHandler::Result::OK);
+    EXPECT_EQ(uart.SimulateTxCompleteForUnitTest(), UartHandler::Result::ERR);
+    EXPECT_TRUE(ReadUartTx(uart).empty());
+
+    // reinit, to drop the queued DMA transfer
+    transport.Init(config);
+    transport.StartRx(CollectUartRx, nullptr);
+
+    const uint8_t note_on[] = {0x90, 60, 100};
+    EXPECT_EQ(transport.TxAsync(note_on, 3), 3u);
+    EXPECT_TRUE(transport.TxBusy());
+    EXPECT_EQ(transport.TxAsync(note_on, 3), 0u);
+    EXPECT_EQ(ReadUartTx(uart), Bytes({0x90, 60, 100}));
+
+    // received while sending, wrapping around the circular buffer
+    const uint8_t cc[] = {0xb0, 1, 10, 0xb0, 1, 11, 0xb0, 1, 12};
+    EXPECT_EQ(uart.SimulateRxForUnitTest(cc, 6), UartHandler::Result::OK);
+    EXPECT_EQ(uart.SimulateRxForUnitTest(cc + 6, 3), UartHandler::Result::OK);
+    EXPECT_EQ(uart_received, Bytes(cc, cc + 9));
+
+    EXPECT_EQ(uart.SimulateTxCompleteForUnitTest(), UartHandler::Result::OK);
+    EXPECT_FALSE(transport.TxBusy());
+    EXPECT_TRUE(transport.RxActive());
+
+    const uint8_t note_off[] = {0x80, 60, 0};
+    EXPECT_EQ(transport.TxAsync(note_off, 3), 3u);
+    EXPECT_EQ(ReadUartTx(uart), Bytes({0x80, 60, 0}));
+    EXPECT_EQ(uart.SimulateTxCompleteForUnitTest(), UartHandler::Result::OK);
+    EXPECT_FALSE(transport.TxBusy());
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "hid/midi.h"
+#include "hid/midi_router.h"
+#include "sys/system.h"
+
+using namespace daisy;
+
+namespace
+{
+class MidiRouterTestTransport
+{
+  public:
+    struct Config
+    {
+    };
+
+    void Init(Config) {}
+    void StartRx(MidiUartTransport::MidiRxParseCallback, void*) {}
+    bool RxActive() { return true; }
+    void FlushRx() {}
+    void Tx(uint8_t*, size_t) {}
+};
+
+using TestHandler = MidiHandler<MidiRouterTestTransport>;
+using TestRouter  = MidiRouter<3, 64>;
+
+MidiEvent Note(uint8_t chn, uint8_t note)
+{
+    MidiEvent event = {};
+    event.type      = NoteOn;
+    event.channel   = chn;
+    event.data[0]   = note;
+    event.data[1]   = 100;
+    return event;
+}
+
+uint32_t TestClock()
+{
+    return System::GetUs();
+}
+} // namespace
+
+TEST(hid_MidiRouter, mergesHandlersByTime)
+{
+    TestHandler         uart, usb;
+    TestHandler::Config config;
+    uart.Init(config);
+    usb.Init(config);
+
+    TestRouter         router;
+    TestRouter::Config router_config;
+    router_config.clock = TestClock;
+    router.Init(router_config);
+    router.Attach(0, uart);
+    router.Attach(1, usb);
+
+    const uint8_t a[] = {0x90, 60, 100};
+    const uint8_t b[] = {0x91, 61, 100};
+    const uint8_t c[] = {0x90, 62, 100};
+    System::SetUsForUnitTest(100);
+    uart.Parse(a, sizeof(a));
+    System::SetUsForUnitTest(200);
+    usb.Parse(b, sizeof(b));
+    System::SetUsForUnitTest(300);
+    uart.Parse(c, sizeof(c));
+    EXPECT_FALSE(uart.HasEvents());
+    EXPECT_EQ(router.GetNumWaiting(), 3u);
+
+    System::SetUsForUnitTest(400);
+    std::vector<TestRouter::RoutedEvent> events;
+    auto collect = [&](const TestRouter::RoutedEvent& e) {
+        events.push_back(e);
+    };
+    EXPECT_EQ(router.Process(collect), 3u);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].event.data[0], 60);
+    EXPECT_EQ(events[0].port, 0);
+    EXPECT_EQ(events[0].time, 100u);
+    EXPECT_EQ(events[1].event.data[0], 61);
+    EXPECT_EQ(events[1].port, 1);
+    EXPECT_EQ(events[2].event.data[0], 62);
+
+    const TestRouter::PortStats& stats = router.GetStats(0);
+    EXPECT_EQ(stats.received, 2u);
+    EXPECT_EQ(stats.dispatched, 2u);
+    EXPECT_EQ(stats.latency_min, 100u);
+    EXPECT_EQ(stats.latency_max, 300u);
+    EXPECT_FLOAT_EQ(stats.GetMeanLatency(), 200.f);
+    EXPECT_EQ(router.GetStats(1).latency_max, 200u);
+    EXPECT_EQ(router.GetStats(2).received, 0u);
+}
+
+TEST(hid_MidiRouter, ordersWrappingTimestamps)
+{
+    TestRouter router;
+    router.Push(0, Note(0, 61), 10);
+    router.Push(1, Note(0, 60), 0xfffffff0);
+
+    TestRouter::RoutedEvent event;
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.event.data[0], 60);
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.event.data[0], 61);
+    EXPECT_FALSE(router.Pop(event));
+}
+
+TEST(hid_MidiRouter, filtersAndRemaps)
+{
+    TestRouter router;
+
+    // drop clock from port 1
+    TestRouter::Rule no_clock;
+    no_clock.ports = 1 << 1;
+    no_clock.types = 1 << SystemRealTime;
+    no_clock.drop  = true;
+    EXPECT_TRUE(router.AddRule(no_clock));
+
+    // move channel 1 of port 0 to channel 5, an octave up
+    TestRouter::Rule remap;
+    remap.ports     = 1 << 0;
+    remap.channels  = 1 << 1;
+    remap.channel   = 5;
+    remap.transpose = 12;
+    EXPECT_TRUE(router.AddRule(remap));
+
+    MidiEvent clock = {};
+    clock.type      = SystemRealTime;
+    clock.srt_type  = TimingClock;
+
+    EXPECT_FALSE(router.Push(1, clock));
+    EXPECT_TRUE(router.Push(0, clock));
+    EXPECT_TRUE(router.Push(0, Note(1, 60)));
+    EXPECT_TRUE(router.Push(1, Note(1, 60)));
+    EXPECT_FALSE(router.Push(0, Note(1, 120))); // out of range
+    EXPECT_TRUE(router.Push(0, Note(2, 60)));
+
+    TestRouter::RoutedEvent event;
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.event.type, SystemRealTime);
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.event.channel, 5);
+    EXPECT_EQ(event.event.data[0], 72);
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.port, 1);
+    EXPECT_EQ(event.event.channel, 1);
+    EXPECT_EQ(event.event.data[0], 60);
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(event.event.channel, 2);
+
+    EXPECT_EQ(router.GetStats(0).filtered, 1u);
+    EXPECT_EQ(router.GetStats(1).filtered, 1u);
+    EXPECT_EQ(router.GetStats(0).received, 4u);
+
+    router.ClearRules();
+    EXPECT_TRUE(router.Push(1, clock));
+}
+
+TEST(hid_MidiRouter, countsOverflow)
+{
+    MidiRouter<1, 4> router;
+    for(int i = 0; i < 6; i++)
+    {
+        router.Push(0, Note(0, 60 + i));
+    }
+    EXPECT_EQ(router.GetStats(0).overflowed, 2u);
+    EXPECT_EQ(router.GetNumWaiting(), 4u);
+
+    // without a clock, latency counts the events that arrived meanwhile
+    MidiRouter<1, 4>::RoutedEvent event;
+    ASSERT_TRUE(router.Pop(event));
+    EXPECT_EQ(router.GetStats(0).latency_max, 6u);
+}
+
+TEST(hid_MidiRouter, highRateMergeStaysOrdered)
+{
+    // 3 ports at about 3000 events per second each, drained every ms
+    TestRouter         router;
+    TestRouter::Config config;
+    config.clock = TestClock;
+    router.Init(config);
+
+    uint32_t last_time = 0;
+    size_t   count     = 0;
+    for(uint32_t us = 0; us < 1000000; us += 111)
+    {
+        System::SetUsForUnitTest(us);
+        router.Push((us / 111) % 3, Note(0, us % 128));
+        if(us / 1000 != (us + 111) / 1000)
+        {
+            router.Process([&](const TestRouter::RoutedEvent& e) {
+                EXPECT_LE(last_time, e.time);
+                last_time = e.time;
+                count++;
+            });
+        }
+    }
+    EXPECT_EQ(count, 9010u);
+    for(size_t port = 0; port < 3; port++)
+    {
+        EXPECT_EQ(router.GetStats(port).overflowed, 0u);
+        EXPECT_LT(router.GetStats(port).latency_max, 1000u);
+    }
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "hid/midi_ump.h"
+
+using namespace daisy;
+
+namespace
+{
+MidiEvent Midi1(MidiMessageType type, uint8_t chn, uint8_t d0, uint8_t d1)
+{
+    MidiEvent event = {};
+    event.type      = type;
+    event.channel   = chn;
+    event.data[0]   = d0;
+    event.data[1]   = d1;
+    return event;
+}
+
+std::vector<UmpEvent> ParseWords(const std::vector<uint32_t>& words)
+{
+    UmpParser             parser;
+    std::vector<UmpEvent> events;
+    parser.ParseBlock(words.data(), words.size(), [&](const UmpEvent& e) {
+        events.push_back(e);
+    });
+    return events;
+}
+} // namespace
+
+TEST(hid_MidiUmp, upscaleKeepsMinCenterMax)
+{
+    EXPECT_EQ(UmpEvent::Upscale(0, 7, 32), 0u);
+    EXPECT_EQ(UmpEvent::Upscale(64, 7, 32), 0x80000000u);
+    EXPECT_EQ(UmpEvent::Upscale(127, 7, 32), 0xffffffffu);
+    EXPECT_EQ(UmpEvent::Upscale(0x2000, 14, 32), 0x80000000u);
+    EXPECT_EQ(UmpEvent::Upscale(0x3fff, 14, 32), 0xffffffffu);
+    EXPECT_EQ(UmpEvent::Upscale(127, 7, 16), 0xffffu);
+    EXPECT_EQ(UmpEvent::Upscale(0xffff, 16, 32), 0xffffffffu);
+
+    // monotonic
+    uint32_t last = 0;
+    for(uint32_t v = 1; v < 0x4000; v++)
+    {
+        const uint32_t scaled = UmpEvent::Upscale(v, 14, 32);
+        EXPECT_GT(scaled, last);
+        last = scaled;
+    }
+}
+
+TEST(hid_MidiUmp, midiEventRoundTrip)
+{
+    const MidiEvent events[] = {
+        Midi1(NoteOn, 3, 60, 100),
+        Midi1(NoteOff, 3, 60, 20),
+        Midi1(PolyphonicKeyPressure, 1, 61, 127),
+        Midi1(ControlChange, 0, 74, 64),
+        Midi1(ProgramChange, 9, 12, 0),
+        Midi1(ChannelPressure, 2, 90, 0),
+        Midi1(PitchBend, 15, 0x7f, 0x3f),
+    };
+    for(const MidiEvent& event : events)
+    {
+        const UmpEvent ump = UmpEvent::FromMidiEvent(event, 2);
+        EXPECT_EQ(ump.type, event.type);
+        EXPECT_EQ(ump.group, 2);
+        MidiEvent back;
+        ASSERT_TRUE(ump.ToMidiEvent(&back));
+        EXPECT_EQ(back.type, event.type);
+        EXPECT_EQ(back.channel, event.channel);
+        EXPECT_EQ(back.data[0], event.data[0]);
+        if(event.type != ProgramChange && event.type != ChannelPressure)
+        {
+            EXPECT_EQ(back.data[1], event.data[1]);
+        }
+    }
+
+    // centered values
+    EXPECT_EQ(UmpEvent::FromMidiEvent(Midi1(PitchBend, 0, 0, 0x40)).value,
+              UmpEvent::kCenter);
+    EXPECT_FLOAT_EQ(
+        UmpEvent::FromMidiEvent(Midi1(PitchBend, 0, 0x7f, 0x7f)).GetBipolar(),
+        1.f);
+}
+
+TEST(hid_MidiUmp, noteOnVelocityZero)
+{
+    // a Note Off in MIDI 1.0, a valid velocity in MIDI 2.0
+    EXPECT_EQ(UmpEvent::FromMidiEvent(Midi1(NoteOn, 0, 60, 0)).type, NoteOff);
+
+    UmpEvent quiet = {};
+    quiet.type     = NoteOn;
+    quiet.note     = 60;
+    quiet.value    = 0x00010000;
+    MidiEvent event;
+    ASSERT_TRUE(quiet.ToMidiEvent(&event));
+    EXPECT_EQ(event.type, NoteOn);
+    EXPECT_EQ(event.data[1], 1);
+}
+
+TEST(hid_MidiUmp, channelMode)
+{
+    MidiEvent event = Midi1(ChannelMode, 0, 123, 0);
+    event.cm_type   = AllNotesOff;
+    const UmpEvent ump = UmpEvent::FromMidiEvent(event);
+    EXPECT_EQ(ump.type, ControlChange);
+    EXPECT_EQ(ump.index, 123);
+
+    MidiEvent back;
+    ASSERT_TRUE(ump.ToMidiEvent(&back));
+    EXPECT_EQ(back.type, ChannelMode);
+    EXPECT_EQ(back.cm_type, AllNotesOff);
+}
+
+TEST(hid_MidiUmp, parsesMidi1Packets)
+{
+    // note on and pitch bend in group 1
+    const auto events = ParseWords({0x21934064, 0x21e30040});
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0].type, NoteOn);
+    EXPECT_EQ(events[0].group, 1);
+    EXPECT_EQ(events[0].channel, 3);
+    EXPECT_EQ(events[0].note, 0x40);
+    EXPECT_EQ(events[0].value, UmpEvent::Upscale(100, 7, 32));
+    EXPECT_EQ(events[1].type, PitchBend);
+    EXPECT_EQ(events[1].value, UmpEvent::kCenter);
+}
+
+TEST(hid_MidiUmp, parsesMidi2Packets)
+{
+    const auto events = ParseWords({
+        0x40923c00, 0xfff00000, // note on, 16 bit velocity
+        0x40b24a00, 0x12345678, // CC 74, 32 bit value
+        0x40623c00, 0x90000000, // per-note pitch bend
+        0x40123c05, 0xabcdef01, // assignable per-note controller 5
+        0x40c20000, 0x07000000, // program change
+        0x40220006, 0x00000000, // RPN, skipped
+    });
+    ASSERT_EQ(events.size(), 5u);
+    EXPECT_EQ(events[0].type, NoteOn);
+    EXPECT_EQ(events[0].channel, 2);
+    EXPECT_EQ(events[0].note, 60);
+    EXPECT_EQ(events[0].value >> 16, 0xfff0u);
+    EXPECT_EQ(events[1].type, ControlChange);
+    EXPECT_EQ(events[1].index, 74);
+    EXPECT_EQ(events[1].value, 0x12345678u);
+    EXPECT_FALSE(events[1].per_note);
+    EXPECT_EQ(events[2].type, PitchBend);
+    EXPECT_TRUE(events[2].per_note);
+    EXPECT_EQ(events[2].note, 60);
+    EXPECT_EQ(events[3].type, ControlChange);
+    EXPECT_TRUE(events[3].per_note);
+    EXPECT_EQ(events[3].index, 5);
+    EXPECT_EQ(events[4].type, ProgramChange);
+    EXPECT_EQ(events[4].index, 7);
+
+    MidiEvent midi1;
+    EXPECT_FALSE(events[2].ToMidiEvent(&midi1));
+}
+
+TEST(hid_MidiUmp, skipsOtherPackets)
+{
+    const auto events = ParseWords({
+        0x00000000,                                     // utility
+        0x10f80000,                                     // system real time
+        0x30160102, 0x03040506,                         // SysEx7
+        0x50000000, 0x00000000, 0x00000000, 0x00000000, // data 128
+        0x20904040,                                     // note on
+    });
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].type, NoteOn);
+}
+
+TEST(hid_MidiUmp, encodeParseRoundTrip)
+{
+    UmpEvent events[6] = {};
+    events[0].type     = NoteOn;
+    events[0].note     = 64;
+    events[0].value    = 0xabcd0000;
+    events[1].type     = ControlChange;
+    events[1].index    = 1;
+    events[1].value    = 0x87654321;
+    events[2].type     = PitchBend;
+    events[2].per_note = true;
+    events[2].note     = 64;
+    events[2].value    = 0x7fffffff;
+    events[3].type     = ProgramChange;
+    events[3].index    = 42;
+    events[4].type     = ChannelPressure;
+    events[4].value    = 0x10000000;
+    events[5].type     = PolyphonicKeyPressure;
+    events[5].note     = 64;
+    events[5].value    = 0x20000000;
+
+    std::vector<uint32_t> words;
+    for(UmpEvent& event : events)
+    {
+        event.group   = 4;
+        event.channel = 9;
+        uint32_t packet[2];
+        ASSERT_EQ(event.Encode(packet), 2u);
+        words.insert(words.end(), packet, packet + 2);
+    }
+
+    const auto parsed = ParseWords(words);
+    ASSERT_EQ(parsed.size(), 6u);
+    for(size_t i = 0; i < 6; i++)
+    {
+        EXPECT_EQ(parsed[i].type, events[i].type);
+        EXPECT_EQ(parsed[i].group, 4);
+        EXPECT_EQ(parsed[i].channel, 9);
+        EXPECT_EQ(parsed[i].note, events[i].note);
+        EXPECT_EQ(parsed[i].index, events[i].index);
+        EXPECT_EQ(parsed[i].per_note, events[i].per_note);
+    }
+    EXPECT_EQ(parsed[0].value >> 16, 0xabcdu);
+    EXPECT_EQ(parsed[1].value, 0x87654321u);
+    EXPECT_EQ(parsed[2].value, 0x7fffffffu);
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
 #include "hid/midi.h"
 #include "sys/system.h"
 
@@ -519,7 +521,7 @@ TEST_F(MidiTest, systemExclusive)
     // short message
     int                  size       = 6;
     MidiEvent            event      = ParseAndPopSysex(msgs, size);
-    SystemExclusiveEvent sysexEvent = event.AsSystemExclusive();
+    SystemExclusiveEvent sysexEvent = midi.AsSystemExclusive(event);
     EXPECT_EQ(event.type, SystemCommon);
     EXPECT_EQ(event.sc_type, SystemExclusive);
 
@@ -535,7 +537,7 @@ TEST_F(MidiTest, systemExclusive)
     // full length message
     size       = 128;
     event      = ParseAndPopSysex(msgs, size);
-    sysexEvent = event.AsSystemExclusive();
+    sysexEvent = midi.AsSystemExclusive(event);
     EXPECT_EQ(event.type, SystemCommon);
     EXPECT_EQ(event.sc_type, SystemExclusive);
 
@@ -548,14 +550,15 @@ TEST_F(MidiTest, systemExclusive)
 
     EXPECT_FALSE(midi.HasEvents());
 
-    //max len is 128, let's go past that
+    //SystemExclusiveEvent holds 128 bytes, let's go past that
     size       = 135;
     event      = ParseAndPopSysex(msgs, size);
-    sysexEvent = event.AsSystemExclusive();
+    sysexEvent = midi.AsSystemExclusive(event);
     EXPECT_EQ(event.type, SystemCommon);
     EXPECT_EQ(event.sc_type, SystemExclusive);
 
-    //max len
+    //the event has all of it, the struct only gets the max len
+    EXPECT_EQ(event.sysex_message_len, size);
     EXPECT_EQ(sysexEvent.length, 128);
 
     for(int i = 0; i < 128; i++)
@@ -566,6 +569,73 @@ TEST_F(MidiTest, systemExclusive)
     EXPECT_FALSE(midi.HasEvents());
 }
 
+TEST_F(MidiTest, systemExclusiveLongDump)
+{
+    // longer than SYSEX_BUFFER_LEN, is received without truncation
+    uint8_t msgs[600];
+    for(int i = 0; i < 600; i++)
+    {
+        msgs[i] = (uint8_t)(i * 7) & 0x7f;
+    }
+    MidiEvent event = ParseAndPopSysex(msgs, 600);
+    EXPECT_EQ(event.sysex_message_len, 600);
+
+    uint8_t data[1024];
+    ASSERT_EQ(midi.GetSysEx(event, data, sizeof(data)), 600u);
+    for(int i = 0; i < 600; i++)
+    {
+        EXPECT_EQ(data[i], msgs[i]);
+    }
+
+    // limited to the destination size
+    EXPECT_EQ(midi.GetSysEx(event, data, 10), 10u);
+
+    // messages are queued with their data
+    MidiEvent first = ParseAndPopSysex(msgs, 300);
+    midi.Parse(0xf0);
+    Parse(&msgs[300], 200);
+    midi.Parse(0xf7);
+    MidiEvent second = midi.PopEvent();
+    ASSERT_EQ(midi.GetSysEx(first, data, sizeof(data)), 300u);
+    EXPECT_EQ(data[299], msgs[299]);
+    ASSERT_EQ(midi.GetSysEx(second, data, sizeof(data)), 200u);
+    EXPECT_EQ(data[0], msgs[300]);
+
+    // the oldest data is overwritten by newer messages
+    ParseAndPopSysex(msgs, 600);
+    EXPECT_EQ(midi.GetSysEx(first, data, sizeof(data)), 0u);
+    ASSERT_EQ(midi.GetSysEx(second, data, sizeof(data)), 200u);
+    EXPECT_EQ(data[199], msgs[499]);
+
+    // messages longer than the arena are truncated
+    midi.Parse(0xf0);
+    for(int i = 0; i < 2000; i++)
+    {
+        midi.Parse(i & 0x7f);
+    }
+    midi.Parse(0xf7);
+    event = midi.PopEvent();
+    EXPECT_EQ(event.sysex_message_len, 1024);
+    ASSERT_EQ(midi.GetSysEx(event, data, sizeof(data)), 1024u);
+    EXPECT_EQ(data[1023], 1023 & 0x7f);
+    EXPECT_FALSE(midi.HasEvents());
+}
+
+TEST(MidiEventTest, isCompact)
+{
+    EXPECT_EQ(sizeof(MidiEvent), 8u);
+
+    // a parser without an arena still reports SysEx messages
+    MidiParser parser;
+    MidiEvent  event;
+    parser.Init();
+    parser.Parse(0xf0, &event);
+    parser.Parse(0x01, &event);
+    EXPECT_TRUE(parser.Parse(0xf7, &event));
+    EXPECT_EQ(event.sc_type, SystemExclusive);
+    EXPECT_EQ(event.sysex_message_len, 0);
+}
+
 // ================ Running Status ================
 
 TEST_F(MidiTest, runningStatus)
@@ -781,4 +851,189 @@ TEST_F(MidiTest, singleByteRunningStatusTest)
     }
 
     EXPECT_FALSE(midi.HasEvents());
-}
\ No newline at end of file
+}
+/** Real Time messages in the middle of other messages don't change them */
+TEST_F(MidiTest, realtimeInsideMessages)
+{
+    uint8_t msgs[] = {0x93, 0x24, 0xf8, 0x40, 0x25, 0xfa, 0x41};
+    Parse(msgs, sizeof(msgs));
+
+    EXPECT_EQ(midi.PopEvent().srt_type, TimingClock);
+    MidiEvent   event   = midi.PopEvent();
+    NoteOnEvent onEvent = event.AsNoteOn();
+    EXPECT_EQ(event.type, NoteOn);
+    EXPECT_EQ(onEvent.channel, 3);
+    EXPECT_EQ(onEvent.note, 0x24);
+    EXPECT_EQ(onEvent.velocity, 0x40);
+    EXPECT_EQ(midi.PopEvent().srt_type, Start);
+    event = midi.PopEvent();
+    EXPECT_EQ(event.type, NoteOn);
+    EXPECT_EQ(event.channel, 3);
+    EXPECT_EQ(event.data[0], 0x25);
+    EXPECT_EQ(event.data[1], 0x41);
+    EXPECT_FALSE(midi.HasEvents());
+
+    // ... and aren't part of SysEx data
+    uint8_t sysex[] = {0xf0, 0x01, 0xf8, 0x02, 0xf7};
+    Parse(sysex, sizeof(sysex));
+    EXPECT_EQ(midi.PopEvent().srt_type, TimingClock);
+    event = midi.PopEvent();
+    uint8_t data[4];
+    ASSERT_EQ(midi.GetSysEx(event, data, sizeof(data)), 2u);
+    EXPECT_EQ(data[1], 0x02);
+    EXPECT_FALSE(midi.HasEvents());
+}
+
+// ================ Block Parsing ================
+
+namespace
+{
+// Pseudo random stream with every kind of message, running status,
+// real time bytes in between and broken messages
+std::vector<uint8_t> MakeMixedStream(size_t size)
+{
+    std::vector<uint8_t> stream;
+    uint32_t             rnd = 1;
+    while(stream.size() < size)
+    {
+        rnd          = rnd * 1664525 + 1013904223;
+        uint8_t byte = (rnd >> 24) & 0x7f;
+        switch((rnd >> 8) % 16)
+        {
+            case 0: byte |= 0x80; break;                // any status
+            case 1: byte = 0xf8; break;                 // clock
+            case 2: byte = 0xb0 | (byte & 0x0f); break; // CC
+            case 3: byte = (rnd & 0x1000) ? 0xf0 : 0xf7; break;
+            default: break; // data
+        }
+        stream.push_back(byte);
+    }
+    return stream;
+}
+
+void ExpectSameEvent(const MidiEvent& a, const MidiEvent& b)
+{
+    ASSERT_EQ(a.type, b.type);
+    switch(a.type)
+    {
+        case SystemRealTime: EXPECT_EQ(a.srt_type, b.srt_type); break;
+        case SystemCommon:
+            EXPECT_EQ(a.sc_type, b.sc_type);
+            if(a.sc_type == SystemExclusive)
+            {
+                EXPECT_EQ(a.sysex_message_len, b.sysex_message_len);
+                return;
+            }
+            break;
+        case ChannelMode: EXPECT_EQ(a.cm_type, b.cm_type); break;
+        default: break;
+    }
+    EXPECT_EQ(a.channel, b.channel);
+    EXPECT_EQ(a.data[0], b.data[0]);
+    if(a.type != ProgramChange && a.type != ChannelPressure
+       && a.type != SystemCommon)
+    {
+        EXPECT_EQ(a.data[1], b.data[1]);
+    }
+}
+} // namespace
+
+TEST(MidiParserTest, parseBlockMatchesParse)
+{
+    const auto             stream = MakeMixedStream(20000);
+    MidiSysExArena<256>    arena_a, arena_b;
+    MidiParser             bytewise, blockwise;
+    std::vector<MidiEvent> expected, events;
+    bytewise.Init(&arena_a);
+    blockwise.Init(&arena_b);
+
+    for(uint8_t byte : stream)
+    {
+        MidiEvent event;
+        if(bytewise.Parse(byte, &event))
+            expected.push_back(event);
+    }
+    // blocks of varying size, so messages are split between blocks
+    size_t pos = 0, block = 1;
+    while(pos < stream.size())
+    {
+        block        = std::min(block % 37 + 1, stream.size() - pos);
+        size_t count = blockwise.ParseBlock(
+            &stream[pos], block, [&events](const MidiEvent& event) {
+                events.push_back(event);
+            });
+        EXPECT_LE(count, block);
+        pos += block;
+    }
+
+    ASSERT_EQ(events.size(), expected.size());
+    EXPECT_GT(events.size(), 2000u);
+    for(size_t i = 0; i < events.size(); i++)
+    {
+        SCOPED_TRACE(i);
+        ExpectSameEvent(events[i], expected[i]);
+    }
+}
+
+TEST(MidiParserTest, parseBlockRunningStatus)
+{
+    MidiParser parser;
+    parser.Init();
+    std::vector<MidiEvent> events;
+    auto sink = [&events](const MidiEvent& event) { events.push_back(event); };
+
+    // CCs with running status, including a channel mode message
+    uint8_t ccs[] = {0xb5, 1, 10, 2, 20, 123, 0, 7, 100};
+    EXPECT_EQ(parser.ParseBlock(ccs, sizeof(ccs), sink), 4u);
+    ASSERT_EQ(events.size(), 4u);
+    EXPECT_EQ(events[1].AsControlChange().control_number, 2);
+    EXPECT_EQ(events[1].AsControlChange().value, 20);
+    EXPECT_EQ(events[2].type, ChannelMode);
+    EXPECT_EQ(events[2].cm_type, AllNotesOff);
+    EXPECT_EQ(events[3].type, ControlChange);
+    EXPECT_EQ(events[3].channel, 5);
+
+    // notes, with velocity 0 as note off, split across two blocks
+    events.clear();
+    uint8_t notes[] = {0x90, 60, 100, 60, 0, 62};
+    EXPECT_EQ(parser.ParseBlock(notes, sizeof(notes), sink), 2u);
+    uint8_t rest[] = {90};
+    EXPECT_EQ(parser.ParseBlock(rest, 1, sink), 1u);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[1].type, NoteOff);
+    EXPECT_EQ(events[2].type, NoteOn);
+    EXPECT_EQ(events[2].AsNoteOn().note, 62);
+
+    // data without any status is ignored
+    parser.Reset();
+    EXPECT_EQ(parser.ParseBlock(rest, 1, sink), 0u);
+}
+
+TEST_F(MidiTest, eventCallback)
+{
+    struct Received
+    {
+        int       count = 0;
+        MidiEvent last;
+    } received;
+    midi.SetEventCallback(
+        [](const MidiEvent& event, void* context) {
+            auto r = static_cast<Received*>(context);
+            r->count++;
+            r->last = event;
+        },
+        &received);
+
+    uint8_t msgs[] = {0xe2, 0x00, 0x40, 0x7f, 0x7f, 0xf8};
+    midi.Parse(msgs, sizeof(msgs));
+    EXPECT_EQ(received.count, 3);
+    EXPECT_EQ(received.last.type, SystemRealTime);
+    EXPECT_FALSE(midi.HasEvents());
+
+    // back to the queue
+    midi.SetEventCallback(nullptr);
+    midi.Parse(msgs, sizeof(msgs));
+    EXPECT_EQ(received.count, 3);
+    EXPECT_TRUE(midi.HasEvents());
+    EXPECT_EQ(midi.PopEvent().AsPitchBend().value, 0);
+}
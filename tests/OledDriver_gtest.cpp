@@ -0,0 +1,466 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "dev/oled_ssd130x.h"
+#include "dev/oled_sh1106.h"
+#include "dev/oled_ssd1351.h"
+#include "dev/oled_ssd1327.h"
+#include "hid/disp/oled_display.h"
+#include "hid/disp/oled_color_display.h"
+#include "hid/disp/color_compositor.h"
+#include "ui/UI.h"
+
+using namespace daisy;
+
+namespace
+{
+/** Records what a driver sends to the display */
+struct TransportLog
+{
+    std::vector<uint8_t> commands;
+    std::vector<uint8_t> data;
+    size_t               num_data_bytes = 0;
+    size_t               num_transfers  = 0;
+    // the data of the DMA transfers, and the one that isn't done yet
+    std::vector<uint8_t>              dma_data;
+    SpiHandle::EndCallbackFunctionPtr dma_callback = nullptr;
+    void*                             dma_context  = nullptr;
+
+    void Clear() { *this = TransportLog(); }
+};
+
+TransportLog transport_log;
+
+class MockTransport
+{
+  public:
+    struct Config
+    {
+    };
+
+    void Init(const Config&) {}
+    void SendCommand(uint8_t cmd) { transport_log.commands.push_back(cmd); }
+    void SendData(uint8_t* buff, size_t size)
+    {
+        transport_log.data.insert(transport_log.data.end(), buff, buff + size);
+        transport_log.num_data_bytes += size;
+        transport_log.num_transfers++;
+    }
+    void SendData(uint8_t) { transport_log.num_data_bytes++; }
+    void SendDataDma(uint8_t*                          buff,
+                     size_t                            size,
+                     SpiHandle::EndCallbackFunctionPtr callback,
+                     void*                             context)
+    {
+        EXPECT_EQ(transport_log.dma_callback, nullptr);
+        transport_log.dma_data.insert(
+            transport_log.dma_data.end(), buff, buff + size);
+        transport_log.dma_callback = callback;
+        transport_log.dma_context  = context;
+        SendData(buff, size);
+    }
+};
+
+/** Finishes the running DMA transfer */
+bool FinishDmaTransfer()
+{
+    const auto callback = transport_log.dma_callback;
+    if(callback == nullptr)
+        return false;
+    transport_log.dma_callback = nullptr;
+    callback(transport_log.dma_context, SpiHandle::Result::OK);
+    return true;
+}
+
+void CountCallback(void* context)
+{
+    (*static_cast<int*>(context))++;
+}
+
+/** Hides the fast drawing functions of a driver, so that the display draws
+ *  pixel by pixel
+ */
+template <typename Driver>
+class PixelsOnly
+{
+  public:
+    using Config = typename Driver::Config;
+
+    void   Init(Config config) { driver_.Init(config); }
+    size_t Width() const { return driver_.Width(); }
+    size_t Height() const { return driver_.Height(); }
+    void   DrawPixel(uint_fast8_t x, uint_fast8_t y, bool on)
+    {
+        driver_.DrawPixel(x, y, on);
+    }
+    void Fill(bool on) { driver_.Fill(on); }
+    void Update() { driver_.Update(); }
+    void SetColorFG(uint8_t red, uint8_t green, uint8_t blue)
+    {
+        driver_.SetColorFG(red, green, blue);
+    }
+    void SetColorBG(uint8_t red, uint8_t green, uint8_t blue)
+    {
+        driver_.SetColorBG(red, green, blue);
+    }
+
+  private:
+    Driver driver_;
+};
+
+/** Draws lines, rectangles and text, partly outside of the display */
+template <typename Display>
+void DrawScene(Display& display)
+{
+    static const uint16_t bitmap[3] = {0xA5F0, 0xFFFF, 0x8001};
+    display.DrawLine(3, 5, 100, 5, true);
+    display.DrawLine(100, 9, 3, 9, true);
+    display.DrawLine(7, 2, 7, 60, true);
+    display.DrawLine(9, 60, 9, 2, true);
+    display.DrawLine(0, 0, 127, 63, true);
+    display.DrawRect(20, 13, 40, 30, true, true);
+    display.DrawRect(25, 15, 30, 17, false, true);
+    display.DrawRect(50, 3, 90, 50, true, false);
+    display.DrawRect(110, 60, 200, 200, true, true);
+    display.SetCursor(12, 35);
+    display.WriteString("Fast 42", Font_7x10, true);
+    display.SetCursor(60, 50);
+    display.WriteString("Inv", Font_6x8, false);
+    display.BlitBitmap(120, 20, bitmap, 16, 3, true);
+    display.BlitBitmap(60, 62, bitmap, 12, 3, false);
+
+    static GlyphCache<95 * 11> font;
+    if(font.GetHeight() == 0)
+        font.Init(Font_11x18);
+    display.SetCursor(70, 27);
+    display.WriteString("Gain", font, true);
+    display.SetCursor(2, 50);
+    display.WriteString("dB", font, false);
+}
+
+/** Returns the data that the first update after Init() sends */
+template <typename Display>
+std::vector<uint8_t> RenderScene(Display& display)
+{
+    display.Fill(false);
+    DrawScene(display);
+    transport_log.Clear();
+    display.Update();
+    return transport_log.data;
+}
+
+using MonoDriver  = SSD130xDriver<128, 64, MockTransport>;
+using ColorDriver = SSD1351Driver<128, 128, MockTransport>;
+} // namespace
+
+TEST(dev_OledSSD130x, a_firstUpdateSendsAll)
+{
+    MonoDriver driver;
+    driver.Init(MonoDriver::Config());
+    driver.Fill(false);
+    transport_log.Clear();
+
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 128u * 64 / 8);
+    EXPECT_EQ(transport_log.num_transfers, 8u);
+
+    // nothing changed
+    transport_log.Clear();
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 0u);
+    EXPECT_TRUE(transport_log.commands.empty());
+}
+
+TEST(dev_OledSSD130x, b_sendsChangedColumns)
+{
+    MonoDriver driver;
+    driver.Init(MonoDriver::Config());
+    driver.Fill(false);
+    driver.Update();
+
+    transport_log.Clear();
+    driver.DrawPixel(10, 20, true);
+    driver.DrawPixel(12, 21, true);
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 3u);
+    // page 2, column 10
+    const std::vector<uint8_t> expected = {0xB2, 0x0A, 0x10};
+    EXPECT_EQ(transport_log.commands, expected);
+
+    // drawing what is already there changes nothing
+    transport_log.Clear();
+    driver.DrawPixel(10, 20, true);
+    driver.Fill(false);
+    driver.Fill(false);
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 3u);
+
+    transport_log.Clear();
+    driver.SetAllDirty();
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 128u * 64 / 8);
+}
+
+TEST(dev_OledSSD130x, c_changedDigit)
+{
+    using Display = OledDisplay<MonoDriver>;
+    Display display;
+    display.Init(Display::Config());
+    display.Fill(false);
+    display.SetCursor(0, 0);
+    display.WriteString("1234", Font_7x10, true);
+    display.Update();
+
+    // characters are drawn with their background, so only the pixels of the
+    // last digit change. It spans two pages.
+    transport_log.Clear();
+    display.SetCursor(0, 0);
+    display.WriteString("1235", Font_7x10, true);
+    display.Update();
+    EXPECT_GT(transport_log.num_data_bytes, 0u);
+    EXPECT_LE(transport_log.num_data_bytes, 2u * 7);
+    const auto& commands = transport_log.commands;
+    ASSERT_GE(commands.size(), 3u);
+    ASSERT_LE(commands.size(), 6u);
+    for(size_t i = 0; i < commands.size(); i += 3)
+    {
+        EXPECT_LE(commands[i], 0xB1);
+        const int column = (commands[i + 2] & 0x0F) << 4 | commands[i + 1];
+        EXPECT_GE(column, 3 * 7);
+    }
+}
+
+TEST(dev_OledSH1106, a_columnOffset)
+{
+    SH1106Driver<128, 64, MockTransport> driver;
+    driver.Init(MonoDriver::Config());
+    driver.Fill(false);
+    driver.Update();
+
+    transport_log.Clear();
+    driver.DrawPixel(127, 63, true);
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 1u);
+    // page 7, column 127 + 2
+    const std::vector<uint8_t> expected = {0xB7, 0x01, 0x18};
+    EXPECT_EQ(transport_log.commands, expected);
+}
+
+TEST(dev_OledSSD1351, a_sendsChangedRectangle)
+{
+    static ColorDriver driver;
+    driver.Init(ColorDriver::Config());
+    transport_log.Clear();
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 2 + 2 + 128u * 128 * 2);
+
+    transport_log.Clear();
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 0u);
+    EXPECT_TRUE(transport_log.commands.empty());
+
+    // a 3x2 rectangle, sent row by row
+    transport_log.Clear();
+    driver.DrawPixel(10, 20, true);
+    driver.DrawPixel(12, 21, true);
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 2 + 2 + 3u * 2 * 2);
+    EXPECT_EQ(transport_log.num_transfers, 2u);
+
+    // back to the background color
+    transport_log.Clear();
+    driver.Fill(false);
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 2 + 2 + 3u * 2 * 2);
+}
+
+TEST(dev_OledSSD130x, d_asyncUpdate)
+{
+    MonoDriver driver;
+    driver.Init(MonoDriver::Config());
+    driver.Fill(false);
+    transport_log.Clear();
+
+    int num_done = 0;
+    EXPECT_TRUE(driver.UpdateAsync(&CountCallback, &num_done));
+    EXPECT_TRUE(driver.IsBusy());
+    EXPECT_FALSE(driver.UpdateAsync());
+
+    // drawing while the pages are sent goes into the next update
+    driver.DrawPixel(0, 0, true);
+    size_t num_pages = 1;
+    while(FinishDmaTransfer())
+        num_pages += driver.IsBusy();
+    EXPECT_EQ(num_pages, 8u);
+    EXPECT_FALSE(driver.IsBusy());
+    EXPECT_EQ(num_done, 1);
+    EXPECT_EQ(transport_log.dma_data,
+              std::vector<uint8_t>(128u * 64 / 8, 0x00));
+
+    transport_log.Clear();
+    EXPECT_TRUE(driver.UpdateAsync(&CountCallback, &num_done));
+    EXPECT_EQ(transport_log.dma_data, std::vector<uint8_t>(1, 0x01));
+    const std::vector<uint8_t> expected = {0xB0, 0x00, 0x10};
+    EXPECT_EQ(transport_log.commands, expected);
+    EXPECT_TRUE(FinishDmaTransfer());
+    EXPECT_EQ(num_done, 2);
+
+    // nothing changed, done right away
+    transport_log.Clear();
+    EXPECT_TRUE(driver.UpdateAsync(&CountCallback, &num_done));
+    EXPECT_FALSE(driver.IsBusy());
+    EXPECT_EQ(num_done, 3);
+    EXPECT_TRUE(transport_log.commands.empty());
+}
+
+TEST(dev_OledSSD130x, e_flushDisplayAsync)
+{
+    using Display = OledDisplay<MonoDriver>;
+    Display display;
+    display.Init(Display::Config());
+    display.Fill(false);
+    display.Update();
+
+    UiCanvasDescriptor canvas;
+    canvas.handle_        = &display;
+    canvas.flushFunction_ = &FlushDisplayAsync<Display>;
+
+    transport_log.Clear();
+    display.DrawPixel(5, 5, true);
+    canvas.flushFunction_(canvas);
+    EXPECT_TRUE(display.IsBusy());
+
+    // a flush while busy doesn't wait. The changes are sent later.
+    display.DrawPixel(6, 5, true);
+    canvas.flushFunction_(canvas);
+    EXPECT_EQ(transport_log.dma_data.size(), 1u);
+    EXPECT_TRUE(FinishDmaTransfer());
+    EXPECT_FALSE(display.IsBusy());
+    canvas.flushFunction_(canvas);
+    EXPECT_EQ(transport_log.dma_data.size(), 2u);
+    EXPECT_TRUE(FinishDmaTransfer());
+}
+
+TEST(dev_OledSSD1351, b_asyncUpdatePacksRectangle)
+{
+    static ColorDriver driver;
+    driver.Init(ColorDriver::Config());
+    driver.Update();
+
+    // a 3x2 rectangle, sent in one transfer
+    transport_log.Clear();
+    driver.DrawPixel(10, 20, true);
+    driver.DrawPixel(12, 21, true);
+    int num_done = 0;
+    EXPECT_TRUE(driver.UpdateAsync(&CountCallback, &num_done));
+    EXPECT_TRUE(driver.IsBusy());
+    EXPECT_EQ(transport_log.dma_data.size(), 3u * 2 * 2);
+    const std::vector<uint8_t> expected_data = {
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x00, // row 20
+        0x00, 0x00, 0x00, 0x00, 0xff, 0xff, // row 21
+    };
+    EXPECT_EQ(transport_log.dma_data, expected_data);
+
+    // the back buffer is free to draw to
+    driver.DrawPixel(11, 20, true);
+    EXPECT_TRUE(FinishDmaTransfer());
+    EXPECT_FALSE(driver.IsBusy());
+    EXPECT_EQ(num_done, 1);
+
+    transport_log.Clear();
+    driver.Update();
+    EXPECT_EQ(transport_log.num_data_bytes, 2 + 2 + 2u);
+}
+
+TEST(dev_OledSSD1327, a_asyncUpdate)
+{
+    using GrayDriver = SSD1327Driver<128, 128, MockTransport>;
+    static GrayDriver driver;
+    driver.Init(GrayDriver::Config());
+    transport_log.Clear();
+
+    EXPECT_TRUE(driver.UpdateAsync());
+    EXPECT_TRUE(driver.IsBusy());
+    EXPECT_FALSE(driver.UpdateAsync());
+    driver.Fill(true);
+    EXPECT_TRUE(FinishDmaTransfer());
+    EXPECT_FALSE(driver.IsBusy());
+    EXPECT_EQ(transport_log.dma_data, std::vector<uint8_t>(128u * 64, 0x00));
+}
+
+TEST(dev_OledSSD130x, f_fastPathsMatchPixels)
+{
+    using Display     = OledDisplay<MonoDriver>;
+    using PixelDriver = PixelsOnly<MonoDriver>;
+    Display                  display;
+    OledDisplay<PixelDriver> pixel_display;
+    display.Init(Display::Config());
+    pixel_display.Init(OledDisplay<PixelDriver>::Config());
+
+    const auto expected = RenderScene(pixel_display);
+    ASSERT_EQ(expected.size(), 128u * 64 / 8);
+    EXPECT_EQ(RenderScene(display), expected);
+
+    // drawing the same text again changes nothing
+    transport_log.Clear();
+    display.SetCursor(12, 35);
+    display.WriteString("Fast 42", Font_7x10, true);
+    display.DrawRect(20, 13, 40, 14, true, true);
+    display.Update();
+    EXPECT_TRUE(transport_log.commands.empty());
+}
+
+TEST(dev_OledSSD1351, c_fastPathsMatchPixels)
+{
+    using Display     = OledColorDisplay<ColorDriver>;
+    using PixelDriver = PixelsOnly<ColorDriver>;
+    static Display                       display;
+    static OledColorDisplay<PixelDriver> pixel_display;
+    display.Init(Display::Config());
+    pixel_display.Init(OledColorDisplay<PixelDriver>::Config());
+    display.SetColorFG(31, 0, 0);
+    pixel_display.SetColorFG(31, 0, 0);
+
+    const auto expected = RenderScene(pixel_display);
+    ASSERT_EQ(expected.size(), 128u * 128 * 2);
+    EXPECT_EQ(RenderScene(display), expected);
+
+    transport_log.Clear();
+    display.SetCursor(12, 35);
+    display.WriteString("Fast 42", Font_7x10, true);
+    display.DrawRect(20, 13, 40, 14, true, true);
+    display.Update();
+    EXPECT_TRUE(transport_log.commands.empty());
+}
+
+TEST(dev_OledSSD1351, d_streamDriver)
+{
+    using StreamDriver = SSD1351StreamDriver<128, 128, MockTransport>;
+    static ColorDriver driver;
+    transport_log.Clear();
+    driver.Init(ColorDriver::Config());
+    const auto init_commands = transport_log.commands;
+
+    // the same setup as the framebuffer driver
+    StreamDriver stream;
+    transport_log.Clear();
+    stream.Init(StreamDriver::Config());
+    EXPECT_EQ(transport_log.commands, init_commands);
+    EXPECT_EQ(stream.Width(), 128u);
+
+    // one band of 2 rows, sent high byte first
+    ColorCompositor<128, 2> compositor;
+    compositor.Init(Rgb565(0, 0, 255));
+    transport_log.Clear();
+    compositor.Render(stream, Rectangle(10, 20, 3, 2));
+    const std::vector<uint8_t> expected_commands = {0x15, 0x75, 0x5c};
+    EXPECT_EQ(transport_log.commands, expected_commands);
+    EXPECT_EQ(transport_log.dma_data.size(), 3u * 2 * 2);
+    EXPECT_EQ(transport_log.dma_data[0], 0x00);
+    EXPECT_EQ(transport_log.dma_data[1], 0x1f);
+
+    // the next pixels wait for the running transfer
+    EXPECT_TRUE(stream.IsBusy());
+    EXPECT_FALSE(stream.WritePixelsDma(nullptr, 0));
+    EXPECT_TRUE(FinishDmaTransfer());
+    EXPECT_FALSE(stream.IsBusy());
+}
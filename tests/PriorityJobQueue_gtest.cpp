@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/PriorityJobQueue.h"
+#include "per/i2c.h"
+
+using namespace daisy;
+
+namespace
+{
+struct TestJob
+{
+    int      id;
+    uint8_t  priority;
+    uint32_t deadline;
+};
+
+template <size_t size>
+std::vector<int> PopAll(PriorityJobQueue<TestJob, size>& queue)
+{
+    std::vector<int> ids;
+    TestJob          job;
+    while(queue.Pop(&job))
+        ids.push_back(job.id);
+    return ids;
+}
+} // namespace
+
+TEST(util_PriorityJobQueue, a_fifoForEqualJobs)
+{
+    PriorityJobQueue<TestJob, 4> queue;
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_EQ(queue.Peek(), nullptr);
+    for(int i = 0; i < 4; i++)
+        EXPECT_TRUE(queue.Push({i, 0, 0}));
+    EXPECT_FALSE(queue.Push({4, 0, 0}));
+    EXPECT_EQ(queue.GetNumJobs(), 4u);
+    EXPECT_EQ(queue.Peek()->id, 0);
+
+    const std::vector<int> expected = {0, 1, 2, 3};
+    EXPECT_EQ(PopAll(queue), expected);
+    EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST(util_PriorityJobQueue, b_priorityThenDeadline)
+{
+    PriorityJobQueue<TestJob, 8> queue;
+    queue.Push({0, 0, 0});
+    queue.Push({1, 0, 500});
+    queue.Push({2, 1, 0});
+    queue.Push({3, 0, 200});
+    queue.Push({4, 1, 900});
+    queue.Push({5, 0, 200});
+    // higher priority first, then earliest deadline, then the order of
+    // pushing. Jobs without deadline come last.
+    const std::vector<int> expected = {4, 2, 3, 5, 1, 0};
+    EXPECT_EQ(PopAll(queue), expected);
+}
+
+TEST(util_PriorityJobQueue, c_deadlinesWrapAround)
+{
+    PriorityJobQueue<TestJob, 4> queue;
+    queue.Push({0, 0, 0x00000010});
+    queue.Push({1, 0, 0xfffffff0}); // before the wrap
+    const std::vector<int> expected = {1, 0};
+    EXPECT_EQ(PopAll(queue), expected);
+}
+
+TEST(util_PriorityJobQueue, d_orderKeptWhileOthersPass)
+{
+    // a low priority job waits while many urgent jobs pass through
+    PriorityJobQueue<TestJob, 4> queue;
+    queue.Push({0, 0, 0});
+    TestJob job;
+    for(int i = 0; i < 1000; i++)
+    {
+        queue.Push({100 + i, 1, 0});
+        EXPECT_TRUE(queue.Pop(&job));
+        EXPECT_EQ(job.id, 100 + i);
+    }
+    queue.Push({1, 0, 0});
+    const std::vector<int> expected = {0, 1};
+    EXPECT_EQ(PopAll(queue), expected);
+}
+
+TEST(util_PriorityJobQueue, e_i2cTransactions)
+{
+    PriorityJobQueue<I2CHandle::Transaction, 4> queue;
+    I2CHandle::Transaction                      sensor, leds;
+    sensor.priority = 2;
+    sensor.deadline = 10;
+    leds.priority   = 1;
+    queue.Push(leds);
+    queue.Push(sensor);
+    EXPECT_TRUE(decltype(queue)::IsMoreUrgent(sensor, leds));
+    EXPECT_EQ(queue.Peek()->priority, 2);
+}
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "util/ringbuffer.h"
+
+using namespace daisy;
+
+class util_RingBuffer : public ::testing::Test
+{
+  protected:
+    static constexpr size_t      bufferSize_ = 8;
+    RingBuffer<int, bufferSize_> buffer_;
+};
+constexpr size_t util_RingBuffer::bufferSize_; // requried for C++14...
+
+TEST_F(util_RingBuffer, a_stateAfterInit)
+{
+    EXPECT_EQ(buffer_.capacity(), bufferSize_);
+    EXPECT_EQ(buffer_.readable(), 0u);
+    EXPECT_EQ(buffer_.writable(), bufferSize_);
+    EXPECT_TRUE(buffer_.isEmpty());
+}
+
+TEST_F(util_RingBuffer, b_singleWriteAndRead)
+{
+    // the whole buffer can be filled
+    for(int i = 0; i < int(bufferSize_); i++)
+        EXPECT_TRUE(buffer_.TryWrite(i));
+    EXPECT_FALSE(buffer_.TryWrite(100));
+    EXPECT_EQ(buffer_.readable(), bufferSize_);
+    EXPECT_EQ(buffer_.writable(), 0u);
+
+    int v;
+    for(int i = 0; i < int(bufferSize_); i++)
+    {
+        EXPECT_TRUE(buffer_.TryRead(v));
+        EXPECT_EQ(v, i);
+    }
+    EXPECT_FALSE(buffer_.TryRead(v));
+    EXPECT_TRUE(buffer_.isEmpty());
+    // reading from an empty buffer leaves it unchanged
+    EXPECT_EQ(buffer_.ImmediateRead(), 0);
+    EXPECT_TRUE(buffer_.isEmpty());
+}
+
+TEST_F(util_RingBuffer, c_bulkWriteAndReadWrapAround)
+{
+    const int in[6] = {1, 2, 3, 4, 5, 6};
+    int       out[8];
+    // move the positions close to the end of the storage
+    EXPECT_EQ(buffer_.TryWrite(in, 5), 5u);
+    EXPECT_EQ(buffer_.TryRead(out, 5), 5u);
+
+    // this write and read wrap around
+    EXPECT_EQ(buffer_.TryWrite(in, 6), 6u);
+    EXPECT_EQ(buffer_.TryWrite(in, 6), 2u); // only 2 more fit
+    EXPECT_EQ(buffer_.ImmediateRead(out, 8), 8u);
+    const int expected[8] = {1, 2, 3, 4, 5, 6, 1, 2};
+    for(int i = 0; i < 8; i++)
+        EXPECT_EQ(out[i], expected[i]);
+    EXPECT_EQ(buffer_.ImmediateRead(out, 8), 0u);
+}
+
+TEST_F(util_RingBuffer, d_overwriteDiscardsOldest)
+{
+    for(int i = 0; i < 10; i++)
+        buffer_.Overwrite(i);
+    EXPECT_EQ(buffer_.readable(), bufferSize_);
+    EXPECT_EQ(buffer_.Read(), 2);
+
+    const int in[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    buffer_.Overwrite(in, 3);
+    EXPECT_EQ(buffer_.readable(), bufferSize_);
+    EXPECT_EQ(buffer_.Read(), 5); // 3, 4 were discarded
+
+    // only the last elements of an oversized write are kept
+    buffer_.Overwrite(in, 12);
+    int out[8];
+    EXPECT_EQ(buffer_.TryRead(out, 8), 8u);
+    for(int i = 0; i < 8; i++)
+        EXPECT_EQ(out[i], i + 4);
+}
+
+TEST_F(util_RingBuffer, e_flushAndSwallow)
+{
+    for(int i = 0; i < 6; i++)
+        buffer_.Write(i);
+    buffer_.Swallow(4); // 2 free already, drop 2
+    EXPECT_EQ(buffer_.readable(), 4u);
+    EXPECT_EQ(buffer_.Read(), 2);
+    buffer_.Swallow(1); // enough room, nothing dropped
+    EXPECT_EQ(buffer_.readable(), 3u);
+    buffer_.Flush();
+    EXPECT_TRUE(buffer_.isEmpty());
+    EXPECT_EQ(buffer_.writable(), bufferSize_);
+}
+
+TEST_F(util_RingBuffer, f_prepareAndCommit)
+{
+    for(int i = 0; i < 6; i++)
+        buffer_.Write(i);
+    int out[4];
+    buffer_.TryRead(out, 4);
+
+    // the free space wraps, the first region ends at the end of the storage
+    auto w = buffer_.PrepareWrite();
+    EXPECT_EQ(w.length, 2u);
+    w.data[0] = 6;
+    w.data[1] = 7;
+    buffer_.CommitWrite(2);
+    w = buffer_.PrepareWrite();
+    EXPECT_EQ(w.length, 4u);
+    EXPECT_EQ(w.data, buffer_.GetMutableBuffer());
+    w.data[0] = 8;
+    buffer_.CommitWrite(1);
+    EXPECT_EQ(buffer_.readable(), 5u);
+
+    auto r = buffer_.PrepareRead();
+    ASSERT_EQ(r.length, 4u);
+    for(size_t i = 0; i < r.length; i++)
+        EXPECT_EQ(r.data[i], int(i) + 4);
+    buffer_.CommitRead(r.length);
+    r = buffer_.PrepareRead();
+    ASSERT_EQ(r.length, 1u);
+    EXPECT_EQ(r.data[0], 8);
+    buffer_.CommitRead(1);
+    EXPECT_TRUE(buffer_.isEmpty());
+
+    // Advance is clamped to the free space
+    buffer_.Advance(100);
+    EXPECT_EQ(buffer_.readable(), bufferSize_);
+}
+
+TEST(util_RingBufferThreads, a_singleElementStress)
+{
+    constexpr uint32_t              numElements = 1000000;
+    static RingBuffer<uint32_t, 64> buffer;
+    buffer.Init();
+
+    // yield instead of spinning, so that this also runs on a single core
+    std::thread producer([&]() {
+        for(uint32_t i = 0; i < numElements; i++)
+            while(!buffer.TryWrite(i))
+                std::this_thread::yield();
+    });
+
+    uint32_t errors = 0;
+    for(uint32_t i = 0; i < numElements; i++)
+    {
+        uint32_t v;
+        while(!buffer.TryRead(v))
+            std::this_thread::yield();
+        errors += v != i;
+    }
+    producer.join();
+
+    EXPECT_EQ(errors, 0u);
+    EXPECT_TRUE(buffer.isEmpty());
+}
+
+TEST(util_RingBufferThreads, b_bulkAndSpanStress)
+{
+    constexpr uint32_t               numElements = 1000000;
+    static RingBuffer<uint32_t, 256> buffer;
+    buffer.Init();
+
+    // the producer alternates between bulk writes and writing in place
+    std::thread producer([&]() {
+        uint32_t next = 0;
+        uint32_t chunk[37];
+        bool     inPlace = false;
+        while(next < numElements)
+        {
+            if(inPlace)
+            {
+                auto   span = buffer.PrepareWrite();
+                size_t n
+                    = std::min<size_t>(span.length, numElements - next);
+                for(size_t i = 0; i < n; i++)
+                    span.data[i] = next++;
+                buffer.CommitWrite(n);
+            }
+            else
+            {
+                size_t n = std::min<size_t>(37, numElements - next);
+                for(size_t i = 0; i < n; i++)
+                    chunk[i] = next + i;
+                next += buffer.TryWrite(chunk, n);
+            }
+            inPlace = !inPlace;
+            std::this_thread::yield();
+        }
+    });
+
+    // the consumer alternates between bulk reads and reading in place
+    uint32_t expected = 0;
+    uint32_t errors   = 0;
+    uint32_t chunk[29];
+    bool     inPlace = false;
+    while(expected < numElements)
+    {
+        if(inPlace)
+        {
+            auto span = buffer.PrepareRead();
+            for(size_t i = 0; i < span.length; i++)
+                errors += span.data[i] != expected++;
+            buffer.CommitRead(span.length);
+        }
+        else
+        {
+            size_t n = buffer.TryRead(chunk, 29);
+            for(size_t i = 0; i < n; i++)
+                errors += chunk[i] != expected++;
+        }
+        inPlace = !inPlace;
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    EXPECT_EQ(errors, 0u);
+    EXPECT_EQ(expected, numElements);
+    EXPECT_TRUE(buffer.isEmpty());
+}
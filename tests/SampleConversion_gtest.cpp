@@ -0,0 +1,136 @@
+#include "util/SampleConversion.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+// odd length, so the unrolled loops and their remainder both run
+constexpr size_t kNumSamples = 67;
+
+std::vector<float> MakeSignal()
+{
+    std::vector<float> sig(kNumSamples);
+    for(size_t i = 0; i < kNumSamples; i++)
+        sig[i] = -1.2f + 2.4f * i / (kNumSamples - 1);
+    return sig;
+}
+} // namespace
+
+TEST(util_SampleConversion, a_matchesScalarConversion16)
+{
+    const auto           sig = MakeSignal();
+    std::vector<int32_t> ints(kNumSamples);
+    std::vector<float>   floats(kNumSamples);
+    SampleConversion<16>::FromFloat(sig.data(), ints.data(), kNumSamples);
+    SampleConversion<16>::ToFloat(ints.data(), floats.data(), kNumSamples);
+    for(size_t i = 0; i < kNumSamples; i++)
+    {
+        EXPECT_EQ(ints[i], f2s16(sig[i]));
+        EXPECT_FLOAT_EQ(floats[i], s162f(ints[i]));
+    }
+}
+
+TEST(util_SampleConversion, b_matchesScalarConversion24)
+{
+    const auto           sig = MakeSignal();
+    std::vector<int32_t> ints(kNumSamples);
+    std::vector<float>   floats(kNumSamples);
+    SampleConversion<24>::FromFloat(sig.data(), ints.data(), kNumSamples);
+    for(size_t i = 0; i < kNumSamples; i++)
+    {
+        EXPECT_EQ(ints[i], f2s24(sig[i]));
+        // the SAI delivers 24 bit words with the upper byte cleared
+        ints[i] &= 0x00ffffff;
+    }
+    SampleConversion<24>::ToFloat(ints.data(), floats.data(), kNumSamples);
+    for(size_t i = 0; i < kNumSamples; i++)
+        EXPECT_FLOAT_EQ(floats[i], s242f(ints[i]));
+}
+
+TEST(util_SampleConversion, c_matchesScalarConversion32)
+{
+    const auto           sig = MakeSignal();
+    std::vector<int32_t> ints(kNumSamples);
+    std::vector<float>   floats(kNumSamples);
+    SampleConversion<32>::FromFloat(sig.data(), ints.data(), kNumSamples);
+    SampleConversion<32>::ToFloat(ints.data(), floats.data(), kNumSamples);
+    for(size_t i = 0; i < kNumSamples; i++)
+    {
+        EXPECT_EQ(ints[i], f2s32(sig[i]));
+        EXPECT_FLOAT_EQ(floats[i], s322f(ints[i]));
+    }
+}
+
+TEST(util_SampleConversion, d_gainIsApplied)
+{
+    const int32_t in[4] = {0x100000, -0x100000, 0x200000, 0x7fffff};
+    float         out[4];
+    SampleConversion<24>::ToFloat(in, out, 4, 0.5f);
+    EXPECT_FLOAT_EQ(out[0], 0.0625f);
+    EXPECT_FLOAT_EQ(out[1], -0.0625f);
+    EXPECT_FLOAT_EQ(out[2], 0.125f);
+
+    const float f[4] = {0.25f, -0.25f, 0.6f, -0.6f};
+    int32_t     ints[4];
+    SampleConversion<16>::FromFloat(f, ints, 4, 2.f);
+    EXPECT_EQ(ints[0], f2s16(0.5f));
+    EXPECT_EQ(ints[1], f2s16(-0.5f));
+    // saturates
+    EXPECT_EQ(ints[2], f2s16(1.f));
+    EXPECT_EQ(ints[3], f2s16(-1.f));
+}
+
+TEST(util_SampleConversion, e_deinterleaveAndInterleave)
+{
+    for(size_t chns = 1; chns <= 8; chns++)
+    {
+        const size_t         frames = 13;
+        std::vector<int32_t> in(frames * chns);
+        for(size_t i = 0; i < in.size(); i++)
+            in[i] = int32_t(i) * 1000 - 20000;
+
+        std::vector<float>  buff(frames * chns);
+        std::vector<float*> chn_ptrs(chns);
+        for(size_t c = 0; c < chns; c++)
+            chn_ptrs[c] = buff.data() + c * frames;
+
+        SampleConversion<32>::DeinterleaveToFloat(
+            in.data(), chn_ptrs.data(), frames, chns);
+        for(size_t f = 0; f < frames; f++)
+            for(size_t c = 0; c < chns; c++)
+                EXPECT_FLOAT_EQ(chn_ptrs[c][f], s322f(in[f * chns + c]));
+
+        std::vector<int32_t> out(frames * chns);
+        SampleConversion<32>::InterleaveFromFloat(
+            chn_ptrs.data(), out.data(), frames, chns);
+        for(size_t i = 0; i < in.size(); i++)
+            EXPECT_NEAR(out[i], in[i], 1);
+    }
+}
+
+TEST(util_SampleConversion, f_saturatingVersion)
+{
+    // the arithmetic of the Cortex-M7 version, with SSAT emulated
+    for(float x : MakeSignal())
+    {
+        const bool    in_range = x > FBIPMIN && x < FBIPMAX;
+        const int32_t s16      = SampleConversion<16>::FromFloatSaturating(x);
+        const int32_t s24      = SampleConversion<24>::FromFloatSaturating(x);
+        EXPECT_EQ(SampleConversion<32>::FromFloatSaturating(x), f2s32(x));
+        if(in_range)
+        {
+            EXPECT_EQ(s16, f2s16(x)) << x;
+            EXPECT_EQ(s24, f2s24(x)) << x;
+        }
+        else
+        {
+            EXPECT_EQ(s16, x > 0.f ? 32767 : -32768) << x;
+            EXPECT_EQ(s24, x > 0.f ? 8388607 : -8388608) << x;
+        }
+    }
+    EXPECT_EQ(SampleConversion<16>::FromFloatSaturating(1e30f), 32767);
+    EXPECT_EQ(SampleConversion<24>::FromFloatSaturating(-1e30f), -8388608);
+    EXPECT_EQ(SampleConversion<32>::FromFloatSaturating(1e30f), f2s32(1.f));
+}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "util/ScanListScheduler.h"
+#include "per/spiMultislave.h"
+
+using namespace daisy;
+
+namespace
+{
+struct TestJob
+{
+    size_t   device_index = 0;
+    uint8_t* tx_data      = nullptr;
+    uint8_t* rx_data      = nullptr;
+    size_t   size         = 0;
+    uint8_t  priority     = 0;
+    uint32_t deadline     = 0;
+};
+
+struct TestStep
+{
+    size_t   device_index;
+    uint8_t* tx_data[2];
+    uint8_t* rx_data[2];
+    size_t   size;
+};
+
+using Scheduler = ScanListScheduler<TestJob, TestStep, 4>;
+
+TestJob MakeJob(size_t device_index, uint8_t priority)
+{
+    TestJob job;
+    job.device_index = device_index;
+    job.size         = 1;
+    job.priority     = priority;
+    return job;
+}
+
+/** Runs the scheduler until it's idle or max_jobs were started. Queued jobs
+ *  are recorded with their device index, scan steps with 100 + the device
+ *  index, finished passes with -1 - the buffer index.
+ */
+std::vector<int> RunJobs(Scheduler& scheduler, size_t max_jobs = 100)
+{
+    std::vector<int> log;
+    TestJob          job;
+    bool             is_scan_step;
+    while(max_jobs-- > 0 && scheduler.GetNextJob(&job, &is_scan_step))
+    {
+        if(!is_scan_step)
+        {
+            log.push_back(int(job.device_index));
+            continue;
+        }
+        log.push_back(100 + int(job.device_index));
+        size_t buffer_index;
+        bool   pass_ok;
+        if(scheduler.FinishScanStep(true, &buffer_index, &pass_ok))
+            log.push_back(-1 - int(buffer_index));
+    }
+    return log;
+}
+} // namespace
+
+TEST(util_ScanListScheduler, a_queuedJobsOnly)
+{
+    Scheduler scheduler;
+    TestJob   job;
+    bool      is_scan_step;
+    EXPECT_FALSE(scheduler.GetNextJob(&job, &is_scan_step));
+    for(size_t i = 0; i < 4; i++)
+        EXPECT_TRUE(scheduler.Queue(MakeJob(i, i == 2 ? 1 : 0)));
+    EXPECT_FALSE(scheduler.Queue(MakeJob(4, 0)));
+    EXPECT_EQ(scheduler.GetNumQueuedJobs(), 4u);
+
+    const std::vector<int> expected = {2, 0, 1, 3};
+    EXPECT_EQ(RunJobs(scheduler), expected);
+    EXPECT_EQ(scheduler.GetNumQueuedJobs(), 0u);
+}
+
+TEST(util_ScanListScheduler, b_priorityBetweenSteps)
+{
+    uint8_t        buf[4];
+    const TestStep steps[3] = {{0, {buf, nullptr}, {nullptr, nullptr}, 1},
+                               {1, {buf, nullptr}, {nullptr, nullptr}, 1},
+                               {2, {buf, nullptr}, {nullptr, nullptr}, 1}};
+    Scheduler      scheduler;
+    scheduler.StartScanList(steps, 3, false, 1);
+
+    // an urgent job runs between two steps, jobs of the same or a lower
+    // priority wait for the end of the pass
+    TestJob job;
+    bool    is_scan_step;
+    ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+    EXPECT_TRUE(is_scan_step);
+    EXPECT_EQ(job.priority, 1);
+    size_t buffer_index;
+    bool   pass_ok;
+    EXPECT_FALSE(scheduler.FinishScanStep(true, &buffer_index, &pass_ok));
+
+    scheduler.Queue(MakeJob(7, 1));
+    scheduler.Queue(MakeJob(6, 0));
+    scheduler.Queue(MakeJob(5, 2));
+    const std::vector<int> expected = {5, 101, 102, -1, 7, 6};
+    EXPECT_EQ(RunJobs(scheduler), expected);
+    EXPECT_FALSE(scheduler.IsScanRunning());
+}
+
+TEST(util_ScanListScheduler, c_continuousPassDefersToQueuedJobs)
+{
+    uint8_t        buf[4];
+    const TestStep steps[2] = {{0, {buf, nullptr}, {nullptr, nullptr}, 1},
+                               {1, {buf, nullptr}, {nullptr, nullptr}, 1}};
+    Scheduler      scheduler;
+    scheduler.StartScanList(steps, 2, true, 1);
+
+    // a continuous list of a higher priority would starve the queue, so the
+    // jobs queued during a pass run before the next one
+    TestJob job;
+    bool    is_scan_step;
+    ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+    scheduler.Queue(MakeJob(7, 0));
+    scheduler.Queue(MakeJob(6, 0));
+    size_t buffer_index;
+    bool   pass_ok;
+    scheduler.FinishScanStep(true, &buffer_index, &pass_ok);
+
+    const std::vector<int> expected
+        = {101, -1, 7, 6, 100, 101, -2, 100, 101, -1};
+    EXPECT_EQ(RunJobs(scheduler, 7), expected);
+
+    // jobs queued after the pass ended wait for the next one
+    scheduler.Queue(MakeJob(5, 0));
+    const std::vector<int> expected2 = {100, 101, -2, 5};
+    EXPECT_EQ(RunJobs(scheduler, 3), expected2);
+    EXPECT_TRUE(scheduler.IsScanRunning());
+    EXPECT_EQ(scheduler.GetNumOverruns(), 0u);
+}
+
+TEST(util_ScanListScheduler, d_doubleBuffers)
+{
+    uint8_t        tx[2][4], rx[2][4], cmd[1];
+    const TestStep steps[2] = {{0, {tx[0], tx[1]}, {rx[0], rx[1]}, 4},
+                               {1, {cmd, nullptr}, {nullptr, nullptr}, 1}};
+    Scheduler      scheduler;
+    scheduler.StartScanList(steps, 2, true, 0);
+
+    for(size_t pass = 0; pass < 4; pass++)
+    {
+        const size_t i = pass % 2;
+        EXPECT_EQ(scheduler.GetScanBufferIndex(), i);
+
+        TestJob job;
+        bool    is_scan_step;
+        size_t  buffer_index;
+        bool    pass_ok;
+        ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+        EXPECT_EQ(job.tx_data, tx[i]);
+        EXPECT_EQ(job.rx_data, rx[i]);
+        EXPECT_EQ(job.size, 4u);
+        EXPECT_FALSE(scheduler.FinishScanStep(true, &buffer_index, &pass_ok));
+
+        // a step without a second buffer uses the first in every pass
+        ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+        EXPECT_EQ(job.tx_data, cmd);
+        EXPECT_EQ(job.rx_data, nullptr);
+        // a failed step fails its pass only
+        const bool ok = pass != 1;
+        EXPECT_TRUE(scheduler.FinishScanStep(ok, &buffer_index, &pass_ok));
+        EXPECT_EQ(buffer_index, i);
+        EXPECT_EQ(pass_ok, ok);
+    }
+}
+
+TEST(util_ScanListScheduler, e_triggerAndOverruns)
+{
+    uint8_t        buf[4];
+    const TestStep steps[2] = {{0, {buf, nullptr}, {nullptr, nullptr}, 1},
+                               {1, {buf, nullptr}, {nullptr, nullptr}, 1}};
+    Scheduler      scheduler;
+    EXPECT_FALSE(scheduler.Trigger()); // no scan list
+
+    scheduler.StartScanList(steps, 2, false, 0);
+    const std::vector<int> pass0 = {100, 101, -1};
+    const std::vector<int> pass1 = {100, 101, -2};
+    EXPECT_EQ(RunJobs(scheduler), pass0);
+    EXPECT_TRUE(RunJobs(scheduler).empty()); // waits for the trigger
+
+    EXPECT_TRUE(scheduler.Trigger());
+    EXPECT_EQ(RunJobs(scheduler, 1), std::vector<int>{100});
+    // triggers while the pass runs are skipped and counted
+    EXPECT_FALSE(scheduler.Trigger());
+    EXPECT_FALSE(scheduler.Trigger());
+    EXPECT_EQ(scheduler.GetNumOverruns(), 2u);
+    EXPECT_EQ(RunJobs(scheduler), std::vector<int>({101, -2}));
+
+    EXPECT_TRUE(scheduler.Trigger());
+    EXPECT_EQ(RunJobs(scheduler), pass0);
+    EXPECT_TRUE(scheduler.Trigger());
+    EXPECT_EQ(RunJobs(scheduler), pass1);
+    EXPECT_EQ(scheduler.GetNumOverruns(), 2u);
+
+    // stopping removes the list
+    scheduler.StopScanList();
+    EXPECT_FALSE(scheduler.Trigger());
+    EXPECT_TRUE(RunJobs(scheduler).empty());
+
+    // a new list starts with buffer 0 and no overruns
+    scheduler.StartScanList(steps, 2, false, 0);
+    EXPECT_EQ(scheduler.GetNumOverruns(), 0u);
+    EXPECT_EQ(RunJobs(scheduler), pass0);
+}
+
+TEST(util_ScanListScheduler, f_multiSlaveSpiTypes)
+{
+    // the scheduler of MultiSlaveSpiHandle
+    using Spi = MultiSlaveSpiHandle;
+    ScanListScheduler<Spi::Transaction, Spi::ScanStep, 2> scheduler;
+
+    uint8_t        tx[2][2];
+    const Spi::ScanStep step = {1, {tx[0], tx[1]}, {nullptr, nullptr}, 2};
+    scheduler.StartScanList(&step, 1, true, 0);
+
+    Spi::Transaction job;
+    job.device_index = 2;
+    job.tx_data      = tx[0];
+    job.size         = 1;
+    job.priority     = 1;
+    EXPECT_TRUE(scheduler.Queue(job));
+
+    bool is_scan_step;
+    ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+    EXPECT_FALSE(is_scan_step);
+    EXPECT_EQ(job.device_index, 2u);
+    ASSERT_TRUE(scheduler.GetNextJob(&job, &is_scan_step));
+    EXPECT_TRUE(is_scan_step);
+    EXPECT_EQ(job.device_index, 1u);
+    EXPECT_EQ(job.tx_data, tx[0]);
+}
@@ -0,0 +1,328 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "dev/sensor_sampling.h"
+#include "sys/system.h"
+#include "dev/mpr121.h"
+#include "dev/apds9960.h"
+#include "dev/tlv493d.h"
+
+using namespace daisy;
+
+namespace
+{
+struct TestSample
+{
+    int32_t  value;
+    uint32_t check; // ~value, to detect torn copies
+};
+
+/** Completes reads when the test says so, like an interrupt would */
+class FakeTransport
+{
+  public:
+    bool ReadRegAsync(uint8_t                       *reg,
+                      uint8_t                       *buff,
+                      uint16_t                       size,
+                      I2CHandle::CallbackFunctionPtr callback,
+                      void                          *context)
+    {
+        if(fail_queue)
+            return false;
+        reg_      = *reg;
+        buff_     = buff;
+        size_     = size;
+        callback_ = callback;
+        context_  = context;
+        num_reads++;
+        return true;
+    }
+
+    void Complete(uint8_t first_byte, bool ok = true)
+    {
+        for(uint16_t i = 0; i < size_; i++)
+            buff_[i] = uint8_t(first_byte + i);
+        callback_(context_, ok ? I2CHandle::Result::OK : I2CHandle::Result::ERR);
+    }
+
+    void CompleteWith(const uint8_t *data)
+    {
+        memcpy(buff_, data, size_);
+        callback_(context_, I2CHandle::Result::OK);
+    }
+
+    uint8_t  GetReg() const { return reg_; }
+    uint16_t GetSize() const { return size_; }
+
+    bool fail_queue = false;
+    int  num_reads  = 0;
+
+  private:
+    uint8_t                        reg_;
+    uint8_t                       *buff_;
+    uint16_t                       size_;
+    I2CHandle::CallbackFunctionPtr callback_;
+    void                          *context_;
+};
+
+/** Answers the blocking transfers of a driver's Init() with zeros */
+class FakeSensorTransport : public FakeTransport
+{
+  public:
+    struct Config
+    {
+    };
+
+    /** Returns the transport that was initialized last */
+    static FakeSensorTransport *&Last()
+    {
+        static FakeSensorTransport *last = nullptr;
+        return last;
+    }
+
+    bool Init(Config)
+    {
+        Last() = this;
+        return false;
+    }
+    bool Write(uint8_t *, uint16_t) { return false; }
+    bool Read(uint8_t *data, uint16_t size)
+    {
+        memset(data, 0, size);
+        return false;
+    }
+    void    WriteAddress(uint8_t, uint8_t *, uint16_t) {}
+    bool    GetError() { return false; }
+    uint8_t GetAddress() { return TLV493D_ADDRESS1; }
+};
+
+void DecodeSum(const uint8_t *data, TestSample &sample, void *context)
+{
+    int32_t sum = *static_cast<int32_t *>(context);
+    for(int i = 0; i < 4; i++)
+        sum += data[i];
+    sample.value = sum;
+    sample.check = ~uint32_t(sum);
+}
+
+void CountDone(void *context, bool ok)
+{
+    *static_cast<int *>(context) += ok ? 1 : 100;
+}
+} // namespace
+
+TEST(dev_SampleSnapshot, a_readsLatest)
+{
+    SampleSnapshot<TestSample> snapshot;
+    TestSample                 sample;
+    EXPECT_FALSE(snapshot.Read(sample));
+    EXPECT_EQ(snapshot.GetCount(), 0u);
+
+    snapshot.Write({1, ~1u});
+    snapshot.Write({2, ~2u});
+    EXPECT_TRUE(snapshot.Read(sample));
+    EXPECT_EQ(sample.value, 2);
+    EXPECT_EQ(snapshot.GetCount(), 2u);
+
+    snapshot.BeginWrite() = {3, ~3u};
+    // not published yet
+    EXPECT_TRUE(snapshot.Read(sample));
+    EXPECT_EQ(sample.value, 2);
+    snapshot.EndWrite();
+    EXPECT_TRUE(snapshot.Read(sample));
+    EXPECT_EQ(sample.value, 3);
+
+    snapshot.Reset();
+    EXPECT_FALSE(snapshot.Read(sample));
+}
+
+TEST(dev_SampleSnapshot, b_noTornReads)
+{
+    // the writer stands in for the interrupt, the test thread for the main
+    // loop. Every sample read must be complete.
+    static SampleSnapshot<TestSample> snapshot;
+    snapshot.Reset();
+    constexpr int32_t numSamples = 200000;
+
+    std::atomic<bool> done{false};
+    std::thread       writer([&]() {
+        for(int32_t i = 1; i <= numSamples; i++)
+        {
+            TestSample &sample = snapshot.BeginWrite();
+            sample.value       = i;
+            sample.check       = ~uint32_t(i);
+            snapshot.EndWrite();
+        }
+        done = true;
+    });
+
+    uint32_t   errors = 0;
+    int32_t    last   = 0;
+    TestSample sample;
+    while(!done)
+    {
+        if(!snapshot.Read(sample))
+            continue;
+        errors += sample.check != ~uint32_t(sample.value);
+        errors += sample.value < last;
+        last = sample.value;
+    }
+    writer.join();
+
+    EXPECT_EQ(errors, 0u);
+    EXPECT_TRUE(snapshot.Read(sample));
+    EXPECT_EQ(sample.value, numSamples);
+}
+
+TEST(dev_SensorSamplingSession, a_startAndComplete)
+{
+    FakeTransport                                     transport;
+    SensorSamplingSession<FakeTransport, TestSample, 4> session;
+    int32_t                                           offset = 1000;
+    int                                               done   = 0;
+    TestSample                                        sample;
+
+    // not initialized
+    EXPECT_FALSE(session.Start());
+
+    session.Init(&transport, 0x2D, &DecodeSum, &offset);
+    EXPECT_FALSE(session.GetLatest(sample));
+    EXPECT_TRUE(session.Start(&CountDone, &done));
+    EXPECT_TRUE(session.IsBusy());
+    EXPECT_EQ(transport.GetReg(), 0x2D);
+
+    // one read at a time
+    EXPECT_FALSE(session.Start(&CountDone, &done));
+    EXPECT_EQ(transport.num_reads, 1);
+
+    transport.Complete(10);
+    EXPECT_FALSE(session.IsBusy());
+    EXPECT_EQ(done, 1);
+    EXPECT_TRUE(session.GetLatest(sample));
+    EXPECT_EQ(sample.value, 1000 + 10 + 11 + 12 + 13);
+    EXPECT_EQ(session.GetNumSamples(), 1u);
+
+    // the next read can be started from the callback
+    EXPECT_TRUE(session.Start());
+    transport.Complete(0);
+    EXPECT_TRUE(session.GetLatest(sample));
+    EXPECT_EQ(sample.value, 1000 + 0 + 1 + 2 + 3);
+    EXPECT_EQ(session.GetNumSamples(), 2u);
+    EXPECT_EQ(session.GetNumErrors(), 0u);
+}
+
+TEST(dev_SensorSamplingSession, b_errorsKeepLastSample)
+{
+    FakeTransport                                     transport;
+    SensorSamplingSession<FakeTransport, TestSample, 4> session;
+    int32_t                                           offset = 0;
+    int                                               done   = 0;
+    TestSample                                        sample;
+
+    session.Init(&transport, 0x00, &DecodeSum, &offset);
+    session.Start();
+    transport.Complete(1);
+
+    // a failed transfer is reported but doesn't replace the sample
+    EXPECT_TRUE(session.Start(&CountDone, &done));
+    transport.Complete(50, false);
+    EXPECT_EQ(done, 100);
+    EXPECT_FALSE(session.IsBusy());
+    EXPECT_TRUE(session.GetLatest(sample));
+    EXPECT_EQ(sample.value, 1 + 2 + 3 + 4);
+
+    // as is one that couldn't be queued
+    transport.fail_queue = true;
+    EXPECT_FALSE(session.Start(&CountDone, &done));
+    EXPECT_FALSE(session.IsBusy());
+    EXPECT_EQ(done, 100);
+    EXPECT_EQ(session.GetNumErrors(), 2u);
+    EXPECT_EQ(session.GetNumSamples(), 1u);
+}
+
+TEST(dev_SensorSamplingSession, c_mpr121)
+{
+    static Mpr121<FakeSensorTransport> mpr121;
+    EXPECT_EQ(mpr121.Init({}), Mpr121<FakeSensorTransport>::OK);
+    FakeSensorTransport &transport = *FakeSensorTransport::Last();
+
+    EXPECT_TRUE(mpr121.StartSampling());
+    EXPECT_TRUE(mpr121.IsSampling());
+    EXPECT_EQ(transport.GetReg(), 0x00); // TOUCHSTATUS_L
+    ASSERT_EQ(transport.GetSize(), 30);
+
+    uint8_t data[30] = {};
+    data[0]          = 0x05; // touch status, bits 12..15 aren't channels
+    data[1]          = 0xf1;
+    data[4 + 2 * 3]  = 0x34; // channel 3
+    data[5 + 2 * 3]  = 0x02;
+    data[4 + 2 * 12] = 0xff; // channel 12
+    data[5 + 2 * 12] = 0x03;
+    transport.CompleteWith(data);
+
+    Mpr121<FakeSensorTransport>::Sample sample;
+    EXPECT_FALSE(mpr121.IsSampling());
+    ASSERT_TRUE(mpr121.GetLatestSample(sample));
+    EXPECT_EQ(sample.touched, 0x105);
+    EXPECT_EQ(sample.filtered[0], 0);
+    EXPECT_EQ(sample.filtered[3], 0x234);
+    EXPECT_EQ(sample.filtered[12], 0x3ff);
+    EXPECT_EQ(mpr121.GetNumSamples(), 1u);
+}
+
+TEST(dev_SensorSamplingSession, d_apds9960)
+{
+    static Apds9960<FakeSensorTransport> apds;
+    EXPECT_EQ(apds.Init({}), Apds9960<FakeSensorTransport>::OK);
+    FakeSensorTransport &transport = *FakeSensorTransport::Last();
+
+    EXPECT_TRUE(apds.StartSampling());
+    EXPECT_EQ(transport.GetReg(), APDS9960_STATUS);
+    ASSERT_EQ(transport.GetSize(), 10);
+
+    // status, clear, red, green, blue, proximity
+    const uint8_t data[10]
+        = {0x01, 0x02, 0x01, 0x04, 0x03, 0x06, 0x05, 0x08, 0x07, 77};
+    transport.CompleteWith(data);
+
+    Apds9960<FakeSensorTransport>::Sample sample;
+    ASSERT_TRUE(apds.GetLatestSample(sample));
+    EXPECT_TRUE(sample.color_valid);
+    EXPECT_FALSE(sample.proximity_valid);
+    EXPECT_EQ(sample.clear, 0x0102);
+    EXPECT_EQ(sample.red, 0x0304);
+    EXPECT_EQ(sample.green, 0x0506);
+    EXPECT_EQ(sample.blue, 0x0708);
+    EXPECT_EQ(sample.proximity, 77);
+}
+
+TEST(dev_SensorSamplingSession, e_tlv493d)
+{
+    static Tlv493d<FakeSensorTransport> tlv;
+    EXPECT_EQ(tlv.Init({}), Tlv493d<FakeSensorTransport>::OK);
+    FakeSensorTransport &transport = *FakeSensorTransport::Last();
+
+    EXPECT_TRUE(tlv.StartSampling());
+    ASSERT_EQ(transport.GetSize(), TLV493D_MEASUREMENT_READOUT);
+
+    // 12 bit values: the high bytes, then the low nibbles packed
+    const uint8_t data[7] = {
+        0x10, // Bx high
+        0xff, // By high
+        0x00, // Bz high
+        0x10, // temperature high nibble
+        0x2f, // Bx, By low nibbles
+        0x05, // Bz low nibble
+        0x40, // temperature low byte
+    };
+    transport.CompleteWith(data);
+
+    Tlv493d<FakeSensorTransport>::Sample sample;
+    ASSERT_TRUE(tlv.GetLatestSample(sample));
+    EXPECT_FLOAT_EQ(sample.x, 0x102 * TLV493D_B_MULT);
+    EXPECT_FLOAT_EQ(sample.y, -1 * TLV493D_B_MULT);
+    EXPECT_FLOAT_EQ(sample.z, 5 * TLV493D_B_MULT);
+    EXPECT_NEAR(sample.temperature, (0x140 - 315) * 1.1f, 1e-4f);
+}
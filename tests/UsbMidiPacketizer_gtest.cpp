@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "hid/usb_midi_packetizer.h"
+
+using namespace daisy;
+
+namespace
+{
+using Bytes = std::vector<uint8_t>;
+
+class UsbMidiPacketizerTest : public ::testing::Test
+{
+  protected:
+    /** Converts the bytes in one go and returns the packets */
+    Bytes Packetize(const Bytes& bytes, size_t max_size = 1024)
+    {
+        Bytes  packets(max_size);
+        size_t size = 0;
+        consumed_   = packetizer_.Packetize(
+            bytes.data(), bytes.size(), packets.data(), max_size, size);
+        packets.resize(size);
+        return packets;
+    }
+
+    UsbMidiPacketizer packetizer_;
+    size_t            consumed_ = 0;
+};
+} // namespace
+
+TEST_F(UsbMidiPacketizerTest, channelMessages)
+{
+    EXPECT_EQ(
+        Packetize({0x93, 60, 100, 0xc1, 5, 0xe2, 0, 64}),
+        Bytes({0x09, 0x93, 60, 100, 0x0c, 0xc1, 5, 0, 0x0e, 0xe2, 0, 64}));
+}
+
+TEST_F(UsbMidiPacketizerTest, runningStatus)
+{
+    EXPECT_EQ(Packetize({0x90, 60, 100, 64, 100, 67}),
+              Bytes({0x09, 0x90, 60, 100, 0x09, 0x90, 64, 100}));
+    // the message continues in the next call
+    EXPECT_EQ(
+        Packetize({100, 0xd0, 10, 20}),
+        Bytes({0x09, 0x90, 67, 100, 0x0d, 0xd0, 10, 0, 0x0d, 0xd0, 20, 0}));
+}
+
+TEST_F(UsbMidiPacketizerTest, systemMessages)
+{
+    EXPECT_EQ(Packetize({0xf2, 1, 2, 0xf3, 4, 0xf1, 5, 0xf6}),
+              Bytes({0x03, 0xf2, 1, 2, 0x02, 0xf3, 4, 0, 0x02, 0xf1, 5, 0,
+                     0x05, 0xf6, 0, 0}));
+    // system common messages cancel running status
+    EXPECT_EQ(Packetize({0x90, 60, 100, 0xf3, 1, 62, 100}),
+              Bytes({0x09, 0x90, 60, 100, 0x02, 0xf3, 1, 0}));
+}
+
+TEST_F(UsbMidiPacketizerTest, realTimeInsideMessages)
+{
+    EXPECT_EQ(Packetize({0x90, 60, 0xf8, 100, 62, 0xfa, 100}),
+              Bytes({0x0f, 0xf8, 0, 0, 0x09, 0x90, 60, 100, 0x0f, 0xfa, 0, 0,
+                     0x09, 0x90, 62, 100}));
+}
+
+TEST_F(UsbMidiPacketizerTest, sysEx)
+{
+    EXPECT_EQ(Packetize({0xf0, 0x7d, 0xf7}), Bytes({0x07, 0xf0, 0x7d, 0xf7}));
+    EXPECT_EQ(Packetize({0xf0, 0xf7}), Bytes({0x06, 0xf0, 0xf7, 0}));
+    EXPECT_EQ(Packetize({0xf0, 1, 2, 3, 0xf7}),
+              Bytes({0x04, 0xf0, 1, 2, 0x06, 3, 0xf7, 0}));
+    EXPECT_EQ(Packetize({0xf0, 1, 2, 3, 4, 0xf7}),
+              Bytes({0x04, 0xf0, 1, 2, 0x07, 3, 4, 0xf7}));
+    EXPECT_EQ(Packetize({0xf0, 1, 2, 3, 4, 5, 0xf7}),
+              Bytes({0x04, 0xf0, 1, 2, 0x04, 3, 4, 5, 0x05, 0xf7, 0, 0}));
+}
+
+TEST_F(UsbMidiPacketizerTest, sysExSplitOverCalls)
+{
+    EXPECT_EQ(Packetize({0xf0, 1, 2, 3}), Bytes({0x04, 0xf0, 1, 2}));
+    EXPECT_EQ(Packetize({4, 5}), Bytes({0x04, 3, 4, 5}));
+    EXPECT_EQ(Packetize({6, 0xf7}), Bytes({0x06, 6, 0xf7, 0}));
+}
+
+TEST_F(UsbMidiPacketizerTest, skipsMalformedData)
+{
+    // data without status, unfinished message, stray end of SysEx
+    EXPECT_EQ(Packetize({1, 2, 0x90, 60, 0xf7, 0xb0, 7, 100}),
+              Bytes({0x0b, 0xb0, 7, 100}));
+    // an unfinished SysEx is dropped
+    EXPECT_EQ(Packetize({0xf0, 1, 2, 3, 4, 0x80, 60, 0}),
+              Bytes({0x04, 0xf0, 1, 2, 0x08, 0x80, 60, 0}));
+}
+
+TEST_F(UsbMidiPacketizerTest, stopsWhenFull)
+{
+    const Bytes notes = {0x90, 60, 100, 62, 100, 64, 100};
+    EXPECT_EQ(Packetize(notes, 9),
+              Bytes({0x09, 0x90, 60, 100, 0x09, 0x90, 62, 100}));
+    EXPECT_EQ(consumed_, 5u);
+
+    EXPECT_EQ(Packetize(Bytes(notes.begin() + 5, notes.end())),
+              Bytes({0x09, 0x90, 64, 100}));
+}
+
+TEST_F(UsbMidiPacketizerTest, batchesLargeDumps)
+{
+    // A 1000 byte SysEx dump in 256 byte transfers, as the USB transport
+    // sends it
+    Bytes dump = {0xf0};
+    for(int i = 0; i < 998; i++)
+        dump.push_back(i & 0x7f);
+    dump.push_back(0xf7);
+
+    Bytes  received;
+    size_t done = 0, transfers = 0;
+    while(done < dump.size())
+    {
+        uint8_t packets[256];
+        size_t  size = 0;
+        done += packetizer_.Packetize(
+            dump.data() + done, dump.size() - done, packets, 256, size);
+        ASSERT_EQ(size % 4, 0u);
+        for(size_t i = 0; i < size; i += 4)
+        {
+            const uint8_t cin   = packets[i];
+            const size_t  count = cin == 0x04 ? 3 : cin - 0x04;
+            received.insert(
+                received.end(), packets + i + 1, packets + i + 1 + count);
+        }
+        transfers++;
+    }
+    EXPECT_EQ(received, dump);
+    EXPECT_EQ(transfers, 6u);
+}
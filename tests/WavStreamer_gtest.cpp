@@ -0,0 +1,256 @@
+#include "hid/wavstreamer.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+// WavStreamFile that reads from memory
+class MemoryFile : public WavStreamFile
+{
+  public:
+    std::vector<uint8_t> data;
+    size_t               pos   = 0;
+    size_t               reads = 0;
+
+    size_t Read(void* dst, size_t size) override
+    {
+        size = std::min(size, data.size() - pos);
+        memcpy(dst, data.data() + pos, size);
+        pos += size;
+        reads++;
+        return size;
+    }
+
+    bool Seek(size_t p) override
+    {
+        if(p > data.size())
+            return false;
+        pos = p;
+        return true;
+    }
+};
+
+template <typename T>
+void Append(std::vector<uint8_t>& v, T x, size_t bytes = sizeof(T))
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&x);
+    v.insert(v.end(), p, p + bytes);
+}
+
+// Builds a wav file from interleaved samples in the range -1..1
+MemoryFile MakeWav(const std::vector<float>& samples,
+                   uint16_t                  chns,
+                   uint16_t                  bits,
+                   bool                      is_float   = false,
+                   uint32_t                  samplerate = 48000)
+{
+    const uint16_t       bytes = bits / 8;
+    std::vector<uint8_t> pcm;
+    for(float s : samples)
+    {
+        if(is_float)
+            Append(pcm, s);
+        else // keep the top bytes of a 32 bit sample
+            Append(pcm, int32_t(s * 2147483647.f) >> (32 - bits), bytes);
+    }
+
+    MemoryFile f;
+    Append(f.data, kWavFileChunkId);
+    Append(f.data, uint32_t(4 + 26 + 8 + 8 + pcm.size()));
+    Append(f.data, kWavFileWaveId);
+    // an unknown chunk with an odd size that must be skipped
+    Append(f.data, uint32_t(0x5453494c)); // "LIST"
+    Append(f.data, uint32_t(1));
+    Append(f.data, uint16_t(0));
+    Append(f.data, kWavFileSubChunk1Id);
+    Append(f.data, uint32_t(16));
+    Append(f.data,
+           uint16_t(is_float ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM));
+    Append(f.data, chns);
+    Append(f.data, samplerate);
+    Append(f.data, uint32_t(samplerate * chns * bytes));
+    Append(f.data, uint16_t(chns * bytes));
+    Append(f.data, bits);
+    Append(f.data, kWavFileSubChunk2Id);
+    Append(f.data, uint32_t(pcm.size()));
+    f.data.insert(f.data.end(), pcm.begin(), pcm.end());
+    return f;
+}
+
+std::vector<float> MakeRamp(size_t length)
+{
+    std::vector<float> ramp(length);
+    for(size_t i = 0; i < length; i++)
+        ramp[i] = float(i) / 1024.f;
+    return ramp;
+}
+
+using SmallStreamer = WavStreamer<4, 64>;
+} // namespace
+
+TEST(hid_WavStreamer, a_monoAtUnityRate)
+{
+    static SmallStreamer streamer;
+    streamer.Init(48000.f);
+    MemoryFile file = MakeWav(MakeRamp(100), 1, 16);
+    auto&      voice = streamer.GetVoice(0);
+    ASSERT_EQ(voice.Open(&file), SmallStreamer::Voice::Result::OK);
+    ASSERT_EQ(voice.Play(), SmallStreamer::Voice::Result::OK);
+
+    // every frame of the file once, mono copied to both channels
+    std::vector<float> out(2 * 120);
+    for(size_t pos = 0; pos < 120; pos += 10)
+    {
+        streamer.Prepare(4);
+        streamer.Stream(&out[2 * pos], 10);
+    }
+    for(size_t i = 0; i < 100; i++)
+    {
+        EXPECT_NEAR(out[2 * i], i / 1024.f, 1e-4f) << "at frame " << i;
+        EXPECT_FLOAT_EQ(out[2 * i + 1], out[2 * i]);
+    }
+    for(size_t i = 200; i < out.size(); i++)
+        EXPECT_EQ(out[i], 0.f);
+    EXPECT_FALSE(voice.IsPlaying());
+    EXPECT_EQ(voice.GetNumUnderruns(), 0u);
+}
+
+TEST(hid_WavStreamer, b_stereoFormats)
+{
+    std::vector<float> stereo(2 * 40);
+    for(size_t i = 0; i < 40; i++)
+    {
+        stereo[2 * i]     = 0.5f - i / 64.f;
+        stereo[2 * i + 1] = -0.25f + i / 128.f;
+    }
+    struct Format
+    {
+        uint16_t bits;
+        bool     is_float;
+        float    tolerance;
+    };
+    const Format formats[] = {{16, false, 1e-4f},
+                              {24, false, 1e-6f},
+                              {32, false, 1e-6f},
+                              {32, true, 0.f}};
+    for(const auto& fmt : formats)
+    {
+        static SmallStreamer streamer;
+        streamer.Init(48000.f);
+        MemoryFile file  = MakeWav(stereo, 2, fmt.bits, fmt.is_float);
+        auto&      voice = streamer.GetVoice(2);
+        ASSERT_EQ(voice.Open(&file), SmallStreamer::Voice::Result::OK);
+        voice.SetGain(2.f);
+        voice.Play();
+        streamer.Prepare(4);
+        std::vector<float> out(2 * 32);
+        streamer.Stream(out.data(), 32);
+        for(size_t i = 0; i < out.size(); i++)
+            EXPECT_NEAR(out[i], 2.f * stereo[i], 2.f * fmt.tolerance)
+                << fmt.bits << " bit, sample " << i;
+    }
+}
+
+TEST(hid_WavStreamer, c_fractionalRates)
+{
+    static SmallStreamer streamer;
+    streamer.Init(48000.f);
+    MemoryFile file  = MakeWav(MakeRamp(100), 1, 32);
+    auto&      voice = streamer.GetVoice(0);
+    voice.Open(&file);
+
+    // half speed interpolates between the frames
+    voice.SetRate(0.5f);
+    voice.Play();
+    streamer.Prepare(4);
+    std::vector<float> out(2 * 20);
+    streamer.Stream(out.data(), 20);
+    for(size_t i = 0; i < 20; i++)
+        EXPECT_NEAR(out[2 * i], i / 2048.f, 1e-6f);
+
+    // double speed skips every other frame
+    voice.SetRate(2.f);
+    voice.Play();
+    streamer.Prepare(4);
+    streamer.Stream(out.data(), 20);
+    for(size_t i = 0; i < 20; i++)
+        EXPECT_NEAR(out[2 * i], i / 512.f, 1e-6f);
+
+    // a file at half the engine sample rate plays at half speed
+    MemoryFile slow = MakeWav(MakeRamp(100), 1, 32, false, 24000);
+    voice.Open(&slow);
+    voice.SetRate(1.f);
+    voice.Play();
+    streamer.Prepare(4);
+    streamer.Stream(out.data(), 20);
+    for(size_t i = 0; i < 20; i++)
+        EXPECT_NEAR(out[2 * i], i / 2048.f, 1e-6f);
+}
+
+TEST(hid_WavStreamer, d_looping)
+{
+    static SmallStreamer streamer;
+    streamer.Init(48000.f);
+    MemoryFile file  = MakeWav(MakeRamp(50), 1, 24);
+    auto&      voice = streamer.GetVoice(1);
+    voice.Open(&file);
+    voice.SetLooping(true);
+    voice.Play();
+
+    std::vector<float> out(2 * 8);
+    for(size_t pos = 0; pos < 400; pos += 8)
+    {
+        streamer.Prepare(4);
+        streamer.Stream(out.data(), 8);
+        for(size_t i = 0; i < 8; i++)
+            EXPECT_NEAR(out[2 * i], ((pos + i) % 50) / 1024.f, 1e-6f)
+                << "at frame " << pos + i;
+    }
+    EXPECT_TRUE(voice.IsPlaying());
+    EXPECT_EQ(voice.GetNumUnderruns(), 0u);
+}
+
+TEST(hid_WavStreamer, e_prefetchServicesTheEmptiestVoice)
+{
+    static SmallStreamer streamer;
+    streamer.Init(48000.f);
+    MemoryFile files[2] = {MakeWav(MakeRamp(1000), 1, 16),
+                           MakeWav(MakeRamp(1000), 1, 16)};
+    for(size_t v = 0; v < 2; v++)
+    {
+        streamer.GetVoice(v).Open(&files[v]);
+        streamer.GetVoice(v).Play();
+        files[v].reads = 0;
+    }
+    // voice 1 consumes its data faster
+    streamer.GetVoice(1).SetRate(1.5f);
+
+    // Both start empty, so both get read once, voice 0 first
+    EXPECT_EQ(streamer.Prepare(1), 1u);
+    EXPECT_EQ(files[0].reads, 1u);
+    EXPECT_EQ(streamer.Prepare(1), 1u);
+    EXPECT_EQ(files[1].reads, 1u);
+
+    // Top up both (one more chunk each), then nothing is left to do
+    EXPECT_EQ(streamer.Prepare(10), 2u);
+    EXPECT_EQ(streamer.Prepare(10), 0u);
+    EXPECT_EQ(streamer.GetVoice(0).GetBufferedFrames(), 64u);
+    EXPECT_EQ(streamer.GetVoice(1).GetBufferedFrames(), 64u);
+
+    // Playing 40 frames frees a chunk in both buffers. Voice 1 has less
+    // time left, so it is read first.
+    std::vector<float> out(2 * 40);
+    streamer.Stream(out.data(), 40);
+    files[0].reads = files[1].reads = 0;
+    EXPECT_EQ(streamer.Prepare(1), 1u);
+    EXPECT_EQ(files[1].reads, 1u);
+    EXPECT_EQ(files[0].reads, 0u);
+
+    // Without prefetching, voice 1 runs dry
+    for(size_t i = 0; i < 10; i++)
+        streamer.Stream(out.data(), 40);
+    EXPECT_GT(streamer.GetVoice(1).GetNumUnderruns(), 0u);
+}
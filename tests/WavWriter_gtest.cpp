@@ -0,0 +1,234 @@
+#include "util/WavWriter.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+uint16_t Get16(const uint8_t* p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return v;
+}
+
+uint32_t Get32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+uint64_t Get64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+/** Checks the chunks before the audio, and returns the fmt chunk */
+const uint8_t* CheckChunks(const uint8_t* h, bool rf64, bool is_float)
+{
+    size_t pos = 12;
+    if(rf64)
+    {
+        EXPECT_EQ(Get32(h + pos), kWavFileDs64Id);
+        pos += 8 + Get32(h + pos + 4);
+    }
+    EXPECT_EQ(Get32(h + pos), kWavFileJunkId);
+    pos += 8 + Get32(h + pos + 4);
+    const uint8_t* fmt = h + pos;
+    EXPECT_EQ(Get32(fmt), kWavFileSubChunk1Id);
+    pos += 8 + Get32(fmt + 4);
+    if(is_float)
+    {
+        EXPECT_EQ(Get32(h + pos), kWavFileFactId);
+        EXPECT_EQ(Get32(h + pos + 4), 4u);
+        pos += 12;
+    }
+    EXPECT_EQ(pos, 504u);
+    EXPECT_EQ(Get32(h + 504), kWavFileSubChunk2Id);
+    return fmt;
+}
+} // namespace
+
+TEST(util_WavWriter, a_header)
+{
+    WavEncoder encoder;
+    uint8_t    h[WavEncoder::kHeaderSize];
+    EXPECT_TRUE(encoder.Init(48000, 2, 16, false));
+    encoder.BuildHeader(1000, h);
+
+    EXPECT_EQ(Get32(h), kWavFileChunkId);
+    EXPECT_EQ(Get32(h + 4), 504u + 4000u);
+    EXPECT_EQ(Get32(h + 8), kWavFileWaveId);
+    const uint8_t* fmt = CheckChunks(h, false, false);
+    EXPECT_EQ(Get32(fmt + 4), 16u);
+    EXPECT_EQ(Get16(fmt + 8), WAVE_FORMAT_PCM);
+    EXPECT_EQ(Get16(fmt + 10), 2);
+    EXPECT_EQ(Get32(fmt + 12), 48000u);
+    EXPECT_EQ(Get32(fmt + 16), 192000u);
+    EXPECT_EQ(Get16(fmt + 20), 4);
+    EXPECT_EQ(Get16(fmt + 22), 16);
+    EXPECT_EQ(Get32(h + 508), 4000u);
+
+    // unsupported formats
+    EXPECT_FALSE(encoder.Init(48000, 2, 8, false));
+    EXPECT_FALSE(encoder.Init(48000, 2, 24, true));
+    EXPECT_FALSE(encoder.Init(48000, 0, 16, false));
+    EXPECT_FALSE(encoder.Init(48000, 33, 16, false));
+}
+
+TEST(util_WavWriter, b_floatHeader)
+{
+    WavEncoder encoder;
+    uint8_t    h[WavEncoder::kHeaderSize];
+    EXPECT_TRUE(encoder.Init(44100, 1, 32, true));
+    encoder.BuildHeader(300, h);
+
+    EXPECT_EQ(Get32(h + 4), 504u + 1200u);
+    const uint8_t* fmt = CheckChunks(h, false, true);
+    EXPECT_EQ(Get32(fmt + 4), 18u);
+    EXPECT_EQ(Get16(fmt + 8), WAVE_FORMAT_IEEE_FLOAT);
+    EXPECT_EQ(Get16(fmt + 24), 0); // no extension
+    EXPECT_EQ(Get32(fmt + 16), 176400u);
+    // the number of frames in the fact chunk
+    EXPECT_EQ(Get32(h + 500), 300u);
+    EXPECT_EQ(Get32(h + 508), 1200u);
+}
+
+TEST(util_WavWriter, c_rf64)
+{
+    WavEncoder encoder;
+    uint8_t    h[WavEncoder::kHeaderSize];
+    EXPECT_TRUE(encoder.Init(48000, 2, 16, false));
+
+    // the largest recording that still fits into RIFF
+    const uint64_t max_frames = (0xffffffffull - 504) / 4;
+    encoder.BuildHeader(max_frames, h);
+    EXPECT_EQ(Get32(h), kWavFileChunkId);
+    EXPECT_EQ(Get32(h + 4), uint32_t(504 + max_frames * 4));
+    CheckChunks(h, false, false);
+
+    const uint64_t frames = max_frames + 1;
+    encoder.BuildHeader(frames, h);
+    EXPECT_EQ(Get32(h), kWavFileRF64Id);
+    EXPECT_EQ(Get32(h + 4), 0xffffffffu);
+    EXPECT_EQ(Get32(h + 16), 28u);
+    EXPECT_EQ(Get64(h + 20), 504 + frames * 4);
+    EXPECT_EQ(Get64(h + 28), frames * 4);
+    EXPECT_EQ(Get64(h + 36), frames);
+    EXPECT_EQ(Get32(h + 44), 0u);
+    CheckChunks(h, true, false);
+    EXPECT_EQ(Get32(h + 508), 0xffffffffu);
+
+    EXPECT_TRUE(encoder.Init(48000, 2, 32, true));
+    encoder.BuildHeader(frames, h);
+    EXPECT_EQ(Get32(h), kWavFileRF64Id);
+    CheckChunks(h, true, true);
+    EXPECT_EQ(Get32(h + 500), 0xffffffffu);
+}
+
+TEST(util_WavWriter, d_sampleFormats)
+{
+    const float  l[]           = {0.5f, -0.25f, 1.5f};
+    const float  r[]           = {-1.f, 0.125f, 0.f};
+    const float* planar[]      = {l, r};
+    const float  interleaved[] = {0.5f, -1.f, -0.25f, 0.125f, 1.5f, 0.f};
+
+    for(int bits : {16, 24, 32, 0})
+    {
+        WavEncoder encoder;
+        EXPECT_TRUE(encoder.Init(48000, 2, bits ? bits : 32, bits == 0));
+        const size_t bytes = bits ? bits / 8 : 4;
+        EXPECT_EQ(encoder.GetFrameBytes(), 2 * bytes);
+
+        std::vector<uint8_t> expected(6 * bytes);
+        for(size_t i = 0; i < 6; i++)
+        {
+            const float x = interleaved[i];
+            int32_t     v = 0;
+            switch(bits)
+            {
+                case 16: v = f2s16(x); break;
+                case 24: v = f2s24(x); break;
+                case 32: v = f2s32(x); break;
+                default: memcpy(&v, &x, 4); break;
+            }
+            memcpy(&expected[i * bytes], &v, bytes);
+        }
+
+        std::vector<uint8_t> out(6 * bytes);
+        encoder.Pack(interleaved, nullptr, 0, 3, out.data());
+        EXPECT_EQ(out, expected) << bits;
+        encoder.Pack(nullptr, planar, 0, 3, out.data());
+        EXPECT_EQ(out, expected) << bits;
+
+        // from an offset into the input
+        const std::vector<uint8_t> last(expected.begin() + 4 * bytes,
+                                        expected.end());
+        std::vector<uint8_t>       tail(2 * bytes);
+        encoder.Pack(nullptr, planar, 2, 1, tail.data());
+        EXPECT_EQ(tail, last) << bits;
+        encoder.Pack(interleaved, nullptr, 2, 1, tail.data());
+        EXPECT_EQ(tail, last) << bits;
+    }
+}
+
+TEST(util_WavWriter, e_recording)
+{
+    WavWriter<512>         writer;
+    WavWriter<512>::Config config;
+    config.samplerate    = 48000;
+    config.channels      = 2;
+    config.bitspersample = 24;
+    EXPECT_EQ(writer.Init(config), WavWriter<512>::Result::OK);
+    writer.OpenFile("rec.wav");
+    EXPECT_TRUE(writer.IsRecording());
+
+    // blocks of 48 frames (288 bytes), which wrap around the buffer
+    std::vector<float> l(48), r(48), all;
+    const float*       planar[] = {l.data(), r.data()};
+    for(int block = 0; block < 20; block++)
+    {
+        for(size_t i = 0; i < 48; i++)
+        {
+            l[i] = (block * 48 + i) / 1000.f - 0.5f;
+            r[i] = -l[i];
+            all.push_back(l[i]);
+            all.push_back(r[i]);
+        }
+        writer.SampleBlock(planar, 48);
+        EXPECT_EQ(writer.Write(), WavWriter<512>::Result::OK);
+    }
+    EXPECT_EQ(writer.GetLengthSamps(), 960u);
+    EXPECT_EQ(writer.GetNumDroppedFrames(), 0u);
+
+    // without Write(), the buffer of 1024 bytes fills up
+    writer.SampleBlock(all.data(), 48);
+    writer.SampleBlock(all.data(), 48);
+    writer.SampleBlock(all.data(), 48);
+    writer.SampleBlock(all.data(), 48);
+    EXPECT_EQ(writer.GetNumDroppedFrames(), 48u);
+    all.insert(all.end(), all.begin(), all.begin() + 96);
+    all.insert(all.end(), all.begin(), all.begin() + 96);
+    all.insert(all.end(), all.begin(), all.begin() + 96);
+    writer.SaveFile();
+    EXPECT_FALSE(writer.IsRecording());
+
+    const std::vector<uint8_t>& file = FatFsFilesForUnitTest()["rec.wav"];
+    const size_t                frames = 960 + 3 * 48;
+    ASSERT_EQ(file.size(), 512 + frames * 6);
+
+    WavEncoder encoder;
+    uint8_t    header[WavEncoder::kHeaderSize];
+    encoder.Init(48000, 2, 24, false);
+    encoder.BuildHeader(frames, header);
+    EXPECT_TRUE(std::equal(header, header + 512, file.begin()));
+
+    std::vector<uint8_t> audio(frames * 6);
+    encoder.Pack(all.data(), nullptr, 0, frames, audio.data());
+    EXPECT_TRUE(std::equal(audio.begin(), audio.end(), file.begin() + 512));
+}
@@ -0,0 +1,160 @@
+#include "util/WaveTableLoader.h"
+#include "daisy_core.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+constexpr size_t kSamps  = 8;
+constexpr size_t kTables = 4;
+
+template <typename T>
+void Append(std::vector<uint8_t>& v, T x)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&x);
+    v.insert(v.end(), p, p + sizeof(T));
+}
+
+int16_t Sample(size_t table, size_t i)
+{
+    return int16_t((table * kSamps + i) * 100 - 1000);
+}
+
+/** Writes a 16 bit wav file with kTables tables to the FatFs stub */
+void MakeBank(const char* name)
+{
+    std::vector<uint8_t>& f = FatFsFilesForUnitTest()[name];
+    Append(f, kWavFileChunkId);
+    Append(f, uint32_t(4 + 24 + 8 + kTables * kSamps * 2));
+    Append(f, kWavFileWaveId);
+    Append(f, kWavFileSubChunk1Id);
+    Append(f, uint32_t(16));
+    Append(f, uint16_t(WAVE_FORMAT_PCM));
+    Append(f, uint16_t(1));
+    Append(f, uint32_t(48000));
+    Append(f, uint32_t(96000));
+    Append(f, uint16_t(2));
+    Append(f, uint16_t(16));
+    Append(f, kWavFileSubChunk2Id);
+    Append(f, uint32_t(kTables * kSamps * 2));
+    for(size_t t = 0; t < kTables; t++)
+        for(size_t i = 0; i < kSamps; i++)
+            Append(f, Sample(t, i));
+}
+
+void ExpectTable(const float* table, size_t idx)
+{
+    ASSERT_NE(table, nullptr) << idx;
+    for(size_t i = 0; i < kSamps; i++)
+        EXPECT_FLOAT_EQ(table[i], s162f(Sample(idx, i))) << idx;
+}
+
+size_t NumReads()
+{
+    return FatFsStateForUnitTest()->num_reads;
+}
+} // namespace
+
+TEST(util_WaveTableLoader, a_import)
+{
+    MakeBank("bank.wav");
+    float           mem[kTables * kSamps];
+    WaveTableLoader loader;
+    loader.Init(mem, kTables * kSamps);
+    EXPECT_EQ(loader.SetWaveTableInfo(kSamps, kTables),
+              WaveTableLoader::Result::OK);
+    EXPECT_EQ(loader.Import("bank.wav"), WaveTableLoader::Result::OK);
+    for(size_t t = 0; t < kTables; t++)
+        ExpectTable(loader.GetTable(t), t);
+    EXPECT_EQ(loader.GetTable(kTables), nullptr);
+    EXPECT_EQ(loader.Import("missing.wav"),
+              WaveTableLoader::Result::ERR_FILE_READ);
+}
+
+TEST(util_WaveTableLoader, b_loadsOnDemand)
+{
+    MakeBank("bank.wav");
+    float           mem[2 * kSamps]; // two cache slots
+    WaveTableLoader loader;
+    loader.Init(mem, 2 * kSamps);
+    EXPECT_EQ(loader.Open("bank.wav", kSamps), WaveTableLoader::Result::OK);
+    EXPECT_EQ(loader.GetNumTables(), kTables);
+
+    // nothing is read until a table is used
+    size_t reads = NumReads();
+    EXPECT_EQ(loader.GetLoadedTable(0), nullptr);
+    EXPECT_EQ(NumReads(), reads);
+    ExpectTable(loader.GetTable(0), 0);
+    EXPECT_GT(NumReads(), reads);
+    ExpectTable(loader.GetLoadedTable(0), 0);
+
+    ExpectTable(loader.GetTable(1), 1);
+    reads = NumReads();
+    ExpectTable(loader.GetTable(0), 0);
+    EXPECT_EQ(NumReads(), reads);
+    EXPECT_EQ(loader.GetTable(kTables), nullptr);
+    loader.Close();
+}
+
+TEST(util_WaveTableLoader, c_evictsLeastRecentlyUsed)
+{
+    MakeBank("bank.wav");
+    float           mem[2 * kSamps];
+    WaveTableLoader loader;
+    loader.Init(mem, 2 * kSamps);
+    EXPECT_EQ(loader.Open("bank.wav", kSamps), WaveTableLoader::Result::OK);
+
+    loader.GetTable(0);
+    loader.GetTable(1);
+    loader.GetTable(0);
+    // 1 was used least recently
+    ExpectTable(loader.GetTable(2), 2);
+    EXPECT_EQ(loader.GetLoadedTable(1), nullptr);
+    ExpectTable(loader.GetLoadedTable(0), 0);
+
+    // GetLoadedTable() doesn't count as a use, so 0 is evicted next
+    for(int i = 0; i < 10; i++)
+        loader.GetLoadedTable(0);
+    ExpectTable(loader.GetTable(3), 3);
+    EXPECT_EQ(loader.GetLoadedTable(0), nullptr);
+    ExpectTable(loader.GetLoadedTable(2), 2);
+    ExpectTable(loader.GetLoadedTable(3), 3);
+    loader.Close();
+}
+
+TEST(util_WaveTableLoader, d_exportAndMap)
+{
+    MakeBank("bank.wav");
+    float           mem[2 * kSamps];
+    WaveTableLoader loader;
+    loader.Init(mem, 2 * kSamps);
+    EXPECT_EQ(loader.Open("bank.wav", kSamps), WaveTableLoader::Result::OK);
+    // exporting loads every table through the small cache
+    EXPECT_EQ(loader.ExportBinary("bank.bin"), WaveTableLoader::Result::OK);
+    loader.Close();
+
+    // e.g. copied to QSPI, 4 byte aligned
+    const std::vector<uint8_t>& file = FatFsFilesForUnitTest()["bank.bin"];
+    ASSERT_EQ(file.size(),
+              sizeof(WaveTableLoader::BinaryHeader)
+                  + kTables * kSamps * sizeof(float));
+    std::vector<uint32_t> mapped(file.size() / 4);
+    memcpy(mapped.data(), file.data(), file.size());
+
+    WaveTableLoader bank;
+    bank.Init(nullptr, 0);
+    EXPECT_EQ(bank.Map(mapped.data()), WaveTableLoader::Result::OK);
+    EXPECT_EQ(bank.GetNumTables(), kTables);
+    for(size_t t = 0; t < kTables; t++)
+    {
+        ExpectTable(bank.GetTable(t), t);
+        EXPECT_EQ(bank.GetLoadedTable(t), bank.GetTable(t));
+    }
+    EXPECT_EQ(bank.GetTable(kTables), nullptr);
+
+    mapped[0] = 0;
+    EXPECT_EQ(bank.Map(mapped.data()), WaveTableLoader::Result::ERR_GENERIC);
+}
@@ -0,0 +1,168 @@
+#include <benchmark/benchmark.h>
+#include "hid/disp/oled_display.h"
+#include "dev/oled_ssd130x.h"
+
+using namespace daisy;
+
+namespace
+{
+/** A transport that sends nothing */
+class NullTransport
+{
+  public:
+    struct Config
+    {
+    };
+
+    void Init(const Config&) {}
+    void SendCommand(uint8_t) {}
+    void SendData(uint8_t* buff, size_t) { benchmark::DoNotOptimize(buff); }
+};
+
+using BenchDriver = SSD130xDriver<128, 64, NullTransport>;
+
+/** The SSD130x driver without its span and bitmap functions, so that the
+ *  display draws pixel by pixel
+ */
+class PixelDriver
+{
+  public:
+    using Config = BenchDriver::Config;
+
+    void   Init(Config config) { driver_.Init(config); }
+    size_t Width() const { return driver_.Width(); }
+    size_t Height() const { return driver_.Height(); }
+    void   DrawPixel(uint_fast8_t x, uint_fast8_t y, bool on)
+    {
+        driver_.DrawPixel(x, y, on);
+    }
+    void Fill(bool on) { driver_.Fill(on); }
+    void Update() { driver_.Update(); }
+
+  private:
+    BenchDriver driver_;
+};
+
+using PixelDisplay = OledDisplay<PixelDriver>;
+using SpanDisplay  = OledDisplay<BenchDriver>;
+
+template <typename Display>
+Display& GetDisplay()
+{
+    static Display display;
+    display.Init(typename Display::Config());
+    return display;
+}
+} // namespace
+
+template <typename Display>
+static void hid_Display_drawPixel(benchmark::State& state)
+{
+    auto&   display = GetDisplay<Display>();
+    uint8_t x = 0, y = 0;
+    for(auto _ : state)
+    {
+        display.DrawPixel(x, y, true);
+        x = (x + 1) & 127;
+        y = (y + 3) & 63;
+    }
+    display.Update();
+}
+BENCHMARK_TEMPLATE(hid_Display_drawPixel, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_drawPixel, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_drawLine(benchmark::State& state)
+{
+    auto& display = GetDisplay<Display>();
+    for(auto _ : state)
+    {
+        display.DrawLine(0, 0, 127, 63, true);  // diagonal
+        display.DrawLine(0, 32, 127, 32, true); // horizontal
+        display.DrawLine(64, 0, 64, 63, true);  // vertical
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_drawLine, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_drawLine, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_fillRect(benchmark::State& state)
+{
+    auto& display = GetDisplay<Display>();
+    for(auto _ : state)
+    {
+        display.DrawRect(10, 10, 117, 53, true, true);
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_fillRect, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_fillRect, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_writeString(benchmark::State& state)
+{
+    auto& display = GetDisplay<Display>();
+    for(auto _ : state)
+    {
+        display.SetCursor(0, 0);
+        display.WriteString("Cutoff: 1234.5 Hz", Font_7x10, true);
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_writeString, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_writeString, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_fullScreenText(benchmark::State& state)
+{
+    auto& display = GetDisplay<Display>();
+    for(auto _ : state)
+    {
+        display.Fill(false);
+        for(uint8_t line = 0; line < 8; line++)
+        {
+            display.SetCursor(0, line * 8);
+            display.WriteString("The quick brown fox", Font_6x8, true);
+        }
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_fullScreenText, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_fullScreenText, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_writeStringGlyphCache(benchmark::State& state)
+{
+    auto&                     display = GetDisplay<Display>();
+    static GlyphCache<95 * 7> font;
+    font.Init(Font_7x10);
+    for(auto _ : state)
+    {
+        display.SetCursor(0, 0);
+        display.WriteString("Cutoff: 1234.5 Hz", font, true);
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_writeStringGlyphCache, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_writeStringGlyphCache, SpanDisplay);
+
+template <typename Display>
+static void hid_Display_fullScreenTextGlyphCache(benchmark::State& state)
+{
+    auto&                     display = GetDisplay<Display>();
+    static GlyphCache<95 * 6> font;
+    font.Init(Font_6x8);
+    for(auto _ : state)
+    {
+        display.Fill(false);
+        for(uint8_t line = 0; line < 8; line++)
+        {
+            display.SetCursor(0, line * 8);
+            display.WriteString("The quick brown fox", font, true);
+        }
+        display.Update();
+    }
+}
+BENCHMARK_TEMPLATE(hid_Display_fullScreenTextGlyphCache, PixelDisplay);
+BENCHMARK_TEMPLATE(hid_Display_fullScreenTextGlyphCache, SpanDisplay);
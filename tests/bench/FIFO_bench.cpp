@@ -0,0 +1,71 @@
+#include <benchmark/benchmark.h>
+#include "util/FIFO.h"
+#include "util/ringbuffer.h"
+#include "util/EventBus.h"
+
+using namespace daisy;
+
+// Pushes and pops in blocks of state.range(0) elements
+
+static void util_FIFO_pushPop(benchmark::State& state)
+{
+    FIFO<int, 256> fifo;
+    const int      block = state.range(0);
+    for(auto _ : state)
+    {
+        for(int i = 0; i < block; i++)
+            fifo.PushBack(i);
+        for(int i = 0; i < block; i++)
+            benchmark::DoNotOptimize(fifo.PopFront());
+    }
+    state.SetItemsProcessed(state.iterations() * block);
+}
+BENCHMARK(util_FIFO_pushPop)->Arg(1)->Arg(64);
+
+static void util_RingBuffer_pushPop(benchmark::State& state)
+{
+    RingBuffer<int, 256> ring;
+    const int            block = state.range(0);
+    for(auto _ : state)
+    {
+        for(int i = 0; i < block; i++)
+            ring.TryWrite(i);
+        int v = 0;
+        for(int i = 0; i < block; i++)
+        {
+            ring.TryRead(v);
+            benchmark::DoNotOptimize(v);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * block);
+}
+BENCHMARK(util_RingBuffer_pushPop)->Arg(1)->Arg(64);
+
+static void util_RingBuffer_bulkPushPop(benchmark::State& state)
+{
+    RingBuffer<int, 256> ring;
+    const size_t         block = state.range(0);
+    int                  src[256] = {}, dst[256];
+    for(auto _ : state)
+    {
+        ring.TryWrite(src, block);
+        ring.TryRead(dst, block);
+        benchmark::DoNotOptimize(dst);
+    }
+    state.SetItemsProcessed(state.iterations() * block);
+}
+BENCHMARK(util_RingBuffer_bulkPushPop)->Arg(1)->Arg(64);
+
+static void util_MpscQueue_postDrain(benchmark::State& state)
+{
+    MpscQueue<int, 256> queue;
+    const int           block = state.range(0);
+    for(auto _ : state)
+    {
+        for(int i = 0; i < block; i++)
+            queue.Post(i);
+        queue.Drain([](const int& v) { benchmark::DoNotOptimize(v); });
+    }
+    state.SetItemsProcessed(state.iterations() * block);
+}
+BENCHMARK(util_MpscQueue_postDrain)->Arg(1)->Arg(64);
@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+#include "util/FixedCapStr.h"
+
+using namespace daisy;
+
+static void util_FixedCapStr_appendInt(benchmark::State& state)
+{
+    FixedCapStr<32> str;
+    int             value = -12345;
+    for(auto _ : state)
+    {
+        str.Clear();
+        str.AppendInt(value++);
+        benchmark::DoNotOptimize(str.Cstr());
+    }
+}
+BENCHMARK(util_FixedCapStr_appendInt);
+
+static void util_FixedCapStr_appendFloat(benchmark::State& state)
+{
+    FixedCapStr<32> str;
+    float           value = -123.456f;
+    for(auto _ : state)
+    {
+        str.Clear();
+        str.AppendFloat(value, 3);
+        value += 0.001f;
+        benchmark::DoNotOptimize(str.Cstr());
+    }
+}
+BENCHMARK(util_FixedCapStr_appendFloat);
+
+static void util_FixedCapStr_formatLabel(benchmark::State& state)
+{
+    FixedCapStr<32> str;
+    float           value = 0.f;
+    for(auto _ : state)
+    {
+        str.Clear();
+        str.Append("Cutoff: ");
+        str.AppendFloat(value, 1);
+        str.Append(" Hz");
+        value += 0.5f;
+        benchmark::DoNotOptimize(str.Cstr());
+    }
+}
+BENCHMARK(util_FixedCapStr_formatLabel);
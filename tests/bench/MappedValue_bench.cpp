@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+#include "util/MappedValue.h"
+
+using namespace daisy;
+
+namespace
+{
+using Mapping = MappedFloatValue::Mapping;
+
+// Sweeps the normalized value like a knob that is turned
+void SetAndGet(benchmark::State& state, Mapping mapping)
+{
+    MappedFloatValue value(20.f, 20000.f, 1000.f, mapping, "Hz");
+    float            knob = 0.f;
+    for(auto _ : state)
+    {
+        value.SetFrom0to1(knob);
+        benchmark::DoNotOptimize(value.Get());
+        benchmark::DoNotOptimize(value.GetAs0to1());
+        knob = knob < 1.f ? knob + 0.001f : 0.f;
+    }
+}
+} // namespace
+
+static void util_MappedFloatValue_lin(benchmark::State& state)
+{
+    SetAndGet(state, Mapping::lin);
+}
+BENCHMARK(util_MappedFloatValue_lin);
+
+static void util_MappedFloatValue_log(benchmark::State& state)
+{
+    SetAndGet(state, Mapping::log);
+}
+BENCHMARK(util_MappedFloatValue_log);
+
+static void util_MappedFloatValue_pow2(benchmark::State& state)
+{
+    SetAndGet(state, Mapping::pow2);
+}
+BENCHMARK(util_MappedFloatValue_pow2);
+
+static void util_MappedFloatValue_toString(benchmark::State& state)
+{
+    MappedFloatValue value(20.f, 20000.f, 1000.f, Mapping::log, "Hz", 2);
+    FixedCapStr<32>  str;
+    for(auto _ : state)
+    {
+        str.Clear();
+        value.AppentToString(str);
+        benchmark::DoNotOptimize(str.Cstr());
+    }
+}
+BENCHMARK(util_MappedFloatValue_toString);
@@ -0,0 +1,157 @@
+#include <benchmark/benchmark.h>
+#include "hid/midi_parser.h"
+#include "hid/midi_router.h"
+#include "util/FIFO.h"
+#include <vector>
+
+using namespace daisy;
+
+namespace
+{
+// A typical stream: notes, controllers and a pitch bend, with and without
+// running status, and some clock bytes in between
+std::vector<uint8_t> MakeStream()
+{
+    std::vector<uint8_t> stream;
+    for(uint8_t i = 0; i < 64; i++)
+    {
+        const uint8_t note = 36 + (i % 48);
+        stream.insert(stream.end(), {0x90, note, 100, note, 0});
+        stream.insert(stream.end(), {0xb0, 74, uint8_t(i * 2), 71, i});
+        stream.insert(stream.end(), {0xf8, 0xe0, 0, uint8_t(i + 32)});
+    }
+    return stream;
+}
+
+// Dense load of a busy sequencer: a clock, CC streams with running status
+// on two channels and a short SysEx message every now and then
+std::vector<uint8_t> MakeDenseStream()
+{
+    std::vector<uint8_t> stream;
+    for(uint8_t i = 0; i < 96; i++)
+    {
+        stream.push_back(0xf8);
+        stream.insert(stream.end(), {0xb0, 1, i, 2, uint8_t(127 - i), 3, i});
+        stream.insert(stream.end(), {0xb1, 74, i, 0xf8, 71, i, 74, i});
+        stream.insert(stream.end(), {0xe0, 0, i, 0, uint8_t(i + 1)});
+        if(i % 16 == 0)
+            stream.insert(stream.end(), {0xf0, 0x7d, 1, 2, 3, 4, 5, 6, 0xf7});
+    }
+    return stream;
+}
+
+std::vector<uint8_t> MakeSysEx(size_t length)
+{
+    std::vector<uint8_t> stream = {0xf0, 0x7d};
+    for(size_t i = 0; i < length; i++)
+        stream.push_back(i & 0x7f);
+    stream.push_back(0xf7);
+    return stream;
+}
+
+void ParseStream(benchmark::State& state, const std::vector<uint8_t>& stream)
+{
+    static MidiSysExArena<1024> sysex;
+    MidiParser                  parser;
+    MidiEvent                   event;
+    parser.Init(&sysex);
+    for(auto _ : state)
+    {
+        for(uint8_t byte : stream)
+        {
+            bool did_parse = parser.Parse(byte, &event);
+            benchmark::DoNotOptimize(did_parse);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+} // namespace
+
+static void hid_MidiParser_channelMessages(benchmark::State& state)
+{
+    ParseStream(state, MakeStream());
+}
+BENCHMARK(hid_MidiParser_channelMessages);
+
+static void hid_MidiParser_sysEx(benchmark::State& state)
+{
+    ParseStream(state, MakeSysEx(state.range(0)));
+}
+BENCHMARK(hid_MidiParser_sysEx)->Arg(16)->Arg(128);
+
+// A dense stream parsed one byte at a time into a queue, like MidiHandler
+// used to, compared to block parsing into a sink
+static void hid_MidiParser_denseBytesToQueue(benchmark::State& state)
+{
+    static MidiSysExArena<1024>  sysex;
+    static FIFO<MidiEvent, 1024> queue;
+    const auto                   stream = MakeDenseStream();
+    MidiParser                   parser;
+    MidiEvent                    event;
+    parser.Init(&sysex);
+    for(auto _ : state)
+    {
+        for(uint8_t byte : stream)
+            if(parser.Parse(byte, &event))
+                queue.PushBack(event);
+        while(!queue.IsEmpty())
+            benchmark::DoNotOptimize(queue.PopFront());
+    }
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+BENCHMARK(hid_MidiParser_denseBytesToQueue);
+
+static void hid_MidiParser_denseBlockToSink(benchmark::State& state)
+{
+    static MidiSysExArena<1024> sysex;
+    const auto                  stream = MakeDenseStream();
+    MidiParser                  parser;
+    uint32_t                    sum = 0;
+    parser.Init(&sysex);
+    for(auto _ : state)
+    {
+        // consume the events right away, e.g. to update parameters
+        parser.ParseBlock(stream.data(),
+                          stream.size(),
+                          [&sum](const MidiEvent& event) {
+                              sum += event.type + event.data[1];
+                          });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+BENCHMARK(hid_MidiParser_denseBlockToSink);
+
+// Events of four ports merged by time, with a remap rule, drained in
+// batches of 64 like a main loop would
+static void hid_MidiRouter_mergeFourPorts(benchmark::State& state)
+{
+    static MidiRouter<4, 64> router;
+    MidiRouter<4, 64>::Rule  remap;
+    remap.channels  = 1 << 1;
+    remap.channel   = 2;
+    remap.transpose = 12;
+    router.Init();
+    router.AddRule(remap);
+
+    MidiEvent event = {};
+    event.type      = NoteOn;
+    uint32_t time   = 0;
+    uint32_t sum    = 0;
+    for(auto _ : state)
+    {
+        for(size_t i = 0; i < 64; i++)
+        {
+            event.channel = i & 1;
+            event.data[0] = i;
+            router.Push(i & 3, event, time++);
+        }
+        router.Process([&sum](const MidiRouter<4, 64>::RoutedEvent& e) {
+            sum += e.event.data[0];
+        });
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+}
+BENCHMARK(hid_MidiRouter_mergeFourPorts);
@@ -0,0 +1,89 @@
+#include <benchmark/benchmark.h>
+#include "util/SampleConversion.h"
+#include <vector>
+
+using namespace daisy;
+
+// Everything converts one audio block of state.range(0) frames
+
+namespace
+{
+std::vector<float> MakeSignal(size_t length)
+{
+    std::vector<float> sig(length);
+    for(size_t i = 0; i < length; i++)
+        sig[i] = -1.f + 2.f * i / length;
+    return sig;
+}
+
+template <int bits>
+void util_SampleConversion_toFloat(benchmark::State& state)
+{
+    const size_t         n = state.range(0);
+    std::vector<int32_t> in(n, 1234);
+    std::vector<float>   out(n);
+    for(auto _ : state)
+    {
+        SampleConversion<bits>::ToFloat(in.data(), out.data(), n);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <int bits>
+void util_SampleConversion_fromFloat(benchmark::State& state)
+{
+    const size_t         n  = state.range(0);
+    const auto           in = MakeSignal(n);
+    std::vector<int32_t> out(n);
+    for(auto _ : state)
+    {
+        SampleConversion<bits>::FromFloat(in.data(), out.data(), n);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+} // namespace
+
+BENCHMARK_TEMPLATE(util_SampleConversion_toFloat, 16)->Arg(48);
+BENCHMARK_TEMPLATE(util_SampleConversion_toFloat, 24)->Arg(48);
+BENCHMARK_TEMPLATE(util_SampleConversion_toFloat, 32)->Arg(48);
+BENCHMARK_TEMPLATE(util_SampleConversion_fromFloat, 16)->Arg(48);
+BENCHMARK_TEMPLATE(util_SampleConversion_fromFloat, 24)->Arg(48);
+BENCHMARK_TEMPLATE(util_SampleConversion_fromFloat, 32)->Arg(48);
+
+// Interleaved stereo codec data to and from two float channels
+static void util_SampleConversion_deinterleave(benchmark::State& state)
+{
+    const size_t         n = state.range(0);
+    std::vector<int32_t> in(2 * n, 1234);
+    std::vector<float>   left(n), right(n);
+    float* const         out[2] = {left.data(), right.data()};
+    for(auto _ : state)
+    {
+        SampleConversion<24>::DeinterleaveToFloat(in.data(), out, n, 2);
+        benchmark::DoNotOptimize(out[0]);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * n);
+}
+BENCHMARK(util_SampleConversion_deinterleave)->Arg(48);
+
+static void util_SampleConversion_interleave(benchmark::State& state)
+{
+    const size_t         n     = state.range(0);
+    const auto           left  = MakeSignal(n);
+    const auto           right = MakeSignal(n);
+    const float* const   in[2] = {left.data(), right.data()};
+    std::vector<int32_t> out(2 * n);
+    for(auto _ : state)
+    {
+        SampleConversion<24>::InterleaveFromFloat(in, out.data(), n, 2);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * n);
+}
+BENCHMARK(util_SampleConversion_interleave)->Arg(48);
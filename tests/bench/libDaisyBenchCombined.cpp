@@ -0,0 +1,6 @@
+// The sources needed by the benchmarks. Unlike libDaisyCombined.cpp, this
+// leaves out the dummy System, which depends on googletest.
+#include "util/MappedValue.cpp"
+#include "util/oled_fonts.c"
+#include "hid/midi_parser.cpp"
+#include "hid/midi_ump.cpp"
@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TestIsolator.h"
+
+/** A stand-in for FatFs (sys/fatfs.h) in unit tests.
+ *  The files are kept in memory, separately for each test, and can be
+ *  inspected and prepared with FatFsFilesForUnitTest().
+ *  Only the functions used by the code under test are provided.
+ */
+
+typedef unsigned int UINT;
+typedef uint8_t      BYTE;
+typedef uint32_t     DWORD;
+typedef uint64_t     FSIZE_t;
+typedef char         TCHAR;
+
+typedef enum
+{
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_INT_ERR,
+    FR_NOT_READY,
+    FR_NO_FILE,
+} FRESULT;
+
+#define FA_READ 0x01
+#define FA_WRITE 0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_ALWAYS 0x08
+
+struct FIL
+{
+    std::vector<uint8_t>* data = nullptr;
+    FSIZE_t               fptr = 0;
+};
+
+/** The files of the test that's currently running */
+struct FatFsStubState
+{
+    std::map<std::string, std::vector<uint8_t>> files;
+    size_t                                      num_reads = 0;
+};
+
+inline std::shared_ptr<FatFsStubState> FatFsStateForUnitTest()
+{
+    static TestIsolator<FatFsStubState> isolator;
+    return isolator.GetStateForCurrentTest();
+}
+
+inline std::map<std::string, std::vector<uint8_t>>& FatFsFilesForUnitTest()
+{
+    return FatFsStateForUnitTest()->files;
+}
+
+inline FRESULT f_open(FIL* fp, const TCHAR* path, BYTE mode)
+{
+    auto& files = FatFsFilesForUnitTest();
+    if(mode & FA_CREATE_ALWAYS)
+        files[path].clear();
+    else if(files.find(path) == files.end())
+        return FR_NO_FILE;
+    fp->data = &files[path];
+    fp->fptr = 0;
+    return FR_OK;
+}
+
+inline FRESULT f_close(FIL* fp)
+{
+    fp->data = nullptr;
+    return FR_OK;
+}
+
+inline FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br)
+{
+    if(fp->data == nullptr)
+        return FR_INT_ERR;
+    const size_t size = fp->data->size();
+    *br = fp->fptr < size ? UINT(std::min<FSIZE_t>(btr, size - fp->fptr)) : 0;
+    if(*br > 0)
+        memcpy(buff, fp->data->data() + fp->fptr, *br);
+    fp->fptr += *br;
+    FatFsStateForUnitTest()->num_reads++;
+    return FR_OK;
+}
+
+inline FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw)
+{
+    if(fp->data == nullptr)
+        return FR_INT_ERR;
+    if(fp->data->size() < fp->fptr + btw)
+        fp->data->resize(fp->fptr + btw);
+    memcpy(fp->data->data() + fp->fptr, buff, btw);
+    fp->fptr += btw;
+    *bw = btw;
+    return FR_OK;
+}
+
+inline FRESULT f_lseek(FIL* fp, FSIZE_t ofs)
+{
+    if(fp->data == nullptr)
+        return FR_INT_ERR;
+    fp->fptr = ofs;
+    return FR_OK;
+}
+
+inline FSIZE_t f_tell(FIL* fp)
+{
+    return fp->fptr;
+}
+
+inline FSIZE_t f_size(FIL* fp)
+{
+    return fp->data->size();
+}
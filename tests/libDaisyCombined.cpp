@@ -2,6 +2,12 @@
 #include "ui/AbstractMenu.cpp"
 #include "ui/UI.cpp"
 #include "util/MappedValue.cpp"
+#include "util/WaveTableLoader.cpp"
 #include "util/oled_fonts.c"
 #include "per/qspi.cpp"
+#include "hid/midi.cpp"
 #include "hid/midi_parser.cpp"
+#include "hid/midi_ump.cpp"
+#include "per/sai.cpp"
+#include "per/uart.cpp"
+#include "hid/audio.cpp"